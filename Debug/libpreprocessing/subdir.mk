@@ -4,21 +4,54 @@
 
 # Add inputs and outputs from these tool invocations to the build variables 
 C_SRCS += \
+../libpreprocessing/align.c \
 ../libpreprocessing/ana.c \
 ../libpreprocessing/arith.c \
+../libpreprocessing/complex.c \
+../libpreprocessing/expr.c \
+../libpreprocessing/fft.c \
+../libpreprocessing/fit.c \
 ../libpreprocessing/flatfield.c \
+../libpreprocessing/graph.c \
+../libpreprocessing/hough.c \
+../libpreprocessing/kernel.c \
+../libpreprocessing/prof.c \
+../libpreprocessing/queue.c \
+../libpreprocessing/stack.c \
 ../libpreprocessing/vmem.c 
 
 OBJS += \
+./libpreprocessing/align.o \
 ./libpreprocessing/ana.o \
 ./libpreprocessing/arith.o \
+./libpreprocessing/complex.o \
+./libpreprocessing/expr.o \
+./libpreprocessing/fft.o \
+./libpreprocessing/fit.o \
 ./libpreprocessing/flatfield.o \
+./libpreprocessing/graph.o \
+./libpreprocessing/hough.o \
+./libpreprocessing/kernel.o \
+./libpreprocessing/prof.o \
+./libpreprocessing/queue.o \
+./libpreprocessing/stack.o \
 ./libpreprocessing/vmem.o 
 
 C_DEPS += \
+./libpreprocessing/align.d \
 ./libpreprocessing/ana.d \
 ./libpreprocessing/arith.d \
+./libpreprocessing/complex.d \
+./libpreprocessing/expr.d \
+./libpreprocessing/fft.d \
+./libpreprocessing/fit.d \
 ./libpreprocessing/flatfield.d \
+./libpreprocessing/graph.d \
+./libpreprocessing/hough.d \
+./libpreprocessing/kernel.d \
+./libpreprocessing/prof.d \
+./libpreprocessing/queue.d \
+./libpreprocessing/stack.d \
 ./libpreprocessing/vmem.d 
 
 
@@ -26,7 +59,7 @@ C_DEPS += \
 libpreprocessing/%.o: ../libpreprocessing/%.c
 	@echo 'Building file: $<'
 	@echo 'Invoking: GCC C Compiler'
-	gcc -I/usr/local/include -O0 -g3 -Wall -c -fmessage-length=0 -std=c99 -MMD -MP -MF"$(@:%.o=%.d)" -MT"$(@)" -o "$@" "$<"
+	gcc -I/usr/local/include -O0 -g3 -Wall -c -fmessage-length=0 -std=c99 -fopenmp -MMD -MP -MF"$(@:%.o=%.d)" -MT"$(@)" -o "$@" "$<"
 	@echo 'Finished building: $<'
 	@echo ' '
 
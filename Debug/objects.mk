@@ -4,5 +4,5 @@
 
 USER_OBJS :=
 
-LIBS := -lcfitsio
+LIBS := -lcfitsio -lpthread
 
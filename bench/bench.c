@@ -0,0 +1,853 @@
+/*
+ * Project: Solar Orbiter - PHI (SO/PHI)
+ * Module:  Preprocessing - a library for image pre-processing.
+ *
+ * Copyright (C) 2016, Max Planck Institute for Solar System Research
+ */
+
+/**
+ * @file
+ *
+ * This file contains the benchmark of the pre-processing operations. Every
+ * preprocessing_arith_*, preprocessing_ana_* and udp_* frame operation and a
+ * frame-sized batch of the eve_fp_* conversions and arithmetic runs on
+ * synthetic 24.8 frames of 512 x 512, 1024 x 1024 and 2048 x 2048 pixels.
+ *
+ * Each operation is run a number of warmup times and then timed a number of
+ * repetitions. The result is written as JSON: the minimum, median, mean and
+ * standard deviation of the run time, and from the median the time and the
+ * cycles per pixel and the bandwidth of the nominal frame traffic (the
+ * frames read and written once).
+ *
+ * Usage: bench [-w warmup] [-r repetitions] [-s size]... [-f filter]
+ *              [-o file]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../libpreprocessing/preprocessing/ana.h"
+#include "../libpreprocessing/preprocessing/arith.h"
+#include "../libpreprocessing/preprocessing/def.h"
+#include "../libpreprocessing/preprocessing/vmem.h"
+#include "../udp/udp.h"
+
+/* from libeve */
+#include "../libeve/eve/fixed_point.h"
+
+/* from std c */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_CYCLES() ((uint64_t)(__rdtsc()))
+#else
+#define BENCH_CYCLES() ((uint64_t)(0))
+#endif
+
+/* PRIVATE INTERFACE *********************************************************/
+
+/**
+ * This is the largest frame edge and the number of frame edges.
+ */
+#define BENCH_MAX_SIZE 2048
+#define BENCH_MAX_SIZES 8
+
+/**
+ * This is the number of histogram values.
+ */
+#define BENCH_HISTOGRAM_VALUES 1024
+
+/**
+ * This is the largest number of repetitions.
+ */
+#define BENCH_MAX_REPETITIONS 1000
+
+/**
+ * These are the VMEM (SDRAM) frames of a benchmark: two images, a binary
+ * mask, a pixel count, a mask of all frames, three results, the kernels and
+ * the histogram, and a NAND frame.
+ */
+struct bench_Frames
+{
+    uint16_t rows;
+    uint16_t cols;
+
+    uint32_t a;
+    uint32_t b;
+    uint32_t mask;
+    uint32_t count;
+    uint32_t all;
+    uint32_t dst;
+    uint32_t dst2;
+    uint32_t dst3;
+    uint32_t kernel3;
+    uint32_t kernel11;
+    uint32_t histogram;
+
+    int32_t* pa;
+    int32_t* pb;
+    int32_t* pdst;
+    double* pdouble;
+    int32_t* nand;
+};
+
+/**
+ * This structure describes one operation: its name, the number of
+ * frame-sized streams it reads and writes, the largest frame edge it runs
+ * on (0 for all) and the function that runs it once.
+ */
+struct bench_Op
+{
+    const char* name;
+    unsigned int streams;
+    uint16_t limit;
+    int (*run)(const struct bench_Frames* f);
+};
+
+/**
+ * This is the timing of one operation.
+ */
+struct bench_Result
+{
+    double min;
+    double median;
+    double mean;
+    double stddev;
+    double cycles;
+    int status;
+};
+
+/**
+ * Fill the frames with reproducible synthetic 24.8 data.
+ *
+ * @param f     the frames.
+ * @param store the storage of the frames.
+ */
+static void bench_fill(struct bench_Frames* f, int32_t* store);
+
+/**
+ * Run one operation.
+ *
+ * @param op          the operation.
+ * @param f           the frames.
+ * @param warmup      the number of untimed runs.
+ * @param repetitions the number of timed runs.
+ * @param result      the timing.
+ */
+static void bench_run(const struct bench_Op* op, const struct bench_Frames* f,
+        unsigned int warmup, unsigned int repetitions,
+        struct bench_Result* result);
+
+/**
+ * Get the time of a monotonic clock.
+ *
+ * @return the time in nanoseconds.
+ */
+static double bench_now(void);
+
+/**
+ * Compare two doubles for qsort.
+ *
+ * @param a the first double.
+ * @param b the second double.
+ *
+ * @return -1, 0 or 1.
+ */
+static int bench_compare(const void* a, const void* b);
+
+/**
+ * These are the eve_fp_* and scalar udp_* batches, one call per pixel.
+ */
+static int bench_eve_add32(const struct bench_Frames* f);
+static int bench_eve_subtract32(const struct bench_Frames* f);
+static int bench_eve_multiply32(const struct bench_Frames* f);
+static int bench_eve_divide32(const struct bench_Frames* f);
+static int bench_eve_compare32(const struct bench_Frames* f);
+static int bench_eve_int2s32(const struct bench_Frames* f);
+static int bench_eve_double2s32(const struct bench_Frames* f);
+static int bench_eve_signed32ToDouble(const struct bench_Frames* f);
+static int bench_udp_double2s32rounded(const struct bench_Frames* f);
+
+/**
+ * This is the list of operations: name, streams, limit and call.
+ */
+#define BENCH_OPS(OP) \
+    OP(preprocessing_arith_addImages, 3, 0, \
+            preprocessing_arith_addImages(f->a, f->b, f->rows, f->cols, \
+                    f->dst)) \
+    OP(preprocessing_arith_subtractImages, 3, 0, \
+            preprocessing_arith_subtractImages(f->a, f->b, f->rows, f->cols, \
+                    f->dst)) \
+    OP(preprocessing_arith_multiplyImages, 3, 0, \
+            preprocessing_arith_multiplyImages(f->a, f->b, f->rows, f->cols, \
+                    f->dst)) \
+    OP(preprocessing_arith_divideImages, 3, 0, \
+            preprocessing_arith_divideImages(f->a, f->b, f->rows, f->cols, \
+                    f->dst)) \
+    OP(preprocessing_arith_addScalar, 2, 0, \
+            preprocessing_arith_addScalar(f->a, f->rows, f->cols, 384, \
+                    f->dst)) \
+    OP(preprocessing_arith_subtractScalar, 2, 0, \
+            preprocessing_arith_subtractScalar(f->a, f->rows, f->cols, 384, \
+                    f->dst)) \
+    OP(preprocessing_arith_multiplyScalar, 2, 0, \
+            preprocessing_arith_multiplyScalar(f->a, f->rows, f->cols, 384, \
+                    f->dst)) \
+    OP(preprocessing_arith_divideScalar, 2, 0, \
+            preprocessing_arith_divideScalar(f->a, f->rows, f->cols, 384, \
+                    f->dst)) \
+    OP(preprocessing_arith_meanImage, 1, 0, \
+            preprocessing_arith_meanImage(f->mask, f->rows, f->cols, \
+                    f->dst)) \
+    OP(preprocessing_arith_sumImage, 1, 0, \
+            preprocessing_arith_sumImage(f->mask, f->rows, f->cols, \
+                    f->dst)) \
+    OP(preprocessing_arith_meanColumns, 1, 0, \
+            preprocessing_arith_meanColumns(f->a, f->rows, f->cols, f->dst)) \
+    OP(preprocessing_arith_sumColumns, 1, 0, \
+            preprocessing_arith_sumColumns(f->count, f->rows, f->cols, \
+                    f->dst)) \
+    OP(preprocessing_arith_rootMeanSquare, 1, 0, \
+            preprocessing_arith_rootMeanSquare(f->mask, f->rows, f->cols, \
+                    f->dst)) \
+    OP(preprocessing_arith_squareRootImage, 2, 0, \
+            preprocessing_arith_squareRootImage(f->a, f->rows, f->cols, \
+                    f->dst)) \
+    OP(preprocessing_arith_logarithm10Image, 2, 0, \
+            preprocessing_arith_logarithm10Image(f->a, f->rows, f->cols, \
+                    f->dst)) \
+    OP(preprocessing_arith_multiplyMatrices, 3, 512, \
+            preprocessing_arith_multiplyMatrices(f->count, f->rows, f->cols, \
+                    f->mask, f->rows, f->cols, f->dst)) \
+    OP(preprocessing_ana_underThresh, 2, 0, \
+            preprocessing_ana_underThresh(f->a, f->rows, f->cols, \
+                    1000 << FP32_FWL, f->dst)) \
+    OP(preprocessing_ana_equalThresh, 2, 0, \
+            preprocessing_ana_equalThresh(f->a, f->rows, f->cols, \
+                    1000 << FP32_FWL, f->dst)) \
+    OP(preprocessing_ana_overThresh, 2, 0, \
+            preprocessing_ana_overThresh(f->a, f->rows, f->cols, \
+                    1000 << FP32_FWL, f->dst)) \
+    OP(preprocessing_ana_minImage, 2, 0, \
+            preprocessing_ana_minImage(f->a, f->rows, f->cols, f->dst, 0)) \
+    OP(preprocessing_ana_maxImage, 2, 0, \
+            preprocessing_ana_maxImage(f->a, f->rows, f->cols, f->dst, 0)) \
+    OP(preprocessing_ana_extrema, 1, 0, \
+            bench_extrema(f)) \
+    OP(preprocessing_ana_extremaMask, 2, 0, \
+            preprocessing_ana_extremaMask(f->a, f->rows, f->cols, 0, 0, \
+                    (uint32_t)(f->rows) * f->cols, f->dst)) \
+    OP(preprocessing_ana_deriveX, 3, 0, \
+            preprocessing_ana_deriveX(f->a, f->rows, f->cols, f->dst)) \
+    OP(preprocessing_ana_deriveY, 3, 0, \
+            preprocessing_ana_deriveY(f->a, f->rows, f->cols, f->dst)) \
+    OP(preprocessing_ana_gradient, 3, 0, \
+            preprocessing_ana_gradient(f->a, f->rows, f->cols, \
+                    PREPROCESSING_ANA_STENCIL_SOBEL, f->dst, f->dst2)) \
+    OP(preprocessing_ana_gradientMagnitude, 2, 0, \
+            preprocessing_ana_gradientMagnitude(f->a, f->rows, f->cols, \
+                    PREPROCESSING_ANA_STENCIL_SOBEL, f->dst)) \
+    OP(preprocessing_ana_createHistogram, 1, 0, \
+            preprocessing_ana_createHistogram(f->a, f->rows, f->cols, \
+                    BENCH_HISTOGRAM_VALUES, f->histogram)) \
+    OP(preprocessing_ana_createHistogramRange, 1, 0, \
+            preprocessing_ana_createHistogramRange(f->a, f->rows, f->cols, \
+                    BENCH_HISTOGRAM_VALUES, f->histogram)) \
+    OP(preprocessing_ana_percentile, 2, 0, \
+            bench_percentile(f)) \
+    OP(preprocessing_ana_medianValue, 2, 0, \
+            bench_medianValue(f)) \
+    OP(preprocessing_ana_mad, 2, 0, \
+            bench_mad(f)) \
+    OP(preprocessing_ana_crossCorrelate, 2, 0, \
+            preprocessing_ana_crossCorrelate(f->a, f->rows, f->cols, \
+                    f->kernel3, 3, 3, f->dst)) \
+    OP(preprocessing_ana_convolve, 2, 0, \
+            preprocessing_ana_convolve(f->a, f->rows, f->cols, f->kernel11, \
+                    11, 11, f->dst)) \
+    OP(preprocessing_ana_median, 2, 0, \
+            preprocessing_ana_median(f->a, f->rows, f->cols, f->dst)) \
+    OP(preprocessing_ana_medianFilter, 2, 0, \
+            preprocessing_ana_medianFilter(f->a, f->rows, f->cols, 15, \
+                    f->dst)) \
+    OP(preprocessing_ana_cast, 2, 0, \
+            preprocessing_ana_cast(f->a, f->rows, f->cols, f->dst)) \
+    OP(preprocessing_ana_invertMask, 2, 0, \
+            preprocessing_ana_invertMask(f->mask, f->rows, f->cols, f->dst)) \
+    OP(preprocessing_ana_cropImage, 1, 0, \
+            preprocessing_ana_cropImage(f->a, f->rows, f->cols, 0, 0, \
+                    f->rows / 2 - 1, f->cols / 2 - 1, f->dst)) \
+    OP(preprocessing_ana_constructRowImage, 1, 0, \
+            preprocessing_ana_constructRowImage(f->a, 1, f->cols, f->rows, \
+                    f->dst)) \
+    OP(udp_loadImage, 2, 0, \
+            udp_loadImage(f->nand, f->rows, f->cols, f->dst)) \
+    OP(udp_storeImage, 2, 0, \
+            udp_storeImage(f->a, f->rows, f->cols, f->nand)) \
+    OP(udp_getMask, 2, 0, \
+            udp_getMask(f->all, f->rows, f->cols, 3, f->dst)) \
+    OP(udp_maskImagesLog10, 3, 0, \
+            udp_maskImagesLog10(f->a, f->rows, f->cols, 3, 0, \
+                    82000 << FP32_FWL, f->dst3)) \
+    OP(udp_loadROI, 2, 0, \
+            udp_loadROI(f->nand, f->rows, f->cols, 17, -9, f->dst)) \
+    OP(udp_createROI, 2, 0, \
+            udp_createROI(f->a, f->rows, f->cols, 17, -9, f->dst)) \
+    OP(udp_addROI, 3, 0, \
+            udp_addROI(f->a, f->b, f->rows, f->cols, 17, -9, f->dst)) \
+    OP(udp_substractROI, 3, 0, \
+            udp_substractROI(f->a, f->b, f->rows, f->cols, 17, -9, f->dst)) \
+    OP(udp_multiplyOverlap, 3, 0, \
+            udp_multiplyOverlap(f->a, f->mask, f->rows, f->cols, 17, -9, \
+                    f->dst)) \
+    OP(udp_subtractOverlap, 3, 0, \
+            udp_subtractOverlap(f->a, f->b, f->rows, f->cols, 17, -9, \
+                    f->dst)) \
+    OP(udp_normalize, 3, 0, \
+            udp_normalize(f->a, f->count, f->rows, f->cols, f->dst)) \
+    OP(udp_mean, 2, 0, \
+            udp_mean(f->mask, f->count, f->rows, f->cols, f->dst)) \
+    OP(udp_fivesigma, 1, 0, \
+            udp_fivesigma(f->mask, f->rows, f->cols, 128, 64, f->dst)) \
+    OP(udp_flatfield, 3, 0, \
+            udp_flatfield(f->mask, f->count, f->rows, f->cols, f->dst)) \
+    OP(udp_double2s32rounded, 3, 0, \
+            bench_udp_double2s32rounded(f)) \
+    OP(eve_fp_add32, 3, 0, \
+            bench_eve_add32(f)) \
+    OP(eve_fp_subtract32, 3, 0, \
+            bench_eve_subtract32(f)) \
+    OP(eve_fp_multiply32, 3, 0, \
+            bench_eve_multiply32(f)) \
+    OP(eve_fp_divide32, 3, 0, \
+            bench_eve_divide32(f)) \
+    OP(eve_fp_compare32, 3, 0, \
+            bench_eve_compare32(f)) \
+    OP(eve_fp_int2s32, 2, 0, \
+            bench_eve_int2s32(f)) \
+    OP(eve_fp_double2s32, 3, 0, \
+            bench_eve_double2s32(f)) \
+    OP(eve_fp_signed32ToDouble, 3, 0, \
+            bench_eve_signed32ToDouble(f))
+
+/**
+ * These are the operations that return values through pointers.
+ */
+static int bench_extrema(const struct bench_Frames* f);
+static int bench_percentile(const struct bench_Frames* f);
+static int bench_medianValue(const struct bench_Frames* f);
+static int bench_mad(const struct bench_Frames* f);
+
+/**
+ * One function per operation.
+ */
+#define BENCH_FUNCTION(name, streams, limit, call) \
+    static int bench_op_##name(const struct bench_Frames* f) \
+    { \
+        return call; \
+    }
+
+BENCH_OPS(BENCH_FUNCTION)
+
+#define BENCH_ENTRY(name, streams, limit, call) \
+    { #name, streams, limit, bench_op_##name },
+
+static const struct bench_Op bench_ops[] = { BENCH_OPS(BENCH_ENTRY) };
+
+/* PUBLIC IMPLEMENTATION *****************************************************/
+
+int main(int argc, char** argv)
+{
+    unsigned int warmup = 2;
+    unsigned int repetitions = 10;
+    uint16_t sizes[BENCH_MAX_SIZES] = { 512, 1024, 2048 };
+    unsigned int nSizes = 0;
+    const char* filter = 0;
+    const char* output = 0;
+    int threads = 1;
+    int first = 1;
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "-w") == 0)
+        {
+            warmup = (unsigned int)(atoi(argv[i + 1]));
+        }
+        else if (strcmp(argv[i], "-r") == 0)
+        {
+            repetitions = (unsigned int)(atoi(argv[i + 1]));
+        }
+        else if ((strcmp(argv[i], "-s") == 0) && (nSizes < BENCH_MAX_SIZES))
+        {
+            sizes[nSizes++] = (uint16_t)(atoi(argv[i + 1]));
+        }
+        else if (strcmp(argv[i], "-f") == 0)
+        {
+            filter = argv[i + 1];
+        }
+        else if (strcmp(argv[i], "-o") == 0)
+        {
+            output = argv[i + 1];
+        }
+        else
+        {
+            printf("Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    nSizes = (nSizes == 0) ? 3 : nSizes;
+
+    if ((repetitions == 0) || (repetitions > BENCH_MAX_REPETITIONS))
+    {
+        printf("Repetitions out of range: %u.\n", repetitions);
+        return 1;
+    }
+
+    for (unsigned int s = 0; s < nSizes; s++)
+    {
+        if ((sizes[s] < 16) || (sizes[s] > BENCH_MAX_SIZE))
+        {
+            printf("Frame size out of range: %u.\n", sizes[s]);
+            return 1;
+        }
+    }
+
+    FILE* out = (output != 0) ? fopen(output, "w") : stdout;
+
+    if (out == 0)
+    {
+        printf("Could not open %s\n", output);
+        return 1;
+    }
+
+    // Eleven frames, the kernels and the histogram.
+    size_t frame = (size_t)(BENCH_MAX_SIZE) * BENCH_MAX_SIZE;
+    int32_t* store = malloc((11 * frame + 3 * 3 + 11 * 11
+            + 2 * BENCH_HISTOGRAM_VALUES) * sizeof(int32_t));
+    double* doubles = malloc(frame * sizeof(double));
+
+    if ((store == 0) || (doubles == 0))
+    {
+        printf("Out of memory\n");
+        return 1;
+    }
+
+#ifdef _OPENMP
+    threads = omp_get_max_threads();
+#endif
+
+    fprintf(out, "{\n  \"benchmark\": \"libpreprocessing\",\n");
+    fprintf(out, "  \"threads\": %d,\n  \"warmup\": %u,\n", threads, warmup);
+    fprintf(out, "  \"repetitions\": %u,\n  \"results\": [", repetitions);
+
+    for (unsigned int s = 0; s < nSizes; s++)
+    {
+        struct bench_Frames f;
+
+        f.rows = sizes[s];
+        f.cols = sizes[s];
+        f.pdouble = doubles;
+        bench_fill(&f, store);
+
+        for (unsigned int o = 0; o < sizeof(bench_ops) / sizeof(bench_ops[0]);
+                o++)
+        {
+            const struct bench_Op* op = bench_ops + o;
+            struct bench_Frames g = f;
+            struct bench_Result result;
+
+            if ((filter != 0) && (strstr(op->name, filter) == 0))
+            {
+                continue;
+            }
+
+            // Quadratic and larger operations run on a part of the frame.
+            if ((op->limit != 0) && (g.rows > op->limit))
+            {
+                g.rows = op->limit;
+                g.cols = op->limit;
+            }
+
+            bench_run(op, &g, warmup, repetitions, &result);
+
+            double pixels = (double)(g.rows) * g.cols;
+            double bytes = pixels * op->streams * sizeof(int32_t);
+
+            fprintf(out, "%s\n    {\"op\": \"%s\", \"rows\": %u, "
+                    "\"cols\": %u, \"status\": %d,\n", first ? "" : ",",
+                    op->name, g.rows, g.cols, result.status);
+            fprintf(out, "     \"ns\": {\"min\": %.0f, \"median\": %.0f, "
+                    "\"mean\": %.0f, \"stddev\": %.0f},\n", result.min,
+                    result.median, result.mean, result.stddev);
+            fprintf(out, "     \"ns_per_pixel\": %.4f, \"gb_per_s\": %.3f, ",
+                    result.median / pixels, bytes / result.median);
+
+            if (result.cycles > 0.0)
+            {
+                fprintf(out, "\"cycles_per_pixel\": %.3f}",
+                        result.cycles / pixels);
+            }
+            else
+            {
+                fprintf(out, "\"cycles_per_pixel\": null}");
+            }
+
+            fflush(out);
+            first = 0;
+        }
+    }
+
+    fprintf(out, "\n  ]\n}\n");
+
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+
+    preprocessing_vmem_deleteAll();
+    free(store);
+    free(doubles);
+
+    return 0;
+}
+
+/* PRIVATE IMPLEMENTATION ****************************************************/
+
+static void bench_fill(struct bench_Frames* f, int32_t* store)
+{
+    uint32_t n = (uint32_t)(f->rows) * f->cols;
+    uint32_t seed = 12345;
+    int32_t* p[11];
+
+    for (unsigned int i = 0; i < 11; i++)
+    {
+        p[i] = store + (size_t)(i) * n;
+    }
+
+    int32_t* kernel3 = store + (size_t)(11) * n;
+    int32_t* kernel11 = kernel3 + 3 * 3;
+    int32_t* histogram = kernel11 + 11 * 11;
+
+    // A smooth disc with noise and a few outliers, all within 24.8 range.
+    for (uint32_t i = 0; i < n; i++)
+    {
+        double y = (double)(i / f->cols) - f->rows / 2.0;
+        double x = (double)(i % f->cols) - f->cols / 2.0;
+        double disc = (y * y + x * x < 0.16 * f->rows * f->rows) ? 1000.0
+                : 100.0;
+
+        seed = seed * 1664525u + 1013904223u;
+        p[0][i] = (int32_t)((disc + (double)(seed >> 22)) * 256.0);
+        p[1][i] = (int32_t)(256 + (seed >> 20));
+        p[2][i] = ((seed >> 9) % 5 != 0) ? FP32_BINARY_TRUE : 0;
+        p[3][i] = (int32_t)(((seed >> 13) % 9 + 1) << FP32_FWL);
+        p[4][i] = (int32_t)(seed >> 9);
+        p[5][i] = 0;
+        p[6][i] = 0;
+        p[7][i] = 0;
+        p[8][i] = p[0][i];
+        p[9][i] = p[1][i];
+        p[10][i] = 0;
+
+        if ((seed >> 8) % 1000 == 0)
+        {
+            p[0][i] = 60000 << FP32_FWL;
+        }
+    }
+
+    for (unsigned int i = 0; i < 3 * 3; i++)
+    {
+        kernel3[i] = (int32_t)((i % 3 + 1) << (FP32_FWL - 3));
+    }
+
+    for (unsigned int i = 0; i < 11 * 11; i++)
+    {
+        kernel11[i] = (int32_t)(((i * 7) % 11 + 1) << (FP32_FWL - 6));
+    }
+
+    memset(histogram, 0, 2 * BENCH_HISTOGRAM_VALUES * sizeof(int32_t));
+
+    preprocessing_vmem_deleteAll();
+
+    f->a = 0;
+    f->b = f->a + n;
+    f->mask = f->b + n;
+    f->count = f->mask + n;
+    f->all = f->count + n;
+    f->dst = f->all + n;
+    f->dst2 = f->dst + n;
+    f->dst3 = f->dst2 + n;
+    f->kernel3 = f->dst3 + n;
+    f->kernel11 = f->kernel3 + 3 * 3;
+    f->histogram = f->kernel11 + 11 * 11;
+
+    preprocessing_vmem_setEntry(f->a, n, 1, p[0]);
+    preprocessing_vmem_setEntry(f->b, n, 2, p[1]);
+    preprocessing_vmem_setEntry(f->mask, n, 3, p[2]);
+    preprocessing_vmem_setEntry(f->count, n, 4, p[3]);
+    preprocessing_vmem_setEntry(f->all, n, 5, p[4]);
+    preprocessing_vmem_setEntry(f->dst, n, 6, p[5]);
+    preprocessing_vmem_setEntry(f->dst2, n, 7, p[6]);
+    preprocessing_vmem_setEntry(f->dst3, n, 8, p[8]);
+    preprocessing_vmem_setEntry(f->kernel3, 3 * 3, 9, kernel3);
+    preprocessing_vmem_setEntry(f->kernel11, 11 * 11, 10, kernel11);
+    preprocessing_vmem_setEntry(f->histogram, 2 * BENCH_HISTOGRAM_VALUES, 11,
+            histogram);
+
+    f->pa = p[0];
+    f->pb = p[1];
+    f->pdst = p[7];
+    f->nand = p[9];
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        f->pdouble[i] = eve_fp_signed32ToDouble(p[0][i], FP32_FWL);
+    }
+}
+
+/*****************************************************************************/
+
+static void bench_run(const struct bench_Op* op, const struct bench_Frames* f,
+        unsigned int warmup, unsigned int repetitions,
+        struct bench_Result* result)
+{
+    double times[BENCH_MAX_REPETITIONS];
+    double cycles[BENCH_MAX_REPETITIONS];
+    double sum = 0.0;
+    double squares = 0.0;
+
+    for (unsigned int i = 0; i < warmup; i++)
+    {
+        op->run(f);
+    }
+
+    for (unsigned int i = 0; i < repetitions; i++)
+    {
+        uint64_t c0 = BENCH_CYCLES();
+        double t0 = bench_now();
+
+        result->status = op->run(f);
+
+        double t1 = bench_now();
+        uint64_t c1 = BENCH_CYCLES();
+
+        times[i] = t1 - t0;
+        cycles[i] = (double)(c1 - c0);
+        sum += times[i];
+    }
+
+    result->mean = sum / repetitions;
+
+    for (unsigned int i = 0; i < repetitions; i++)
+    {
+        squares += (times[i] - result->mean) * (times[i] - result->mean);
+    }
+
+    result->stddev = (repetitions > 1) ? sqrt(squares / (repetitions - 1))
+            : 0.0;
+
+    qsort(times, repetitions, sizeof(double), bench_compare);
+    qsort(cycles, repetitions, sizeof(double), bench_compare);
+
+    result->min = times[0];
+    result->median = ((repetitions % 2) == 0) ? (times[repetitions / 2 - 1]
+            + times[repetitions / 2]) / 2.0 : times[repetitions / 2];
+    result->cycles = ((repetitions % 2) == 0) ? (cycles[repetitions / 2 - 1]
+            + cycles[repetitions / 2]) / 2.0 : cycles[repetitions / 2];
+}
+
+/*****************************************************************************/
+
+static double bench_now(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    return (double)(t.tv_sec) * 1e9 + (double)(t.tv_nsec);
+}
+
+/*****************************************************************************/
+
+static int bench_compare(const void* a, const void* b)
+{
+    double x = *(const double*)(a);
+    double y = *(const double*)(b);
+
+    return (x < y) ? -1 : (x > y);
+}
+
+/*****************************************************************************/
+
+static int bench_extrema(const struct bench_Frames* f)
+{
+    struct preprocessing_ana_Extrema extrema;
+
+    return preprocessing_ana_extrema(f->a, f->rows, f->cols, &extrema);
+}
+
+/*****************************************************************************/
+
+static int bench_percentile(const struct bench_Frames* f)
+{
+    int32_t value = 0;
+
+    return preprocessing_ana_percentile(f->a, f->mask, f->rows, f->cols,
+            90 << FP32_FWL, &value);
+}
+
+/*****************************************************************************/
+
+static int bench_medianValue(const struct bench_Frames* f)
+{
+    int32_t median = 0;
+
+    return preprocessing_ana_medianValue(f->a, f->mask, f->rows, f->cols,
+            &median);
+}
+
+/*****************************************************************************/
+
+static int bench_mad(const struct bench_Frames* f)
+{
+    int32_t median = 0;
+    int32_t mad = 0;
+
+    return preprocessing_ana_mad(f->a, f->mask, f->rows, f->cols, &median,
+            &mad);
+}
+
+/*****************************************************************************/
+
+static int bench_eve_add32(const struct bench_Frames* f)
+{
+    uint32_t n = (uint32_t)(f->rows) * f->cols;
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        f->pdst[i] = eve_fp_add32(f->pa[i], f->pb[i]);
+    }
+
+    return PREPROCESSING_SUCCESSFUL;
+}
+
+/*****************************************************************************/
+
+static int bench_eve_subtract32(const struct bench_Frames* f)
+{
+    uint32_t n = (uint32_t)(f->rows) * f->cols;
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        f->pdst[i] = eve_fp_subtract32(f->pa[i], f->pb[i]);
+    }
+
+    return PREPROCESSING_SUCCESSFUL;
+}
+
+/*****************************************************************************/
+
+static int bench_eve_multiply32(const struct bench_Frames* f)
+{
+    uint32_t n = (uint32_t)(f->rows) * f->cols;
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        f->pdst[i] = eve_fp_multiply32(f->pa[i], f->pb[i], FP32_FWL);
+    }
+
+    return PREPROCESSING_SUCCESSFUL;
+}
+
+/*****************************************************************************/
+
+static int bench_eve_divide32(const struct bench_Frames* f)
+{
+    uint32_t n = (uint32_t)(f->rows) * f->cols;
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        f->pdst[i] = eve_fp_divide32(f->pa[i], f->pb[i], FP32_FWL);
+    }
+
+    return PREPROCESSING_SUCCESSFUL;
+}
+
+/*****************************************************************************/
+
+static int bench_eve_compare32(const struct bench_Frames* f)
+{
+    uint32_t n = (uint32_t)(f->rows) * f->cols;
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        f->pdst[i] = eve_fp_compare32(f->pa + i, f->pb + i);
+    }
+
+    return PREPROCESSING_SUCCESSFUL;
+}
+
+/*****************************************************************************/
+
+static int bench_eve_int2s32(const struct bench_Frames* f)
+{
+    uint32_t n = (uint32_t)(f->rows) * f->cols;
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        f->pdst[i] = eve_fp_int2s32(f->pb[i] >> FP32_FWL, FP32_FWL);
+    }
+
+    return PREPROCESSING_SUCCESSFUL;
+}
+
+/*****************************************************************************/
+
+static int bench_eve_double2s32(const struct bench_Frames* f)
+{
+    uint32_t n = (uint32_t)(f->rows) * f->cols;
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        f->pdst[i] = eve_fp_double2s32(f->pdouble[i], FP32_FWL);
+    }
+
+    return PREPROCESSING_SUCCESSFUL;
+}
+
+/*****************************************************************************/
+
+static int bench_eve_signed32ToDouble(const struct bench_Frames* f)
+{
+    uint32_t n = (uint32_t)(f->rows) * f->cols;
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        f->pdouble[i] = eve_fp_signed32ToDouble(f->pa[i], FP32_FWL);
+    }
+
+    return PREPROCESSING_SUCCESSFUL;
+}
+
+/*****************************************************************************/
+
+static int bench_udp_double2s32rounded(const struct bench_Frames* f)
+{
+    uint32_t n = (uint32_t)(f->rows) * f->cols;
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        f->pdst[i] = udp_double2s32rounded(f->pdouble[i], FP32_FWL);
+    }
+
+    return PREPROCESSING_SUCCESSFUL;
+}
@@ -0,0 +1,597 @@
+/*
+ * Project: Solar Orbiter - PHI (SO/PHI)
+ * Module:  Preprocessing - a library for image pre-processing.
+ *
+ * Copyright (C) 2016, Max Planck Institute for Solar System Research
+ */
+
+/**
+ * @file
+ *
+ * This file contains the end-to-end benchmark of the flatfield (KLL)
+ * pipeline on a synthetic dataset (see synth.h). The mask, const, iterate and
+ * flatfield stages are timed separately, the same way main.c runs them, and
+ * the recovered gain is compared with the gain the frames were made with.
+ *
+ * The gain is only known up to a factor, so the recovered gain is scaled by
+ * the geometric mean ratio before the relative error is taken over the pixels
+ * seen by at least one frame pair. The benchmark fails if the RMS error
+ * exceeds the tolerance.
+ *
+ * Usage: flatbench [-s size] [-n images] [-a offset] [-e noise] [-l loops]
+ *                  [-m sigma|mad] [-r repetitions] [-t tolerance] [-o file]
+ *        flatbench [options] -g dir
+ *
+ * The frames are 1024 x 1024 pixels and offset by 3/32 of the frame unless
+ * given.
+ *
+ * With -g the dataset is written to dir in the layout main.c reads
+ * (imNN.fits, mask.fits and disp.txt) together with the gain (GainTruth.bin,
+ * 24.8 fixed point like im/Gain.fits) and nothing is run.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "synth.h"
+
+#include "../libpreprocessing/preprocessing/def.h"
+#include "../libpreprocessing/preprocessing/def_flatfield.h"
+#include "../libpreprocessing/preprocessing/flatfield.h"
+#include "../libpreprocessing/preprocessing/vmem.h"
+#include "../udp/udp.h"
+
+/* from libeve */
+#include "../libeve/eve/fixed_point.h"
+
+/* from std c */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/* PRIVATE INTERFACE *********************************************************/
+
+/**
+ * These are the stages of the pipeline.
+ */
+#define FLATBENCH_MASK 0
+#define FLATBENCH_CONST 1
+#define FLATBENCH_ITERATE 2
+#define FLATBENCH_FLATFIELD 3
+#define FLATBENCH_STAGES 4
+
+/**
+ * This is the largest number of repetitions.
+ */
+#define FLATBENCH_MAX_REPETITIONS 100
+
+/**
+ * This is the accuracy of a recovered gain.
+ */
+struct flatbench_Accuracy
+{
+    unsigned int pixels;
+    double rms;
+    double max;
+};
+
+/**
+ * Run the pipeline once.
+ *
+ * @param job    the flatfield job, with the raw frames in NAND.
+ * @param times  the run time of each stage in nanoseconds.
+ *
+ * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+ */
+static int flatbench_run(const struct preprocessing_flatfield_Job* job,
+        double* times);
+
+/**
+ * Compare a recovered gain with the true gain.
+ *
+ * @param job      the flatfield job after a run.
+ * @param gain     the recovered gain (24.8 fixed point).
+ * @param truth    the true gain.
+ * @param accuracy the accuracy.
+ */
+static void flatbench_compare(const struct preprocessing_flatfield_Job* job,
+        const int32_t* gain, const double* truth,
+        struct flatbench_Accuracy* accuracy);
+
+/**
+ * Write the dataset in the layout of main.c.
+ *
+ * @param config the dataset.
+ * @param gain   the true gain.
+ * @param disp   the offsets.
+ * @param dir    the directory.
+ *
+ * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+ */
+static int flatbench_write(const struct synth_Config* config,
+        const double* gain, const int16_t* disp, const char* dir);
+
+/**
+ * Get the time of a monotonic clock.
+ *
+ * @return the time in nanoseconds.
+ */
+static double flatbench_now(void);
+
+/**
+ * Compare two doubles for qsort.
+ *
+ * @param a the first double.
+ * @param b the second double.
+ *
+ * @return -1, 0 or 1.
+ */
+static int flatbench_compareDouble(const void* a, const void* b);
+
+/**
+ * These are the names of the stages.
+ */
+static const char* const flatbench_stages[FLATBENCH_STAGES] =
+        { "mask", "const", "iterate", "flatfield" };
+
+/* PUBLIC IMPLEMENTATION *****************************************************/
+
+int main(int argc, char** argv)
+{
+    struct synth_Config config;
+    unsigned int repetitions = 3;
+    uint16_t loops = LOOPS_ITERA;
+    uint16_t clip = CLIP_MODE;
+    double tolerance = 0.02;
+    const char* output = 0;
+    const char* dir = 0;
+    int threads = 1;
+    int status = PREPROCESSING_SUCCESSFUL;
+
+    synth_defaultConfig(&config);
+    config.rows = 1024;
+    config.cols = 1024;
+    config.offset = 0;
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "-s") == 0)
+        {
+            config.rows = (uint16_t)(atoi(argv[i + 1]));
+            config.cols = config.rows;
+        }
+        else if (strcmp(argv[i], "-n") == 0)
+        {
+            config.images = (uint16_t)(atoi(argv[i + 1]));
+        }
+        else if (strcmp(argv[i], "-a") == 0)
+        {
+            config.offset = (uint16_t)(atoi(argv[i + 1]));
+        }
+        else if (strcmp(argv[i], "-e") == 0)
+        {
+            config.noise = atof(argv[i + 1]);
+        }
+        else if (strcmp(argv[i], "-l") == 0)
+        {
+            loops = (uint16_t)(atoi(argv[i + 1]));
+        }
+        else if (strcmp(argv[i], "-m") == 0)
+        {
+            clip = (strcmp(argv[i + 1], "mad") == 0)
+                    ? PREPROCESSING_FLATFIELD_CLIP_MAD
+                    : PREPROCESSING_FLATFIELD_CLIP_SIGMA;
+        }
+        else if (strcmp(argv[i], "-r") == 0)
+        {
+            repetitions = (unsigned int)(atoi(argv[i + 1]));
+        }
+        else if (strcmp(argv[i], "-t") == 0)
+        {
+            tolerance = atof(argv[i + 1]);
+        }
+        else if (strcmp(argv[i], "-o") == 0)
+        {
+            output = argv[i + 1];
+        }
+        else if (strcmp(argv[i], "-g") == 0)
+        {
+            dir = argv[i + 1];
+        }
+        else
+        {
+            printf("Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    // The offsets scale with the frame unless given.
+    if (config.offset == 0)
+    {
+        config.offset = (uint16_t)(config.rows * 3 / 32);
+    }
+
+    // Check parameters.
+    if ((config.images < 2)
+            || (config.images > PREPROCESSING_FLATFIELD_MAX_IMAGES))
+    {
+        printf("Number of frames out of range: %u.\n", config.images);
+        return 1;
+    }
+
+    if ((config.rows < 64) || (2 * config.offset >= config.rows)
+            || (repetitions == 0)
+            || (repetitions > FLATBENCH_MAX_REPETITIONS))
+    {
+        printf("Frame size, offset or repetitions out of range.\n");
+        return 1;
+    }
+
+    unsigned int size = (unsigned int)(config.rows) * config.cols;
+    double* truth = malloc(size * sizeof(double));
+    int16_t* disp = malloc(config.images * DISP_COLS * sizeof(int16_t));
+
+    if ((truth == 0) || (disp == 0))
+    {
+        printf("Out of memory\n");
+        return 1;
+    }
+
+    synth_gain(&config, truth);
+    synth_offsets(&config, disp);
+
+    if (dir != 0)
+    {
+        status = flatbench_write(&config, truth, disp, dir);
+        free(truth);
+        free(disp);
+        return (status == PREPROCESSING_SUCCESSFUL) ? 0 : 1;
+    }
+
+    // NAND: the frames and the shared entries, the pair contributions are
+    // not kept.
+    unsigned int entries = NAND_PAIR_DISP_INDEX(config.images);
+    int32_t** entriesOfNAND = calloc(NAND_ENTRIES(config.images),
+            sizeof(int32_t*));
+    int32_t* nand = malloc((size_t)(entries) * size * sizeof(int32_t));
+    int32_t* raw = malloc((size_t)(config.images) * size * sizeof(int32_t));
+
+    // VMEM (SDRAM): the disp table and the frames of the job.
+    uint32_t sdSize = config.images * DISP_COLS
+            + PREPROCESSING_FLATFIELD_TMP_FRAMES * size;
+    int32_t* sdram = malloc(sdSize * sizeof(int32_t));
+
+    if ((entriesOfNAND == 0) || (nand == 0) || (raw == 0) || (sdram == 0))
+    {
+        printf("Out of memory\n");
+        return 1;
+    }
+
+    for (unsigned int i = 0; i < entries; i++)
+    {
+        entriesOfNAND[i] = nand + (size_t)(i) * size;
+    }
+
+    struct preprocessing_flatfield_Job job;
+
+    preprocessing_flatfield_initJob(&job, entriesOfNAND, config.rows,
+            config.cols, config.images, config.images);
+    job.loops = loops;
+    job.clip = clip;
+    job.checkpoint = NULL;
+    job.pairDisp = NULL;
+    job.pairs = NULL;
+
+    job.sdDisp = 0;
+    preprocessing_vmem_setEntry(job.sdDisp, config.images * DISP_COLS, 1,
+            sdram);
+
+    for (unsigned int i = 0; i < PREPROCESSING_FLATFIELD_TMP_FRAMES; i++)
+    {
+        job.sdTmp[i] = config.images * DISP_COLS + i * size;
+        preprocessing_vmem_setEntry(job.sdTmp[i], size, i + 2,
+                sdram + job.sdTmp[i]);
+    }
+
+    // Raw frames in 24.8 like udp_createNANDFLASH(), all pixels valid.
+    for (unsigned int i = 0; i < config.images; i++)
+    {
+        int32_t* frame = raw + (size_t)(i) * size;
+
+        synth_frame(&config, truth, (uint16_t)(i), disp[2 * i],
+                disp[2 * i + 1], frame);
+
+        for (unsigned int p = 0; p < size; p++)
+        {
+            frame[p] = eve_fp_int2s32(frame[p], FP32_FWL);
+        }
+
+        job.disp[2 * i] = eve_fp_int2s32(disp[2 * i], FP32_FWL);
+        job.disp[2 * i + 1] = eve_fp_int2s32(disp[2 * i + 1], FP32_FWL);
+    }
+
+    for (unsigned int p = 0; p < size; p++)
+    {
+        job.mask[p] = FP32_BINARY_TRUE;
+    }
+
+    double times[FLATBENCH_STAGES][FLATBENCH_MAX_REPETITIONS];
+    struct flatbench_Accuracy accuracy;
+
+    for (unsigned int r = 0; r < repetitions; r++)
+    {
+        double stageTimes[FLATBENCH_STAGES];
+
+        // The mask stage replaces the frames by their log10.
+        memcpy(nand, raw, (size_t)(config.images) * size * sizeof(int32_t));
+
+        status = flatbench_run(&job, stageTimes);
+
+        if (status != PREPROCESSING_SUCCESSFUL)
+        {
+            printf("Flatfield failed: %d\n", status);
+            return 1;
+        }
+
+        for (unsigned int s = 0; s < FLATBENCH_STAGES; s++)
+        {
+            times[s][r] = stageTimes[s];
+        }
+    }
+
+    flatbench_compare(&job, sdram + job.sdTmp[0], truth, &accuracy);
+
+    FILE* out = (output != 0) ? fopen(output, "w") : stdout;
+
+    if (out == 0)
+    {
+        printf("Could not open %s\n", output);
+        return 1;
+    }
+
+#ifdef _OPENMP
+    threads = omp_get_max_threads();
+#endif
+
+    fprintf(out, "{\n  \"benchmark\": \"flatfield\",\n");
+    fprintf(out, "  \"threads\": %d,\n  \"rows\": %u,\n  \"cols\": %u,\n",
+            threads, config.rows, config.cols);
+    fprintf(out, "  \"images\": %u,\n  \"offset\": %u,\n  \"noise\": %g,\n",
+            config.images, config.offset, config.noise);
+    fprintf(out, "  \"loops\": %u,\n  \"clip\": \"%s\",\n", loops,
+            (clip == PREPROCESSING_FLATFIELD_CLIP_MAD) ? "mad" : "sigma");
+    fprintf(out, "  \"repetitions\": %u,\n  \"stages\": [", repetitions);
+
+    double total = 0.0;
+
+    for (unsigned int s = 0; s < FLATBENCH_STAGES; s++)
+    {
+        qsort(times[s], repetitions, sizeof(double), flatbench_compareDouble);
+
+        double median = ((repetitions % 2) == 0)
+                ? (times[s][repetitions / 2 - 1] + times[s][repetitions / 2])
+                        / 2.0
+                : times[s][repetitions / 2];
+
+        total += median;
+        fprintf(out, "%s\n    {\"stage\": \"%s\", \"ns\": {\"min\": %.0f, "
+                "\"median\": %.0f}, \"ns_per_pixel\": %.3f}", (s == 0) ? ""
+                : ",", flatbench_stages[s], times[s][0], median,
+                median / size);
+    }
+
+    fprintf(out, "\n  ],\n  \"total_ns\": %.0f,\n", total);
+    fprintf(out, "  \"accuracy\": {\"pixels\": %u, \"rms\": %.6f, "
+            "\"max\": %.6f, \"tolerance\": %g, \"pass\": %s}\n}\n",
+            accuracy.pixels, accuracy.rms, accuracy.max, tolerance,
+            (accuracy.rms <= tolerance) ? "true" : "false");
+
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+
+    preprocessing_vmem_deleteAll();
+    free(truth);
+    free(disp);
+    free(entriesOfNAND);
+    free(nand);
+    free(raw);
+    free(sdram);
+
+    return ((accuracy.pixels > 0) && (accuracy.rms <= tolerance)) ? 0 : 2;
+}
+
+/* PRIVATE IMPLEMENTATION ****************************************************/
+
+static int flatbench_run(const struct preprocessing_flatfield_Job* job,
+        double* times)
+{
+    int status = PREPROCESSING_SUCCESSFUL;
+    double t0 = flatbench_now();
+
+    CHECK_STATUS(preprocessing_flatfield_maskImages(job))
+
+    double t1 = flatbench_now();
+
+    CHECK_STATUS(preprocessing_flatfield_getConst(job))
+
+    double t2 = flatbench_now();
+
+    // The loops of preprocessing_arith_iterate(), the flatfield apart.
+    CHECK_STATUS(preprocessing_flatfield_initGain(job, job->sdTmp[4],
+            job->sdTmp[0]))
+
+    for (uint16_t i = 0; i < job->loops; i++)
+    {
+        CHECK_STATUS(preprocessing_arith_doIteration(job, job->sdTmp[1],
+                job->sdTmp[2], job->sdTmp[3], job->sdTmp[0]))
+    }
+
+    double t3 = flatbench_now();
+
+    udp_loadImage(job->maskTmp, job->rows, job->cols, job->sdTmp[1]);
+    CHECK_STATUS(udp_flatfield(job->sdTmp[0], job->sdTmp[1], job->rows,
+            job->cols, job->sdTmp[0]))
+
+    double t4 = flatbench_now();
+
+    times[FLATBENCH_MASK] = t1 - t0;
+    times[FLATBENCH_CONST] = t2 - t1;
+    times[FLATBENCH_ITERATE] = t3 - t2;
+    times[FLATBENCH_FLATFIELD] = t4 - t3;
+
+    return status;
+}
+
+/*****************************************************************************/
+
+static void flatbench_compare(const struct preprocessing_flatfield_Job* job,
+        const int32_t* gain, const double* truth,
+        struct flatbench_Accuracy* accuracy)
+{
+    unsigned int size = (unsigned int)(job->rows) * job->cols;
+    double sum = 0.0;
+    double squares = 0.0;
+    double max = 0.0;
+    unsigned int n = 0;
+
+    // Pixels seen by at least one pair, in the mask of all frames.
+    for (unsigned int p = 0; p < size; p++)
+    {
+        if ((job->pixCount[p] > 0) && (job->maskTmp[p] != 0)
+                && (gain[p] > 0))
+        {
+            sum += log(eve_fp_signed32ToDouble(gain[p], FP32_FWL) / truth[p]);
+            n++;
+        }
+    }
+
+    double scale = (n > 0) ? exp(sum / n) : 1.0;
+
+    for (unsigned int p = 0; p < size; p++)
+    {
+        if ((job->pixCount[p] > 0) && (job->maskTmp[p] != 0)
+                && (gain[p] > 0))
+        {
+            double e = eve_fp_signed32ToDouble(gain[p], FP32_FWL)
+                    / (scale * truth[p]) - 1.0;
+
+            squares += e * e;
+            max = (fabs(e) > max) ? fabs(e) : max;
+        }
+    }
+
+    accuracy->pixels = n;
+    accuracy->rms = (n > 0) ? sqrt(squares / n) : 0.0;
+    accuracy->max = max;
+}
+
+/*****************************************************************************/
+
+static int flatbench_write(const struct synth_Config* config,
+        const double* gain, const int16_t* disp, const char* dir)
+{
+    unsigned int size = (unsigned int)(config->rows) * config->cols;
+    int32_t* frame = malloc(size * sizeof(int32_t));
+    char path[4096];
+
+    if (frame == 0)
+    {
+        printf("Out of memory\n");
+        return PREPROCESSING_NO_MEMORY;
+    }
+
+    // FITS_saveImage() takes the rows of the image, the first one is used.
+    int32_t* image[1] = { frame };
+
+    for (unsigned int i = 0; i < config->images; i++)
+    {
+        synth_frame(config, gain, (uint16_t)(i), disp[2 * i],
+                disp[2 * i + 1], frame);
+        snprintf(path, sizeof(path), "%s/im%02u.fits", dir, i);
+        FITS_saveImage(image, path, config->cols, config->rows, 0, 0);
+    }
+
+    for (unsigned int p = 0; p < size; p++)
+    {
+        frame[p] = 1;
+    }
+
+    snprintf(path, sizeof(path), "%s/mask.fits", dir);
+    FITS_saveImage(image, path, config->cols, config->rows, 0, 0);
+
+    snprintf(path, sizeof(path), "%s/disp.txt", dir);
+    FILE* fp = fopen(path, "w");
+
+    if (fp == 0)
+    {
+        printf("Could not open %s\n", path);
+        free(frame);
+        return PREPROCESSING_INVALID_ADDRESS;
+    }
+
+    for (unsigned int i = 0; i < config->images; i++)
+    {
+        fprintf(fp, "%d %d\n", disp[2 * i], disp[2 * i + 1]);
+    }
+
+    fclose(fp);
+
+    for (unsigned int p = 0; p < size; p++)
+    {
+        frame[p] = eve_fp_double2s32(gain[p], FP32_FWL);
+    }
+
+    snprintf(path, sizeof(path), "%s/GainTruth.bin", dir);
+    fp = fopen(path, "wb");
+
+    if (fp == 0)
+    {
+        printf("Could not open %s\n", path);
+        free(frame);
+        return PREPROCESSING_INVALID_ADDRESS;
+    }
+
+    size_t written = fwrite(frame, sizeof(int32_t), size, fp);
+
+    fclose(fp);
+    free(frame);
+
+    if (written != size)
+    {
+        printf("Could not write %s\n", path);
+        return PREPROCESSING_INVALID_ADDRESS;
+    }
+
+    printf("Dataset of %u frames of %u x %u pixels written to %s\n",
+            config->images, config->rows, config->cols, dir);
+
+    return PREPROCESSING_SUCCESSFUL;
+}
+
+/*****************************************************************************/
+
+static double flatbench_now(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    return (double)(t.tv_sec) * 1e9 + (double)(t.tv_nsec);
+}
+
+/*****************************************************************************/
+
+static int flatbench_compareDouble(const void* a, const void* b)
+{
+    double x = *(const double*)(a);
+    double y = *(const double*)(b);
+
+    return (x < y) ? -1 : (x > y);
+}
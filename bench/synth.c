@@ -0,0 +1,185 @@
+/*
+ * Project: Solar Orbiter - PHI (SO/PHI)
+ * Module:  Preprocessing - a library for image pre-processing.
+ *
+ * Copyright (C) 2016, Max Planck Institute for Solar System Research
+ */
+
+/**
+ * @file
+ *
+ * This file contains the synthetic flatfield dataset.
+ */
+
+#include "synth.h"
+
+/* from std c */
+#include <math.h>
+
+/* PRIVATE INTERFACE *********************************************************/
+
+/**
+ * This is the limb darkening coefficient of the disc.
+ */
+#define SYNTH_LIMB_DARKENING 0.6
+
+/**
+ * Get a reproducible uniform random number of a pixel.
+ *
+ * @param seed the seed.
+ * @param p    the pixel.
+ *
+ * @return the number in [0, 1).
+ */
+static double synth_uniform(uint32_t seed, uint32_t p);
+
+/**
+ * Get a reproducible normal random number of a pixel.
+ *
+ * @param seed the seed.
+ * @param p    the pixel.
+ *
+ * @return the number.
+ */
+static double synth_normal(uint32_t seed, uint32_t p);
+
+/* PUBLIC IMPLEMENTATION *****************************************************/
+
+void synth_defaultConfig(struct synth_Config* config)
+{
+    config->rows = 2048;
+    config->cols = 2048;
+    config->images = 9;
+    config->offset = 192;
+    config->radius = 0.4;
+    config->intensity = 40000.0;
+    config->pattern = 0.05;
+    config->pixel = 0.02;
+    config->noise = 0.0;
+    config->seed = 12345;
+}
+
+/*****************************************************************************/
+
+void synth_offsets(const struct synth_Config* config, int16_t* disp)
+{
+    const double pi = 3.14159265358979323846;
+
+    disp[0] = 0;
+    disp[1] = 0;
+
+    for (unsigned int i = 1; i < config->images; i++)
+    {
+        double angle = 2.0 * pi * (i - 1) / (config->images - 1);
+
+        disp[2 * i] = (int16_t)(lround(config->offset * sin(angle)));
+        disp[2 * i + 1] = (int16_t)(lround(config->offset * cos(angle)));
+    }
+}
+
+/*****************************************************************************/
+
+void synth_gain(const struct synth_Config* config, double* gain)
+{
+    const double pi = 3.14159265358979323846;
+    unsigned int size = (unsigned int)(config->rows) * config->cols;
+    double sum = 0.0;
+
+    // Two dust spots, 30 % and 20 % deep.
+    double spotY[2] = { 0.35 * config->rows, 0.6 * config->rows };
+    double spotX[2] = { 0.55 * config->cols, 0.3 * config->cols };
+    double spotDepth[2] = { 0.3, 0.2 };
+    double spotWidth = 0.01 * config->cols + 1.0;
+
+    for (unsigned int p = 0; p < size; p++)
+    {
+        double y = (double)(p / config->cols);
+        double x = (double)(p % config->cols);
+        double g = 1.0 + config->pattern * sin(2.0 * pi * x / config->cols)
+                * cos(3.0 * pi * y / config->rows);
+
+        g *= 1.0 + config->pixel * (2.0 * synth_uniform(config->seed, p)
+                - 1.0);
+
+        for (unsigned int s = 0; s < 2; s++)
+        {
+            double d = ((y - spotY[s]) * (y - spotY[s])
+                    + (x - spotX[s]) * (x - spotX[s]))
+                    / (spotWidth * spotWidth);
+
+            g *= 1.0 - spotDepth[s] * exp(-d);
+        }
+
+        gain[p] = g;
+        sum += g;
+    }
+
+    for (unsigned int p = 0; p < size; p++)
+    {
+        gain[p] *= size / sum;
+    }
+}
+
+/*****************************************************************************/
+
+void synth_frame(const struct synth_Config* config, const double* gain,
+        uint16_t index, int16_t dy, int16_t dx, int32_t* frame)
+{
+    unsigned int size = (unsigned int)(config->rows) * config->cols;
+    double edge = (config->rows < config->cols) ? config->rows : config->cols;
+    double radius = config->radius * edge;
+    uint32_t seed = config->seed + 7919u * (index + 1u);
+
+    for (unsigned int p = 0; p < size; p++)
+    {
+        double y = (double)(p / config->cols) - dy - config->rows / 2.0;
+        double x = (double)(p % config->cols) - dx - config->cols / 2.0;
+        double r2 = (y * y + x * x) / (radius * radius);
+        double v = 0.0;
+
+        if (r2 < 1.0)
+        {
+            double mu = sqrt(1.0 - r2);
+
+            v = config->intensity * (1.0 - SYNTH_LIMB_DARKENING * (1.0 - mu));
+
+            if (config->noise > 0.0)
+            {
+                v *= 1.0 + config->noise * synth_normal(seed, p);
+            }
+
+            v *= gain[p];
+        }
+
+        frame[p] = (v > 0.0) ? (int32_t)(lround(v)) : 0;
+    }
+}
+
+/* PRIVATE IMPLEMENTATION ****************************************************/
+
+static double synth_uniform(uint32_t seed, uint32_t p)
+{
+    // Integer hash of seed and pixel (lowbias32).
+    uint32_t h = seed ^ (p * 0x9E3779B9u);
+
+    h ^= h >> 16;
+    h *= 0x7FEB352Du;
+    h ^= h >> 15;
+    h *= 0x846CA68Bu;
+    h ^= h >> 16;
+
+    return (double)(h) / 4294967296.0;
+}
+
+/*****************************************************************************/
+
+static double synth_normal(uint32_t seed, uint32_t p)
+{
+    const double pi = 3.14159265358979323846;
+
+    // Box-Muller transform of two uniform numbers.
+    double u1 = 1.0 - synth_uniform(seed, 2u * p);
+    double u2 = synth_uniform(seed, 2u * p + 1u);
+
+    return sqrt(-2.0 * log(u1)) * cos(2.0 * pi * u2);
+}
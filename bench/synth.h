@@ -0,0 +1,118 @@
+/*
+ * Project: Solar Orbiter - PHI (SO/PHI)
+ * Module:  Preprocessing - a library for image pre-processing.
+ *
+ * Copyright (C) 2016, Max Planck Institute for Solar System Research
+ */
+
+/**
+ * @file
+ *
+ * This file contains declarations of the synthetic flatfield dataset: a set
+ * of limb-darkened solar disc frames at known offsets, each multiplied by the
+ * same known gain. The frames hold integer counts like the FITS frames read by
+ * udp_createNANDFLASH(), the offsets are rows of the disp table (dy, dx).
+ */
+
+#ifndef BENCH_SYNTH_H
+#define BENCH_SYNTH_H
+
+#include <sys/types.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * This structure describes a synthetic dataset.
+     */
+    struct synth_Config
+    {
+        /**
+         * These are the number of frame rows and columns and the number of
+         * offset frames.
+         */
+        uint16_t rows;
+        uint16_t cols;
+        uint16_t images;
+
+        /**
+         * Frame 0 is centered, the other frames are offset on a circle of
+         * \a offset pixels.
+         */
+        uint16_t offset;
+
+        /**
+         * This is the disc radius relative to the smaller frame edge.
+         */
+        double radius;
+
+        /**
+         * This is the intensity of the disc center in counts.
+         */
+        double intensity;
+
+        /**
+         * These are the amplitude of the large scale gain pattern and the
+         * amplitude of the pixel to pixel gain variation.
+         */
+        double pattern;
+        double pixel;
+
+        /**
+         * This is the standard deviation of the noise relative to the
+         * intensity. 0 for none.
+         */
+        double noise;
+
+        /**
+         * This is the seed of the pixel gain and the noise.
+         */
+        uint32_t seed;
+    };
+
+    /**
+     * Set up a dataset of 9 frames of 2048 x 2048 pixels.
+     *
+     * @param config the dataset.
+     */
+    void synth_defaultConfig(struct synth_Config* config);
+
+    /**
+     * Calculate the offsets of all frames.
+     *
+     * @param config the dataset.
+     * @param disp   the offsets, one row (dy, dx) per frame (images x 2).
+     */
+    void synth_offsets(const struct synth_Config* config, int16_t* disp);
+
+    /**
+     * Calculate the gain. It is the product of a large scale pattern, a pixel
+     * to pixel variation and two dust spots, normalized to a mean of 1.
+     *
+     * @param config the dataset.
+     * @param gain   the gain (rows x cols).
+     */
+    void synth_gain(const struct synth_Config* config, double* gain);
+
+    /**
+     * Calculate one frame: the disc at offset dy, dx times the gain, in
+     * counts. The background is 0.
+     *
+     * @param config the dataset.
+     * @param gain   the gain (rows x cols).
+     * @param index  the index of the frame, seeds the noise.
+     * @param dy     the row offset.
+     * @param dx     the column offset.
+     * @param frame  the frame (rows x cols).
+     */
+    void synth_frame(const struct synth_Config* config, const double* gain,
+            uint16_t index, int16_t dy, int16_t dx, int32_t* frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BENCH_SYNTH_H */
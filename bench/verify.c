@@ -0,0 +1,2155 @@
+/*
+ * Project: Solar Orbiter - PHI (SO/PHI)
+ * Module:  Preprocessing - a library for image pre-processing.
+ *
+ * Copyright (C) 2016, Max Planck Institute for Solar System Research
+ */
+
+/**
+ * @file
+ *
+ * This file contains the differential verification of the kernel backends.
+ * Every operation that runs on a kernel of preprocessing/kernel.h (the
+ * expressions of preprocessing/expr.h and the graphs of
+ * preprocessing/graph.h too), and the operations built on
+ * eve_fp_divide32() like udp_mean(), runs once with the
+ * reference backend and once with each other backend the processor supports
+ * on the same input. All frames are compared afterwards, so a difference in
+ * an output, in the pixels an operation must leave unchanged or in the
+ * returned status is found.
+ *
+ * The inputs are three datasets on frames with odd and even edges, so the
+ * pixels left over by the vector loops are covered:
+ *
+ * - typical: the smooth disc with noise of the benchmark.
+ * - edge:    NaN, the range limits, 0, +-1, +-1.0 and the thresholds of the
+ *            overflow of a sum and a product, mixed with small pixels.
+ * - random:  uniformly random 32 bit pixels with NaN here and there.
+ *
+ * The scalar eve_fp_* arithmetic is compared with a copy of its current
+ * implementation on the same pixels, so a faster version of it must keep the
+ * results too. The small convolutions and the derivations of
+ * preprocessing/ana.h are compared with a pixel by pixel sum that follows their
+ * documented overflow rule, status included. An expression of
+ * preprocessing/expr.h and a graph of preprocessing/graph.h are compared with
+ * the operations they replace, run one after the other. The flatfield pipeline
+ * is run end to end on a small synthetic dataset with each backend, with both
+ * outlier rejections. The disp table estimated from its raw frames must be
+ * their offsets, above and below one bin. A frame is appended to it and one is
+ * replaced with preprocessing_flatfield_updateFrame(), const, pixCount, the
+ * masks and the pair contributions must be those of a full run. A run stopped
+ * after one loop and resumed from its checkpoint must end with the gain of a
+ * run without a stop, the checkpoint must be refused by a job of another
+ * outlier rejection or disp table. A mix of dependent and independent commands
+ * runs through the command queue of preprocessing/queue.h, as one batch, and
+ * one by one in order, the frames and the first failure must be the same.
+ *
+ * A difference is measured in units of the last place of the 24.8 format
+ * (LSB, 1/256). A run drifts if a status or the position of a NaN differs or
+ * if a pixel differs by more than the tolerance (0 by default: bit exact).
+ * The result is written as JSON, verify exits with 2 on drift.
+ *
+ * Usage: verify [-s size]... [-t tolerance] [-f filter] [-o file]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "synth.h"
+
+#include "../libpreprocessing/preprocessing/ana.h"
+#include "../libpreprocessing/preprocessing/arith.h"
+#include "../libpreprocessing/preprocessing/def.h"
+#include "../libpreprocessing/preprocessing/def_flatfield.h"
+#include "../libpreprocessing/preprocessing/expr.h"
+#include "../libpreprocessing/preprocessing/flatfield.h"
+#include "../libpreprocessing/preprocessing/graph.h"
+#include "../libpreprocessing/preprocessing/kernel.h"
+#include "../libpreprocessing/preprocessing/queue.h"
+#include "../libpreprocessing/preprocessing/vmem.h"
+#include "../udp/udp.h"
+
+/* from libeve */
+#include "../libeve/eve/fixed_point.h"
+
+/* from std c */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* PRIVATE INTERFACE *********************************************************/
+
+/**
+ * This is the largest frame edge and the number of frame edges.
+ */
+#define VERIFY_MAX_SIZE 1024
+#define VERIFY_MAX_SIZES 8
+
+/**
+ * This is the number of VMEM (SDRAM) frames.
+ */
+#define VERIFY_FRAMES 8
+
+/**
+ * These are the datasets.
+ */
+#define VERIFY_TYPICAL 0
+#define VERIFY_EDGE 1
+#define VERIFY_RANDOM 2
+#define VERIFY_DATASETS 3
+
+/**
+ * This is the frame edge, the number of frames and the offset of the frames
+ * of the flatfield pipeline.
+ */
+#define VERIFY_FLATFIELD_SIZE 128
+#define VERIFY_FLATFIELD_IMAGES 9
+#define VERIFY_FLATFIELD_OFFSET 12
+#define VERIFY_FLATFIELD_SUB_BIN 2
+#define VERIFY_FLATFIELD_LOOPS 3
+
+/**
+ * This is the largest difference in LSB of a log10 gain seeded from a gain:
+ * the gain is rounded to 24.8.
+ */
+#define VERIFY_SEED_TOLERANCE 1
+
+/**
+ * This is the largest number of commands of the queue check.
+ */
+#define VERIFY_QUEUE_COMMANDS 32
+
+/**
+ * These are the VMEM (SDRAM) frames of a check: two images, a binary mask,
+ * a pixel count, a mask of all frames and three results, and the scalar of
+ * the scalar operations.
+ */
+struct verify_Frames
+{
+    uint16_t rows;
+    uint16_t cols;
+
+    uint32_t a;
+    uint32_t b;
+    uint32_t mask;
+    uint32_t count;
+    uint32_t all;
+    uint32_t dst;
+    uint32_t dst2;
+    uint32_t dst3;
+
+    int32_t scalar;
+    int32_t* pa;
+    int32_t* pb;
+    int32_t* pdst;
+};
+
+/**
+ * This structure describes one operation: its name and the function that
+ * runs it once.
+ */
+struct verify_Op
+{
+    const char* name;
+    int (*run)(const struct verify_Frames* f);
+};
+
+/**
+ * This structure describes one operation checked against a reference: its
+ * name and the function that runs both, the result in dst and the reference
+ * in dst2.
+ */
+struct verify_Check
+{
+    const char* name;
+    int (*run)(const struct verify_Frames* f, int* statusRef);
+};
+
+/**
+ * This is the difference of two runs.
+ */
+struct verify_Diff
+{
+    unsigned int mismatches;
+    unsigned int nans;
+    int64_t maxLsb;
+};
+
+/**
+ * Fill the frames with reproducible data of a dataset.
+ *
+ * @param f       the frames.
+ * @param store   the storage of the frames.
+ * @param dataset the dataset.
+ */
+static void verify_fill(struct verify_Frames* f, int32_t* store,
+        unsigned int dataset);
+
+/**
+ * Compare the pixels of a run with the pixels of the reference run.
+ *
+ * @param reference the pixels of the reference run.
+ * @param pixels    the pixels of the run.
+ * @param n         the number of pixels.
+ * @param diff      the difference.
+ */
+static void verify_compare(const int32_t* reference, const int32_t* pixels,
+        size_t n, struct verify_Diff* diff);
+
+/**
+ * Write one result and tell whether it drifts.
+ *
+ * @param out       the output.
+ * @param first     1 for the first result of a list.
+ * @param name      the name of the operation.
+ * @param rows      the number of frame rows.
+ * @param cols      the number of frame columns.
+ * @param dataset   the name of the dataset.
+ * @param backend   the name of the backend.
+ * @param statusRef the status of the reference run.
+ * @param status    the status of the run.
+ * @param diff      the difference.
+ * @param tolerance the largest difference in LSB.
+ *
+ * @return 1 if the result drifts, 0 otherwise.
+ */
+static int verify_write(FILE* out, int first, const char* name,
+        uint16_t rows, uint16_t cols, const char* dataset,
+        const char* backend, int statusRef, int status,
+        const struct verify_Diff* diff, int64_t tolerance);
+
+/**
+ * Set up a flatfield job on the synthetic dataset, with room for all frames
+ * of the dataset. The VMEM entries are set up again, the disp table holds the
+ * offsets of all frames and the input mask is all true.
+ *
+ * @param job           the flatfield job.
+ * @param entriesOfNAND the NAND entries.
+ * @param config        the dataset.
+ * @param images        the number of frames of the job.
+ * @param disp          the offsets, one row (dy, dx) per frame.
+ * @param sdram         the VMEM.
+ */
+static void verify_flatfieldJob(struct preprocessing_flatfield_Job* job,
+        int32_t** entriesOfNAND, const struct synth_Config* config,
+        uint16_t images, const int16_t* disp, int32_t* sdram);
+
+/**
+ * Compare the NAND of a flatfield job with the NAND of the reference job:
+ * the frames, the masks, const, pixCount and the tables in full, the pair
+ * contributions in their overlap, the only pixels stored.
+ *
+ * @param config    the dataset.
+ * @param reference the NAND of the reference job.
+ * @param nand      the NAND of the job.
+ * @param diff      the difference.
+ */
+static void verify_compareNand(const struct synth_Config* config,
+        const int32_t* reference, const int32_t* nand,
+        struct verify_Diff* diff);
+
+/**
+ * Start the flatfield pipeline on the synthetic dataset: mask the frames,
+ * calculate const and pixCount and the first gain in sdTmp[0].
+ *
+ * @param job the flatfield job, with the raw frames in NAND.
+ *
+ * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+ */
+static int verify_flatfieldStart(
+        const struct preprocessing_flatfield_Job* job);
+
+/**
+ * Run the flatfield pipeline on the synthetic dataset, the way flatbench
+ * does.
+ *
+ * @param job the flatfield job, with the raw frames in NAND.
+ *
+ * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+ */
+static int verify_flatfield(const struct preprocessing_flatfield_Job* job);
+
+/**
+ * Get the commands of the queue check: two rounds of commands that depend
+ * on each other in all ways, commands that do not, and two that fail, one
+ * that runs late and one that runs early but comes later.
+ *
+ * @param f        the frames.
+ * @param commands the commands, VERIFY_QUEUE_COMMANDS at most.
+ *
+ * @return the number of commands.
+ */
+static unsigned int verify_queueCommands(const struct verify_Frames* f,
+        struct preprocessing_queue_Command* commands);
+
+/**
+ * Hold the worker of the queue until the gate is open, the callback of the
+ * first command of the queue check, so the others are taken as one batch.
+ *
+ * @param fence  not used.
+ * @param status not used.
+ * @param user   not used.
+ */
+static void verify_queueHold(uint32_t fence, int status, void* user);
+
+/**
+ * Run a command of the queue check at once.
+ *
+ * @param c the command.
+ *
+ * @return the status of the operation.
+ */
+static int verify_queueRun(const struct preprocessing_queue_Command* c);
+
+/**
+ * Evaluate an expression of all node kinds on a window of the frames.
+ *
+ * @param f the frames.
+ *
+ * @return the status of preprocessing_expr_evaluate().
+ */
+static int verify_expr(const struct verify_Frames* f);
+
+/**
+ * Evaluate the expression of verify_expr() and, as the reference, run the
+ * operations of arith.h and ana.h it replaces one after the other on copies
+ * of the windows. The selection, which has no operation, is done pixel by
+ * pixel.
+ *
+ * @param f         the frames.
+ * @param statusRef the first failure of the operations.
+ *
+ * @return the status of preprocessing_expr_evaluate().
+ */
+static int verify_exprChain(const struct verify_Frames* f, int* statusRef);
+
+/**
+ * Run a graph of elementwise operations and stencils on small strips.
+ *
+ * @param f the frames.
+ *
+ * @return the status of preprocessing_graph_run().
+ */
+static int verify_graph(const struct verify_Frames* f);
+
+/**
+ * Run the graph of verify_graph() and, as the reference, the operations of
+ * arith.h and ana.h it replaces one after the other.
+ *
+ * @param f         the frames.
+ * @param sum       0 to compare the stored median frames, 1 to compare the
+ *                  sums, put into the first pixel of the same frames.
+ * @param statusRef the first failure of the operations.
+ *
+ * @return the status of preprocessing_graph_run().
+ */
+static int verify_graphChain(const struct verify_Frames* f, int sum,
+        int* statusRef);
+
+/**
+ * These are the eve_fp_* batches, one call per pixel.
+ */
+static int verify_eve_add32(const struct verify_Frames* f);
+static int verify_eve_subtract32(const struct verify_Frames* f);
+static int verify_eve_multiply32(const struct verify_Frames* f);
+static int verify_eve_divide32(const struct verify_Frames* f);
+
+/**
+ * Run a convolution or cross-correlation with a kernel of the first pixels
+ * of count and the reference sum of it.
+ *
+ * @param f         the frames.
+ * @param rows2     the number of kernel rows.
+ * @param cols2     the number of kernel columns.
+ * @param convolve  1 for preprocessing_ana_convolve(), 0 for
+ *                  preprocessing_ana_crossCorrelate().
+ * @param statusRef the status of the reference sum.
+ *
+ * @return the status of the operation.
+ */
+static int verify_ana_filter(const struct verify_Frames* f, uint16_t rows2,
+        uint16_t cols2, int convolve, int* statusRef);
+
+/**
+ * Run a derivation and the reference sum of the convolution with [-1 0 1]
+ * with the mirrored border.
+ *
+ * @param f         the frames.
+ * @param down      1 for preprocessing_ana_deriveX() (along the rows), 0
+ *                  for preprocessing_ana_deriveY().
+ * @param statusRef the status of the reference sum.
+ *
+ * @return the status of the derivation.
+ */
+static int verify_ana_derive(const struct verify_Frames* f, int down,
+        int* statusRef);
+
+/**
+ * Add the direct sum of a kernel over an image to the result image pixel by
+ * pixel. A pixel that is NaN, or whose product or partial sum leaves the
+ * 24.8 range, is NaN.
+ *
+ * @param src    the image.
+ * @param rows   the number of image rows.
+ * @param cols   the number of image columns.
+ * @param w      the kernel, rotated by 180 degrees for a convolution.
+ * @param rows2  the number of kernel rows.
+ * @param cols2  the number of kernel columns.
+ * @param mirror 1 for mirroring at the image border, 0 for zero padding.
+ * @param dst    the result image.
+ *
+ * @return PREPROCESSING_INVALID_NUMBER if a pixel is NaN,
+ *         PREPROCESSING_SUCCESSFUL otherwise.
+ */
+static int verify_filter(const int32_t* src, uint16_t rows, uint16_t cols,
+        const int32_t* w, uint16_t rows2, uint16_t cols2, int mirror,
+        int32_t* dst);
+
+/**
+ * These are copies of the current eve_fp_add32(), eve_fp_subtract32(),
+ * eve_fp_multiply32() and eve_fp_divide32() with FP32_FWL fraction bits,
+ * the behavior a faster version must keep.
+ * @{
+ */
+static int32_t verify_add32(int32_t a, int32_t b);
+static int32_t verify_subtract32(int32_t a, int32_t b);
+static int32_t verify_multiply32(int32_t a, int32_t b);
+static int32_t verify_divide32(int32_t a, int32_t b);
+/**
+ * @}
+ */
+
+/**
+ * This is the list of operations on the kernel backends: name and call.
+ */
+#define VERIFY_OPS(OP) \
+    OP(preprocessing_arith_addImages, \
+            preprocessing_arith_addImages(f->a, f->b, f->rows, f->cols, \
+                    f->dst)) \
+    OP(preprocessing_arith_subtractImages, \
+            preprocessing_arith_subtractImages(f->a, f->b, f->rows, f->cols, \
+                    f->dst)) \
+    OP(preprocessing_arith_multiplyImages, \
+            preprocessing_arith_multiplyImages(f->a, f->b, f->rows, f->cols, \
+                    f->dst)) \
+    OP(preprocessing_arith_divideImages, \
+            preprocessing_arith_divideImages(f->a, f->b, f->rows, f->cols, \
+                    f->dst)) \
+    OP(preprocessing_arith_addScalar, \
+            preprocessing_arith_addScalar(f->a, f->rows, f->cols, f->scalar, \
+                    f->dst)) \
+    OP(preprocessing_arith_subtractScalar, \
+            preprocessing_arith_subtractScalar(f->a, f->rows, f->cols, \
+                    f->scalar, f->dst)) \
+    OP(preprocessing_arith_multiplyScalar, \
+            preprocessing_arith_multiplyScalar(f->a, f->rows, f->cols, \
+                    f->scalar, f->dst)) \
+    OP(preprocessing_arith_divideScalar, \
+            preprocessing_arith_divideScalar(f->a, f->rows, f->cols, \
+                    f->scalar, f->dst)) \
+    OP(preprocessing_arith_sumImage, \
+            preprocessing_arith_sumImage(f->a, f->rows, f->cols, f->dst)) \
+    OP(preprocessing_arith_sumImage_mask, \
+            preprocessing_arith_sumImage(f->mask, f->rows, f->cols, \
+                    f->dst)) \
+    OP(preprocessing_arith_meanImage, \
+            preprocessing_arith_meanImage(f->a, f->rows, f->cols, f->dst)) \
+    OP(preprocessing_arith_logarithm10Image, \
+            preprocessing_arith_logarithm10Image(f->a, f->rows, f->cols, \
+                    f->dst)) \
+    OP(preprocessing_ana_medianFilter_3x3, \
+            preprocessing_ana_medianFilter(f->a, f->rows, f->cols, 3, \
+                    f->dst)) \
+    OP(preprocessing_ana_medianFilter_5x5, \
+            preprocessing_ana_medianFilter(f->a, f->rows, f->cols, 5, \
+                    f->dst)) \
+    OP(udp_getMask, \
+            udp_getMask(f->all, f->rows, f->cols, 3, f->dst)) \
+    OP(udp_maskImagesLog10, \
+            udp_maskImagesLog10(f->a, f->rows, f->cols, 3, 0, \
+                    82000 << FP32_FWL, f->dst3)) \
+    OP(udp_addROI, \
+            udp_addROI(f->a, f->b, f->rows, f->cols, 17, -9, f->dst)) \
+    OP(udp_substractROI, \
+            udp_substractROI(f->a, f->b, f->rows, f->cols, 17, -9, f->dst)) \
+    OP(udp_multiplyOverlap, \
+            udp_multiplyOverlap(f->a, f->mask, f->rows, f->cols, 17, -9, \
+                    f->dst)) \
+    OP(udp_subtractOverlap, \
+            udp_subtractOverlap(f->a, f->b, f->rows, f->cols, 17, -9, \
+                    f->dst)) \
+    OP(udp_normalize, \
+            udp_normalize(f->a, f->count, f->rows, f->cols, f->dst)) \
+    OP(udp_mean, \
+            udp_mean(f->a, f->mask, f->rows, f->cols, f->dst)) \
+    OP(udp_fivesigma, \
+            udp_fivesigma(f->a, f->rows, f->cols, 128, 64, f->dst)) \
+    OP(udp_flatfield, \
+            udp_flatfield(f->b, f->mask, f->rows, f->cols, f->dst)) \
+    OP(udp_flatfield_log, \
+            udp_flatfield(f->a, f->count, f->rows, f->cols, f->dst)) \
+    OP(preprocessing_expr_evaluate, \
+            verify_expr(f)) \
+    OP(preprocessing_graph_run, \
+            verify_graph(f))
+
+/**
+ * This is the list of the eve_fp_* functions: name and call.
+ */
+#define VERIFY_EVE(OP) \
+    OP(eve_fp_add32, verify_eve_add32(f)) \
+    OP(eve_fp_subtract32, verify_eve_subtract32(f)) \
+    OP(eve_fp_multiply32, verify_eve_multiply32(f)) \
+    OP(eve_fp_divide32, verify_eve_divide32(f))
+
+/**
+ * This is the list of the operations checked against a reference sum or
+ * against the operations they replace: name and call.
+ */
+#define VERIFY_ANA(OP) \
+    OP(preprocessing_ana_convolve_3x3, verify_ana_filter(f, 3, 3, 1, \
+            statusRef)) \
+    OP(preprocessing_ana_convolve_1x3, verify_ana_filter(f, 1, 3, 1, \
+            statusRef)) \
+    OP(preprocessing_ana_convolve_3x1, verify_ana_filter(f, 3, 1, 1, \
+            statusRef)) \
+    OP(preprocessing_ana_crossCorrelate_3x3, verify_ana_filter(f, 3, 3, 0, \
+            statusRef)) \
+    OP(preprocessing_ana_crossCorrelate_1x3, verify_ana_filter(f, 1, 3, 0, \
+            statusRef)) \
+    OP(preprocessing_ana_deriveX, verify_ana_derive(f, 1, statusRef)) \
+    OP(preprocessing_ana_deriveY, verify_ana_derive(f, 0, statusRef)) \
+    OP(preprocessing_expr_evaluate_chain, verify_exprChain(f, statusRef)) \
+    OP(preprocessing_graph_run_chain, verify_graphChain(f, 0, statusRef)) \
+    OP(preprocessing_graph_run_sum, verify_graphChain(f, 1, statusRef))
+
+/**
+ * One function per operation.
+ */
+#define VERIFY_FUNCTION(name, call) \
+    static int verify_op_##name(const struct verify_Frames* f) \
+    { \
+        return call; \
+    }
+
+#define VERIFY_CHECK_FUNCTION(name, call) \
+    static int verify_op_##name(const struct verify_Frames* f, \
+            int* statusRef) \
+    { \
+        return call; \
+    }
+
+VERIFY_OPS(VERIFY_FUNCTION)
+VERIFY_EVE(VERIFY_FUNCTION)
+VERIFY_ANA(VERIFY_CHECK_FUNCTION)
+
+#define VERIFY_ENTRY(name, call) { #name, verify_op_##name },
+
+static const struct verify_Op verify_ops[] = { VERIFY_OPS(VERIFY_ENTRY) };
+static const struct verify_Op verify_eve[] = { VERIFY_EVE(VERIFY_ENTRY) };
+static const struct verify_Check verify_ana[] = { VERIFY_ANA(VERIFY_ENTRY) };
+
+/**
+ * This is the gate of verify_queueHold().
+ */
+static pthread_mutex_t verify_gateMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t verify_gateOpened = PTHREAD_COND_INITIALIZER;
+static int verify_gateOpen = 0;
+
+/**
+ * These are the names of the datasets.
+ */
+static const char* const verify_datasets[VERIFY_DATASETS] =
+        { "typical", "edge", "random" };
+
+/**
+ * These are the edge pixels: NaN, the range limits, 0, +-1 LSB, +-1.0, the
+ * limits of a pixel of a chunk of a vector sum and of a product of two
+ * equal pixels, and the half of the range.
+ */
+static const int32_t verify_edges[] =
+{
+    EVE_FP32_NAN, EVE_FP32_MIN, EVE_FP32_MAX, 0, 1, -1,
+    FP32_BINARY_TRUE, -FP32_BINARY_TRUE, FP32_BINARY_TRUE + 1,
+    FP32_BINARY_TRUE - 1, (1 << 24) - 1, 1 << 24, -(1 << 24),
+    741455, 741456, -741456, 1 << 30, -(1 << 30), 0x7fffff00
+};
+
+/* PUBLIC IMPLEMENTATION *****************************************************/
+
+int main(int argc, char** argv)
+{
+    uint16_t sizes[VERIFY_MAX_SIZES] = { 67, 256 };
+    unsigned int nSizes = 0;
+    int64_t tolerance = 0;
+    const char* filter = 0;
+    const char* output = 0;
+    const struct preprocessing_kernel_Backend* backends[
+            PREPROCESSING_KERNEL_BACKENDS];
+    unsigned int drifts = 0;
+    unsigned int checks = 0;
+    int first = 1;
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if ((strcmp(argv[i], "-s") == 0) && (nSizes < VERIFY_MAX_SIZES))
+        {
+            sizes[nSizes++] = (uint16_t)(atoi(argv[i + 1]));
+        }
+        else if (strcmp(argv[i], "-t") == 0)
+        {
+            tolerance = atoll(argv[i + 1]);
+        }
+        else if (strcmp(argv[i], "-f") == 0)
+        {
+            filter = argv[i + 1];
+        }
+        else if (strcmp(argv[i], "-o") == 0)
+        {
+            output = argv[i + 1];
+        }
+        else
+        {
+            printf("Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    nSizes = (nSizes == 0) ? 2 : nSizes;
+
+    // The ROI operations shift by 17 columns.
+    for (unsigned int s = 0; s < nSizes; s++)
+    {
+        if ((sizes[s] < 32) || (sizes[s] > VERIFY_MAX_SIZE))
+        {
+            printf("Frame size out of range: %u.\n", sizes[s]);
+            return 1;
+        }
+    }
+
+    unsigned int count = preprocessing_kernel_supported(backends);
+    size_t frames = (size_t)(VERIFY_FRAMES) * VERIFY_MAX_SIZE
+            * VERIFY_MAX_SIZE;
+    int32_t* store = malloc(frames * sizeof(int32_t));
+    int32_t* reference = malloc(frames * sizeof(int32_t));
+
+    if ((store == 0) || (reference == 0))
+    {
+        printf("Out of memory\n");
+        return 1;
+    }
+
+    FILE* out = (output != 0) ? fopen(output, "w") : stdout;
+
+    if (out == 0)
+    {
+        printf("Could not open %s\n", output);
+        return 1;
+    }
+
+    fprintf(out, "{\n  \"verify\": \"libpreprocessing\",\n  \"backends\": [");
+
+    for (unsigned int b = 0; b < count; b++)
+    {
+        fprintf(out, "%s\"%s\"", (b == 0) ? "" : ", ", backends[b]->name);
+    }
+
+    fprintf(out, "],\n  \"tolerance_lsb\": %lld,\n  \"kernels\": [",
+            (long long)(tolerance));
+
+    // Each operation with the reference backend, then with the others.
+    for (unsigned int s = 0; s < nSizes; s++)
+    {
+        for (unsigned int d = 0; d < VERIFY_DATASETS; d++)
+        {
+            for (unsigned int o = 0;
+                    o < sizeof(verify_ops) / sizeof(verify_ops[0]); o++)
+            {
+                const struct verify_Op* op = verify_ops + o;
+                struct verify_Frames f;
+
+                if ((filter != 0) && (strstr(op->name, filter) == 0))
+                {
+                    continue;
+                }
+
+                f.rows = sizes[s];
+                f.cols = sizes[s];
+                size_t n = (size_t)(VERIFY_FRAMES) * f.rows * f.cols;
+
+                verify_fill(&f, store, d);
+                preprocessing_kernel_select("reference");
+                int statusRef = op->run(&f);
+                memcpy(reference, store, n * sizeof(int32_t));
+
+                for (unsigned int b = 1; b < count; b++)
+                {
+                    struct verify_Diff diff;
+
+                    verify_fill(&f, store, d);
+                    preprocessing_kernel_select(backends[b]->name);
+                    int status = op->run(&f);
+                    verify_compare(reference, store, n, &diff);
+
+                    drifts += verify_write(out, first, op->name, f.rows,
+                            f.cols, verify_datasets[d], backends[b]->name,
+                            statusRef, status, &diff, tolerance);
+                    checks++;
+                    first = 0;
+                }
+            }
+        }
+    }
+
+    fprintf(out, "\n  ],\n  \"eve\": [");
+    first = 1;
+
+    // Each eve_fp_* function against the copy of its current version.
+    for (unsigned int s = 0; s < nSizes; s++)
+    {
+        for (unsigned int d = 0; d < VERIFY_DATASETS; d++)
+        {
+            for (unsigned int o = 0;
+                    o < sizeof(verify_eve) / sizeof(verify_eve[0]); o++)
+            {
+                const struct verify_Op* op = verify_eve + o;
+                struct verify_Frames f;
+                struct verify_Diff diff;
+
+                if ((filter != 0) && (strstr(op->name, filter) == 0))
+                {
+                    continue;
+                }
+
+                f.rows = sizes[s];
+                f.cols = sizes[s];
+                size_t n = (size_t)(f.rows) * f.cols;
+
+                verify_fill(&f, store, d);
+                op->run(&f);
+                verify_compare(f.pdst, f.pdst + n, n, &diff);
+
+                drifts += verify_write(out, first, op->name, f.rows, f.cols,
+                        verify_datasets[d], "scalar", PREPROCESSING_SUCCESSFUL,
+                        PREPROCESSING_SUCCESSFUL, &diff, tolerance);
+                checks++;
+                first = 0;
+            }
+        }
+    }
+
+    fprintf(out, "\n  ],\n  \"ana\": [");
+    first = 1;
+
+    // Each small filter against the reference sum, each expression and
+    // graph against the operations it replaces.
+    for (unsigned int s = 0; s < nSizes; s++)
+    {
+        for (unsigned int d = 0; d < VERIFY_DATASETS; d++)
+        {
+            for (unsigned int o = 0;
+                    o < sizeof(verify_ana) / sizeof(verify_ana[0]); o++)
+            {
+                const struct verify_Check* op = verify_ana + o;
+                struct verify_Frames f;
+                struct verify_Diff diff;
+                int statusRef = PREPROCESSING_SUCCESSFUL;
+
+                if ((filter != 0) && (strstr(op->name, filter) == 0))
+                {
+                    continue;
+                }
+
+                f.rows = sizes[s];
+                f.cols = sizes[s];
+                size_t n = (size_t)(f.rows) * f.cols;
+
+                verify_fill(&f, store, d);
+                int status = op->run(&f, &statusRef);
+                verify_compare(f.pdst + n, f.pdst, n, &diff);
+
+                drifts += verify_write(out, first, op->name, f.rows, f.cols,
+                        verify_datasets[d], "scalar", statusRef, status,
+                        &diff, tolerance);
+                checks++;
+                first = 0;
+            }
+        }
+    }
+
+    fprintf(out, "\n  ],\n  \"queue\": [");
+    first = 1;
+
+    // The commands through the queue against the same commands in order.
+    if ((filter == 0) || (strstr("preprocessing_queue", filter) != 0))
+    {
+        if (preprocessing_queue_start() != PREPROCESSING_SUCCESSFUL)
+        {
+            printf("Could not start the queue\n");
+            return 1;
+        }
+
+        for (unsigned int s = 0; s < nSizes; s++)
+        {
+            for (unsigned int d = 0; d < VERIFY_DATASETS; d++)
+            {
+                struct preprocessing_queue_Command commands[
+                        VERIFY_QUEUE_COMMANDS];
+                struct verify_Frames f;
+                struct verify_Diff diff;
+                int statusRef = PREPROCESSING_SUCCESSFUL;
+                int status = PREPROCESSING_SUCCESSFUL;
+
+                f.rows = sizes[s];
+                f.cols = sizes[s];
+                size_t n = (size_t)(VERIFY_FRAMES) * f.rows * f.cols;
+
+                verify_fill(&f, store, d);
+                unsigned int m = verify_queueCommands(&f, commands);
+
+                for (unsigned int i = 0; i < m; i++)
+                {
+                    int result = verify_queueRun(commands + i);
+
+                    statusRef = (statusRef != PREPROCESSING_SUCCESSFUL)
+                            ? statusRef : result;
+                }
+
+                memcpy(reference, store, n * sizeof(int32_t));
+                verify_fill(&f, store, d);
+
+                verify_gateOpen = 0;
+                commands[0].done = verify_queueHold;
+
+                for (unsigned int i = 0; i < m; i++)
+                {
+                    int result = preprocessing_queue_submit(commands + i, 0);
+
+                    status = (status != PREPROCESSING_SUCCESSFUL) ? status
+                            : result;
+                }
+
+                pthread_mutex_lock(&verify_gateMutex);
+                verify_gateOpen = 1;
+                pthread_cond_broadcast(&verify_gateOpened);
+                pthread_mutex_unlock(&verify_gateMutex);
+
+                int result = preprocessing_queue_finish();
+
+                status = (status != PREPROCESSING_SUCCESSFUL) ? status
+                        : result;
+                verify_compare(reference, store, n, &diff);
+
+                drifts += verify_write(out, first, "preprocessing_queue",
+                        f.rows, f.cols, verify_datasets[d], "queue",
+                        statusRef, status, &diff, tolerance);
+                checks++;
+                first = 0;
+            }
+        }
+
+        preprocessing_queue_stop();
+    }
+
+    fprintf(out, "\n  ],\n  \"flatfield\": [");
+    first = 1;
+
+    if ((filter == 0) || (strstr("flatfield", filter) != 0))
+    {
+        struct synth_Config config;
+
+        synth_defaultConfig(&config);
+        config.rows = VERIFY_FLATFIELD_SIZE;
+        config.cols = VERIFY_FLATFIELD_SIZE;
+        config.images = VERIFY_FLATFIELD_IMAGES;
+        config.offset = VERIFY_FLATFIELD_OFFSET;
+
+        unsigned int size = (unsigned int)(config.rows) * config.cols;
+        unsigned int entries = NAND_ENTRIES(config.images);
+        uint32_t sdSize = config.images * DISP_COLS
+                + PREPROCESSING_FLATFIELD_TMP_FRAMES * size;
+        size_t nandSize = (size_t)(entries) * size;
+        double* truth = malloc(size * sizeof(double));
+        int16_t* disp = malloc(config.images * DISP_COLS * sizeof(int16_t));
+        int32_t** entriesOfNAND = malloc(entries * sizeof(int32_t*));
+        int32_t* nand = malloc(nandSize * sizeof(int32_t));
+        int32_t* raw = malloc((size_t)(config.images) * size
+                * sizeof(int32_t));
+        int32_t* sdram = malloc(sdSize * sizeof(int32_t));
+        int32_t* nandRef = malloc(nandSize * sizeof(int32_t));
+        int32_t* sdramRef = malloc(sdSize * sizeof(int32_t));
+        int16_t* dispNew = malloc(config.images * DISP_COLS
+                * sizeof(int16_t));
+        int32_t* rawNew = malloc(size * sizeof(int32_t));
+
+        if ((truth == 0) || (disp == 0) || (entriesOfNAND == 0) || (nand == 0)
+                || (raw == 0) || (sdram == 0) || (nandRef == 0)
+                || (sdramRef == 0) || (dispNew == 0) || (rawNew == 0))
+        {
+            printf("Out of memory\n");
+            return 1;
+        }
+
+        synth_gain(&config, truth);
+        synth_offsets(&config, disp);
+
+        for (unsigned int i = 0; i < entries; i++)
+        {
+            entriesOfNAND[i] = nand + (size_t)(i) * size;
+        }
+
+        // Raw frames in 24.8 like udp_createNANDFLASH().
+        for (unsigned int i = 0; i < config.images; i++)
+        {
+            int32_t* frame = raw + (size_t)(i) * size;
+
+            synth_frame(&config, truth, (uint16_t)(i), disp[2 * i],
+                    disp[2 * i + 1], frame);
+
+            for (unsigned int p = 0; p < size; p++)
+            {
+                frame[p] = eve_fp_int2s32(frame[p], FP32_FWL);
+            }
+        }
+
+        // A new exposure of the middle frame at another offset.
+        uint16_t replaced = config.images / 2;
+
+        memcpy(dispNew, disp, config.images * DISP_COLS * sizeof(int16_t));
+        dispNew[2 * replaced] += 2;
+        dispNew[2 * replaced + 1] -= 3;
+        synth_frame(&config, truth, config.images, dispNew[2 * replaced],
+                dispNew[2 * replaced + 1], rawNew);
+
+        for (unsigned int p = 0; p < size; p++)
+        {
+            rawNew[p] = eve_fp_int2s32(rawNew[p], FP32_FWL);
+        }
+
+        // The disp table estimated from the raw frames must be the offsets
+        // of the frames: above one bin, below one bin and at binning 1.
+        for (unsigned int o = 0; o < 3; o++)
+        {
+            static const char* names[3] = { "flatfield_getDisp",
+                    "flatfield_getDisp_subBin", "flatfield_getDisp_binning1" };
+            struct preprocessing_flatfield_Job job;
+            struct synth_Config shifted = config;
+            struct verify_Diff diff;
+            int16_t offsets[VERIFY_FLATFIELD_IMAGES * DISP_COLS];
+            int32_t expected[VERIFY_FLATFIELD_IMAGES * DISP_COLS];
+
+            shifted.offset = (o == 1) ? VERIFY_FLATFIELD_SUB_BIN
+                    : VERIFY_FLATFIELD_OFFSET;
+            synth_offsets(&shifted, offsets);
+            memset(nand, 0, nandSize * sizeof(int32_t));
+
+            for (unsigned int i = 0; i < config.images; i++)
+            {
+                int32_t* frame = entriesOfNAND[i];
+
+                synth_frame(&shifted, truth, (uint16_t)(i), offsets[2 * i],
+                        offsets[2 * i + 1], frame);
+
+                for (unsigned int p = 0; p < size; p++)
+                {
+                    frame[p] = eve_fp_int2s32(frame[p], FP32_FWL);
+                }
+
+                expected[2 * i] = eve_fp_int2s32(offsets[2 * i], FP32_FWL);
+                expected[2 * i + 1] = eve_fp_int2s32(offsets[2 * i + 1],
+                        FP32_FWL);
+            }
+
+            verify_flatfieldJob(&job, entriesOfNAND, &config, config.images,
+                    disp, sdram);
+            memset(job.disp, 0, sizeof(expected));
+
+            int status = preprocessing_flatfield_getDisp(&job, 0,
+                    (o == 2) ? 1 : DISP_BINNING);
+
+            verify_compare(expected, job.disp, config.images * DISP_COLS,
+                    &diff);
+
+            drifts += verify_write(out, first, names[o], config.rows,
+                    config.cols, "synthetic", "scalar",
+                    PREPROCESSING_SUCCESSFUL, status, &diff, tolerance);
+            checks++;
+            first = 0;
+        }
+
+        for (unsigned int c = 0; c < 2; c++)
+        {
+            struct preprocessing_flatfield_Job job;
+            uint16_t clip = (c == 0) ? PREPROCESSING_FLATFIELD_CLIP_SIGMA
+                    : PREPROCESSING_FLATFIELD_CLIP_MAD;
+            int statusRef = PREPROCESSING_SUCCESSFUL;
+
+            for (unsigned int b = 0; b < count; b++)
+            {
+                struct verify_Diff diff;
+                struct verify_Diff diffNand;
+
+                // The same job and the same NAND and VMEM on every run.
+                memset(nand, 0, nandSize * sizeof(int32_t));
+                memset(sdram, 0, sdSize * sizeof(int32_t));
+                memcpy(nand, raw, (size_t)(config.images) * size
+                        * sizeof(int32_t));
+
+                verify_flatfieldJob(&job, entriesOfNAND, &config,
+                        config.images, disp, sdram);
+                job.loops = VERIFY_FLATFIELD_LOOPS;
+                job.clip = clip;
+                job.pairDisp = NULL;
+                job.pairs = NULL;
+
+                preprocessing_kernel_select(backends[b]->name);
+
+                if (b == 0)
+                {
+                    statusRef = verify_flatfield(&job);
+                    memcpy(nandRef, nand, nandSize * sizeof(int32_t));
+                    memcpy(sdramRef, sdram, sdSize * sizeof(int32_t));
+                    continue;
+                }
+
+                int status = verify_flatfield(&job);
+
+                verify_compare(sdramRef, sdram, sdSize, &diff);
+                verify_compare(nandRef, nand, nandSize, &diffNand);
+
+                diff.mismatches += diffNand.mismatches;
+                diff.nans += diffNand.nans;
+                diff.maxLsb = (diffNand.maxLsb > diff.maxLsb)
+                        ? diffNand.maxLsb : diff.maxLsb;
+
+                drifts += verify_write(out, first, (c == 0)
+                        ? "flatfield_sigma" : "flatfield_mad", config.rows,
+                        config.cols, "synthetic", backends[b]->name,
+                        statusRef, status, &diff, tolerance);
+                checks++;
+                first = 0;
+            }
+        }
+
+        // The last frame is appended, then the middle frame is replaced.
+        // Const, pixCount, the masks and the pair contributions must be the
+        // same as those of a full run on the final set.
+        for (unsigned int b = 0; b < count; b++)
+        {
+            struct preprocessing_flatfield_Job job;
+
+            preprocessing_kernel_select(backends[b]->name);
+
+            for (unsigned int u = 0; u < 2; u++)
+            {
+                const int16_t* dispFinal = (u == 0) ? disp : dispNew;
+                struct verify_Diff diff;
+                int statusRef;
+                int status;
+
+                memset(nand, 0, nandSize * sizeof(int32_t));
+                memset(sdram, 0, sdSize * sizeof(int32_t));
+                memcpy(nand, raw, (size_t)(config.images) * size
+                        * sizeof(int32_t));
+
+                if (u == 1)
+                {
+                    memcpy(entriesOfNAND[replaced], rawNew,
+                            size * sizeof(int32_t));
+                }
+
+                verify_flatfieldJob(&job, entriesOfNAND, &config,
+                        config.images, dispFinal, sdram);
+                statusRef = preprocessing_flatfield_maskImages(&job);
+
+                if (statusRef == PREPROCESSING_SUCCESSFUL)
+                {
+                    statusRef = preprocessing_flatfield_getConst(&job);
+                }
+
+                memcpy(nandRef, nand, nandSize * sizeof(int32_t));
+
+                memset(nand, 0, nandSize * sizeof(int32_t));
+                memset(sdram, 0, sdSize * sizeof(int32_t));
+                memcpy(nand, raw, (size_t)(config.images) * size
+                        * sizeof(int32_t));
+
+                verify_flatfieldJob(&job, entriesOfNAND, &config,
+                        config.images - 1, disp, sdram);
+                status = preprocessing_flatfield_maskImages(&job);
+
+                if (status == PREPROCESSING_SUCCESSFUL)
+                {
+                    status = preprocessing_flatfield_getConst(&job);
+                }
+
+                if (status == PREPROCESSING_SUCCESSFUL)
+                {
+                    status = preprocessing_flatfield_updateFrame(&job,
+                            config.images - 1);
+                }
+
+                if ((u == 1) && (status == PREPROCESSING_SUCCESSFUL))
+                {
+                    memcpy(job.frames[replaced], rawNew,
+                            size * sizeof(int32_t));
+                    job.disp[2 * replaced] = eve_fp_int2s32(
+                            dispNew[2 * replaced], FP32_FWL);
+                    job.disp[2 * replaced + 1] = eve_fp_int2s32(
+                            dispNew[2 * replaced + 1], FP32_FWL);
+                    status = preprocessing_flatfield_updateFrame(&job,
+                            replaced);
+                }
+
+                verify_compareNand(&config, nandRef, nand, &diff);
+
+                drifts += verify_write(out, first, (u == 0)
+                        ? "flatfield_append" : "flatfield_replace",
+                        config.rows, config.cols, "synthetic",
+                        backends[b]->name, statusRef, status, &diff,
+                        tolerance);
+                checks++;
+                first = 0;
+            }
+        }
+
+        // A run stopped after its first loop goes on from its checkpoint in
+        // a new job and must end with the gain of a run without a stop. The
+        // checkpoint is not taken by a job of another outlier rejection or
+        // disp table. The log10 gain seeded from the gain of the run must be
+        // the log10 gain of the run but for the rounding of the gain.
+        char checkpoint[] = "/tmp/verify_XXXXXX";
+        int fd = mkstemp(checkpoint);
+
+        if (fd < 0)
+        {
+            printf("Could not create %s\n", checkpoint);
+            return 1;
+        }
+
+        close(fd);
+
+        for (unsigned int b = 0; b < count; b++)
+        {
+            struct preprocessing_flatfield_Job job;
+            struct verify_Diff diff;
+            struct verify_Diff diffNand;
+            const struct verify_Diff none = { 0, 0, 0 };
+            uint16_t iteration = 0;
+            int statusRef;
+            int status;
+            int statusClip;
+            int statusDisp;
+
+            preprocessing_kernel_select(backends[b]->name);
+
+            memset(nand, 0, nandSize * sizeof(int32_t));
+            memset(sdram, 0, sdSize * sizeof(int32_t));
+            memcpy(nand, raw, (size_t)(config.images) * size
+                    * sizeof(int32_t));
+
+            verify_flatfieldJob(&job, entriesOfNAND, &config, config.images,
+                    disp, sdram);
+            job.loops = VERIFY_FLATFIELD_LOOPS;
+            statusRef = verify_flatfieldStart(&job);
+
+            if (statusRef == PREPROCESSING_SUCCESSFUL)
+            {
+                statusRef = preprocessing_arith_iterate(&job, job.sdTmp[1],
+                        job.sdTmp[2], job.sdTmp[3], job.sdTmp[0]);
+            }
+
+            memcpy(nandRef, nand, nandSize * sizeof(int32_t));
+            memcpy(sdramRef, sdram, sdSize * sizeof(int32_t));
+
+            status = preprocessing_flatfield_seedGain(&job,
+                    preprocessing_vmem_getDataAddress(job.sdTmp[0]),
+                    job.sdTmp[1]);
+            verify_compare(job.logGain,
+                    preprocessing_vmem_getDataAddress(job.sdTmp[1]), size,
+                    &diff);
+
+            drifts += verify_write(out, first, "flatfield_seedGain",
+                    config.rows, config.cols, "synthetic", backends[b]->name,
+                    statusRef, status, &diff,
+                    (tolerance > VERIFY_SEED_TOLERANCE) ? tolerance
+                    : VERIFY_SEED_TOLERANCE);
+            checks++;
+            first = 0;
+
+            memset(nand, 0, nandSize * sizeof(int32_t));
+            memset(sdram, 0, sdSize * sizeof(int32_t));
+            memcpy(nand, raw, (size_t)(config.images) * size
+                    * sizeof(int32_t));
+
+            verify_flatfieldJob(&job, entriesOfNAND, &config, config.images,
+                    disp, sdram);
+            job.loops = VERIFY_FLATFIELD_LOOPS;
+            job.checkpoint = checkpoint;
+            status = verify_flatfieldStart(&job);
+
+            if (status == PREPROCESSING_SUCCESSFUL)
+            {
+                status = preprocessing_arith_doIteration(&job, job.sdTmp[1],
+                        job.sdTmp[2], job.sdTmp[3], job.sdTmp[0]);
+            }
+
+            if (status == PREPROCESSING_SUCCESSFUL)
+            {
+                status = preprocessing_flatfield_writeCheckpoint(&job,
+                        job.sdTmp[0], 1);
+            }
+
+            job.clip = (job.clip == PREPROCESSING_FLATFIELD_CLIP_SIGMA)
+                    ? PREPROCESSING_FLATFIELD_CLIP_MAD
+                    : PREPROCESSING_FLATFIELD_CLIP_SIGMA;
+            statusClip = preprocessing_flatfield_resume(&job, job.sdTmp[1],
+                    &iteration);
+            job.clip = (job.clip == PREPROCESSING_FLATFIELD_CLIP_SIGMA)
+                    ? PREPROCESSING_FLATFIELD_CLIP_MAD
+                    : PREPROCESSING_FLATFIELD_CLIP_SIGMA;
+
+            job.disp[DISP_COLS + 1] += 1 << FP32_FWL;
+            statusDisp = preprocessing_flatfield_resume(&job, job.sdTmp[1],
+                    &iteration);
+            job.disp[DISP_COLS + 1] -= 1 << FP32_FWL;
+
+            // The new job knows nothing of the stopped one but its NAND.
+            memset(nand, 0, nandSize * sizeof(int32_t));
+            memset(sdram, 0, sdSize * sizeof(int32_t));
+            memcpy(nand, raw, (size_t)(config.images) * size
+                    * sizeof(int32_t));
+
+            verify_flatfieldJob(&job, entriesOfNAND, &config, config.images,
+                    disp, sdram);
+            job.loops = 1;
+            job.checkpoint = checkpoint;
+
+            if (status == PREPROCESSING_SUCCESSFUL)
+            {
+                status = verify_flatfieldStart(&job);
+            }
+
+            if (status == PREPROCESSING_SUCCESSFUL)
+            {
+                status = preprocessing_flatfield_resume(&job, job.sdTmp[0],
+                        &iteration);
+            }
+
+            if (status == PREPROCESSING_SUCCESSFUL)
+            {
+                status = preprocessing_arith_iterateFrom(&job, iteration,
+                        job.sdTmp[1], job.sdTmp[2], job.sdTmp[3],
+                        job.sdTmp[0]);
+            }
+
+            verify_compare(sdramRef, sdram, sdSize, &diff);
+            verify_compare(nandRef, nand, nandSize, &diffNand);
+
+            diff.mismatches += diffNand.mismatches;
+            diff.nans += diffNand.nans;
+            diff.maxLsb = (diffNand.maxLsb > diff.maxLsb) ? diffNand.maxLsb
+                    : diff.maxLsb;
+
+            drifts += verify_write(out, first, "flatfield_resume",
+                    config.rows, config.cols, "synthetic", backends[b]->name,
+                    statusRef, status, &diff, tolerance);
+            drifts += verify_write(out, first, "flatfield_resume_clip",
+                    config.rows, config.cols, "synthetic", backends[b]->name,
+                    PREPROCESSING_INVALID_SIZE, statusClip, &none,
+                    tolerance);
+            drifts += verify_write(out, first, "flatfield_resume_disp",
+                    config.rows, config.cols, "synthetic", backends[b]->name,
+                    PREPROCESSING_INVALID_SIZE, statusDisp, &none,
+                    tolerance);
+            checks += 3;
+        }
+
+        remove(checkpoint);
+
+        free(truth);
+        free(disp);
+        free(entriesOfNAND);
+        free(nand);
+        free(raw);
+        free(sdram);
+        free(nandRef);
+        free(sdramRef);
+        free(dispNew);
+        free(rawNew);
+    }
+
+    fprintf(out, "\n  ],\n  \"checks\": %u,\n  \"drifts\": %u\n}\n", checks,
+            drifts);
+
+    if (out != stdout)
+    {
+        fclose(out);
+        printf("verify: %u checks, %u drifts\n", checks, drifts);
+    }
+
+    preprocessing_vmem_deleteAll();
+    preprocessing_kernel_select(0);
+    free(store);
+    free(reference);
+
+    return (drifts == 0) ? 0 : 2;
+}
+
+/* PRIVATE IMPLEMENTATION ****************************************************/
+
+static void verify_fill(struct verify_Frames* f, int32_t* store,
+        unsigned int dataset)
+{
+    uint32_t n = (uint32_t)(f->rows) * f->cols;
+    uint32_t seed = 12345 + 7919 * dataset;
+    unsigned int edges = sizeof(verify_edges) / sizeof(verify_edges[0]);
+    int32_t* p[VERIFY_FRAMES];
+
+    for (unsigned int i = 0; i < VERIFY_FRAMES; i++)
+    {
+        p[i] = store + (size_t)(i) * n;
+    }
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        for (unsigned int k = 0; k < VERIFY_FRAMES; k++)
+        {
+            seed = seed * 1664525u + 1013904223u;
+
+            if (dataset == VERIFY_TYPICAL)
+            {
+                // A smooth disc with noise and a few outliers.
+                double y = (double)(i / f->cols) - f->rows / 2.0;
+                double x = (double)(i % f->cols) - f->cols / 2.0;
+                double disc = (y * y + x * x < 0.16 * f->rows * f->rows)
+                        ? 1000.0 : 100.0;
+
+                switch (k)
+                {
+                case 0:
+                    p[k][i] = ((seed >> 8) % 1000 == 0) ? 60000 << FP32_FWL
+                            : (int32_t)((disc + (double)(seed >> 22))
+                                    * 256.0);
+                    break;
+                case 1:
+                    p[k][i] = (int32_t)(256 + (seed >> 20));
+                    break;
+                case 2:
+                    p[k][i] = ((seed >> 9) % 5 != 0) ? FP32_BINARY_TRUE : 0;
+                    break;
+                case 3:
+                    p[k][i] = (int32_t)(((seed >> 13) % 9 + 1) << FP32_FWL);
+                    break;
+                case 4:
+                    p[k][i] = (int32_t)(seed >> 9);
+                    break;
+                default:
+                    p[k][i] = 0;
+                    break;
+                }
+            }
+            else if (dataset == VERIFY_EDGE)
+            {
+                // Half edge pixels, half small pixels.
+                if ((seed >> 16) & 1)
+                {
+                    p[k][i] = verify_edges[(seed >> 17) % edges];
+                }
+                else
+                {
+                    p[k][i] = (int32_t)(seed >> 11) - (1 << 20);
+                }
+            }
+            else
+            {
+                p[k][i] = ((seed >> 4) % 64 == 0) ? EVE_FP32_NAN
+                        : (int32_t)(seed ^ (seed << 13));
+            }
+        }
+    }
+
+    preprocessing_vmem_deleteAll();
+
+    f->a = 0;
+    f->b = f->a + n;
+    f->mask = f->b + n;
+    f->count = f->mask + n;
+    f->all = f->count + n;
+    f->dst = f->all + n;
+    f->dst2 = f->dst + n;
+    f->dst3 = f->dst2 + n;
+
+    preprocessing_vmem_setEntry(f->a, n, 1, p[0]);
+    preprocessing_vmem_setEntry(f->b, n, 2, p[1]);
+    preprocessing_vmem_setEntry(f->mask, n, 3, p[2]);
+    preprocessing_vmem_setEntry(f->count, n, 4, p[3]);
+    preprocessing_vmem_setEntry(f->all, n, 5, p[4]);
+    preprocessing_vmem_setEntry(f->dst, n, 6, p[5]);
+    preprocessing_vmem_setEntry(f->dst2, n, 7, p[6]);
+    preprocessing_vmem_setEntry(f->dst3, n, 8, p[7]);
+
+    f->scalar = (dataset == VERIFY_TYPICAL) ? 384
+            : (dataset == VERIFY_EDGE) ? (1 << 30) : (int32_t)(seed);
+    f->pa = p[0];
+    f->pb = p[1];
+    f->pdst = p[5];
+}
+
+/*****************************************************************************/
+
+static void verify_compare(const int32_t* reference, const int32_t* pixels,
+        size_t n, struct verify_Diff* diff)
+{
+    diff->mismatches = 0;
+    diff->nans = 0;
+    diff->maxLsb = 0;
+
+    for (size_t p = 0; p < n; p++)
+    {
+        if (pixels[p] == reference[p])
+        {
+            continue;
+        }
+
+        diff->mismatches++;
+
+        if ((pixels[p] == EVE_FP32_NAN) || (reference[p] == EVE_FP32_NAN))
+        {
+            diff->nans++;
+        }
+        else
+        {
+            int64_t d = (int64_t)(pixels[p]) - reference[p];
+
+            d = (d < 0) ? -d : d;
+            diff->maxLsb = (d > diff->maxLsb) ? d : diff->maxLsb;
+        }
+    }
+}
+
+/*****************************************************************************/
+
+static int verify_write(FILE* out, int first, const char* name,
+        uint16_t rows, uint16_t cols, const char* dataset,
+        const char* backend, int statusRef, int status,
+        const struct verify_Diff* diff, int64_t tolerance)
+{
+    int drift = (status != statusRef) || (diff->nans != 0)
+            || (diff->maxLsb > tolerance);
+
+    fprintf(out, "%s\n    {\"op\": \"%s\", \"rows\": %u, \"cols\": %u, "
+            "\"dataset\": \"%s\", \"backend\": \"%s\",\n", first ? "" : ",",
+            name, rows, cols, dataset, backend);
+    fprintf(out, "     \"status_ref\": %d, \"status\": %d, "
+            "\"mismatches\": %u, \"nan_mismatches\": %u, \"max_lsb\": %lld, "
+            "\"exact\": %s, \"drift\": %s}", statusRef, status,
+            diff->mismatches, diff->nans, (long long)(diff->maxLsb),
+            (diff->mismatches == 0) ? "true" : "false",
+            drift ? "true" : "false");
+    fflush(out);
+
+    return drift;
+}
+
+/*****************************************************************************/
+
+static void verify_flatfieldJob(struct preprocessing_flatfield_Job* job,
+        int32_t** entriesOfNAND, const struct synth_Config* config,
+        uint16_t images, const int16_t* disp, int32_t* sdram)
+{
+    unsigned int size = (unsigned int)(config->rows) * config->cols;
+
+    preprocessing_vmem_deleteAll();
+    preprocessing_flatfield_initJob(job, entriesOfNAND, config->rows,
+            config->cols, images, config->images);
+
+    job->sdDisp = 0;
+    preprocessing_vmem_setEntry(job->sdDisp, config->images * DISP_COLS, 1,
+            sdram);
+
+    for (unsigned int i = 0; i < PREPROCESSING_FLATFIELD_TMP_FRAMES; i++)
+    {
+        job->sdTmp[i] = config->images * DISP_COLS + i * size;
+        preprocessing_vmem_setEntry(job->sdTmp[i], size, i + 2,
+                sdram + job->sdTmp[i]);
+    }
+
+    for (unsigned int i = 0; i < config->images; i++)
+    {
+        job->disp[2 * i] = eve_fp_int2s32(disp[2 * i], FP32_FWL);
+        job->disp[2 * i + 1] = eve_fp_int2s32(disp[2 * i + 1], FP32_FWL);
+    }
+
+    for (unsigned int p = 0; p < size; p++)
+    {
+        job->mask[p] = FP32_BINARY_TRUE;
+    }
+}
+
+/*****************************************************************************/
+
+static void verify_compareNand(const struct synth_Config* config,
+        const int32_t* reference, const int32_t* nand,
+        struct verify_Diff* diff)
+{
+    size_t size = (size_t)(config->rows) * config->cols;
+    size_t tables = (size_t)(NAND_PAIR_DISP_INDEX(config->images) + 1) * size;
+    const int32_t* pairDisp = reference + tables - size;
+
+    verify_compare(reference, nand, tables, diff);
+
+    for (unsigned int p = 0; p < NAND_PAIRS(config->images); p++)
+    {
+        int32_t dy = pairDisp[p * DISP_COLS];
+        int32_t dx = pairDisp[p * DISP_COLS + 1];
+        unsigned int rows = config->rows - (unsigned int)((dy < 0) ? -dy : dy);
+        unsigned int cols = config->cols - (unsigned int)((dx < 0) ? -dx : dx);
+
+        // The overlap starts at the first pixel of an entry, row by row.
+        for (unsigned int k = 0; k < 2; k++)
+        {
+            for (unsigned int y = 0; y < rows; y++)
+            {
+                struct verify_Diff row;
+                size_t first = (size_t)(NAND_PAIR_INDEX(config->images, p)
+                        + k) * size + (size_t)(y) * config->cols;
+
+                verify_compare(reference + first, nand + first, cols, &row);
+
+                diff->mismatches += row.mismatches;
+                diff->nans += row.nans;
+                diff->maxLsb = (row.maxLsb > diff->maxLsb) ? row.maxLsb
+                        : diff->maxLsb;
+            }
+        }
+    }
+}
+
+/*****************************************************************************/
+
+static int verify_flatfieldStart(
+        const struct preprocessing_flatfield_Job* job)
+{
+    int status = PREPROCESSING_SUCCESSFUL;
+
+    CHECK_STATUS(preprocessing_flatfield_maskImages(job))
+    CHECK_STATUS(preprocessing_flatfield_getConst(job))
+    CHECK_STATUS(preprocessing_flatfield_initGain(job, job->sdTmp[4],
+            job->sdTmp[0]))
+
+    return status;
+}
+
+/*****************************************************************************/
+
+static int verify_flatfield(const struct preprocessing_flatfield_Job* job)
+{
+    int status = PREPROCESSING_SUCCESSFUL;
+
+    CHECK_STATUS(verify_flatfieldStart(job))
+
+    for (uint16_t i = 0; i < job->loops; i++)
+    {
+        CHECK_STATUS(preprocessing_arith_doIteration(job, job->sdTmp[1],
+                job->sdTmp[2], job->sdTmp[3], job->sdTmp[0]))
+    }
+
+    udp_loadImage(job->maskTmp, job->rows, job->cols, job->sdTmp[1]);
+    CHECK_STATUS(udp_flatfield(job->sdTmp[0], job->sdTmp[1], job->rows,
+            job->cols, job->sdTmp[0]))
+
+    return status;
+}
+
+/*****************************************************************************/
+
+static unsigned int verify_queueCommands(const struct verify_Frames* f,
+        struct preprocessing_queue_Command* commands)
+{
+    uint32_t n = (uint32_t)(f->rows) * f->cols;
+    unsigned int m = 0;
+
+    // Operation, images read, kernel or window, scalar and image written.
+    const struct
+    {
+        int op;
+        uint32_t sdSrc1;
+        uint32_t sdSrc2;
+        uint16_t rows2;
+        uint16_t cols2;
+        int32_t value;
+        uint32_t sdDst;
+    } round[] =
+    {
+        { PREPROCESSING_QUEUE_ADD_IMAGES, f->a, f->b, 0, 0, 0, f->dst },
+        { PREPROCESSING_QUEUE_MULTIPLY_SCALAR, f->a, 0, 0, 0, f->scalar,
+                f->dst2 },
+        { PREPROCESSING_QUEUE_SUBTRACT_IMAGES, f->dst, f->b, 0, 0, 0,
+                f->dst3 },
+        { PREPROCESSING_QUEUE_DERIVE_X, f->dst2, 0, 0, 0, 0, f->dst },
+        { PREPROCESSING_QUEUE_DIVIDE_IMAGES, f->mask, f->count, 0, 0, 0,
+                f->all },
+        { PREPROCESSING_QUEUE_MEDIAN_FILTER, f->dst3, 0, 3, 0, 0, f->dst2 },
+        // An even window: fails in a late wave.
+        { PREPROCESSING_QUEUE_MEDIAN_FILTER, f->dst3, 0, 4, 0, 0, f->dst2 },
+        { PREPROCESSING_QUEUE_CONVOLVE, f->a, f->count, 3, 3, 0, f->dst3 },
+        { PREPROCESSING_QUEUE_SUM_IMAGE, f->all, 0, 0, 0, 0, f->count },
+        { PREPROCESSING_QUEUE_OVER_THRESH, f->dst, 0, 0, 0, f->scalar,
+                f->mask },
+        // A division by 0 into no frame: fails in the first wave with
+        // another status, but after the failure above.
+        { PREPROCESSING_QUEUE_DIVIDE_SCALAR, f->b, 0, 0, 0, 0, f->dst3 + n },
+        { PREPROCESSING_QUEUE_MEAN_IMAGE, f->dst2, 0, 0, 0, 0, f->dst3 },
+        { PREPROCESSING_QUEUE_DIVIDE_SCALAR, f->dst, 0, 0, 0, f->scalar,
+                f->b }
+    };
+    unsigned int commandsOfRound = sizeof(round) / sizeof(round[0]);
+
+    for (unsigned int k = 0; k < 2; k++)
+    {
+        for (unsigned int i = 0; i < commandsOfRound; i++)
+        {
+            struct preprocessing_queue_Command* c = commands + m++;
+
+            memset(c, 0, sizeof(*c));
+            c->op = round[i].op;
+            c->sdSrc1 = round[i].sdSrc1;
+            c->sdSrc2 = round[i].sdSrc2;
+            c->rows = f->rows;
+            c->cols = f->cols;
+            c->rows2 = round[i].rows2;
+            c->cols2 = round[i].cols2;
+            c->value = round[i].value;
+            c->sdDst = round[i].sdDst;
+        }
+    }
+
+    return m;
+}
+
+/*****************************************************************************/
+
+static void verify_queueHold(uint32_t fence, int status, void* user)
+{
+    (void)(fence);
+    (void)(status);
+    (void)(user);
+
+    pthread_mutex_lock(&verify_gateMutex);
+
+    while (!verify_gateOpen)
+    {
+        pthread_cond_wait(&verify_gateOpened, &verify_gateMutex);
+    }
+
+    pthread_mutex_unlock(&verify_gateMutex);
+}
+
+/*****************************************************************************/
+
+static int verify_queueRun(const struct preprocessing_queue_Command* c)
+{
+    switch (c->op)
+    {
+    case PREPROCESSING_QUEUE_ADD_IMAGES:
+        return preprocessing_arith_addImages(c->sdSrc1, c->sdSrc2, c->rows,
+                c->cols, c->sdDst);
+    case PREPROCESSING_QUEUE_SUBTRACT_IMAGES:
+        return preprocessing_arith_subtractImages(c->sdSrc1, c->sdSrc2,
+                c->rows, c->cols, c->sdDst);
+    case PREPROCESSING_QUEUE_DIVIDE_IMAGES:
+        return preprocessing_arith_divideImages(c->sdSrc1, c->sdSrc2,
+                c->rows, c->cols, c->sdDst);
+    case PREPROCESSING_QUEUE_ADD_SCALAR:
+        return preprocessing_arith_addScalar(c->sdSrc1, c->rows, c->cols,
+                c->value, c->sdDst);
+    case PREPROCESSING_QUEUE_MULTIPLY_SCALAR:
+        return preprocessing_arith_multiplyScalar(c->sdSrc1, c->rows,
+                c->cols, c->value, c->sdDst);
+    case PREPROCESSING_QUEUE_DIVIDE_SCALAR:
+        return preprocessing_arith_divideScalar(c->sdSrc1, c->rows, c->cols,
+                c->value, c->sdDst);
+    case PREPROCESSING_QUEUE_SUM_IMAGE:
+        return preprocessing_arith_sumImage(c->sdSrc1, c->rows, c->cols,
+                c->sdDst);
+    case PREPROCESSING_QUEUE_MEAN_IMAGE:
+        return preprocessing_arith_meanImage(c->sdSrc1, c->rows, c->cols,
+                c->sdDst);
+    case PREPROCESSING_QUEUE_OVER_THRESH:
+        return preprocessing_ana_overThresh(c->sdSrc1, c->rows, c->cols,
+                c->value, c->sdDst);
+    case PREPROCESSING_QUEUE_DERIVE_X:
+        return preprocessing_ana_deriveX(c->sdSrc1, c->rows, c->cols,
+                c->sdDst);
+    case PREPROCESSING_QUEUE_MEDIAN_FILTER:
+        return preprocessing_ana_medianFilter(c->sdSrc1, c->rows, c->cols,
+                c->rows2, c->sdDst);
+    case PREPROCESSING_QUEUE_CONVOLVE:
+        return preprocessing_ana_convolve(c->sdSrc1, c->rows, c->cols,
+                c->sdSrc2, c->rows2, c->cols2, c->sdDst);
+    default:
+        return PREPROCESSING_INVALID_NUMBER;
+    }
+}
+
+/*****************************************************************************/
+
+static int verify_expr(const struct verify_Frames* f)
+{
+    struct preprocessing_expr_Expr expr;
+
+    // ((a - b) * mask + scalar) / count where a is over 1000, b elsewhere,
+    // on a window that leaves pixels over at the end of a block.
+    preprocessing_expr_init(&expr, f->rows, f->cols);
+    preprocessing_expr_setWindow(&expr, f->rows - 3, f->cols - 5);
+
+    int a = preprocessing_expr_frame(&expr, f->a, 3, 5);
+    int b = preprocessing_expr_frame(&expr, f->b, 0, 0);
+    int value = preprocessing_expr_divide(&expr,
+            preprocessing_expr_addScalar(&expr,
+                    preprocessing_expr_multiply(&expr,
+                            preprocessing_expr_subtract(&expr, a, b),
+                            preprocessing_expr_frame(&expr, f->mask, 0, 0)),
+                    f->scalar),
+            preprocessing_expr_frame(&expr, f->count, 0, 0));
+    int node = preprocessing_expr_select(&expr,
+            preprocessing_expr_overThresh(&expr, a, 1000 << FP32_FWL), value,
+            b);
+
+    return preprocessing_expr_evaluate(&expr, node, f->dst, 1, 2);
+}
+
+/*****************************************************************************/
+
+static int verify_exprChain(const struct verify_Frames* f, int* statusRef)
+{
+    uint32_t n = (uint32_t)(f->rows) * f->cols;
+    uint16_t rows = f->rows - 3;
+    uint16_t cols = f->cols - 5;
+    uint32_t w = (uint32_t)(rows) * cols;
+    const uint32_t frames[4] = { f->a, f->b, f->mask, f->count };
+    const uint16_t row[4] = { 3, 0, 0, 0 };
+    const uint16_t col[4] = { 5, 0, 0, 0 };
+    int32_t* windows = malloc(6 * (size_t)(w) * sizeof(int32_t));
+    uint32_t sd[6];
+    int status[5];
+
+    *statusRef = PREPROCESSING_SUCCESSFUL;
+
+    if (windows == 0)
+    {
+        printf("Out of memory\n");
+        return PREPROCESSING_NO_MEMORY;
+    }
+
+    // The windows of a, b, mask and count, the value and the threshold mask
+    // after the frames.
+    for (unsigned int i = 0; i < 6; i++)
+    {
+        sd[i] = f->dst3 + n + i * w;
+        preprocessing_vmem_setEntry(sd[i], w, 9 + i, windows + (size_t)(i)
+                * w);
+    }
+
+    for (unsigned int i = 0; i < 4; i++)
+    {
+        const int32_t* src = preprocessing_vmem_getDataAddress(frames[i]);
+
+        for (unsigned int r = 0; r < rows; r++)
+        {
+            memcpy(windows + (size_t)(i) * w + (size_t)(r) * cols,
+                    src + (size_t)(r + row[i]) * f->cols + col[i],
+                    cols * sizeof(int32_t));
+        }
+    }
+
+    status[0] = preprocessing_arith_subtractImages(sd[0], sd[1], rows, cols,
+            sd[4]);
+    status[1] = preprocessing_arith_multiplyImages(sd[4], sd[2], rows, cols,
+            sd[4]);
+    status[2] = preprocessing_arith_addScalar(sd[4], rows, cols, f->scalar,
+            sd[4]);
+    status[3] = preprocessing_arith_divideImages(sd[4], sd[3], rows, cols,
+            sd[4]);
+    status[4] = preprocessing_ana_overThresh(sd[0], rows, cols,
+            1000 << FP32_FWL, sd[5]);
+
+    for (unsigned int i = 0; i < 5; i++)
+    {
+        *statusRef = (*statusRef != PREPROCESSING_SUCCESSFUL) ? *statusRef
+                : status[i];
+    }
+
+    // The value where a is over the threshold, b elsewhere, at (1, 2).
+    memcpy(f->pdst + n, f->pdst, n * sizeof(int32_t));
+
+    for (unsigned int r = 0; r < rows; r++)
+    {
+        for (unsigned int c = 0; c < cols; c++)
+        {
+            size_t p = (size_t)(r) * cols + c;
+            int32_t v = (windows[5 * (size_t)(w) + p] != 0)
+                    ? windows[4 * (size_t)(w) + p] : windows[w + p];
+
+            f->pdst[n + (size_t)(r + 1) * f->cols + c + 2] = v;
+
+            if ((v == EVE_FP32_NAN)
+                    && (*statusRef == PREPROCESSING_SUCCESSFUL))
+            {
+                *statusRef = PREPROCESSING_INVALID_NUMBER;
+            }
+        }
+    }
+
+    for (unsigned int i = 0; i < 6; i++)
+    {
+        preprocessing_vmem_deleteEntry(sd[i]);
+    }
+
+    free(windows);
+
+    return verify_expr(f);
+}
+
+/*****************************************************************************/
+
+static int verify_graph(const struct verify_Frames* f)
+{
+    struct preprocessing_graph_Graph graph;
+
+    // The median of deriveX(a) * mask + scalar, stored and summed, on strips
+    // of 8 rows, so the halos are covered.
+    preprocessing_graph_init(&graph, f->rows, f->cols);
+    graph.stripRows = PREPROCESSING_GRAPH_MIN_STRIP;
+
+    int node = preprocessing_graph_addScalar(&graph,
+            preprocessing_graph_multiply(&graph,
+                    preprocessing_graph_deriveX(&graph,
+                            preprocessing_graph_frame(&graph, f->a)),
+                    preprocessing_graph_frame(&graph, f->mask)),
+            f->scalar);
+    int median = preprocessing_graph_median(&graph, node, 3);
+
+    preprocessing_graph_store(&graph, median, f->dst);
+    preprocessing_graph_sum(&graph, median, f->dst2);
+
+    return preprocessing_graph_run(&graph);
+}
+
+/*****************************************************************************/
+
+static int verify_graphChain(const struct verify_Frames* f, int sum,
+        int* statusRef)
+{
+    uint32_t n = (uint32_t)(f->rows) * f->cols;
+    int32_t* values = malloc((2 * (size_t)(n) + 1) * sizeof(int32_t));
+    int32_t* dst2 = f->pdst + n;
+    uint32_t sd[3];
+    int status[5];
+
+    *statusRef = PREPROCESSING_SUCCESSFUL;
+
+    if (values == 0)
+    {
+        printf("Out of memory\n");
+        return PREPROCESSING_NO_MEMORY;
+    }
+
+    // The value, the median and the sum after the frames. The derivation
+    // adds to an image of 0 as in the graph, both sums add to the first
+    // pixel of dst2.
+    memset(values, 0, n * sizeof(int32_t));
+
+    for (unsigned int i = 0; i < 3; i++)
+    {
+        sd[i] = f->dst3 + n + i * n;
+        preprocessing_vmem_setEntry(sd[i], (i < 2) ? n : 1, 9 + i,
+                values + (size_t)(i) * n);
+    }
+
+    values[2 * (size_t)(n)] = dst2[0];
+
+    int result = verify_graph(f);
+    int32_t total = dst2[0];
+
+    status[0] = preprocessing_ana_deriveX(f->a, f->rows, f->cols, sd[0]);
+    status[1] = preprocessing_arith_multiplyImages(sd[0], f->mask, f->rows,
+            f->cols, sd[0]);
+    status[2] = preprocessing_arith_addScalar(sd[0], f->rows, f->cols,
+            f->scalar, sd[0]);
+    status[3] = preprocessing_ana_medianFilter(sd[0], f->rows, f->cols, 3,
+            sd[1]);
+    status[4] = preprocessing_arith_sumImage(sd[1], f->rows, f->cols, sd[2]);
+
+    for (unsigned int i = 0; i < 5; i++)
+    {
+        *statusRef = (*statusRef != PREPROCESSING_SUCCESSFUL) ? *statusRef
+                : status[i];
+    }
+
+    if (sum)
+    {
+        f->pdst[0] = total;
+        memcpy(dst2, f->pdst, n * sizeof(int32_t));
+        dst2[0] = values[2 * (size_t)(n)];
+    }
+    else
+    {
+        memcpy(dst2, values + n, n * sizeof(int32_t));
+    }
+
+    for (unsigned int i = 0; i < 3; i++)
+    {
+        preprocessing_vmem_deleteEntry(sd[i]);
+    }
+
+    free(values);
+
+    return result;
+}
+
+/*****************************************************************************/
+
+static int verify_eve_add32(const struct verify_Frames* f)
+{
+    uint32_t n = (uint32_t)(f->rows) * f->cols;
+
+    // The result in dst, the copy of the current version in dst2.
+    for (uint32_t i = 0; i < n; i++)
+    {
+        f->pdst[i] = eve_fp_add32(f->pa[i], f->pb[i]);
+        f->pdst[n + i] = verify_add32(f->pa[i], f->pb[i]);
+    }
+
+    return PREPROCESSING_SUCCESSFUL;
+}
+
+/*****************************************************************************/
+
+static int verify_eve_subtract32(const struct verify_Frames* f)
+{
+    uint32_t n = (uint32_t)(f->rows) * f->cols;
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        f->pdst[i] = eve_fp_subtract32(f->pa[i], f->pb[i]);
+        f->pdst[n + i] = verify_subtract32(f->pa[i], f->pb[i]);
+    }
+
+    return PREPROCESSING_SUCCESSFUL;
+}
+
+/*****************************************************************************/
+
+static int verify_eve_multiply32(const struct verify_Frames* f)
+{
+    uint32_t n = (uint32_t)(f->rows) * f->cols;
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        f->pdst[i] = eve_fp_multiply32(f->pa[i], f->pb[i], FP32_FWL);
+        f->pdst[n + i] = verify_multiply32(f->pa[i], f->pb[i]);
+    }
+
+    return PREPROCESSING_SUCCESSFUL;
+}
+
+/*****************************************************************************/
+
+static int verify_eve_divide32(const struct verify_Frames* f)
+{
+    uint32_t n = (uint32_t)(f->rows) * f->cols;
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        f->pdst[i] = eve_fp_divide32(f->pa[i], f->pb[i], FP32_FWL);
+        f->pdst[n + i] = verify_divide32(f->pa[i], f->pb[i]);
+    }
+
+    return PREPROCESSING_SUCCESSFUL;
+}
+
+/*****************************************************************************/
+
+static int verify_ana_filter(const struct verify_Frames* f, uint16_t rows2,
+        uint16_t cols2, int convolve, int* statusRef)
+{
+    uint32_t n = (uint32_t)(f->rows) * f->cols;
+    unsigned int size2 = (unsigned int)(rows2) * cols2;
+    const int32_t* kernel = f->pa + 3 * n; // the pixels of count
+    int32_t w[9];
+    int status = 0;
+
+    // Both start from the same result image.
+    memcpy(f->pdst + n, f->pdst, n * sizeof(int32_t));
+
+    for (unsigned int i = 0; i < size2; i++)
+    {
+        w[i] = convolve ? kernel[size2 - 1 - i] : kernel[i];
+    }
+
+    if (convolve)
+    {
+        status = preprocessing_ana_convolve(f->a, f->rows, f->cols, f->count,
+                rows2, cols2, f->dst);
+    }
+    else
+    {
+        status = preprocessing_ana_crossCorrelate(f->a, f->rows, f->cols,
+                f->count, rows2, cols2, f->dst);
+    }
+
+    *statusRef = verify_filter(f->pa, f->rows, f->cols, w, rows2, cols2,
+            !convolve, f->pdst + n);
+
+    return status;
+}
+
+/*****************************************************************************/
+
+static int verify_ana_derive(const struct verify_Frames* f, int down,
+        int* statusRef)
+{
+    uint32_t n = (uint32_t)(f->rows) * f->cols;
+
+    // The kernel [-1 0 1] rotated by 180 degrees.
+    const int32_t w[3] = { FP32_BINARY_TRUE, 0, -FP32_BINARY_TRUE };
+
+    memcpy(f->pdst + n, f->pdst, n * sizeof(int32_t));
+
+    int status = down
+            ? preprocessing_ana_deriveX(f->a, f->rows, f->cols, f->dst)
+            : preprocessing_ana_deriveY(f->a, f->rows, f->cols, f->dst);
+
+    *statusRef = verify_filter(f->pa, f->rows, f->cols, w, down ? 3 : 1,
+            down ? 1 : 3, 1, f->pdst + n);
+
+    return status;
+}
+
+/*****************************************************************************/
+
+static int verify_filter(const int32_t* src, uint16_t rows, uint16_t cols,
+        const int32_t* w, uint16_t rows2, uint16_t cols2, int mirror,
+        int32_t* dst)
+{
+    int kr = (rows2 - 1) / 2;
+    int kc = (cols2 - 1) / 2;
+    int status = PREPROCESSING_SUCCESSFUL;
+
+    for (int r = 0; r < rows; r++)
+    {
+        for (int c = 0; c < cols; c++)
+        {
+            int64_t acc = dst[r * cols + c];
+            int bad = (acc == EVE_FP32_NAN);
+
+            for (int i = 0; (i < rows2) && !bad; i++)
+            {
+                for (int j = 0; (j < cols2) && !bad; j++)
+                {
+                    int dr = i - kr;
+                    int dc = j - kc;
+
+                    // Mirroring negates the offset, zero padding adds 0.
+                    if (mirror && ((r + dr >= rows) || (r + dr < 0)))
+                    {
+                        dr = 0 - dr;
+                    }
+
+                    if (mirror && ((c + dc >= cols) || (c + dc < 0)))
+                    {
+                        dc = 0 - dc;
+                    }
+
+                    if ((r + dr >= rows) || (r + dr < 0) || (c + dc >= cols)
+                            || (c + dc < 0))
+                    {
+                        continue;
+                    }
+
+                    int64_t prod = ((int64_t)(src[(r + dr) * cols + c + dc])
+                            * w[i * cols2 + j]) >> FP32_FWL;
+
+                    acc += prod;
+                    bad = (prod < EVE_FP32_MIN) || (prod > EVE_FP32_MAX)
+                            || (acc < EVE_FP32_MIN) || (acc > EVE_FP32_MAX);
+                }
+            }
+
+            dst[r * cols + c] = bad ? EVE_FP32_NAN : (int32_t)(acc);
+            status = bad ? PREPROCESSING_INVALID_NUMBER : status;
+        }
+    }
+
+    return status;
+}
+
+/*****************************************************************************/
+
+static int32_t verify_add32(int32_t a, int32_t b)
+{
+    int64_t sum = (int64_t)(a) + b;
+
+    return ((sum >= EVE_FP32_MIN) && (sum <= EVE_FP32_MAX)) ? (int32_t)(sum)
+            : EVE_FP32_NAN;
+}
+
+/*****************************************************************************/
+
+static int32_t verify_subtract32(int32_t a, int32_t b)
+{
+    int64_t difference = (int64_t)(a) - b;
+
+    return ((difference >= EVE_FP32_MIN) && (difference <= EVE_FP32_MAX))
+            ? (int32_t)(difference) : EVE_FP32_NAN;
+}
+
+/*****************************************************************************/
+
+static int32_t verify_multiply32(int32_t a, int32_t b)
+{
+    int64_t product = ((int64_t)(a) * b) >> FP32_FWL;
+
+    return ((product >= EVE_FP32_MIN) && (product <= EVE_FP32_MAX))
+            ? (int32_t)(product) : EVE_FP32_NAN;
+}
+
+/*****************************************************************************/
+
+static int32_t verify_divide32(int32_t a, int32_t b)
+{
+    unsigned int exceededBits = 0;
+
+    if (b == 0)
+    {
+        return EVE_FP32_NAN;
+    }
+
+    int64_t quotient = (int64_t)(a);
+
+    if (a < 0)
+    {
+        quotient = (~quotient) + 1;
+    }
+
+    // The dividend is shifted by the fraction bits that fit in 31 bits.
+    for (unsigned int n = 0; n < FP32_FWL; n++)
+    {
+        if (((quotient >> (31 - FP32_FWL)) & (1 << n)) >> n)
+        {
+            exceededBits = n + 1;
+        }
+    }
+
+    quotient = ((quotient << (FP32_FWL - exceededBits)) / b) << exceededBits;
+
+    if (a < 0)
+    {
+        quotient = (~quotient) + 1;
+    }
+
+    return (int32_t)(quotient);
+}
@@ -0,0 +1,670 @@
+/*
+ * Project: Solar Orbiter - PHI (SO/PHI)
+ * Module:  Preprocessing - a library for image pre-processing.
+ *
+ * Copyright (C) 2016, Max Planck Institute for Solar System Research
+ */
+
+/**
+ * @file
+ *
+ * This file contains implementation of the registration of frames by FFT
+ * phase correlation.
+ */
+
+#include "preprocessing/align.h"
+
+#include "preprocessing/def.h"
+#include "preprocessing/fft.h"
+#include "preprocessing/prof.h"
+#include "preprocessing/vmem.h"
+
+/* from libeve */
+#include "../libeve/eve/fixed_point.h"
+
+/* from std c */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * A peak away from the origin at least this fraction of the height of the
+ * peak at the origin is taken for the shift: the origin peak is then a pattern
+ * fixed to the detector.
+ */
+#define ALIGN_PATTERN_RATIO 0.5
+
+/**
+ * The smallest ratio of the peak to the highest correlation outside of it and
+ * away from the origin for an unambiguous shift. Noisy synthetic frames give
+ * wrong shifts up to about 1.5 and right ones from about 1.4.
+ */
+#define ALIGN_MIN_STRENGTH 1.6
+
+/**
+ * This is everything that is computed once from the reference frame.
+ */
+struct align_Reference
+{
+    uint16_t rows;         /**< frame rows */
+    uint16_t cols;         /**< frame columns */
+    uint16_t binning;      /**< pixels binned per axis */
+    unsigned int fftRows;  /**< rows of the binned transform */
+    unsigned int fftCols;  /**< columns of the binned transform */
+    double* binRe;         /**< spectrum of the binned reference */
+    double* binIm;
+    unsigned int fullRows; /**< rows of the full resolution transform, or 0 */
+    unsigned int fullCols; /**< columns of the full resolution transform */
+    double* fullRe;        /**< spectrum of the full resolution reference */
+    double* fullIm;
+};
+
+/* PRIVATE INTERFACE *********************************************************/
+
+/**
+ * Prepare the spectra of a reference frame.
+ *
+ * @param ref       the reference frame.
+ * @param rows      the number of frame rows.
+ * @param cols      the number of frame columns.
+ * @param binning   the number of pixels binned per axis.
+ * @param reference the prepared reference.
+ *
+ * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+ */
+static int align_prepare(const int32_t* ref, uint16_t rows, uint16_t cols,
+        uint16_t binning, struct align_Reference* reference);
+
+/**
+ * Release the spectra of a reference frame.
+ *
+ * @param reference the prepared reference.
+ */
+static void align_release(struct align_Reference* reference);
+
+/**
+ * Estimate the shift of a frame against the prepared reference.
+ *
+ * @param reference the prepared reference.
+ * @param src       the frame.
+ * @param subPixel  1 for a sub-pixel shift, 0 for an integer shift.
+ * @param dy        the shift in rows.
+ * @param dx        the shift in columns.
+ *
+ * @return PREPROCESSING_SUCCESSFUL on success, PREPROCESSING_INVALID_NUMBER
+ *         if the peak is weaker than ALIGN_MIN_STRENGTH (the shift is still
+ *         stored), failure code otherwise.
+ */
+static int align_estimate(const struct align_Reference* reference,
+        const int32_t* src, int subPixel, double* dy, double* dx);
+
+/**
+ * Bin a frame. NaN pixels are left out of the average of a bin.
+ *
+ * @param src     the frame.
+ * @param rows    the number of frame rows.
+ * @param cols    the number of frame columns.
+ * @param binning the number of pixels binned per axis.
+ * @param dst     the binned frame (rows / binning x cols / binning).
+ */
+static void align_bin(const int32_t* src, uint16_t rows, uint16_t cols,
+        unsigned int binning, double* dst);
+
+/**
+ * Bin a frame, remove its mean, apply a Hann window and transform it, zero
+ * padded to n x m.
+ *
+ * @param src     the frame.
+ * @param rows    the number of frame rows.
+ * @param cols    the number of frame columns.
+ * @param binning the number of pixels binned per axis.
+ * @param n       the number of rows of the transform (a power of 2).
+ * @param m       the number of columns of the transform (a power of 2).
+ * @param re      the real parts of the spectrum.
+ * @param im      the imaginary parts of the spectrum.
+ *
+ * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+ */
+static int align_spectrum(const int32_t* src, uint16_t rows, uint16_t cols,
+        unsigned int binning, unsigned int n, unsigned int m, double* re,
+        double* im);
+
+/**
+ * Find the peak of the phase correlation of two spectra. A pattern fixed to
+ * the detector peaks at the origin, so a peak elsewhere is preferred if it is
+ * at least ALIGN_PATTERN_RATIO as high.
+ *
+ * @param re1      the real parts of spectrum 1.
+ * @param im1      the imaginary parts of spectrum 1.
+ * @param re2      the real parts of spectrum 2 (reference).
+ * @param im2      the imaginary parts of spectrum 2 (reference).
+ * @param n        the number of rows of the transform.
+ * @param m        the number of columns of the transform.
+ * @param radius   the search radius around (cy, cx), 0 to search everywhere.
+ * @param cy       the row of the search center.
+ * @param cx       the column of the search center.
+ * @param py       the row of the peak (sub-pixel).
+ * @param px       the column of the peak (sub-pixel).
+ * @param strength the ratio of the peak to the highest correlation outside of
+ *                 its 3 x 3 neighbourhood and the origin.
+ *
+ * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+ */
+static int align_correlate(const double* re1, const double* im1,
+        const double* re2, const double* im2, unsigned int n, unsigned int m,
+        int radius, int cy, int cx, double* py, double* px, double* strength);
+
+/**
+ * Get the vertex of a parabola through three equidistant samples.
+ *
+ * @param left   the sample before the center.
+ * @param center the center sample.
+ * @param right  the sample after the center.
+ *
+ * @return the offset of the vertex from the center, within [-0.5, 0.5].
+ */
+static double align_vertex(double left, double center, double right);
+
+/**
+ * Get the smallest power of 2 not less than a number.
+ *
+ * @param n the number.
+ *
+ * @return the power of 2.
+ */
+static unsigned int align_pow2(unsigned int n);
+
+/* PUBLIC IMPLEMENTATION *****************************************************/
+
+int preprocessing_align_phaseCorrelate(uint32_t sdSrc, uint32_t sdRef,
+        uint16_t rows, uint16_t cols, uint16_t binning, int subPixel,
+        int32_t* dy, int32_t* dx)
+{
+    PREPROCESSING_PROF_OPERATION(2 * PREPROCESSING_PROF_FRAME(rows, cols), 0);
+
+    int status = PREPROCESSING_SUCCESSFUL;
+    struct align_Reference reference;
+    double y = 0.0;
+    double x = 0.0;
+
+    const int32_t* src = preprocessing_vmem_getDataAddress(sdSrc);
+    const int32_t* ref = preprocessing_vmem_getDataAddress(sdRef);
+
+    if ((dy == 0) || (dx == 0))
+    {
+        printf("Invalid data pointer: %p.\n", (void*)(dy));
+        return PREPROCESSING_INVALID_ADDRESS;
+    }
+
+    // Check whether given rows and columns are in a valid range.
+    if ((!preprocessing_vmem_isProcessingSizeValid(sdSrc, rows, cols))
+            || (!preprocessing_vmem_isProcessingSizeValid(sdRef, rows, cols)))
+    {
+        return PREPROCESSING_INVALID_SIZE;
+    }
+
+    status = align_prepare(ref, rows, cols, binning, &reference);
+
+    if (status != PREPROCESSING_SUCCESSFUL)
+    {
+        return status;
+    }
+
+    status = align_estimate(&reference, src, subPixel, &y, &x);
+    align_release(&reference);
+
+    *dy = (int32_t)(lround(y * (double)(1 << FP32_FWL)));
+    *dx = (int32_t)(lround(x * (double)(1 << FP32_FWL)));
+
+    return status;
+}
+
+/*****************************************************************************/
+
+int preprocessing_align_phaseCorrelateNAND(const int32_t* const* nandSrc,
+        uint16_t frames, uint16_t reference, uint16_t rows, uint16_t cols,
+        uint16_t binning, int subPixel, int32_t* nandDst)
+{
+    PREPROCESSING_PROF_OPERATION(frames * PREPROCESSING_PROF_FRAME(rows, cols),
+            frames * 2 * sizeof(int32_t));
+
+    int status = PREPROCESSING_SUCCESSFUL;
+    struct align_Reference prepared;
+    int invalid = 0;
+
+    if ((nandSrc == 0) || (nandDst == 0) || (reference >= frames))
+    {
+        printf("Invalid data pointer: %p.\n", (const void*)(nandSrc));
+        return PREPROCESSING_INVALID_ADDRESS;
+    }
+
+    for (uint16_t i = 0; i < frames; i++)
+    {
+        if (nandSrc[i] == 0)
+        {
+            printf("Invalid data pointer: %p.\n", (const void*)(nandSrc[i]));
+            return PREPROCESSING_INVALID_ADDRESS;
+        }
+    }
+
+    status = align_prepare(nandSrc[reference], rows, cols, binning, &prepared);
+
+    if (status != PREPROCESSING_SUCCESSFUL)
+    {
+        return status;
+    }
+
+    // Process. An ambiguous shift is stored anyway and reported after all
+    // frames.
+    PREPROCESSING_DEF_PARALLEL_FOR_OR(invalid)
+    for (unsigned int i = 0; i < frames; i++)
+    {
+        double y = 0.0;
+        double x = 0.0;
+        int frameStatus = (i == reference) ? PREPROCESSING_SUCCESSFUL
+                : align_estimate(&prepared, nandSrc[i], subPixel, &y, &x);
+
+        if (frameStatus == PREPROCESSING_INVALID_NUMBER)
+        {
+            invalid |= 1;
+        }
+        else if (frameStatus != PREPROCESSING_SUCCESSFUL)
+        {
+            invalid |= 2;
+        }
+
+        nandDst[2 * i] = (int32_t)(lround(y * (double)(1 << FP32_FWL)));
+        nandDst[2 * i + 1] = (int32_t)(lround(x * (double)(1 << FP32_FWL)));
+    }
+
+    align_release(&prepared);
+
+    return (invalid & 2) ? PREPROCESSING_NO_MEMORY
+            : ((invalid & 1) ? PREPROCESSING_INVALID_NUMBER
+                    : PREPROCESSING_SUCCESSFUL);
+}
+
+/* PRIVATE IMPLEMENTATION ****************************************************/
+
+static int align_prepare(const int32_t* ref, uint16_t rows, uint16_t cols,
+        uint16_t binning, struct align_Reference* reference)
+{
+    int status = PREPROCESSING_SUCCESSFUL;
+
+    memset(reference, 0, sizeof(*reference));
+
+    if ((binning == 0) || (rows / binning < 4) || (cols / binning < 4))
+    {
+        return PREPROCESSING_INVALID_SIZE;
+    }
+
+    reference->rows = rows;
+    reference->cols = cols;
+    reference->binning = binning;
+    reference->fftRows = align_pow2(rows / binning);
+    reference->fftCols = align_pow2(cols / binning);
+
+    // The full resolution pass, if binning leaves anything to refine.
+    if (binning > 1)
+    {
+        reference->fullRows = align_pow2(rows);
+        reference->fullCols = align_pow2(cols);
+    }
+
+    size_t binHalf = (size_t)(reference->fftRows)
+            * PREPROCESSING_FFT_COLS(reference->fftCols);
+    size_t fullHalf = (reference->fullRows == 0) ? 0
+            : (size_t)(reference->fullRows)
+                    * PREPROCESSING_FFT_COLS(reference->fullCols);
+
+    reference->binRe = malloc(2 * (binHalf + fullHalf) * sizeof(double));
+
+    if (reference->binRe == 0)
+    {
+        return PREPROCESSING_NO_MEMORY;
+    }
+
+    reference->binIm = reference->binRe + binHalf;
+    reference->fullRe = reference->binIm + binHalf;
+    reference->fullIm = reference->fullRe + fullHalf;
+
+    status = align_spectrum(ref, rows, cols, binning, reference->fftRows,
+            reference->fftCols, reference->binRe, reference->binIm);
+
+    if ((status == PREPROCESSING_SUCCESSFUL) && (reference->fullRows > 0))
+    {
+        status = align_spectrum(ref, rows, cols, 1, reference->fullRows,
+                reference->fullCols, reference->fullRe, reference->fullIm);
+    }
+
+    if (status != PREPROCESSING_SUCCESSFUL)
+    {
+        align_release(reference);
+    }
+
+    return status;
+}
+
+/*****************************************************************************/
+
+static void align_release(struct align_Reference* reference)
+{
+    free(reference->binRe);
+    reference->binRe = 0;
+    reference->binIm = 0;
+    reference->fullRe = 0;
+    reference->fullIm = 0;
+}
+
+/*****************************************************************************/
+
+static int align_estimate(const struct align_Reference* reference,
+        const int32_t* src, int subPixel, double* dy, double* dx)
+{
+    int status = PREPROCESSING_SUCCESSFUL;
+    unsigned int binning = reference->binning;
+    size_t binHalf = (size_t)(reference->fftRows)
+            * PREPROCESSING_FFT_COLS(reference->fftCols);
+    size_t fullHalf = (reference->fullRows == 0) ? 0
+            : (size_t)(reference->fullRows)
+                    * PREPROCESSING_FFT_COLS(reference->fullCols);
+    size_t half = (binHalf > fullHalf) ? binHalf : fullHalf;
+    double y = 0.0;
+    double x = 0.0;
+    double strength = 0.0;
+
+    double* re = malloc(2 * half * sizeof(double));
+
+    if (re == 0)
+    {
+        return PREPROCESSING_NO_MEMORY;
+    }
+
+    double* im = re + half;
+
+    // Coarse estimate on the binned frames.
+    status = align_spectrum(src, reference->rows, reference->cols, binning,
+            reference->fftRows, reference->fftCols, re, im);
+
+    if (status == PREPROCESSING_SUCCESSFUL)
+    {
+        status = align_correlate(re, im, reference->binRe, reference->binIm,
+                reference->fftRows, reference->fftCols, 0, 0, 0, &y, &x,
+                &strength);
+        y *= binning;
+        x *= binning;
+    }
+
+    // Refine at full resolution within one bin of the coarse estimate. A
+    // shift below one bin has its coarse peak at the origin, next to the
+    // peak of the pattern, which align_correlate() tells apart.
+    if ((status == PREPROCESSING_SUCCESSFUL) && (reference->fullRows > 0))
+    {
+        status = align_spectrum(src, reference->rows, reference->cols, 1,
+                reference->fullRows, reference->fullCols, re, im);
+
+        if (status == PREPROCESSING_SUCCESSFUL)
+        {
+            status = align_correlate(re, im, reference->fullRe,
+                    reference->fullIm, reference->fullRows,
+                    reference->fullCols, (int)(binning), (int)(lround(y)),
+                    (int)(lround(x)), &y, &x, &strength);
+        }
+    }
+
+    if ((status == PREPROCESSING_SUCCESSFUL)
+            && (strength < ALIGN_MIN_STRENGTH))
+    {
+        status = PREPROCESSING_INVALID_NUMBER;
+    }
+
+    free(re);
+
+    *dy = subPixel ? y : floor(y + 0.5);
+    *dx = subPixel ? x : floor(x + 0.5);
+
+    return status;
+}
+
+/*****************************************************************************/
+
+static void align_bin(const int32_t* src, uint16_t rows, uint16_t cols,
+        unsigned int binning, double* dst)
+{
+    unsigned int binRows = rows / binning;
+    unsigned int binCols = cols / binning;
+
+    for (unsigned int by = 0; by < binRows; by++)
+    {
+        for (unsigned int bx = 0; bx < binCols; bx++)
+        {
+            double sum = 0.0;
+            unsigned int n = 0;
+
+            for (unsigned int i = 0; i < binning; i++)
+            {
+                const int32_t* s = src + (size_t)(by * binning + i) * cols
+                        + bx * binning;
+
+                for (unsigned int j = 0; j < binning; j++)
+                {
+                    if (s[j] != EVE_FP32_NAN)
+                    {
+                        sum += s[j];
+                        n++;
+                    }
+                }
+            }
+
+            dst[by * binCols + bx] = (n > 0) ? sum / n : 0.0;
+        }
+    }
+}
+
+/*****************************************************************************/
+
+static int align_spectrum(const int32_t* src, uint16_t rows, uint16_t cols,
+        unsigned int binning, unsigned int n, unsigned int m, double* re,
+        double* im)
+{
+    int status = PREPROCESSING_SUCCESSFUL;
+    unsigned int binRows = rows / binning;
+    unsigned int binCols = cols / binning;
+    double mean = 0.0;
+
+    double* data = calloc((size_t)(n) * m + binRows * binCols, sizeof(double));
+
+    if (data == 0)
+    {
+        return PREPROCESSING_NO_MEMORY;
+    }
+
+    double* binned = data + (size_t)(n) * m;
+
+    align_bin(src, rows, cols, binning, binned);
+
+    for (unsigned int p = 0; p < binRows * binCols; p++)
+    {
+        mean += binned[p];
+    }
+
+    mean /= (double)(binRows * binCols);
+
+    // Remove the mean and taper the edges, so the frame border does not
+    // correlate.
+    for (unsigned int y = 0; y < binRows; y++)
+    {
+        double wy = 0.5 - 0.5 * cos(2.0 * PI * (y + 0.5) / binRows);
+
+        for (unsigned int x = 0; x < binCols; x++)
+        {
+            double wx = 0.5 - 0.5 * cos(2.0 * PI * (x + 0.5) / binCols);
+
+            data[(size_t)(y) * m + x] = (binned[y * binCols + x] - mean) * wy
+                    * wx;
+        }
+    }
+
+    status = preprocessing_fft_real2D(data, n, m, re, im);
+    free(data);
+
+    return status;
+}
+
+/*****************************************************************************/
+
+static int align_correlate(const double* re1, const double* im1,
+        const double* re2, const double* im2, unsigned int n, unsigned int m,
+        int radius, int cy, int cx, double* py, double* px, double* strength)
+{
+    int status = PREPROCESSING_SUCCESSFUL;
+    size_t half = (size_t)(n) * PREPROCESSING_FFT_COLS(m);
+    double best = -INFINITY;
+    unsigned int iy = 0;
+    unsigned int ix = 0;
+
+    double* data = malloc((2 * half + (size_t)(n) * m) * sizeof(double));
+
+    if (data == 0)
+    {
+        return PREPROCESSING_NO_MEMORY;
+    }
+
+    double* re = data;
+    double* im = data + half;
+    double* corr = im + half;
+
+    // Cross power spectrum, normalized to its phase.
+    for (size_t p = 0; p < half; p++)
+    {
+        double a = re1[p] * re2[p] + im1[p] * im2[p];
+        double b = im1[p] * re2[p] - re1[p] * im2[p];
+        double mag = sqrt(a * a + b * b);
+
+        re[p] = (mag > 0.0) ? a / mag : 0.0;
+        im[p] = (mag > 0.0) ? b / mag : 0.0;
+    }
+
+    status = preprocessing_fft_realInverse2D(re, im, n, m, corr);
+
+    if (status != PREPROCESSING_SUCCESSFUL)
+    {
+        free(data);
+        return status;
+    }
+
+    // Peak, everywhere or around the search center, and the origin apart.
+    int y0 = (radius > 0) ? cy - radius : 0;
+    int y1 = (radius > 0) ? cy + radius : (int)(n) - 1;
+    int x0 = (radius > 0) ? cx - radius : 0;
+    int x1 = (radius > 0) ? cx + radius : (int)(m) - 1;
+    double origin = -INFINITY;
+
+    for (int y = y0; y <= y1; y++)
+    {
+        unsigned int wy = (unsigned int)(((y % (int)(n)) + (int)(n))
+                % (int)(n));
+
+        for (int x = x0; x <= x1; x++)
+        {
+            unsigned int wx = (unsigned int)(((x % (int)(m)) + (int)(m))
+                    % (int)(m));
+
+            if ((wy == 0) && (wx == 0))
+            {
+                origin = corr[0];
+            }
+            else if (corr[(size_t)(wy) * m + wx] > best)
+            {
+                best = corr[(size_t)(wy) * m + wx];
+                iy = wy;
+                ix = wx;
+            }
+        }
+    }
+
+    // The origin wins unless the peak elsewhere is high enough to be the
+    // content, then the origin is the pattern and is left out of the vertex
+    // and the strength.
+    if ((origin > best) && (best < ALIGN_PATTERN_RATIO * origin))
+    {
+        best = origin;
+        iy = 0;
+        ix = 0;
+    }
+    else if (origin > 0.0)
+    {
+        corr[0] = 0.0;
+    }
+
+    double subY = align_vertex(corr[(size_t)((iy + n - 1) % n) * m + ix],
+            best, corr[(size_t)((iy + 1) % n) * m + ix]);
+    double subX = align_vertex(corr[(size_t)(iy) * m + (ix + m - 1) % m],
+            best, corr[(size_t)(iy) * m + (ix + 1) % m]);
+    double second = 0.0;
+
+    for (int y = y0; y <= y1; y++)
+    {
+        unsigned int wy = (unsigned int)(((y % (int)(n)) + (int)(n))
+                % (int)(n));
+        unsigned int ry = (wy + n - iy) % n;
+
+        for (int x = x0; x <= x1; x++)
+        {
+            unsigned int wx = (unsigned int)(((x % (int)(m)) + (int)(m))
+                    % (int)(m));
+            unsigned int rx = (wx + m - ix) % m;
+
+            if (((ry > 1) && (ry < n - 1)) || ((rx > 1) && (rx < m - 1)))
+            {
+                second = fmax(second, corr[(size_t)(wy) * m + wx]);
+            }
+        }
+    }
+
+    *strength = (best <= 0.0) ? 0.0
+            : ((second > 0.0) ? best / second : INFINITY);
+
+    // Shifts beyond half the transform are negative.
+    *py = ((iy > n / 2) ? (double)(iy) - n : (double)(iy)) + subY;
+    *px = ((ix > m / 2) ? (double)(ix) - m : (double)(ix)) + subX;
+
+    free(data);
+
+    return status;
+}
+
+/*****************************************************************************/
+
+static double align_vertex(double left, double center, double right)
+{
+    double offset = 0.0;
+
+    // The phase correlation peak of a sub-pixel shift is a sampled sinc, its
+    // larger neighbour gives the offset (Foroosh et al. 2002).
+    if ((right > left) && (right > 0.0))
+    {
+        offset = right / (right + center);
+    }
+    else if (left > 0.0)
+    {
+        offset = 0.0 - left / (left + center);
+    }
+
+    return (offset < -0.5) ? -0.5 : ((offset > 0.5) ? 0.5 : offset);
+}
+
+/*****************************************************************************/
+
+static unsigned int align_pow2(unsigned int n)
+{
+    unsigned int p = 1;
+
+    while (p < n)
+    {
+        p *= 2;
+    }
+
+    return p;
+}
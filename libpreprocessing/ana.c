@@ -15,6 +15,9 @@
 #include "preprocessing/ana.h"
 
 #include "preprocessing/def.h"
+#include "preprocessing/fft.h"
+#include "preprocessing/kernel.h"
+#include "preprocessing/prof.h"
 #include "preprocessing/vmem.h"
 
 /* from libeve */
@@ -30,20 +33,119 @@
 /* PRIVATE INTERFACE *********************************************************/
 
 /**
- * Perform median filtering on an image.
+ * This is the number of image rows of one band of the histogram median. The
+ * bands are spread over all cores.
+ */
+#define ANA_MEDIAN_BAND 64
+
+/**
+ * This is the rank histogram of the histogram median. The ranks of a band
+ * are unique, so a fine bin holds 0 or 1, a mid bin covers 64 ranks and a
+ * coarse bin 4096 ranks.
+ */
+struct ana_Histogram
+{
+    uint8_t* fine;
+    uint8_t* mid;
+    uint16_t* coarse;
+};
+
+/**
+ * Perform median filtering on an image with a square window, see
+ * preprocessing_ana_medianFilter(). 3x3 and 5x5 windows use sorting networks
+ * inside the image, all other sizes a rank histogram.
  *
- * @param src1  the pointer to start pixel of image.
- * @param rows1 the number of pixels of image in x dimension (rows).
- * @param cols1 the number of pixels of image in y dimension (columns).
- * @param src2  the pointer to start pixel of kernel.
- * @param rows2 the number of pixels of kernel in x dimension (rows).
- * @param cols2 the number of pixels of kernel in y dimension (columns).
- * @param dst   the pointer to start pixel of result image.
+ * @param src    the pointer to start pixel of image.
+ * @param rows   the number of pixels of image in x dimension (rows).
+ * @param cols   the number of pixels of image in y dimension (columns).
+ * @param radius the window radius, the window size is 2 * radius + 1.
+ * @param dst    the pointer to start pixel of result image.
+ *
+ * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+ */
+static int ana_median(const int32_t* src, uint16_t rows, uint16_t cols,
+        unsigned int radius, int32_t* dst);
+
+/**
+ * Perform 3x3 median filtering inside the image (a sorting network, on the
+ * windows of a vector of pixels at once with the SIMD kernel backends).
+ *
+ * @param src  the pointer to start pixel of image.
+ * @param rows the number of pixels of image in x dimension (rows).
+ * @param cols the number of pixels of image in y dimension (columns).
+ * @param dst  the pointer to start pixel of result image.
+ */
+static void ana_median3x3(const int32_t* src, uint16_t rows, uint16_t cols,
+        int32_t* dst);
+
+/**
+ * Perform 5x5 median filtering inside the image (a sorting network, on the
+ * windows of a vector of pixels at once with the SIMD kernel backends).
+ *
+ * @param src  the pointer to start pixel of image.
+ * @param rows the number of pixels of image in x dimension (rows).
+ * @param cols the number of pixels of image in y dimension (columns).
+ * @param dst  the pointer to start pixel of result image.
+ */
+static void ana_median5x5(const int32_t* src, uint16_t rows, uint16_t cols,
+        int32_t* dst);
+
+/**
+ * Perform median filtering of the pixels closer than radius to the image
+ * border, with the window cut at the border.
+ *
+ * @param src    the pointer to start pixel of image.
+ * @param rows   the number of pixels of image in x dimension (rows).
+ * @param cols   the number of pixels of image in y dimension (columns).
+ * @param radius the window radius, at most 2.
+ * @param dst    the pointer to start pixel of result image.
+ */
+static void ana_medianBorder(const int32_t* src, uint16_t rows, uint16_t cols,
+        unsigned int radius, int32_t* dst);
+
+/**
+ * Perform median filtering of the rows y0 to y1 with a rank histogram that
+ * slides along each row (Huang): one window column of up to 2 * radius + 1
+ * ranks goes in and one goes out per pixel, so the cost per pixel grows
+ * with the radius, not with the window area. The column histograms of
+ * Perreault and Hebert would make it constant, but only for a histogram of
+ * few bins: this one has a bin per pixel of the band (exact 32 bit values),
+ * adding a column histogram would cost as much as adding its ranks.
+ *
+ * @param src    the pointer to start pixel of image.
+ * @param rows   the number of pixels of image in x dimension (rows).
+ * @param cols   the number of pixels of image in y dimension (columns).
+ * @param radius the window radius.
+ * @param y0     the first row of the band.
+ * @param y1     the row after the band.
+ * @param dst    the pointer to start pixel of result image.
  *
  * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
  */
-static int ana_median(const int32_t* src1, uint16_t rows1, uint16_t cols1,
-        const int32_t* src2, uint16_t rows2, uint16_t cols2, int32_t* dst);
+static int ana_medianBand(const int32_t* src, uint16_t rows, uint16_t cols,
+        unsigned int radius, unsigned int y0, unsigned int y1, int32_t* dst);
+
+/**
+ * Get the median of some values, the average of the two middle ones for an
+ * even number. The values are sorted in place.
+ *
+ * @param values the values.
+ * @param n      the number of values, at least 1.
+ *
+ * @return the median.
+ */
+static int32_t ana_medianOfValues(int32_t* values, unsigned int n);
+
+/**
+ * Get the rank of the k-th smallest entry of a rank histogram.
+ *
+ * @param hist the rank histogram.
+ * @param k    the index of the entry, smaller than the number of entries.
+ *
+ * @return the rank.
+ */
+static uint32_t ana_histogramSelect(const struct ana_Histogram* hist,
+        uint32_t k);
 
 /**
  * Cross-correlate an image with a kernel. Edge handling is done by mirroring
@@ -82,8 +184,7 @@ static int ana_crossCorrelateZero(const int32_t* src1, uint16_t rows1,
         int32_t* dst);
 
 /**
- * Convolve an image with a kernel. Edge handling is done by mirroring at
- * image border.
+ * Convolve an image with a kernel. Edge handling is done by zero padding.
  *
  * @param src1  the pointer to start pixel of image.
  * @param rows1 the number of pixels of image in x dimension (rows).
@@ -95,32 +196,333 @@ static int ana_crossCorrelateZero(const int32_t* src1, uint16_t rows1,
  *
  * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
  */
-static int ana_convolveMirror(const int32_t* src1, uint16_t rows1,
+static int ana_convolveZero(const int32_t* src1, uint16_t rows1,
         uint16_t cols1, const int32_t* src2, uint16_t rows2, uint16_t cols2,
         int32_t* dst);
 
 /**
- * Convolve an image with a kernel. Edge handling is done by zero padding.
+ * This is the number of kernel taps from which on a separable kernel is
+ * applied as two 1-D passes.
+ */
+#define ANA_SEPARABLE_TAPS 25
+
+/**
+ * This is the number of kernel taps from which on a kernel that is not
+ * separable is applied through the FFT.
+ */
+#define ANA_FFT_TAPS 121
+
+/**
+ * Apply a kernel to an image, the engine behind convolution and
+ * cross-correlation. Small kernels run the direct sum with per-tap 24.8
+ * arithmetic. Large separable kernels run two 1-D passes and other large
+ * kernels an overlap-save FFT, both of which round the sum once. With zero
+ * padding all paths read a zero halo buffer. With mirroring the border is
+ * always done by the direct sum.
+ *
+ * @param src1   the pointer to start pixel of image.
+ * @param rows1  the number of pixels of image in x dimension (rows).
+ * @param cols1  the number of pixels of image in y dimension (columns).
+ * @param src2   the pointer to start pixel of kernel.
+ * @param rows2  the number of pixels of kernel in x dimension (rows).
+ * @param cols2  the number of pixels of kernel in y dimension (columns).
+ * @param rotate 1 to rotate the kernel by 180 degrees (convolution).
+ * @param mirror 1 for mirroring at image border, 0 for zero padding.
+ * @param dst    the pointer to start pixel of result image.
+ *
+ * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+ */
+static int ana_filter(const int32_t* src1, uint16_t rows1, uint16_t cols1,
+        const int32_t* src2, uint16_t rows2, uint16_t cols2, int rotate,
+        int mirror, int32_t* dst);
+
+/**
+ * Add the direct sum of the kernel taps to the result pixels of rows r0 to
+ * r1 and columns c0 to c1. The window of each of these pixels must lie
+ * within src.
+ *
+ * @param src    the pointer to pixel (0, 0) of the (padded) image.
+ * @param stride the row stride of src.
+ * @param w      the kernel as cross-correlation weights.
+ * @param rows2  the number of kernel rows.
+ * @param cols2  the number of kernel columns.
+ * @param r0     the first result row.
+ * @param r1     the row after the last result row.
+ * @param c0     the first result column.
+ * @param c1     the column after the last result column.
+ * @param cols1  the row stride of dst.
+ * @param dst    the pointer to start pixel of result image.
+ *
+ * @return 1 if a result pixel is NaN, 0 otherwise, -1 if out of memory.
+ */
+static int ana_filterDirect(const int32_t* src, unsigned int stride,
+        const int32_t* w, uint16_t rows2, uint16_t cols2, unsigned int r0,
+        unsigned int r1, unsigned int c0, unsigned int c1, unsigned int cols1,
+        int32_t* dst);
+
+/**
+ * Add the sum of a separable kernel (u x v) to the result pixels of rows r0
+ * to r1 and columns c0 to c1, as a row and a column pass. The window of each
+ * of these pixels must lie within src.
+ *
+ * @param src    the pointer to pixel (0, 0) of the (padded) image.
+ * @param stride the row stride of src.
+ * @param u      the column factor of the kernel (rows2).
+ * @param v      the row factor of the kernel (cols2).
+ * @param rows2  the number of kernel rows.
+ * @param cols2  the number of kernel columns.
+ * @param r0     the first result row.
+ * @param r1     the row after the last result row.
+ * @param c0     the first result column.
+ * @param c1     the column after the last result column.
+ * @param cols1  the row stride of dst.
+ * @param dst    the pointer to start pixel of result image.
+ *
+ * @return 1 if a result pixel is NaN, 0 otherwise, -1 if out of memory.
+ */
+static int ana_filterSeparable(const int32_t* src, unsigned int stride,
+        const double* u, const double* v, uint16_t rows2, uint16_t cols2,
+        unsigned int r0, unsigned int r1, unsigned int c0, unsigned int c1,
+        unsigned int cols1, int32_t* dst);
+
+/**
+ * Add the sum of the kernel taps to the result pixels of rows r0 to r1 and
+ * columns c0 to c1 by overlap-save FFT tiles. The window of each of these
+ * pixels must lie within src.
+ *
+ * @param src    the pointer to pixel (0, 0) of the (padded) image.
+ * @param stride the row stride of src.
+ * @param w      the kernel as cross-correlation weights.
+ * @param rows2  the number of kernel rows.
+ * @param cols2  the number of kernel columns.
+ * @param r0     the first result row.
+ * @param r1     the row after the last result row.
+ * @param c0     the first result column.
+ * @param c1     the column after the last result column.
+ * @param cols1  the row stride of dst.
+ * @param dst    the pointer to start pixel of result image.
+ *
+ * @return 1 if a result pixel is NaN, 0 otherwise, -1 if out of memory.
+ */
+static int ana_filterFFT(const int32_t* src, unsigned int stride,
+        const int32_t* w, uint16_t rows2, uint16_t cols2, unsigned int r0,
+        unsigned int r1, unsigned int c0, unsigned int c1, unsigned int cols1,
+        int32_t* dst);
+
+/**
+ * Add the direct sum of the kernel taps to the result pixels closer to the
+ * image border than the kernel reaches, with the kernel offsets mirrored at
+ * the result pixel where they exceed the image.
  *
  * @param src1  the pointer to start pixel of image.
  * @param rows1 the number of pixels of image in x dimension (rows).
  * @param cols1 the number of pixels of image in y dimension (columns).
- * @param src2  the pointer to start pixel of kernel.
- * @param rows2 the number of pixels of kernel in x dimension (rows).
- * @param cols2 the number of pixels of kernel in y dimension (columns).
+ * @param w     the kernel as cross-correlation weights.
+ * @param rows2 the number of kernel rows.
+ * @param cols2 the number of kernel columns.
  * @param dst   the pointer to start pixel of result image.
  *
- * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+ * @return 1 if a result pixel is NaN, 0 otherwise.
  */
-static int ana_convolveZero(const int32_t* src1, uint16_t rows1,
-        uint16_t cols1, const int32_t* src2, uint16_t rows2, uint16_t cols2,
+static int ana_filterMirrorBorder(const int32_t* src1, uint16_t rows1,
+        uint16_t cols1, const int32_t* w, uint16_t rows2, uint16_t cols2,
         int32_t* dst);
 
+/**
+ * Factor a kernel into a column and a row vector if it has rank one.
+ *
+ * @param w     the kernel.
+ * @param rows2 the number of kernel rows.
+ * @param cols2 the number of kernel columns.
+ * @param u     the column factor (rows2).
+ * @param v     the row factor (cols2).
+ *
+ * @return 1 if the kernel is separable, 0 otherwise.
+ */
+static int ana_separateKernel(const int32_t* w, uint16_t rows2,
+        uint16_t cols2, double* u, double* v);
+
+/**
+ * Count the pixels of an image into uniform bins, see
+ * preprocessing_ana_createHistogram(). The bin of a pixel is computed from
+ * its value instead of searched among the edges. The pixels are split into
+ * PREPROCESSING_ANA_HISTOGRAM_SLICES parts that are counted in parallel into
+ * their own histograms.
+ *
+ * @param src    the pointer to start pixel of image.
+ * @param size   the number of pixels.
+ * @param low    the upper edge of the first bin.
+ * @param delta  the width of a bin.
+ * @param values the number of bins.
+ * @param valid  1 to leave NaN pixels out, 0 to count them.
+ * @param counts the counts to add to (values).
+ *
+ * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+ */
+static int ana_histogram(const int32_t* src, unsigned int size, int32_t low,
+        int64_t delta, unsigned int values, int valid, int32_t* counts);
+
+/**
+ * This is the number of key bits of a pass of the percentile selection.
+ */
+#define ANA_SELECT_BITS 16
+
+/**
+ * Find a percentile of the valid pixels of an image, see
+ * preprocessing_ana_percentile(). The pixels are mapped to unsigned keys in
+ * value order. The first pass counts the upper key bits and finds the
+ * buckets of the two nearest ranks, the second pass counts the lower key
+ * bits inside the bucket of the lower rank. The upper rank is either in the
+ * same bucket or the smallest key of its own bucket.
+ *
+ * @param src       the pointer to start pixel of image.
+ * @param mask      the pointer to start pixel of image mask.
+ * @param size      the number of pixels.
+ * @param center    the value the deviations are taken from.
+ * @param deviation 1 to select among the absolute deviations from \a center,
+ *                  0 to select among the pixel values.
+ * @param percent   the percentile (0 to 100, 24.8).
+ * @param value     the percentile.
+ *
+ * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+ */
+static int ana_select(const int32_t* src, const int32_t* mask,
+        unsigned int size, int32_t center, int deviation, int32_t percent,
+        int32_t* value);
+
+/**
+ * Map a pixel to its key of the percentile selection.
+ *
+ * @param src       the pointer to start pixel of image.
+ * @param mask      the pointer to start pixel of image mask.
+ * @param p         the pixel.
+ * @param center    the value the deviations are taken from.
+ * @param deviation 1 to map the absolute deviation from \a center, 0 to map
+ *                  the pixel value.
+ * @param key       the key.
+ *
+ * @return 1 if the pixel is valid, 0 otherwise.
+ */
+static inline int ana_selectKey(const int32_t* src, const int32_t* mask,
+        unsigned int p, int32_t center, int deviation, uint32_t* key);
+
+/**
+ * This is the number of pixels whose extrema are found before they are
+ * compared with the running extrema. A block stays in the first level cache
+ * while it is counted.
+ */
+#define ANA_EXTREMA_BLOCK 1024
+
+/**
+ * This is the number of parts of an image whose extrema are found in
+ * parallel and merged afterwards.
+ */
+#define ANA_EXTREMA_SLICES 16
+
+/**
+ * Update running extrema with a block of pixels. A block whose minimum or
+ * maximum reaches the running one is read again for the count and the first
+ * position.
+ *
+ * @param src     the pointer to start pixel of image.
+ * @param begin   the first pixel of the block.
+ * @param end     the pixel after the block.
+ * @param extrema the running extrema, a count of 0 marks an unset extremum.
+ */
+static void ana_extremaBlock(const int32_t* src, unsigned int begin,
+        unsigned int end, struct preprocessing_ana_Extrema* extrema);
+
+/**
+ * Add a central difference to the result image along the rows (\a rows > 1)
+ * or the columns, with the mirrored border. This is the convolution with
+ * [-1 0 1] of preprocessing_ana_deriveX() and preprocessing_ana_deriveY()
+ * without the generic tap loop. Pixels and status are those of the direct
+ * sum of ana_filter() with its overflow rule, not those of the per-pixel
+ * loop it replaced, which kept adding to a sum that had overflowed.
+ *
+ * @param src   the pointer to start pixel of image.
+ * @param rows  the number of pixels of image in x dimension (rows).
+ * @param cols  the number of pixels of image in y dimension (columns).
+ * @param down  1 to differentiate along the rows, 0 along the columns.
+ * @param dst   the pointer to start pixel of result image.
+ *
+ * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+ */
+static int ana_derive(const int32_t* src, uint16_t rows, uint16_t cols,
+        int down, int32_t* dst);
+
+/**
+ * Add the differences of two rows of pixels to a row of result pixels, with
+ * the range checks of the convolution after each tap. The checks are done in
+ * 32 bits, so the loop vectorizes.
+ *
+ * @param a the previous pixels.
+ * @param b the next pixels.
+ * @param n the number of pixels.
+ * @param d the result pixels, NaN if a value or a partial sum is out of
+ *          range.
+ */
+static void ana_difference(const int32_t* restrict a,
+        const int32_t* restrict b, unsigned int n, int32_t* restrict d);
+
+/**
+ * Calculate the gradient of an image, see preprocessing_ana_gradient().
+ *
+ * @param src       the pointer to start pixel of image.
+ * @param rows      the number of pixels of image in x dimension (rows).
+ * @param cols      the number of pixels of image in y dimension (columns).
+ * @param stencil   the stencil.
+ * @param dstY      the pointer to start pixel of row derivation, or 0.
+ * @param dstX      the pointer to start pixel of column derivation, or 0.
+ * @param magnitude the pointer to start pixel of magnitude, or 0.
+ *
+ * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+ */
+static int ana_gradient(const int32_t* src, uint16_t rows, uint16_t cols,
+        int stencil, int32_t* dstY, int32_t* dstX, int32_t* magnitude);
+
+/**
+ * Apply a 3 x 3 derivative stencil to pixels of a row. Pixel i of the run
+ * takes its neighbours from columns l + i and r + i, so the mirrored border
+ * is a run of one pixel with l equal to r.
+ *
+ * @param up     the previous row.
+ * @param mid    the row of the pixels.
+ * @param down   the next row.
+ * @param l      the previous column of the first pixel.
+ * @param c      the column of the first pixel.
+ * @param r      the next column of the first pixel.
+ * @param n      the number of pixels.
+ * @param side   the weight of the side rows or columns.
+ * @param center the weight of the center row or column.
+ * @param gy     the row derivation (row).
+ * @param gx     the column derivation (row).
+ */
+static void ana_stencil(const int32_t* restrict up,
+        const int32_t* restrict mid, const int32_t* restrict down,
+        unsigned int l, unsigned int c, unsigned int r, unsigned int n,
+        int64_t side, int64_t center, int32_t* restrict gy,
+        int32_t* restrict gx);
+
+/**
+ * Add a sum of 24.8 products (scaled by 2^FP32_FWL) to a result pixel.
+ *
+ * @param dst the result pixel.
+ * @param sum the sum of products.
+ *
+ * @return 1 if the result is NaN, 0 otherwise.
+ */
+static int ana_addSum(int32_t* dst, double sum);
+
 /* PUBLIC IMPLEMENTATION *****************************************************/
 
 int preprocessing_ana_underThresh(uint32_t sdSrc, uint16_t rows, uint16_t cols,
         int32_t thresh, uint32_t sdDst)
 {
+    PREPROCESSING_PROF_KERNEL(PREPROCESSING_PROF_FRAME(rows, cols),
+            PREPROCESSING_PROF_FRAME(rows, cols),
+            (uint64_t)(rows) * cols, 1);
+
     int status = PREPROCESSING_SUCCESSFUL;
     unsigned int size = (unsigned int)(rows) * cols;
     unsigned int p = 0;
@@ -165,6 +567,10 @@ int preprocessing_ana_underThresh(uint32_t sdSrc, uint16_t rows, uint16_t cols,
 int preprocessing_ana_equalThresh(uint32_t sdSrc, uint16_t rows, uint16_t cols,
         int32_t thresh, uint32_t sdDst)
 {
+    PREPROCESSING_PROF_KERNEL(PREPROCESSING_PROF_FRAME(rows, cols),
+            PREPROCESSING_PROF_FRAME(rows, cols),
+            (uint64_t)(rows) * cols, 1);
+
     int status = PREPROCESSING_SUCCESSFUL;
     unsigned int size = (unsigned int)(rows) * cols;
     unsigned int p = 0;
@@ -209,6 +615,10 @@ int preprocessing_ana_equalThresh(uint32_t sdSrc, uint16_t rows, uint16_t cols,
 int preprocessing_ana_overThresh(uint32_t sdSrc, uint16_t rows, uint16_t cols,
         int32_t thresh, uint32_t sdDst)
 {
+    PREPROCESSING_PROF_KERNEL(PREPROCESSING_PROF_FRAME(rows, cols),
+            PREPROCESSING_PROF_FRAME(rows, cols),
+            (uint64_t)(rows) * cols, 1);
+
     int status = PREPROCESSING_SUCCESSFUL;
     unsigned int size = (unsigned int)(rows) * cols;
     unsigned int p = 0;
@@ -253,53 +663,150 @@ int preprocessing_ana_overThresh(uint32_t sdSrc, uint16_t rows, uint16_t cols,
 int preprocessing_ana_minImage(uint32_t sdSrc, uint16_t rows, uint16_t cols,
         uint32_t sdDst, int32_t* dstMin)
 {
-    int32_t min = EVE_FP32_MAX;
+    PREPROCESSING_PROF_OPERATION(0, 0);
+
+    int status = PREPROCESSING_SUCCESSFUL;
+    struct preprocessing_ana_Extrema extrema;
+
+    status = preprocessing_ana_extrema(sdSrc, rows, cols, &extrema);
+
+    if (status != PREPROCESSING_SUCCESSFUL)
+    {
+        return status;
+    }
+
+    if (dstMin != 0)
+    {
+        *dstMin = extrema.min;
+    }
+
+    // Create mask of pixels containing the minimum value.
+    return preprocessing_ana_extremaMask(sdSrc, rows, cols, extrema.min,
+            extrema.minFirst, extrema.minCount, sdDst);
+}
+
+/*****************************************************************************/
+
+int preprocessing_ana_maxImage(uint32_t sdSrc, uint16_t rows, uint16_t cols,
+        uint32_t sdDst, int32_t* dstMax)
+{
+    PREPROCESSING_PROF_OPERATION(0, 0);
+
+    int status = PREPROCESSING_SUCCESSFUL;
+    struct preprocessing_ana_Extrema extrema;
+
+    status = preprocessing_ana_extrema(sdSrc, rows, cols, &extrema);
+
+    if (status != PREPROCESSING_SUCCESSFUL)
+    {
+        return status;
+    }
+
+    if (dstMax != 0)
+    {
+        *dstMax = extrema.max;
+    }
+
+    // Create mask of pixels containing the maximum value.
+    return preprocessing_ana_extremaMask(sdSrc, rows, cols, extrema.max,
+            extrema.maxFirst, extrema.maxCount, sdDst);
+}
+
+/*****************************************************************************/
+
+int preprocessing_ana_extrema(uint32_t sdSrc, uint16_t rows, uint16_t cols,
+        struct preprocessing_ana_Extrema* extrema)
+{
+    PREPROCESSING_PROF_KERNEL(PREPROCESSING_PROF_FRAME(rows, cols), 0,
+            (uint64_t)(rows) * cols, 2);
+
     unsigned int size = (unsigned int)(rows) * cols;
-    unsigned int p = 0;
 
     const int32_t* src = preprocessing_vmem_getDataAddress(sdSrc);
-    int32_t* dst = preprocessing_vmem_getDataAddress(sdDst);
+
+    struct preprocessing_ana_Extrema slices[ANA_EXTREMA_SLICES];
 
     // Check whether given rows and columns are in a valid range.
-    if ((!preprocessing_vmem_isProcessingSizeValid(sdSrc, rows, cols))
-            || (!preprocessing_vmem_isProcessingSizeValid(sdDst, rows, cols)))
+    if (!preprocessing_vmem_isProcessingSizeValid(sdSrc, rows, cols))
     {
         return PREPROCESSING_INVALID_SIZE;
     }
 
+    // Check parameters.
+    if (extrema == 0)
+    {
+        printf("Invalid pointer: %p\n", (void*)(extrema));
+        return PREPROCESSING_INVALID_ADDRESS;
+    }
+
     // Process.
-    for (unsigned int r = 0; r < rows; r++)
+    PREPROCESSING_DEF_PARALLEL_FOR
+    for (unsigned int s = 0; s < ANA_EXTREMA_SLICES; s++)
     {
-        for (unsigned int c = 0; c < cols; c++)
-        {
-            p = r * cols + c;
+        unsigned int begin = (unsigned int)((uint64_t)(size) * s
+                / ANA_EXTREMA_SLICES);
+        unsigned int end = (unsigned int)((uint64_t)(size) * (s + 1)
+                / ANA_EXTREMA_SLICES);
 
-            // Check for valid pointer position.
-            PREPROCESSING_DEF_CHECK_POINTER(src, p, size)
-            PREPROCESSING_DEF_CHECK_POINTER(dst, p, size)
+        memset(slices + s, 0, sizeof(slices[s]));
 
-            if (eve_fp_compare32(src + p, &min) == -1)
-            {
-                min = src[p];
-            }
+        for (unsigned int p = begin; p < end; p += ANA_EXTREMA_BLOCK)
+        {
+            ana_extremaBlock(src, p, (end - p > ANA_EXTREMA_BLOCK)
+                    ? p + ANA_EXTREMA_BLOCK : end, slices + s);
         }
     }
 
-    if (dstMin != 0)
+    // Merge the slices in order, so the first positions stay the first.
+    memset(extrema, 0, sizeof(*extrema));
+    extrema->min = EVE_FP32_MAX;
+    extrema->max = EVE_FP32_NAN;
+
+    for (unsigned int s = 0; s < ANA_EXTREMA_SLICES; s++)
     {
-        *dstMin = min;
+        const struct preprocessing_ana_Extrema* e = slices + s;
+
+        if (e->minCount == 0)
+        {
+            continue;
+        }
+
+        if ((extrema->minCount == 0) || (e->min < extrema->min))
+        {
+            extrema->min = e->min;
+            extrema->minCount = e->minCount;
+            extrema->minFirst = e->minFirst;
+        }
+        else if (e->min == extrema->min)
+        {
+            extrema->minCount += e->minCount;
+        }
+
+        if ((extrema->maxCount == 0) || (e->max > extrema->max))
+        {
+            extrema->max = e->max;
+            extrema->maxCount = e->maxCount;
+            extrema->maxFirst = e->maxFirst;
+        }
+        else if (e->max == extrema->max)
+        {
+            extrema->maxCount += e->maxCount;
+        }
     }
 
-    // Create mask of pixels containing the minimum value.
-    return preprocessing_ana_equalThresh(sdSrc, rows, cols, min, sdDst);
+    return PREPROCESSING_SUCCESSFUL;
 }
 
 /*****************************************************************************/
 
-int preprocessing_ana_maxImage(uint32_t sdSrc, uint16_t rows, uint16_t cols,
-        uint32_t sdDst, int32_t* dstMax)
+int preprocessing_ana_extremaMask(uint32_t sdSrc, uint16_t rows,
+        uint16_t cols, int32_t value, uint32_t first, uint32_t count,
+        uint32_t sdDst)
 {
-    int32_t max = EVE_FP32_NAN;
+    PREPROCESSING_PROF_KERNEL(PREPROCESSING_PROF_FRAME(rows, cols),
+            PREPROCESSING_PROF_FRAME(rows, cols),
+            (uint64_t)(rows) * cols, 1);
+
     unsigned int size = (unsigned int)(rows) * cols;
     unsigned int p = 0;
 
@@ -313,32 +820,41 @@ int preprocessing_ana_maxImage(uint32_t sdSrc, uint16_t rows, uint16_t cols,
         return PREPROCESSING_INVALID_SIZE;
     }
 
-    // Process.
-    for (unsigned int r = 0; r < rows; r++)
+    if (count == 0)
     {
-        for (unsigned int c = 0; c < cols; c++)
-        {
-            p = r * cols + c;
-
-            // Check for valid pointer position.
-            PREPROCESSING_DEF_CHECK_POINTER(src, p, size)
-            PREPROCESSING_DEF_CHECK_POINTER(dst, p, size)
+        first = size;
+    }
 
-            if (eve_fp_compare32(src + p, &max) == 1)
-            {
-                max = src[p];
-            }
-        }
+    // Check parameters.
+    if (first > size)
+    {
+        printf("Invalid pixel: %u.\n", first);
+        return PREPROCESSING_INVALID_NUMBER;
     }
 
+    // Process. The image may be the mask, so it is read ahead of the writes.
+    memset(dst, 0, (size_t)(first) * sizeof(int32_t));
 
-    if (dstMax != 0)
+    for (p = first; (p < size) && (count > 0); )
     {
-        *dstMax = max;
+        unsigned int end = (size - p > ANA_EXTREMA_BLOCK)
+                ? p + ANA_EXTREMA_BLOCK : size;
+        uint32_t found = 0;
+
+        for (; p < end; p++)
+        {
+            int32_t equal = (src[p] == value);
+
+            dst[p] = equal * FP32_BINARY_TRUE;
+            found += (uint32_t)(equal);
+        }
+
+        count = (found < count) ? count - found : 0;
     }
-    
-    // Create mask of pixels containing the minimum value.
-    return preprocessing_ana_equalThresh(sdSrc, rows, cols, max, sdDst);
+
+    memset(dst + p, 0, (size_t)(size - p) * sizeof(int32_t));
+
+    return PREPROCESSING_SUCCESSFUL;
 }
 
 /*****************************************************************************/
@@ -346,10 +862,12 @@ int preprocessing_ana_maxImage(uint32_t sdSrc, uint16_t rows, uint16_t cols,
 int preprocessing_ana_deriveX(uint32_t sdSrc, uint16_t rows, uint16_t cols,
         uint32_t sdDst)
 {
+    PREPROCESSING_PROF_KERNEL(2 * PREPROCESSING_PROF_FRAME(rows, cols),
+            PREPROCESSING_PROF_FRAME(rows, cols),
+            (uint64_t)(rows) * cols, 2);
+
     const int32_t* src = preprocessing_vmem_getDataAddress(sdSrc);
     int32_t* dst = preprocessing_vmem_getDataAddress(sdDst);
-    int32_t kernel[3] = { eve_fp_int2s32(-1, FP32_FWL), 0,
-        eve_fp_int2s32(1, FP32_FWL) };
 
     // Check whether given rows and columns are in a valid range.
     if ((!preprocessing_vmem_isProcessingSizeValid(sdSrc, rows, cols))
@@ -358,7 +876,7 @@ int preprocessing_ana_deriveX(uint32_t sdSrc, uint16_t rows, uint16_t cols,
         return PREPROCESSING_INVALID_SIZE;
     }
 
-    return ana_convolveMirror(src, rows, cols, &kernel[0], 3, 1, dst);
+    return ana_derive(src, rows, cols, 1, dst);
 }
 
 /*****************************************************************************/
@@ -366,10 +884,12 @@ int preprocessing_ana_deriveX(uint32_t sdSrc, uint16_t rows, uint16_t cols,
 int preprocessing_ana_deriveY(uint32_t sdSrc, uint16_t rows, uint16_t cols,
         uint32_t sdDst)
 {
+    PREPROCESSING_PROF_KERNEL(2 * PREPROCESSING_PROF_FRAME(rows, cols),
+            PREPROCESSING_PROF_FRAME(rows, cols),
+            (uint64_t)(rows) * cols, 2);
+
     const int32_t* src = preprocessing_vmem_getDataAddress(sdSrc);
     int32_t* dst = preprocessing_vmem_getDataAddress(sdDst);
-    int32_t kernel[3] = { eve_fp_int2s32(-1, FP32_FWL), 0,
-        eve_fp_int2s32(1, FP32_FWL) };
 
     // Check whether given rows and columns are in a valid range.
     if ((!preprocessing_vmem_isProcessingSizeValid(sdSrc, rows, cols))
@@ -378,17 +898,80 @@ int preprocessing_ana_deriveY(uint32_t sdSrc, uint16_t rows, uint16_t cols,
         return PREPROCESSING_INVALID_SIZE;
     }
 
-    return ana_convolveMirror(src, rows, cols, &kernel[0], 1, 3, dst);
+    return ana_derive(src, rows, cols, 0, dst);
 }
 
 /*****************************************************************************/
 
-int preprocessing_ana_createHistogram(uint32_t sdSrc, uint16_t rows,
-        uint16_t cols, unsigned int values, uint32_t sdDst)
+int preprocessing_ana_gradient(uint32_t sdSrc, uint16_t rows,
+        uint16_t cols, int stencil, uint32_t sdDstY, uint32_t sdDstX)
 {
-    int status = PREPROCESSING_SUCCESSFUL;
-    unsigned int size = (unsigned int)(rows) * cols;
-    unsigned int p = 0;
+    PREPROCESSING_PROF_KERNEL(PREPROCESSING_PROF_FRAME(rows, cols),
+            2 * PREPROCESSING_PROF_FRAME(rows, cols),
+            (uint64_t)(rows) * cols, 4);
+
+    const int32_t* src = preprocessing_vmem_getDataAddress(sdSrc);
+    int32_t* dstY = preprocessing_vmem_getDataAddress(sdDstY);
+    int32_t* dstX = preprocessing_vmem_getDataAddress(sdDstX);
+
+    // Check whether given rows and columns are in a valid range.
+    if ((!preprocessing_vmem_isProcessingSizeValid(sdSrc, rows, cols))
+            || (!preprocessing_vmem_isProcessingSizeValid(sdDstY, rows, cols))
+            || (!preprocessing_vmem_isProcessingSizeValid(sdDstX, rows, cols)))
+    {
+        return PREPROCESSING_INVALID_SIZE;
+    }
+
+    // Check parameters.
+    if ((src == 0) || (dstY == 0) || (dstX == 0) || (dstY == dstX))
+    {
+        printf("Invalid pointer: %p\n", (void*)(dstY));
+        return PREPROCESSING_INVALID_ADDRESS;
+    }
+
+    return ana_gradient(src, rows, cols, stencil, dstY, dstX, 0);
+}
+
+/*****************************************************************************/
+
+int preprocessing_ana_gradientMagnitude(uint32_t sdSrc, uint16_t rows,
+        uint16_t cols, int stencil, uint32_t sdDst)
+{
+    PREPROCESSING_PROF_KERNEL(PREPROCESSING_PROF_FRAME(rows, cols),
+            PREPROCESSING_PROF_FRAME(rows, cols),
+            (uint64_t)(rows) * cols, 7);
+
+    const int32_t* src = preprocessing_vmem_getDataAddress(sdSrc);
+    int32_t* dst = preprocessing_vmem_getDataAddress(sdDst);
+
+    // Check whether given rows and columns are in a valid range.
+    if ((!preprocessing_vmem_isProcessingSizeValid(sdSrc, rows, cols))
+            || (!preprocessing_vmem_isProcessingSizeValid(sdDst, rows, cols)))
+    {
+        return PREPROCESSING_INVALID_SIZE;
+    }
+
+    // Check parameters.
+    if ((src == 0) || (dst == 0))
+    {
+        printf("Invalid pointer: %p\n", (void*)(dst));
+        return PREPROCESSING_INVALID_ADDRESS;
+    }
+
+    return ana_gradient(src, rows, cols, stencil, 0, 0, dst);
+}
+
+/*****************************************************************************/
+
+int preprocessing_ana_createHistogram(uint32_t sdSrc, uint16_t rows,
+        uint16_t cols, unsigned int values, uint32_t sdDst)
+{
+    PREPROCESSING_PROF_KERNEL(PREPROCESSING_PROF_FRAME(rows, cols),
+            2 * values * sizeof(int32_t),
+            (uint64_t)(rows) * cols, 2);
+
+    int status = PREPROCESSING_SUCCESSFUL;
+    unsigned int size = (unsigned int)(rows) * cols;
 
     const int32_t* src = preprocessing_vmem_getDataAddress(sdSrc);
     int32_t* dst = preprocessing_vmem_getDataAddress(sdDst);
@@ -448,31 +1031,202 @@ int preprocessing_ana_createHistogram(uint32_t sdSrc, uint16_t rows,
     }
 
     // Process.
-    for (unsigned int r = 0; r < rows; r++)
+    return ana_histogram(src, size, dst[0], deltaValue, values, 0,
+            dst + values);
+}
+
+/*****************************************************************************/
+
+int preprocessing_ana_createHistogramRange(uint32_t sdSrc, uint16_t rows,
+        uint16_t cols, unsigned int values, uint32_t sdDst)
+{
+    PREPROCESSING_PROF_KERNEL(2 * PREPROCESSING_PROF_FRAME(rows, cols),
+            2 * values * sizeof(int32_t),
+            (uint64_t)(rows) * cols, 4);
+
+    unsigned int size = (unsigned int)(rows) * cols;
+
+    const int32_t* src = preprocessing_vmem_getDataAddress(sdSrc);
+    int32_t* dst = preprocessing_vmem_getDataAddress(sdDst);
+
+    int32_t low[PREPROCESSING_ANA_HISTOGRAM_SLICES];
+    int32_t high[PREPROCESSING_ANA_HISTOGRAM_SLICES];
+    int64_t minValue = EVE_FP32_MAX;
+    int64_t maxValue = EVE_FP32_MIN;
+    int64_t deltaValue = 1;
+
+    // Check whether given rows and columns are in a valid range.
+    if ((!preprocessing_vmem_isProcessingSizeValid(sdSrc, rows, cols))
+            || (!preprocessing_vmem_isProcessingSizeValid(sdDst, 2,
+                    (uint16_t)(values))))
     {
-        for (unsigned int c = 0; c < cols; c++)
-        {
-            p = r * cols + c;
+        return PREPROCESSING_INVALID_SIZE;
+    }
 
-            // Check for valid pointer position.
-            PREPROCESSING_DEF_CHECK_POINTER(src, p, size)
+    // Check parameters.
+    if (dst == 0)
+    {
+        printf("Invalid pointer: %p\n", dst);
+        return PREPROCESSING_INVALID_ADDRESS;
+    }
 
-            for (unsigned int n = 0; n < values; n++)
-            {
-                PREPROCESSING_DEF_CHECK_POINTER(dst, n + values, 2 * values)
+    if (values <= 1)
+    {
+        printf("Histogram values equal and lower than 1 are not allowed: "
+                "%u.\n", values);
+        return PREPROCESSING_INVALID_NUMBER;
+    }
 
-                if (eve_fp_compare32(src + p, dst + n) == 1)
-                {
-                    continue;
-                }
+    // Find the range of the valid pixels.
+    PREPROCESSING_DEF_PARALLEL_FOR
+    for (unsigned int s = 0; s < PREPROCESSING_ANA_HISTOGRAM_SLICES; s++)
+    {
+        unsigned int first = (unsigned int)((uint64_t)(size) * s
+                / PREPROCESSING_ANA_HISTOGRAM_SLICES);
+        unsigned int last = (unsigned int)((uint64_t)(size) * (s + 1)
+                / PREPROCESSING_ANA_HISTOGRAM_SLICES);
+
+        low[s] = EVE_FP32_MAX;
+        high[s] = EVE_FP32_MIN;
 
-                dst[n + values]++;
-                break;
+        for (unsigned int p = first; p < last; p++)
+        {
+            if (src[p] == EVE_FP32_NAN)
+            {
+                continue;
             }
+
+            low[s] = (src[p] < low[s]) ? src[p] : low[s];
+            high[s] = (src[p] > high[s]) ? src[p] : high[s];
         }
     }
 
-    return PREPROCESSING_SUCCESSFUL;
+    for (unsigned int s = 0; s < PREPROCESSING_ANA_HISTOGRAM_SLICES; s++)
+    {
+        minValue = (low[s] < minValue) ? low[s] : minValue;
+        maxValue = (high[s] > maxValue) ? high[s] : maxValue;
+    }
+
+    // All pixels are NaN, so nothing is counted.
+    if (minValue > maxValue)
+    {
+        minValue = 0;
+        maxValue = 0;
+    }
+
+    // Create value range, the last edge at or above the largest value.
+    deltaValue = (maxValue - minValue + values - 2) / (values - 1);
+
+    if (deltaValue < 1)
+    {
+        deltaValue = 1;
+    }
+
+    for (unsigned int n = 0; n < values; n++)
+    {
+        int64_t edge = minValue + deltaValue * n;
+
+        dst[n] = (edge > EVE_FP32_MAX) ? EVE_FP32_MAX : (int32_t)(edge);
+    }
+
+    // Process.
+    return ana_histogram(src, size, (int32_t)(minValue),
+            deltaValue, values, 1, dst + values);
+}
+
+/*****************************************************************************/
+
+int preprocessing_ana_percentile(uint32_t sdSrc, uint32_t sdMask,
+        uint16_t rows, uint16_t cols, int32_t percent, int32_t* dstValue)
+{
+    PREPROCESSING_PROF_KERNEL(2 * PREPROCESSING_PROF_FRAME(rows, cols), 0,
+            (uint64_t)(rows) * cols, 2);
+
+    unsigned int size = (unsigned int)(rows) * cols;
+
+    const int32_t* src = preprocessing_vmem_getDataAddress(sdSrc);
+    const int32_t* mask = preprocessing_vmem_getDataAddress(sdMask);
+
+    // Check whether given rows and columns are in a valid range.
+    if ((!preprocessing_vmem_isProcessingSizeValid(sdSrc, rows, cols))
+            || (!preprocessing_vmem_isProcessingSizeValid(sdMask, rows,
+                    cols)))
+    {
+        return PREPROCESSING_INVALID_SIZE;
+    }
+
+    // Check parameters.
+    if (dstValue == 0)
+    {
+        printf("Invalid pointer: %p\n", (void*)(dstValue));
+        return PREPROCESSING_INVALID_ADDRESS;
+    }
+
+    if ((percent < 0) || (percent > eve_fp_int2s32(100, FP32_FWL)))
+    {
+        printf("Percentile out of range: %d.\n", percent);
+        return PREPROCESSING_INVALID_NUMBER;
+    }
+
+    return ana_select(src, mask, size, 0, 0, percent, dstValue);
+}
+
+/*****************************************************************************/
+
+int preprocessing_ana_medianValue(uint32_t sdSrc, uint32_t sdMask,
+        uint16_t rows, uint16_t cols, int32_t* dstMedian)
+{
+    PREPROCESSING_PROF_OPERATION(0, 0);
+
+    return preprocessing_ana_percentile(sdSrc, sdMask, rows, cols,
+            eve_fp_int2s32(50, FP32_FWL), dstMedian);
+}
+
+/*****************************************************************************/
+
+int preprocessing_ana_mad(uint32_t sdSrc, uint32_t sdMask, uint16_t rows,
+        uint16_t cols, int32_t* dstMedian, int32_t* dstMad)
+{
+    PREPROCESSING_PROF_KERNEL(2 * PREPROCESSING_PROF_FRAME(rows, cols), 0,
+            (uint64_t)(rows) * cols, 5);
+
+    int status = PREPROCESSING_SUCCESSFUL;
+    unsigned int size = (unsigned int)(rows) * cols;
+    int32_t median = 0;
+
+    const int32_t* src = preprocessing_vmem_getDataAddress(sdSrc);
+    const int32_t* mask = preprocessing_vmem_getDataAddress(sdMask);
+
+    // Check whether given rows and columns are in a valid range.
+    if ((!preprocessing_vmem_isProcessingSizeValid(sdSrc, rows, cols))
+            || (!preprocessing_vmem_isProcessingSizeValid(sdMask, rows,
+                    cols)))
+    {
+        return PREPROCESSING_INVALID_SIZE;
+    }
+
+    // Check parameters.
+    if (dstMad == 0)
+    {
+        printf("Invalid pointer: %p\n", (void*)(dstMad));
+        return PREPROCESSING_INVALID_ADDRESS;
+    }
+
+    status = preprocessing_ana_medianValue(sdSrc, sdMask, rows, cols,
+            &median);
+
+    if (status != PREPROCESSING_SUCCESSFUL)
+    {
+        return status;
+    }
+
+    if (dstMedian != 0)
+    {
+        *dstMedian = median;
+    }
+
+    return ana_select(src, mask, size, median, 1,
+            eve_fp_int2s32(50, FP32_FWL), dstMad);
 }
 
 /*****************************************************************************/
@@ -481,6 +1235,11 @@ int preprocessing_ana_crossCorrelate(uint32_t sdSrc1, uint16_t rows1,
         uint16_t cols1, uint32_t sdSrc2, uint16_t rows2, uint16_t cols2,
         uint32_t sdDst)
 {
+    PREPROCESSING_PROF_KERNEL(PREPROCESSING_PROF_FRAME(rows1, cols1)
+            + PREPROCESSING_PROF_FRAME(rows2, cols2),
+            PREPROCESSING_PROF_FRAME(rows1, cols1),
+            (uint64_t)(rows1) * cols1, 2 * rows2 * cols2);
+
     const int32_t* src1 = preprocessing_vmem_getDataAddress(sdSrc1);
     const int32_t* src2 = preprocessing_vmem_getDataAddress(sdSrc2);
     int32_t* dst = preprocessing_vmem_getDataAddress(sdDst);
@@ -505,6 +1264,11 @@ int preprocessing_ana_crossCorrelate(uint32_t sdSrc1, uint16_t rows1,
 int preprocessing_ana_convolve(uint32_t sdSrc1, uint16_t rows1, uint16_t cols1,
         uint32_t sdSrc2, uint16_t rows2, uint16_t cols2, uint32_t sdDst)
 {
+    PREPROCESSING_PROF_KERNEL(PREPROCESSING_PROF_FRAME(rows1, cols1)
+            + PREPROCESSING_PROF_FRAME(rows2, cols2),
+            PREPROCESSING_PROF_FRAME(rows1, cols1),
+            (uint64_t)(rows1) * cols1, 2 * rows2 * cols2);
+
     const int32_t* src1 = preprocessing_vmem_getDataAddress(sdSrc1);
     const int32_t* src2 = preprocessing_vmem_getDataAddress(sdSrc2);
     int32_t* dst = preprocessing_vmem_getDataAddress(sdDst);
@@ -529,9 +1293,22 @@ int preprocessing_ana_convolve(uint32_t sdSrc1, uint16_t rows1, uint16_t cols1,
 int preprocessing_ana_median(uint32_t sdSrc, uint16_t rows, uint16_t cols,
         uint32_t sdDst)
 {
+    PREPROCESSING_PROF_OPERATION(0, 0);
+
+    return preprocessing_ana_medianFilter(sdSrc, rows, cols, 3, sdDst);
+}
+
+/*****************************************************************************/
+
+int preprocessing_ana_medianFilter(uint32_t sdSrc, uint16_t rows,
+        uint16_t cols, uint16_t size, uint32_t sdDst)
+{
+    PREPROCESSING_PROF_KERNEL(PREPROCESSING_PROF_FRAME(rows, cols),
+            PREPROCESSING_PROF_FRAME(rows, cols),
+            (uint64_t)(rows) * cols, size * size);
+
     const int32_t* src = preprocessing_vmem_getDataAddress(sdSrc);
     int32_t* dst = preprocessing_vmem_getDataAddress(sdDst);
-    int32_t kernel[9] = { 1, 1, 1, 1, 1, 1, 1, 1, 1 };
 
     // Check whether given rows and columns are in a valid range.
     if ((!preprocessing_vmem_isProcessingSizeValid(sdSrc, rows, cols))
@@ -540,7 +1317,18 @@ int preprocessing_ana_median(uint32_t sdSrc, uint16_t rows, uint16_t cols,
         return PREPROCESSING_INVALID_SIZE;
     }
 
-    return ana_median(src, rows, cols, &kernel[0], 3, 3, dst);
+    if ((size % 2) == 0)
+    {
+        printf("Median filter size %u is not odd.\n", (unsigned int)(size));
+        return PREPROCESSING_INVALID_SIZE;
+    }
+
+    if ((src == 0) || (dst == 0) || (src == dst))
+    {
+        return PREPROCESSING_INVALID_ADDRESS;
+    }
+
+    return ana_median(src, rows, cols, size / 2, dst);
 }
 
 /*****************************************************************************/
@@ -548,6 +1336,10 @@ int preprocessing_ana_median(uint32_t sdSrc, uint16_t rows, uint16_t cols,
 int preprocessing_ana_cast(uint32_t sdSrc, uint16_t rows, uint16_t cols,
         uint32_t sdDst)
 {
+    PREPROCESSING_PROF_KERNEL(PREPROCESSING_PROF_FRAME(rows, cols),
+            PREPROCESSING_PROF_FRAME(rows, cols),
+            (uint64_t)(rows) * cols, 1);
+
     unsigned int size = (unsigned int)(rows) * cols;
     unsigned int p = 0;
 
@@ -584,6 +1376,10 @@ int preprocessing_ana_cast(uint32_t sdSrc, uint16_t rows, uint16_t cols,
 int preprocessing_ana_invertMask(uint32_t sdSrc, uint16_t rows, uint16_t cols,
         uint32_t sdDst)
 {
+    PREPROCESSING_PROF_KERNEL(PREPROCESSING_PROF_FRAME(rows, cols),
+            PREPROCESSING_PROF_FRAME(rows, cols),
+            (uint64_t)(rows) * cols, 1);
+
     unsigned int size = (unsigned int)(rows) * cols;
     unsigned int p = 0;
 
@@ -628,6 +1424,11 @@ int preprocessing_ana_cropImage(uint32_t sdSrc, uint16_t rows, uint16_t cols,
         uint16_t rStart, uint16_t cStart, uint16_t rEnd, uint16_t cEnd,
         uint32_t sdDst)
 {
+    PREPROCESSING_PROF_KERNEL(
+            PREPROCESSING_PROF_FRAME(rEnd - rStart + 1, cEnd - cStart + 1),
+            PREPROCESSING_PROF_FRAME(rEnd - rStart + 1, cEnd - cStart + 1),
+            (uint64_t)(rEnd - rStart + 1) * (cEnd - cStart + 1), 0);
+
     unsigned int size = (unsigned int)(rows) * cols;
     unsigned int p = 0;
     unsigned int pDst = 0;
@@ -668,6 +1469,10 @@ int preprocessing_ana_cropImage(uint32_t sdSrc, uint16_t rows, uint16_t cols,
 int preprocessing_ana_constructRowImage(uint32_t sdSrc, uint16_t rows,
         uint16_t cols, unsigned int rowsNew, uint32_t sdDst)
 {
+    PREPROCESSING_PROF_KERNEL(PREPROCESSING_PROF_FRAME(rows, cols),
+            PREPROCESSING_PROF_FRAME(rowsNew, cols),
+            (uint64_t)(rowsNew) * cols, 0);
+
     unsigned int size = (unsigned int)(rows) * cols;
     unsigned int sizeDst = (unsigned int)(rowsNew) * cols;
     unsigned int p = 0;
@@ -709,393 +1514,379 @@ int preprocessing_ana_constructRowImage(uint32_t sdSrc, uint16_t rows,
 
 /* PRIVATE IMPLEMENTATION ****************************************************/
 
-static int ana_median(const int32_t* src1, uint16_t rows1, uint16_t cols1,
-        const int32_t* src2, uint16_t rows2, uint16_t cols2, int32_t* dst)
+static int ana_median(const int32_t* src, uint16_t rows, uint16_t cols,
+        unsigned int radius, int32_t* dst)
 {
-    unsigned int size1 = (unsigned int)(rows1) * cols1;
-    unsigned int size2 = (unsigned int)(rows2) * cols2;
-    unsigned int p1 = 0;
-    unsigned int p2 = 0;
-
-    // Adjust loop parameters for kernel.
-    int dr = 0;
-    int dc = 0;
-    int r2Max = rows2 / 2 + 1;
-    int r2Min = -(rows2 / 2);
-    int c2Max = cols2 / 2 + 1;
-    int c2Min = -(cols2 / 2);
-    
-    int32_t storage[25];
-    unsigned int storageCount = 0;
+    unsigned int bands = (rows + ANA_MEDIAN_BAND - 1) / ANA_MEDIAN_BAND;
+    int failed = 0;
 
-    memset(storage, 0, sizeof(storage));
-
-    // Check whether filter size exceeds reserved memory.
-    if (sizeof(int32_t) * rows2 * cols2 > sizeof(storage))
+    if ((radius == 1) || (radius == 2))
     {
-        printf("Median filter size %u exceeds reserved memory %u.\n",
-                (unsigned int)(sizeof(int32_t) * rows2 * cols2),
-                (unsigned int)(sizeof(storage)));
-        return PREPROCESSING_INVALID_SIZE;
-    }
+        if (radius == 1)
+        {
+            ana_median3x3(src, rows, cols, dst);
+        }
+        else
+        {
+            ana_median5x5(src, rows, cols, dst);
+        }
 
-    if ((rows2 != 0) && (rows2 % 2 == 0))
-    {
-        r2Min++;
-    }
+        ana_medianBorder(src, rows, cols, radius, dst);
 
-    if ((cols2 != 0) && (cols2 % 2 == 0))
-    {
-        c2Min++;
+        return PREPROCESSING_SUCCESSFUL;
     }
-    
+
     // Process.
-    for (unsigned int r1 = 0; r1 < rows1; r1++)
+    PREPROCESSING_DEF_PARALLEL_FOR_OR(failed)
+    for (unsigned int b = 0; b < bands; b++)
     {
-        for (unsigned int c1 = 0; c1 < cols1; c1++)
-        {
-            p1 = r1 * cols1 + c1;
-
-            // Check for valid pointer position.
-            PREPROCESSING_DEF_CHECK_POINTER(src1, p1, size1)
-            PREPROCESSING_DEF_CHECK_POINTER(dst, p1, size1)
+        unsigned int y0 = b * ANA_MEDIAN_BAND;
+        unsigned int y1 = y0 + ANA_MEDIAN_BAND;
 
-            storageCount = 0;
+        if (y1 > rows)
+        {
+            y1 = rows;
+        }
 
-            for (int r2 = r2Min; r2 < r2Max; r2++)
-            {
-                for (int c2 = c2Min; c2 < c2Max; c2++)
-                {
-                    dr = r2 * cols1;
-                    dc = c2;
-                    p2 = (unsigned int)(r2 - r2Min) * cols2
-                        + (unsigned int)(c2 - c2Min);
+        failed |= (ana_medianBand(src, rows, cols, radius, y0, y1, dst)
+                != PREPROCESSING_SUCCESSFUL);
+    }
 
-                    // Check for valid pointer position.
-                    PREPROCESSING_DEF_CHECK_POINTER(src2, p2, size2)
+    if (failed)
+    {
+        printf("Median filter is out of memory.\n");
+        return PREPROCESSING_NO_MEMORY;
+    }
 
-                    // Consider non-zero kernel pixels only.
-                    if (src2[p2] == 0)
-                    {
-                        continue;
-                    }
+    return PREPROCESSING_SUCCESSFUL;
+}
 
-                    // Check whether kernel exceeds image borders and apply
-                    // zero padding by skipping.
-                    if ((((int)(r1) * cols1 + dr) > (rows1 * cols1 - cols1))
-                        || (((int)(r1) * cols1 + dr) < 0))
-                    {
-                        continue;
-                    }
+/*****************************************************************************/
 
-                    if ((((int)(c1) + dc) < 0) || (((int)(c1) + dc) >= cols1))
-                    {
-                        continue;
-                    }
+static void ana_median3x3(const int32_t* src, uint16_t rows, uint16_t cols,
+        int32_t* dst)
+{
+    const struct preprocessing_kernel_Backend* kernel =
+            preprocessing_kernel_backend();
 
-                    storage[storageCount] = src1[(int)(p1) + dr + dc];
-                    storageCount++;
-                }
-            }
+    if ((rows < 3) || (cols < 3))
+    {
+        return;
+    }
 
-            // Sort median values.
-            qsort(storage, storageCount, sizeof(int32_t), &eve_fp_compare32);
+    PREPROCESSING_DEF_PARALLEL_FOR
+    for (unsigned int r = 1; r < (unsigned int)(rows) - 1; r++)
+    {
+        const int32_t* window[3];
 
-            // Choose median value differently depending on even or odd number
-            // of elements.
-            if ((storageCount % 2) == 0)
-            {
-                dst[p1] = eve_fp_add32(storage[(storageCount / 2) - 1],
-                        + storage[storageCount / 2]);
-                dst[p1] = eve_fp_divide32(dst[p1], eve_fp_int2s32(2, FP32_FWL),
-                        FP32_FWL);
-            }
-            else
-            {
-                dst[p1] = storage[(storageCount / 2)];
-            }
+        for (unsigned int i = 0; i < 3; i++)
+        {
+            window[i] = src + (r - 1 + i) * cols;
         }
-    }
 
-    return PREPROCESSING_SUCCESSFUL;
+        kernel->median9(window, dst + r * cols + 1, cols - 2u);
+    }
 }
 
 /*****************************************************************************/
 
-static int ana_crossCorrelateMirror(const int32_t* src1, uint16_t rows1,
-        uint16_t cols1, const int32_t* src2, uint16_t rows2, uint16_t cols2,
+static void ana_median5x5(const int32_t* src, uint16_t rows, uint16_t cols,
         int32_t* dst)
 {
-    int status = PREPROCESSING_SUCCESSFUL;
-    unsigned int size1 = (unsigned int)(rows1) * cols1;
-    unsigned int size2 = (unsigned int)(rows2) * cols2;
-    unsigned int p1 = 0;
-    unsigned int p2 = 0;
-    int32_t prod = 0;
-
-    // Adjust loop parameters for kernel.
-    int dr = 0;
-    int dc = 0;
-    int r2Max = rows2 / 2 + 1;
-    int r2Min = -(rows2 / 2);
-    int c2Max = cols2 / 2 + 1;
-    int c2Min = -(cols2 / 2);
+    const struct preprocessing_kernel_Backend* kernel =
+            preprocessing_kernel_backend();
 
-    if ((rows2 != 0) && (rows2 % 2 == 0))
+    if ((rows < 5) || (cols < 5))
     {
-        r2Min++;
+        return;
     }
 
-    if ((cols2 != 0) && (cols2 % 2 == 0))
+    PREPROCESSING_DEF_PARALLEL_FOR
+    for (unsigned int r = 2; r < (unsigned int)(rows) - 2; r++)
     {
-        c2Min++;
-    }
-    
-    // Process.
-    for (unsigned int r1 = 0; r1 < rows1; r1++)
-    {
-        for (unsigned int c1 = 0; c1 < cols1; c1++)
+        const int32_t* window[5];
+
+        for (unsigned int i = 0; i < 5; i++)
         {
-            p1 = r1 * cols1 + c1;
+            window[i] = src + (r - 2 + i) * cols;
+        }
 
-            // Check for valid pointer position.
-            PREPROCESSING_DEF_CHECK_POINTER(src1, p1, size1)
-            PREPROCESSING_DEF_CHECK_POINTER(dst, p1, size1)
-
-            for (int r2 = r2Min; r2 < r2Max; r2++)
-            {
-                if ((dst[p1] == EVE_FP32_NAN)
-                        && (status == PREPROCESSING_INVALID_NUMBER))
-                {
-                    break;
-                }
-
-                for (int c2 = c2Min; c2 < c2Max; c2++)
-                {
-                    dr = r2 * cols1;
-                    dc = c2;
-                    p2 = (unsigned int)(r2 - r2Min) * cols2
-                            + (unsigned int)(c2 - c2Min);
-
-                    // Check for valid pointer position.
-                    PREPROCESSING_DEF_CHECK_POINTER(src2, p2, size2)
+        kernel->median25(window, dst + r * cols + 2, cols - 4u);
+    }
+}
 
-                    // Check whether kernel exceeds image borders and apply
-                    // mirror padding.
-                    if ((((int)(r1) * cols1 + dr) > (rows1 * cols1 - cols1))
-                        || (((int)(r1) * cols1 + dr) < 0))
-                    {
-                        dr = 0 - dr;
-                    }
+/*****************************************************************************/
 
-                    if ((((int)(c1) + dc) < 0) || (((int)(c1) + dc) >= cols1))
-                    {
-                        dc = 0 - dc;
-                    }
+static void ana_medianBorder(const int32_t* src, uint16_t rows, uint16_t cols,
+        unsigned int radius, int32_t* dst)
+{
+    PREPROCESSING_DEF_PARALLEL_FOR
+    for (unsigned int r = 0; r < rows; r++)
+    {
+        int32_t storage[25];
+        unsigned int r0 = (r > radius) ? r - radius : 0;
+        unsigned int r1 = (r + radius < rows) ? r + radius + 1 : rows;
+        int inner = (r >= radius) && (r + radius < rows);
 
-                    prod = eve_fp_multiply32(src1[(int)(p1) + dr + dc],
-                            src2[p2], FP32_FWL);
+        for (unsigned int c = 0; c < cols; c++)
+        {
+            // Inside pixels are done by the sorting networks.
+            if (inner && (c >= radius) && (c + radius < cols))
+            {
+                c = cols - radius - 1;
+                continue;
+            }
 
-                    if (prod == EVE_FP32_NAN)
-                    {
-                        dst[p1] = EVE_FP32_NAN;
-                        status = PREPROCESSING_INVALID_NUMBER;
-                        break;
-                    }
+            unsigned int c0 = (c > radius) ? c - radius : 0;
+            unsigned int c1 = (c + radius < cols) ? c + radius + 1 : cols;
+            unsigned int n = 0;
 
-                    dst[p1] = eve_fp_add32(dst[p1], prod);
+            for (unsigned int i = r0; i < r1; i++)
+            {
+                for (unsigned int j = c0; j < c1; j++)
+                {
+                    storage[n] = src[i * cols + j];
+                    n++;
                 }
             }
+
+            dst[r * cols + c] = ana_medianOfValues(storage, n);
         }
     }
-
-    return status;
 }
 
 /*****************************************************************************/
-__attribute__((unused))
-static int ana_crossCorrelateZero(const int32_t* src1, uint16_t rows1,
-        uint16_t cols1, const int32_t* src2, uint16_t rows2, uint16_t cols2,
-        int32_t* dst)
+
+static int ana_medianBand(const int32_t* src, uint16_t rows, uint16_t cols,
+        unsigned int radius, unsigned int y0, unsigned int y1, int32_t* dst)
 {
-    int status = PREPROCESSING_SUCCESSFUL;
-    unsigned int size1 = (unsigned int)(rows1) * cols1;
-    unsigned int size2 = (unsigned int)(rows2) * cols2;
-    unsigned int p1 = 0;
-    unsigned int p2 = 0;
-    int32_t prod = 0;
+    unsigned int ya = (y0 > radius) ? y0 - radius : 0;
+    unsigned int yb = (y1 + radius < rows) ? y1 + radius : rows;
+    unsigned int n = (yb - ya) * cols;
+    const int32_t* s = src + ya * cols;
+    struct ana_Histogram hist;
+
+    uint32_t* key = malloc(4 * n * sizeof(uint32_t));
+    int32_t* values = malloc(n * sizeof(int32_t));
+    uint8_t* fine = calloc(n + (n >> 6) + 2, sizeof(uint8_t));
+    uint16_t* coarse = calloc((n >> 12) + 1, sizeof(uint16_t));
+
+    if ((key == 0) || (values == 0) || (fine == 0) || (coarse == 0))
+    {
+        free(key);
+        free(values);
+        free(fine);
+        free(coarse);
+        return PREPROCESSING_NO_MEMORY;
+    }
 
-    // Adjust loop parameters for kernel.
-    int dr = 0;
-    int dc = 0;
-    int r2Max = rows2 / 2 + 1;
-    int r2Min = -(rows2 / 2);
-    int c2Max = cols2 / 2 + 1;
-    int c2Min = -(cols2 / 2);
+    uint32_t* index = key + n;
+    uint32_t* tmpKey = index + n;
+    uint32_t* tmpIndex = tmpKey + n;
+    uint32_t* rank = tmpKey;
 
-    if ((rows2 != 0) && (rows2 % 2 == 0))
+    hist.fine = fine;
+    hist.mid = fine + n + 1;
+    hist.coarse = coarse;
+
+    // Rank the pixels of the band: a stable radix sort of the values with
+    // the sign bit flipped, ties are ranked by position.
+    for (unsigned int i = 0; i < n; i++)
     {
-        r2Min++;
+        key[i] = (uint32_t)(s[i]) ^ 0x80000000u;
+        index[i] = i;
     }
 
-    if ((cols2 != 0) && (cols2 % 2 == 0))
+    for (unsigned int shift = 0; shift < 32; shift += 8)
     {
-        c2Min++;
+        unsigned int count[257];
+
+        memset(count, 0, sizeof(count));
+
+        for (unsigned int i = 0; i < n; i++)
+        {
+            count[((key[i] >> shift) & 0xFF) + 1]++;
+        }
+
+        // Skip digits that are the same for all pixels.
+        if (count[((key[0] >> shift) & 0xFF) + 1] == n)
+        {
+            continue;
+        }
+
+        for (unsigned int i = 0; i < 256; i++)
+        {
+            count[i + 1] += count[i];
+        }
+
+        for (unsigned int i = 0; i < n; i++)
+        {
+            unsigned int d = count[(key[i] >> shift) & 0xFF]++;
+            tmpKey[d] = key[i];
+            tmpIndex[d] = index[i];
+        }
+
+        memcpy(key, tmpKey, n * sizeof(uint32_t));
+        memcpy(index, tmpIndex, n * sizeof(uint32_t));
     }
-    
-    // Process.
-    for (unsigned int r1 = 0; r1 < rows1; r1++)
+
+    for (unsigned int i = 0; i < n; i++)
     {
-        for (unsigned int c1 = 0; c1 < cols1; c1++)
-        {
-            p1 = r1 * cols1 + c1;
+        values[i] = (int32_t)(key[i] ^ 0x80000000u);
+        rank[index[i]] = i;
+    }
 
-            // Check for valid pointer position.
-            PREPROCESSING_DEF_CHECK_POINTER(src1, p1, size1)
-            PREPROCESSING_DEF_CHECK_POINTER(dst, p1, size1)
+    // Slide the window along each row, one column in and one out.
+    for (unsigned int y = y0; y < y1; y++)
+    {
+        unsigned int wy0 = (y > radius) ? y - radius : 0;
+        unsigned int wy1 = (y + radius < rows) ? y + radius + 1 : rows;
+        unsigned int a = 0;
+        unsigned int b = 0;
+
+        for (unsigned int x = 0; x < cols; x++)
+        {
+            unsigned int wx0 = (x > radius) ? x - radius : 0;
+            unsigned int wx1 = (x + radius < cols) ? x + radius + 1 : cols;
 
-            for (int r2 = r2Min; r2 < r2Max; r2++)
+            for (; b < wx1; b++)
             {
-                if ((dst[p1] == EVE_FP32_NAN)
-                        && (status == PREPROCESSING_INVALID_NUMBER))
+                for (unsigned int i = wy0; i < wy1; i++)
                 {
-                    break;
+                    uint32_t q = rank[(i - ya) * cols + b];
+                    hist.fine[q]++;
+                    hist.mid[q >> 6]++;
+                    hist.coarse[q >> 12]++;
                 }
+            }
 
-                for (int c2 = c2Min; c2 < c2Max; c2++)
+            for (; a < wx0; a++)
+            {
+                for (unsigned int i = wy0; i < wy1; i++)
                 {
-                    dr = r2 * cols1;
-                    dc = c2;
-                    p2 = (unsigned int)(r2 - r2Min) * cols2
-                            + (unsigned int)(c2 - c2Min);
-
-                    // Check for valid pointer position.
-                    PREPROCESSING_DEF_CHECK_POINTER(src2, p2, size2)
-
-                    // Check whether kernel exceeds image borders and apply
-                    // zero padding by skipping.
-                    if ((((int)(r1) * cols1 + dr) > (rows1 * cols1 - cols1))
-                            || (((int)(r1) * cols1 + dr) < 0))
-                    {
-                        continue;
-                    }
-
-                    if ((((int)(c1) + dc) < 0) || (((int)(c1) + dc) >= cols1))
-                    {
-                        continue;
-                    }
+                    uint32_t q = rank[(i - ya) * cols + a];
+                    hist.fine[q]--;
+                    hist.mid[q >> 6]--;
+                    hist.coarse[q >> 12]--;
+                }
+            }
 
-                    prod = eve_fp_multiply32(src1[(int)(p1) + dr + dc],
-                            src2[p2], FP32_FWL);
+            uint32_t count = (wy1 - wy0) * (wx1 - wx0);
 
-                    if (prod == EVE_FP32_NAN)
-                    {
-                        dst[p1] = EVE_FP32_NAN;
-                        status = PREPROCESSING_INVALID_NUMBER;
-                        break;
-                    }
+            // Choose median value differently depending on even or odd
+            // number of elements.
+            if ((count % 2) == 0)
+            {
+                int32_t median = eve_fp_add32(
+                        values[ana_histogramSelect(&hist, count / 2 - 1)],
+                        values[ana_histogramSelect(&hist, count / 2)]);
+                dst[y * cols + x] = eve_fp_divide32(median,
+                        eve_fp_int2s32(2, FP32_FWL), FP32_FWL);
+            }
+            else
+            {
+                dst[y * cols + x] =
+                        values[ana_histogramSelect(&hist, count / 2)];
+            }
+        }
 
-                    dst[p1] = eve_fp_add32(dst[p1], prod);
-                }
+        // Empty the histogram for the next row.
+        for (; a < b; a++)
+        {
+            for (unsigned int i = wy0; i < wy1; i++)
+            {
+                uint32_t q = rank[(i - ya) * cols + a];
+                hist.fine[q]--;
+                hist.mid[q >> 6]--;
+                hist.coarse[q >> 12]--;
             }
         }
     }
 
-    return status;
+    free(key);
+    free(values);
+    free(fine);
+    free(coarse);
+
+    return PREPROCESSING_SUCCESSFUL;
 }
 
 /*****************************************************************************/
 
-static int ana_convolveMirror(const int32_t* src1, uint16_t rows1,
-        uint16_t cols1, const int32_t* src2, uint16_t rows2, uint16_t cols2,
-        int32_t* dst)
+static int32_t ana_medianOfValues(int32_t* values, unsigned int n)
 {
-    int status = PREPROCESSING_SUCCESSFUL;
-    unsigned int size1 = (unsigned int)(rows1) * cols1;
-    unsigned int size2 = (unsigned int)(rows2) * cols2;
-    unsigned int p1 = 0;
-    unsigned int p2 = 0;
-    int32_t prod = 0;
+    // Insertion sort, windows at the border are small.
+    for (unsigned int i = 1; i < n; i++)
+    {
+        int32_t v = values[i];
+        unsigned int j = i;
 
-    // Adjust loop parameters for kernel.
-    int dr = 0;
-    int dc = 0;
-    int r2Max = rows2 / 2 + 1;
-    int r2Min = -(rows2 / 2);
-    int c2Max = cols2 / 2 + 1;
-    int c2Min = -(cols2 / 2);
+        while ((j > 0) && (values[j - 1] > v))
+        {
+            values[j] = values[j - 1];
+            j--;
+        }
 
-    if ((rows2 != 0) && (rows2 % 2 == 0))
-    {
-        r2Min++;
+        values[j] = v;
     }
 
-    if ((cols2 != 0) && (cols2 % 2 == 0))
+    // Choose median value differently depending on even or odd number of
+    // elements.
+    if ((n % 2) == 0)
     {
-        c2Min++;
+        int32_t median = eve_fp_add32(values[(n / 2) - 1], values[n / 2]);
+        return eve_fp_divide32(median, eve_fp_int2s32(2, FP32_FWL), FP32_FWL);
     }
-    
-    // Process.
-    for (unsigned int r1 = 0; r1 < rows1; r1++)
-    {
-        for (unsigned int c1 = 0; c1 < cols1; c1++)
-        {
-            p1 = r1 * cols1 + c1;
 
-            // Check for valid pointer position.
-            PREPROCESSING_DEF_CHECK_POINTER(src1, p1, size1)
-            PREPROCESSING_DEF_CHECK_POINTER(dst, p1, size1)
+    return values[n / 2];
+}
 
-            for (int r2 = r2Min; r2 < r2Max; r2++)
-            {
-                if ((dst[p1] == EVE_FP32_NAN)
-                        && (status == PREPROCESSING_INVALID_NUMBER))
-                {
-                    break;
-                }
+/*****************************************************************************/
 
-                for (int c2 = c2Min; c2 < c2Max; c2++)
-                {
-                    dr = r2 * cols1;
-                    dc = c2;
-                    
-                    // Consider kernel rotation by 180 degrees.
-                    p2 = (unsigned int)((rows2 * cols2 - 1)
-                            - (r2 - r2Min) * cols2 - (c2 - c2Min));
+static uint32_t ana_histogramSelect(const struct ana_Histogram* hist,
+        uint32_t k)
+{
+    uint32_t b = 0;
 
-                    // Check for valid pointer position.
-                    PREPROCESSING_DEF_CHECK_POINTER(src2, p2, size2)
+    while (k >= hist->coarse[b])
+    {
+        k -= hist->coarse[b];
+        b++;
+    }
 
-                    // Check whether kernel exceeds image borders and apply
-                    // mirror padding.
-                    if ((((int)(r1) * cols1 + dr) > (rows1 * cols1 - cols1))
-                            || (((int)(r1) * cols1 + dr) < 0))
-                    {
-                        dr = 0 - dr;
-                    }
+    b <<= 6;
+    while (k >= hist->mid[b])
+    {
+        k -= hist->mid[b];
+        b++;
+    }
 
-                    if ((((int)(c1) + dc) < 0) || (((int)(c1) + dc) >= cols1))
-                    {
-                        dc = 0 - dc;
-                    }
+    b <<= 6;
+    while (k >= hist->fine[b])
+    {
+        k -= hist->fine[b];
+        b++;
+    }
 
-                    prod = eve_fp_multiply32(src1[(int)(p1) + dr + dc],
-                            src2[p2], FP32_FWL);
+    return b;
+}
 
-                    if (prod == EVE_FP32_NAN)
-                    {
-                        dst[p1] = EVE_FP32_NAN;
-                        status = PREPROCESSING_INVALID_NUMBER;
-                        break;
-                    }
+/*****************************************************************************/
 
-                    dst[p1] = eve_fp_add32(dst[p1], prod);
-                }
-            }
-        }
-    }
+static int ana_crossCorrelateMirror(const int32_t* src1, uint16_t rows1,
+        uint16_t cols1, const int32_t* src2, uint16_t rows2, uint16_t cols2,
+        int32_t* dst)
+{
+    return ana_filter(src1, rows1, cols1, src2, rows2, cols2, 0, 1, dst);
+}
 
-    return status;
+/*****************************************************************************/
+__attribute__((unused))
+static int ana_crossCorrelateZero(const int32_t* src1, uint16_t rows1,
+        uint16_t cols1, const int32_t* src2, uint16_t rows2, uint16_t cols2,
+        int32_t* dst)
+{
+    return ana_filter(src1, rows1, cols1, src2, rows2, cols2, 0, 0, dst);
 }
 
 /*****************************************************************************/
@@ -1104,89 +1895,1077 @@ static int ana_convolveZero(const int32_t* src1, uint16_t rows1,
         uint16_t cols1, const int32_t* src2, uint16_t rows2, uint16_t cols2,
         int32_t* dst)
 {
-    int status = PREPROCESSING_SUCCESSFUL;
-    unsigned int size1 = (unsigned int)(rows1) * cols1;
+    return ana_filter(src1, rows1, cols1, src2, rows2, cols2, 1, 0, dst);
+}
+
+/*****************************************************************************/
+
+static int ana_filter(const int32_t* src1, uint16_t rows1, uint16_t cols1,
+        const int32_t* src2, uint16_t rows2, uint16_t cols2, int rotate,
+        int mirror, int32_t* dst)
+{
     unsigned int size2 = (unsigned int)(rows2) * cols2;
-    unsigned int p1 = 0;
-    unsigned int p2 = 0;
-    int32_t prod = 0;
+    int result = 0;
+
+    // Kernel rows above and columns left of the result pixel.
+    unsigned int kr = (rows2 > 0) ? (rows2 - 1u) / 2 : 0;
+    unsigned int kc = (cols2 > 0) ? (cols2 - 1u) / 2 : 0;
+
+    if ((src1 == 0) || (src2 == 0) || (dst == 0) || (size2 == 0))
+    {
+        printf("Invalid data pointer: %p.\n", (const void*)(src2));
+        return PREPROCESSING_INVALID_ADDRESS;
+    }
 
-    // Adjust loop parameters for kernel.
-    int dr = 0;
-    int dc = 0;
-    int r2Max = rows2 / 2 + 1;
-    int r2Min = -(rows2 / 2);
-    int c2Max = cols2 / 2 + 1;
-    int c2Min = -(cols2 / 2);
+    int32_t* w = malloc(size2 * sizeof(int32_t));
+    double* u = malloc(((unsigned int)(rows2) + cols2) * sizeof(double));
 
-    if ((rows2 != 0) && (rows2 % 2 == 0))
+    if ((w == 0) || (u == 0))
     {
-        r2Min++;
+        free(w);
+        free(u);
+        return PREPROCESSING_NO_MEMORY;
     }
 
-    if ((cols2 != 0) && (cols2 % 2 == 0))
+    double* v = u + rows2;
+
+    // Consider kernel rotation by 180 degrees.
+    for (unsigned int i = 0; i < size2; i++)
     {
-        c2Min++;
+        w[i] = rotate ? src2[size2 - 1 - i] : src2[i];
     }
-    
+
+    int separable = (size2 >= ANA_SEPARABLE_TAPS) && (rows2 > 1)
+            && (cols2 > 1) && ana_separateKernel(w, rows2, cols2, u, v);
+    int fft = !separable && (size2 >= ANA_FFT_TAPS);
+
+    if (!mirror)
+    {
+        // Zero halo around the image, so no tap needs a border test.
+        unsigned int stride = cols1 + cols2 - 1u;
+        unsigned int padRows = rows1 + rows2 - 1u;
+        int32_t* pad = calloc((size_t)(padRows) * stride, sizeof(int32_t));
+
+        if (pad == 0)
+        {
+            result = -1;
+        }
+        else
+        {
+            for (unsigned int r = 0; r < rows1; r++)
+            {
+                memcpy(pad + (r + kr) * stride + kc, src1 + r * cols1,
+                        cols1 * sizeof(int32_t));
+            }
+
+            const int32_t* origin = pad + kr * stride + kc;
+
+            if (separable)
+            {
+                result = ana_filterSeparable(origin, stride, u, v, rows2,
+                        cols2, 0, rows1, 0, cols1, cols1, dst);
+            }
+            else if (fft)
+            {
+                result = ana_filterFFT(origin, stride, w, rows2, cols2, 0,
+                        rows1, 0, cols1, cols1, dst);
+            }
+            else
+            {
+                result = ana_filterDirect(origin, stride, w, rows2, cols2, 0,
+                        rows1, 0, cols1, cols1, dst);
+            }
+
+            free(pad);
+        }
+    }
+    else
+    {
+        // Inside pixels read the image directly, the border is mirrored.
+        unsigned int r0 = (kr < rows1) ? kr : rows1;
+        unsigned int c0 = (kc < cols1) ? kc : cols1;
+        unsigned int r1 = (rows2 - 1u - kr < rows1) ? rows1 - (rows2 - 1u - kr)
+                : 0;
+        unsigned int c1 = (cols2 - 1u - kc < cols1) ? cols1 - (cols2 - 1u - kc)
+                : 0;
+
+        if ((r0 < r1) && (c0 < c1))
+        {
+            if (separable)
+            {
+                result = ana_filterSeparable(src1, cols1, u, v, rows2, cols2,
+                        r0, r1, c0, c1, cols1, dst);
+            }
+            else if (fft)
+            {
+                result = ana_filterFFT(src1, cols1, w, rows2, cols2, r0, r1,
+                        c0, c1, cols1, dst);
+            }
+            else
+            {
+                result = ana_filterDirect(src1, cols1, w, rows2, cols2, r0,
+                        r1, c0, c1, cols1, dst);
+            }
+        }
+
+        if (result >= 0)
+        {
+            result |= ana_filterMirrorBorder(src1, rows1, cols1, w, rows2,
+                    cols2, dst);
+        }
+    }
+
+    free(w);
+    free(u);
+
+    if (result < 0)
+    {
+        printf("Filter is out of memory.\n");
+        return PREPROCESSING_NO_MEMORY;
+    }
+
+    return (result != 0) ? PREPROCESSING_INVALID_NUMBER
+            : PREPROCESSING_SUCCESSFUL;
+}
+
+/*****************************************************************************/
+
+static int ana_filterDirect(const int32_t* src, unsigned int stride,
+        const int32_t* w, uint16_t rows2, uint16_t cols2, unsigned int r0,
+        unsigned int r1, unsigned int c0, unsigned int c1, unsigned int cols1,
+        int32_t* dst)
+{
+    unsigned int kr = (rows2 - 1u) / 2;
+    unsigned int kc = (cols2 - 1u) / 2;
+    unsigned int n = c1 - c0;
+    int result = 0;
+
     // Process.
-    for (unsigned int r1 = 0; r1 < rows1; r1++)
+    PREPROCESSING_DEF_PARALLEL_FOR_OR(result)
+    for (unsigned int r = r0; r < r1; r++)
     {
-        for (unsigned int c1 = 0; c1 < cols1; c1++)
+        int64_t* acc = malloc(n * (sizeof(int64_t) + 1));
+
+        if (acc == 0)
+        {
+            result |= -1;
+            continue;
+        }
+
+        uint8_t* bad = (uint8_t*)(acc + n);
+        int32_t* d = dst + r * cols1 + c0;
+
+        for (unsigned int x = 0; x < n; x++)
         {
-            p1 = r1 * cols1 + c1;
+            acc[x] = d[x];
+            bad[x] = (d[x] == EVE_FP32_NAN);
+        }
 
-            // Check for valid pointer position.
-            PREPROCESSING_DEF_CHECK_POINTER(src1, p1, size1)
-            PREPROCESSING_DEF_CHECK_POINTER(dst, p1, size1)
+        // Tap by tap over the row, so the inner loop runs across pixels. A
+        // product or sum out of 24.8 range makes the pixel NaN for good, a
+        // NaN result pixel stays NaN.
+        for (unsigned int i = 0; i < rows2; i++)
+        {
+            const int32_t* s = src + ((long)(r + i) - (long)(kr))
+                    * (long)(stride) + (long)(c0) - (long)(kc);
 
-            for (int r2 = r2Min; r2 < r2Max; r2++)
+            for (unsigned int j = 0; j < cols2; j++)
             {
-                if ((dst[p1] == EVE_FP32_NAN)
-                        && (status == PREPROCESSING_INVALID_NUMBER))
+                int64_t k = w[i * cols2 + j];
+
+                for (unsigned int x = 0; x < n; x++)
                 {
-                    break;
+                    int64_t prod = (s[x + j] * k) >> FP32_FWL;
+                    int okProd = (prod >= EVE_FP32_MIN)
+                            & (prod <= EVE_FP32_MAX);
+                    int64_t sum = acc[x] + (okProd ? prod : 0);
+                    int okSum = (sum >= EVE_FP32_MIN) & (sum <= EVE_FP32_MAX);
+
+                    acc[x] = okSum ? sum : 0;
+                    bad[x] |= (uint8_t)(!(okProd & okSum));
                 }
+            }
+        }
 
-                for (int c2 = c2Min; c2 < c2Max; c2++)
-                {
-                    dr = r2 * cols1;
-                    dc = c2;
-                    // Consider kernel rotation by 180 degrees.
-                    p2 = (unsigned int)((rows2 * cols2 - 1)
-                            - (r2 - r2Min) * cols2 - (c2 - c2Min));
+        for (unsigned int x = 0; x < n; x++)
+        {
+            d[x] = bad[x] ? EVE_FP32_NAN : (int32_t)(acc[x]);
+            result |= bad[x];
+        }
 
-                    // Check for valid pointer position.
-                    PREPROCESSING_DEF_CHECK_POINTER(src2, p2, size2)
+        free(acc);
+    }
 
-                    // Check whether kernel exceeds image borders and apply
-                    // zero padding by skipping.
-                    if ((((int)(r1) * cols1 + dr) > (rows1 * cols1 - cols1))
-                            || (((int)(r1) * cols1 + dr) < 0))
-                    {
-                        continue;
-                    }
+    return (result < 0) ? -1 : result;
+}
 
-                    if ((((int)(c1) + dc) < 0) || (((int)(c1) + dc) >= cols1))
-                    {
-                        continue;
-                    }
+/*****************************************************************************/
 
-                    prod = eve_fp_multiply32(src1[(int)(p1) + dr + dc],
-                            src2[p2], FP32_FWL);
+static int ana_filterSeparable(const int32_t* src, unsigned int stride,
+        const double* u, const double* v, uint16_t rows2, uint16_t cols2,
+        unsigned int r0, unsigned int r1, unsigned int c0, unsigned int c1,
+        unsigned int cols1, int32_t* dst)
+{
+    unsigned int kr = (rows2 - 1u) / 2;
+    unsigned int kc = (cols2 - 1u) / 2;
+    unsigned int n = c1 - c0;
+    unsigned int hRows = r1 - r0 + rows2 - 1u;
+    int result = 0;
 
-                    if (prod == EVE_FP32_NAN)
-                    {
-                        dst[p1] = EVE_FP32_NAN;
-                        status = PREPROCESSING_INVALID_NUMBER;
-                        break;
-                    }
+    // Row pass into a buffer of all rows the column pass reads.
+    double* h = malloc((size_t)(hRows) * n * sizeof(double));
 
-                    dst[p1] = eve_fp_add32(dst[p1], prod);
-                }
+    if (h == 0)
+    {
+        return -1;
+    }
+
+    PREPROCESSING_DEF_PARALLEL_FOR
+    for (unsigned int y = 0; y < hRows; y++)
+    {
+        const int32_t* s = src + ((long)(r0 + y) - (long)(kr))
+                * (long)(stride) + (long)(c0) - (long)(kc);
+        double* t = h + (size_t)(y) * n;
+
+        for (unsigned int x = 0; x < n; x++)
+        {
+            t[x] = 0.0;
+        }
+
+        for (unsigned int j = 0; j < cols2; j++)
+        {
+            for (unsigned int x = 0; x < n; x++)
+            {
+                t[x] += (double)(s[x + j]) * v[j];
             }
         }
     }
 
-    return status;
+    // Column pass, one result row at a time.
+    PREPROCESSING_DEF_PARALLEL_FOR_OR(result)
+    for (unsigned int r = r0; r < r1; r++)
+    {
+        int32_t* d = dst + r * cols1 + c0;
+        const double* t = h + (size_t)(r - r0) * n;
+
+        for (unsigned int x = 0; x < n; x++)
+        {
+            double sum = 0.0;
+
+            for (unsigned int i = 0; i < rows2; i++)
+            {
+                sum += t[(size_t)(i) * n + x] * u[i];
+            }
+
+            result |= ana_addSum(d + x, sum);
+        }
+    }
+
+    free(h);
+
+    return result;
+}
+
+/*****************************************************************************/
+
+static int ana_filterFFT(const int32_t* src, unsigned int stride,
+        const int32_t* w, uint16_t rows2, uint16_t cols2, unsigned int r0,
+        unsigned int r1, unsigned int c0, unsigned int c1, unsigned int cols1,
+        int32_t* dst)
+{
+    unsigned int kr = (rows2 - 1u) / 2;
+    unsigned int kc = (cols2 - 1u) / 2;
+    unsigned int kMax = (rows2 > cols2) ? rows2 : cols2;
+    unsigned int extent = (r1 - r0 > c1 - c0) ? r1 - r0 : c1 - c0;
+    unsigned int n = 64;
+    int result = 0;
+
+    // Tiles of four kernel sizes, or less if the image is smaller.
+    while (n < kMax + ((extent < 3 * kMax) ? extent : 3 * kMax))
+    {
+        n *= 2;
+    }
+
+    unsigned int outRows = n - rows2 + 1u;
+    unsigned int outCols = n - cols2 + 1u;
+    unsigned int tileRows = (r1 - r0 + outRows - 1u) / outRows;
+    unsigned int tileCols = (c1 - c0 + outCols - 1u) / outCols;
+    unsigned int tiles = tileRows * tileCols;
+    size_t points = (size_t)(n) * n;
+
+    // Spectrum of the kernel rotated by 180 degrees, the tiles are
+    // correlated with w.
+    double* kRe = calloc(2 * points, sizeof(double));
+
+    if (kRe == 0)
+    {
+        return -1;
+    }
+
+    double* kIm = kRe + points;
+
+    for (unsigned int i = 0; i < rows2; i++)
+    {
+        for (unsigned int j = 0; j < cols2; j++)
+        {
+            kRe[(size_t)(rows2 - 1u - i) * n + (cols2 - 1u - j)] =
+                    w[i * cols2 + j];
+        }
+    }
+
+    if (preprocessing_fft_complex2D(kRe, kIm, n, n, 0)
+            != PREPROCESSING_SUCCESSFUL)
+    {
+        free(kRe);
+        return -1;
+    }
+
+    // Process.
+    PREPROCESSING_DEF_PARALLEL_FOR_OR(result)
+    for (unsigned int t = 0; t < tiles; t++)
+    {
+        unsigned int tr = r0 + (t / tileCols) * outRows;
+        unsigned int tc = c0 + (t % tileCols) * outCols;
+        unsigned int nr = (r1 - tr < outRows) ? r1 - tr : outRows;
+        unsigned int nc = (c1 - tc < outCols) ? c1 - tc : outCols;
+        double* re = calloc(2 * points, sizeof(double));
+
+        if (re == 0)
+        {
+            result |= -1;
+            continue;
+        }
+
+        double* im = re + points;
+
+        // Load the tile with the rows and columns the kernel reaches.
+        for (unsigned int i = 0; i < nr + rows2 - 1u; i++)
+        {
+            const int32_t* s = src + ((long)(tr + i) - (long)(kr))
+                    * (long)(stride) + (long)(tc) - (long)(kc);
+
+            for (unsigned int j = 0; j < nc + cols2 - 1u; j++)
+            {
+                re[(size_t)(i) * n + j] = s[j];
+            }
+        }
+
+        if (preprocessing_fft_complex2D(re, im, n, n, 0)
+                != PREPROCESSING_SUCCESSFUL)
+        {
+            free(re);
+            result |= -1;
+            continue;
+        }
+
+        for (size_t p = 0; p < points; p++)
+        {
+            double a = re[p] * kRe[p] - im[p] * kIm[p];
+            im[p] = re[p] * kIm[p] + im[p] * kRe[p];
+            re[p] = a;
+        }
+
+        if (preprocessing_fft_complex2D(re, im, n, n, 1)
+                != PREPROCESSING_SUCCESSFUL)
+        {
+            free(re);
+            result |= -1;
+            continue;
+        }
+
+        // The valid part of the circular convolution starts at the kernel
+        // size.
+        for (unsigned int i = 0; i < nr; i++)
+        {
+            int32_t* d = dst + (tr + i) * cols1 + tc;
+            const double* o = re + (size_t)(i + rows2 - 1u) * n + cols2 - 1u;
+
+            for (unsigned int j = 0; j < nc; j++)
+            {
+                result |= ana_addSum(d + j, o[j] / (double)(points));
+            }
+        }
+
+        free(re);
+    }
+
+    free(kRe);
+
+    return (result < 0) ? -1 : result;
+}
+
+/*****************************************************************************/
+
+static int ana_filterMirrorBorder(const int32_t* src1, uint16_t rows1,
+        uint16_t cols1, const int32_t* w, uint16_t rows2, uint16_t cols2,
+        int32_t* dst)
+{
+    int kr = (rows2 - 1) / 2;
+    int kc = (cols2 - 1) / 2;
+    int result = 0;
+
+    // Process.
+    PREPROCESSING_DEF_PARALLEL_FOR_OR(result)
+    for (unsigned int r1 = 0; r1 < rows1; r1++)
+    {
+        int inner = ((int)(r1) >= kr) && ((int)(r1) + rows2 - 1 - kr < rows1);
+
+        for (unsigned int c1 = 0; c1 < cols1; c1++)
+        {
+            // Inside pixels are done already.
+            if (inner && ((int)(c1) >= kc)
+                    && ((int)(c1) + cols2 - 1 - kc < cols1))
+            {
+                c1 = cols1 - (cols2 - kc);
+                continue;
+            }
+
+            int64_t acc = dst[r1 * cols1 + c1];
+            int bad = (acc == EVE_FP32_NAN);
+
+            for (int i = 0; (i < rows2) && !bad; i++)
+            {
+                for (int j = 0; (j < cols2) && !bad; j++)
+                {
+                    int dr = i - kr;
+                    int dc = j - kc;
+
+                    // Check whether kernel exceeds image borders and apply
+                    // mirror padding.
+                    if (((int)(r1) + dr >= rows1) || ((int)(r1) + dr < 0))
+                    {
+                        dr = 0 - dr;
+                    }
+
+                    if (((int)(c1) + dc >= cols1) || ((int)(c1) + dc < 0))
+                    {
+                        dc = 0 - dc;
+                    }
+
+                    // A kernel larger than the image still reaches out.
+                    if (((int)(r1) + dr >= rows1) || ((int)(r1) + dr < 0)
+                            || ((int)(c1) + dc >= cols1)
+                            || ((int)(c1) + dc < 0))
+                    {
+                        continue;
+                    }
+
+                    int64_t prod = ((int64_t)(src1[((int)(r1) + dr) * cols1
+                            + (int)(c1) + dc]) * w[i * cols2 + j]) >> FP32_FWL;
+
+                    acc += prod;
+                    bad = (prod < EVE_FP32_MIN) || (prod > EVE_FP32_MAX)
+                            || (acc < EVE_FP32_MIN) || (acc > EVE_FP32_MAX);
+                }
+            }
+
+            dst[r1 * cols1 + c1] = bad ? EVE_FP32_NAN : (int32_t)(acc);
+            result |= bad;
+        }
+    }
+
+    return result;
+}
+
+/*****************************************************************************/
+
+static int ana_separateKernel(const int32_t* w, uint16_t rows2,
+        uint16_t cols2, double* u, double* v)
+{
+    unsigned int pr = 0;
+    unsigned int pc = 0;
+    int64_t pivot = 0;
+
+    // Largest tap as pivot.
+    for (unsigned int i = 0; i < rows2; i++)
+    {
+        for (unsigned int j = 0; j < cols2; j++)
+        {
+            int64_t a = w[i * cols2 + j];
+
+            if (llabs(a) > llabs(pivot))
+            {
+                pivot = a;
+                pr = i;
+                pc = j;
+            }
+        }
+    }
+
+    if (pivot == 0)
+    {
+        return 0;
+    }
+
+    // Rank one: every 2x2 minor with the pivot vanishes (exact in 64 bit).
+    for (unsigned int i = 0; i < rows2; i++)
+    {
+        for (unsigned int j = 0; j < cols2; j++)
+        {
+            if ((int64_t)(w[i * cols2 + j]) * pivot
+                    != (int64_t)(w[i * cols2 + pc]) * w[pr * cols2 + j])
+            {
+                return 0;
+            }
+        }
+    }
+
+    for (unsigned int i = 0; i < rows2; i++)
+    {
+        u[i] = w[i * cols2 + pc];
+    }
+
+    for (unsigned int j = 0; j < cols2; j++)
+    {
+        v[j] = (double)(w[pr * cols2 + j]) / (double)(pivot);
+    }
+
+    return 1;
+}
+
+/*****************************************************************************/
+
+static int ana_addSum(int32_t* dst, double sum)
+{
+    double v = (double)(*dst) + floor(sum / (double)(1 << FP32_FWL) + 1e-9);
+
+    if ((*dst == EVE_FP32_NAN) || (v < EVE_FP32_MIN) || (v > EVE_FP32_MAX))
+    {
+        *dst = EVE_FP32_NAN;
+        return 1;
+    }
+
+    *dst = (int32_t)(v);
+
+    return 0;
+}
+
+/*****************************************************************************/
+
+static int ana_histogram(const int32_t* src, unsigned int size, int32_t low,
+        int64_t delta, unsigned int values, int valid, int32_t* counts)
+{
+    uint32_t* slices = calloc((size_t)(values)
+            * PREPROCESSING_ANA_HISTOGRAM_SLICES, sizeof(uint32_t));
+
+    if (slices == 0)
+    {
+        return PREPROCESSING_NO_MEMORY;
+    }
+
+    PREPROCESSING_DEF_PARALLEL_FOR
+    for (unsigned int s = 0; s < PREPROCESSING_ANA_HISTOGRAM_SLICES; s++)
+    {
+        uint32_t* slice = slices + (size_t)(s) * values;
+        unsigned int first = (unsigned int)((uint64_t)(size) * s
+                / PREPROCESSING_ANA_HISTOGRAM_SLICES);
+        unsigned int last = (unsigned int)((uint64_t)(size) * (s + 1)
+                / PREPROCESSING_ANA_HISTOGRAM_SLICES);
+
+        for (unsigned int p = first; p < last; p++)
+        {
+            // The bin is the first one whose upper edge is not below the
+            // pixel value.
+            int64_t d = (int64_t)(src[p]) - low;
+            uint64_t n = (d <= 0) ? 0 : (uint64_t)((d + delta - 1) / delta);
+
+            if ((n < values) && (!valid || (src[p] != EVE_FP32_NAN)))
+            {
+                slice[n]++;
+            }
+        }
+    }
+
+    PREPROCESSING_DEF_PARALLEL_FOR
+    for (unsigned int n = 0; n < values; n++)
+    {
+        uint32_t sum = 0;
+
+        for (unsigned int s = 0; s < PREPROCESSING_ANA_HISTOGRAM_SLICES; s++)
+        {
+            sum += slices[(size_t)(s) * values + n];
+        }
+
+        counts[n] += (int32_t)(sum);
+    }
+
+    free(slices);
+
+    return PREPROCESSING_SUCCESSFUL;
+}
+
+/*****************************************************************************/
+
+static int ana_select(const int32_t* src, const int32_t* mask,
+        unsigned int size, int32_t center, int deviation, int32_t percent,
+        int32_t* value)
+{
+    const unsigned int buckets = 1u << ANA_SELECT_BITS;
+    const uint32_t low = buckets - 1;
+    const int64_t scale = (int64_t)(100) << FP32_FWL;
+
+    uint32_t* hist = 0;
+    uint32_t* slices = 0;
+    uint32_t first[PREPROCESSING_ANA_HISTOGRAM_SLICES];
+    uint64_t n = 0;
+    uint64_t below = 0;
+    uint64_t rank[2] = { 0, 0 };
+    uint64_t before[2] = { 0, 0 };
+    unsigned int bucket[2] = { 0, 0 };
+    uint32_t key[2] = { 0, 0 };
+    int64_t offset = 0;
+
+    slices = calloc((size_t)(buckets) * (PREPROCESSING_ANA_HISTOGRAM_SLICES
+            + 1), sizeof(uint32_t));
+
+    if (slices == 0)
+    {
+        return PREPROCESSING_NO_MEMORY;
+    }
+
+    hist = slices + (size_t)(buckets) * PREPROCESSING_ANA_HISTOGRAM_SLICES;
+
+    // Count the upper key bits.
+    PREPROCESSING_DEF_PARALLEL_FOR
+    for (unsigned int s = 0; s < PREPROCESSING_ANA_HISTOGRAM_SLICES; s++)
+    {
+        uint32_t* slice = slices + (size_t)(s) * buckets;
+        unsigned int begin = (unsigned int)((uint64_t)(size) * s
+                / PREPROCESSING_ANA_HISTOGRAM_SLICES);
+        unsigned int end = (unsigned int)((uint64_t)(size) * (s + 1)
+                / PREPROCESSING_ANA_HISTOGRAM_SLICES);
+        uint32_t k = 0;
+
+        for (unsigned int p = begin; p < end; p++)
+        {
+            if (ana_selectKey(src, mask, p, center, deviation, &k))
+            {
+                slice[k >> ANA_SELECT_BITS]++;
+            }
+        }
+    }
+
+    PREPROCESSING_DEF_PARALLEL_FOR
+    for (unsigned int b = 0; b < buckets; b++)
+    {
+        uint32_t sum = 0;
+
+        for (unsigned int s = 0; s < PREPROCESSING_ANA_HISTOGRAM_SLICES; s++)
+        {
+            sum += slices[(size_t)(s) * buckets + b];
+        }
+
+        hist[b] = sum;
+    }
+
+    for (unsigned int b = 0; b < buckets; b++)
+    {
+        n += hist[b];
+    }
+
+    if (n == 0)
+    {
+        free(slices);
+        return PREPROCESSING_INVALID_NUMBER;
+    }
+
+    // The two nearest ranks and their buckets.
+    offset = (int64_t)(percent) * (int64_t)(n - 1);
+    rank[0] = (uint64_t)(offset / scale);
+    rank[1] = ((offset % scale != 0) && (rank[0] + 1 < n)) ? rank[0] + 1
+            : rank[0];
+
+    for (unsigned int i = 0; i < 2; i++)
+    {
+        below = 0;
+        bucket[i] = 0;
+
+        while (below + hist[bucket[i]] <= rank[i])
+        {
+            below += hist[bucket[i]];
+            bucket[i]++;
+        }
+
+        before[i] = below;
+    }
+
+    // Count the lower key bits of the lower bucket and find the smallest
+    // key of the upper one.
+    memset(slices, 0, (size_t)(buckets) * PREPROCESSING_ANA_HISTOGRAM_SLICES
+            * sizeof(uint32_t));
+
+    PREPROCESSING_DEF_PARALLEL_FOR
+    for (unsigned int s = 0; s < PREPROCESSING_ANA_HISTOGRAM_SLICES; s++)
+    {
+        uint32_t* slice = slices + (size_t)(s) * buckets;
+        unsigned int begin = (unsigned int)((uint64_t)(size) * s
+                / PREPROCESSING_ANA_HISTOGRAM_SLICES);
+        unsigned int end = (unsigned int)((uint64_t)(size) * (s + 1)
+                / PREPROCESSING_ANA_HISTOGRAM_SLICES);
+        uint32_t k = 0;
+
+        first[s] = UINT32_MAX;
+
+        for (unsigned int p = begin; p < end; p++)
+        {
+            if (!ana_selectKey(src, mask, p, center, deviation, &k))
+            {
+                continue;
+            }
+
+            if ((k >> ANA_SELECT_BITS) == bucket[0])
+            {
+                slice[k & low]++;
+            }
+            else if (((k >> ANA_SELECT_BITS) == bucket[1]) && (k < first[s]))
+            {
+                first[s] = k;
+            }
+        }
+    }
+
+    PREPROCESSING_DEF_PARALLEL_FOR
+    for (unsigned int b = 0; b < buckets; b++)
+    {
+        uint32_t sum = 0;
+
+        for (unsigned int s = 0; s < PREPROCESSING_ANA_HISTOGRAM_SLICES; s++)
+        {
+            sum += slices[(size_t)(s) * buckets + b];
+        }
+
+        hist[b] = sum;
+    }
+
+    for (unsigned int i = 0; i < 2; i++)
+    {
+        unsigned int b = 0;
+
+        if (bucket[i] != bucket[0])
+        {
+            key[i] = UINT32_MAX;
+
+            for (unsigned int s = 0; s < PREPROCESSING_ANA_HISTOGRAM_SLICES;
+                    s++)
+            {
+                key[i] = (first[s] < key[i]) ? first[s] : key[i];
+            }
+
+            continue;
+        }
+
+        below = before[0];
+
+        while (below + hist[b] <= rank[i])
+        {
+            below += hist[b];
+            b++;
+        }
+
+        key[i] = ((uint32_t)(bucket[0]) << ANA_SELECT_BITS) | b;
+    }
+
+    free(slices);
+
+    // Interpolate between the two ranks.
+    {
+        int64_t v0 = (int32_t)(key[0] ^ 0x80000000u);
+        int64_t v1 = (int32_t)(key[1] ^ 0x80000000u);
+
+        *value = (int32_t)(v0 + (v1 - v0) * (offset % scale) / scale);
+    }
+
+    return PREPROCESSING_SUCCESSFUL;
+}
+
+/*****************************************************************************/
+
+static inline int ana_selectKey(const int32_t* src, const int32_t* mask,
+        unsigned int p, int32_t center, int deviation, uint32_t* key)
+{
+    int64_t v = src[p];
+
+    if ((src[p] == EVE_FP32_NAN) || (mask[p] <= 0))
+    {
+        return 0;
+    }
+
+    if (deviation)
+    {
+        v = (v < center) ? (int64_t)(center) - v : v - center;
+        v = (v > EVE_FP32_MAX) ? EVE_FP32_MAX : v;
+    }
+
+    // Flip the sign bit, so unsigned order is value order.
+    *key = (uint32_t)((int32_t)(v)) ^ 0x80000000u;
+
+    return 1;
+}
+
+/*****************************************************************************/
+
+static void ana_extremaBlock(const int32_t* src, unsigned int begin,
+        unsigned int end, struct preprocessing_ana_Extrema* extrema)
+{
+    int32_t min = src[begin];
+    int32_t max = src[begin];
+
+    // Branch free, so it vectorizes.
+    for (unsigned int p = begin + 1; p < end; p++)
+    {
+        min = (src[p] < min) ? src[p] : min;
+        max = (src[p] > max) ? src[p] : max;
+    }
+
+    if ((extrema->minCount == 0) || (min < extrema->min))
+    {
+        extrema->min = min;
+        extrema->minCount = 0;
+    }
+
+    if ((extrema->maxCount == 0) || (max > extrema->max))
+    {
+        extrema->max = max;
+        extrema->maxCount = 0;
+    }
+
+    // The first position, then a branch free count.
+    if ((min == extrema->min) && (extrema->minCount == 0))
+    {
+        for (extrema->minFirst = begin; src[extrema->minFirst] != min;
+                extrema->minFirst++)
+        {
+        }
+    }
+
+    if ((max == extrema->max) && (extrema->maxCount == 0))
+    {
+        for (extrema->maxFirst = begin; src[extrema->maxFirst] != max;
+                extrema->maxFirst++)
+        {
+        }
+    }
+
+    if ((min == extrema->min) || (max == extrema->max))
+    {
+        uint32_t minCount = 0;
+        uint32_t maxCount = 0;
+
+        for (unsigned int p = begin; p < end; p++)
+        {
+            minCount += (src[p] == min);
+            maxCount += (src[p] == max);
+        }
+
+        extrema->minCount += (min == extrema->min) ? minCount : 0;
+        extrema->maxCount += (max == extrema->max) ? maxCount : 0;
+    }
+}
+
+/*****************************************************************************/
+
+static int ana_derive(const int32_t* src, uint16_t rows, uint16_t cols,
+        int down, int32_t* dst)
+{
+    unsigned int n = down ? rows : cols;
+    int result = 0;
+
+    if ((src == 0) || (dst == 0))
+    {
+        printf("Invalid data pointer: %p.\n", (const void*)(src));
+        return PREPROCESSING_INVALID_ADDRESS;
+    }
+
+    PREPROCESSING_DEF_PARALLEL_FOR_OR(result)
+    for (unsigned int r = 0; r < rows; r++)
+    {
+        const int32_t* s = src + r * cols;
+        int32_t* d = dst + r * cols;
+
+        // A single row or column has no neighbours to take. The mirrored
+        // border reads the same row or column twice.
+        if ((n > 1) && down)
+        {
+            ana_difference((r > 0) ? s - cols : s + cols,
+                    (r + 1 < rows) ? s + cols : s - cols, cols, d);
+        }
+        else if (n > 1)
+        {
+            // Border columns in the prologue and the epilogue.
+            ana_difference(s + 1, s + 1, 1, d);
+            ana_difference(s, s + 2, cols - 2u, d + 1);
+            ana_difference(s + cols - 2, s + cols - 2, 1, d + cols - 1);
+        }
+
+        for (unsigned int c = 0; c < cols; c++)
+        {
+            result |= (d[c] == EVE_FP32_NAN);
+        }
+    }
+
+    return (result != 0) ? PREPROCESSING_INVALID_NUMBER
+            : PREPROCESSING_SUCCESSFUL;
+}
+
+/*****************************************************************************/
+
+static void ana_difference(const int32_t* restrict a,
+        const int32_t* restrict b, unsigned int n, int32_t* restrict d)
+{
+    for (unsigned int i = 0; i < n; i++)
+    {
+        int32_t first = (int32_t)((uint32_t)(d[i]) + (uint32_t)(a[i]));
+        int32_t second = (int32_t)((uint32_t)(first) - (uint32_t)(b[i]));
+
+        // Products by 1 and -1 of NaN are out of range as well, so is a sum
+        // that wraps around or hits NaN.
+        int32_t bad = (d[i] == EVE_FP32_NAN) | (a[i] == EVE_FP32_NAN)
+                | (b[i] == EVE_FP32_NAN) | (first == EVE_FP32_NAN)
+                | (second == EVE_FP32_NAN)
+                | (((d[i] ^ first) & (a[i] ^ first)) < 0)
+                | (((first ^ b[i]) & (first ^ second)) < 0);
+
+        d[i] = bad ? EVE_FP32_NAN : second;
+    }
+}
+
+/*****************************************************************************/
+
+static int ana_gradient(const int32_t* src, uint16_t rows, uint16_t cols,
+        int stencil, int32_t* dstY, int32_t* dstX, int32_t* magnitude)
+{
+    int64_t side = 0;
+    int64_t center = 1;
+    int result = 0;
+
+    switch (stencil)
+    {
+    case PREPROCESSING_ANA_STENCIL_CENTRAL:
+        break;
+    case PREPROCESSING_ANA_STENCIL_SOBEL:
+        side = 1;
+        center = 2;
+        break;
+    case PREPROCESSING_ANA_STENCIL_SCHARR:
+        side = 3;
+        center = 10;
+        break;
+    default:
+        printf("Unknown stencil: %d.\n", stencil);
+        return PREPROCESSING_INVALID_NUMBER;
+    }
+
+    PREPROCESSING_DEF_PARALLEL_FOR_OR(result)
+    for (unsigned int r = 0; r < rows; r++)
+    {
+        const int32_t* mid = src + r * cols;
+        const int32_t* up = (r > 0) ? mid - cols
+                : ((rows > 1) ? mid + cols : mid);
+        const int32_t* down = (r + 1 < rows) ? mid + cols
+                : ((rows > 1) ? mid - cols : mid);
+        int32_t* scratch = 0;
+        int32_t* gy = (dstY != 0) ? dstY + r * cols : 0;
+        int32_t* gx = (dstX != 0) ? dstX + r * cols : 0;
+        unsigned int last = (cols > 1) ? cols - 2u : 0;
+
+        if (magnitude != 0)
+        {
+            scratch = malloc(2 * (size_t)(cols) * sizeof(int32_t));
+
+            if (scratch == 0)
+            {
+                result |= -1;
+                continue;
+            }
+
+            gy = scratch;
+            gx = scratch + cols;
+        }
+
+        // Mirrored border columns in the prologue and the epilogue, the
+        // inner run has no branches.
+        ana_stencil(up, mid, down, cols - 1u - last, 0, cols - 1u - last, 1,
+                side, center, gy, gx);
+
+        if (cols > 1)
+        {
+            ana_stencil(up, mid, down, 0, 1, 2, cols - 2u, side, center, gy,
+                    gx);
+            ana_stencil(up, mid, down, last, cols - 1u, last, 1, side,
+                    center, gy, gx);
+        }
+
+        if (magnitude != 0)
+        {
+            int32_t* m = magnitude + r * cols;
+
+            for (unsigned int c = 0; c < cols; c++)
+            {
+                uint64_t sum = (uint64_t)((int64_t)(gy[c]) * gy[c])
+                        + (uint64_t)((int64_t)(gx[c]) * gx[c]);
+                uint64_t root = (uint64_t)(sqrt((double)(sum)));
+
+                // The square root in double may be one off.
+                root -= (root * root > sum);
+                root += ((root + 1) * (root + 1) <= sum);
+
+                m[c] = ((gy[c] == EVE_FP32_NAN) || (gx[c] == EVE_FP32_NAN)
+                        || (root > EVE_FP32_MAX)) ? EVE_FP32_NAN
+                        : (int32_t)(root);
+            }
+
+            gy = m;
+            gx = m;
+        }
+
+        for (unsigned int c = 0; c < cols; c++)
+        {
+            result |= (gy[c] == EVE_FP32_NAN) | (gx[c] == EVE_FP32_NAN);
+        }
+
+        free(scratch);
+    }
+
+    if (result < 0)
+    {
+        printf("Gradient is out of memory.\n");
+        return PREPROCESSING_NO_MEMORY;
+    }
+
+    return (result != 0) ? PREPROCESSING_INVALID_NUMBER
+            : PREPROCESSING_SUCCESSFUL;
+}
+
+/*****************************************************************************/
+
+static void ana_stencil(const int32_t* restrict up,
+        const int32_t* restrict mid, const int32_t* restrict down,
+        unsigned int l, unsigned int c, unsigned int r, unsigned int n,
+        int64_t side, int64_t center, int32_t* restrict gy,
+        int32_t* restrict gx)
+{
+    for (unsigned int i = 0; i < n; i++)
+    {
+        unsigned int pl = l + i;
+        unsigned int pc = c + i;
+        unsigned int pr = r + i;
+
+        int64_t y = side * ((int64_t)(up[pl]) - down[pl] + up[pr] - down[pr])
+                + center * ((int64_t)(up[pc]) - down[pc]);
+        int64_t x = side * ((int64_t)(up[pl]) - up[pr] + down[pl] - down[pr])
+                + center * ((int64_t)(mid[pl]) - mid[pr]);
+
+        // The corners count for Sobel and Scharr only.
+        int bad = (up[pc] == EVE_FP32_NAN) | (down[pc] == EVE_FP32_NAN)
+                | (mid[pl] == EVE_FP32_NAN) | (mid[pr] == EVE_FP32_NAN)
+                | ((side != 0) & ((up[pl] == EVE_FP32_NAN)
+                        | (up[pr] == EVE_FP32_NAN)
+                        | (down[pl] == EVE_FP32_NAN)
+                        | (down[pr] == EVE_FP32_NAN)));
+
+        gy[pc] = (bad | (y < EVE_FP32_MIN) | (y > EVE_FP32_MAX))
+                ? EVE_FP32_NAN : (int32_t)(y);
+        gx[pc] = (bad | (x < EVE_FP32_MIN) | (x > EVE_FP32_MAX))
+                ? EVE_FP32_NAN : (int32_t)(x);
+    }
 }
@@ -15,6 +15,8 @@
 #include "preprocessing/arith.h"
 
 #include"preprocessing/def.h"
+#include "preprocessing/kernel.h"
+#include "preprocessing/prof.h"
 #include "preprocessing/vmem.h"
 
 /* from libeve */
@@ -27,14 +29,37 @@
 #include <stdlib.h>
 #include <string.h>
 
+/* PRIVATE INTERFACE *********************************************************/
+
+/**
+ * Multiply a tile of two matrices and add it to the result matrix.
+ *
+ * @param src1  matrix 1.
+ * @param cols1 the number of matrix 1 columns (matrix 2 rows).
+ * @param src2  matrix 2.
+ * @param cols2 the number of matrix 2 columns.
+ * @param row0  the first row of the tile.
+ * @param col0  the first column of the tile.
+ * @param rows1 the number of matrix 1 rows.
+ * @param dst   the result matrix.
+ *
+ * @return 1 if a result pixel became NaN, 0 otherwise.
+ */
+static int arith_multiplyTile(const int32_t* src1, uint16_t cols1,
+        const int32_t* src2, uint16_t cols2, unsigned int row0,
+        unsigned int col0, uint16_t rows1, int32_t* dst);
+
 /* PUBLIC IMPLEMENTATION *****************************************************/
 
 int preprocessing_arith_addImages(uint32_t sdSrc1, uint32_t sdSrc2,
         uint16_t rows, uint16_t cols, uint32_t sdDst)
 {
+    PREPROCESSING_PROF_KERNEL(2 * PREPROCESSING_PROF_FRAME(rows, cols),
+            PREPROCESSING_PROF_FRAME(rows, cols),
+            (uint64_t)(rows) * cols, 1);
+
     int status = PREPROCESSING_SUCCESSFUL;
     unsigned int size = (unsigned int)(rows) * cols;
-    unsigned int p = 0;
 
     const int32_t* src1 = preprocessing_vmem_getDataAddress(sdSrc1);
     const int32_t* src2 = preprocessing_vmem_getDataAddress(sdSrc2);
@@ -48,25 +73,15 @@ int preprocessing_arith_addImages(uint32_t sdSrc1, uint32_t sdSrc2,
         return PREPROCESSING_INVALID_SIZE;
     }
 
+    // Check for valid pointer position.
+    PREPROCESSING_DEF_CHECK_POINTER(src1, 0, size)
+    PREPROCESSING_DEF_CHECK_POINTER(src2, 0, size)
+    PREPROCESSING_DEF_CHECK_POINTER(dst, 0, size)
+
     // Process.
-    for (unsigned int r = 0; r < rows; r++)
+    if (preprocessing_kernel_backend()->add(src1, src2, dst, size))
     {
-        for (unsigned int c = 0; c < cols; c++)
-        {
-            p = r * cols + c;
-
-            // Check for valid pointer position.
-            PREPROCESSING_DEF_CHECK_POINTER(src1, p, size)
-            PREPROCESSING_DEF_CHECK_POINTER(src2, p, size)
-            PREPROCESSING_DEF_CHECK_POINTER(dst, p, size)
-
-            dst[p] = eve_fp_add32(src1[p], src2[p]);
-
-            if (dst[p] == EVE_FP32_NAN)
-            {
-                status = PREPROCESSING_INVALID_NUMBER;
-            }
-        }
+        status = PREPROCESSING_INVALID_NUMBER;
     }
 
     return status;
@@ -77,9 +92,12 @@ int preprocessing_arith_addImages(uint32_t sdSrc1, uint32_t sdSrc2,
 int preprocessing_arith_subtractImages(uint32_t sdSrc1, uint32_t sdSrc2,
         uint16_t rows, uint16_t cols, uint32_t sdDst)
 {
+    PREPROCESSING_PROF_KERNEL(2 * PREPROCESSING_PROF_FRAME(rows, cols),
+            PREPROCESSING_PROF_FRAME(rows, cols),
+            (uint64_t)(rows) * cols, 1);
+
     int status = PREPROCESSING_SUCCESSFUL;
     unsigned int size = (unsigned int)(rows) * cols;
-    unsigned int p = 0;
 
     const int32_t* src1 = preprocessing_vmem_getDataAddress(sdSrc1);
     const int32_t* src2 = preprocessing_vmem_getDataAddress(sdSrc2);
@@ -93,25 +111,15 @@ int preprocessing_arith_subtractImages(uint32_t sdSrc1, uint32_t sdSrc2,
         return PREPROCESSING_INVALID_SIZE;
     }
 
+    // Check for valid pointer position.
+    PREPROCESSING_DEF_CHECK_POINTER(src1, 0, size)
+    PREPROCESSING_DEF_CHECK_POINTER(src2, 0, size)
+    PREPROCESSING_DEF_CHECK_POINTER(dst, 0, size)
+
     // Process.
-    for (unsigned int r = 0; r < rows; r++)
+    if (preprocessing_kernel_backend()->subtract(src1, src2, dst, size))
     {
-        for (unsigned int c = 0; c < cols; c++)
-        {
-            p = r * cols + c;
-
-            // Check for valid pointer position.
-            PREPROCESSING_DEF_CHECK_POINTER(src1, p, size)
-            PREPROCESSING_DEF_CHECK_POINTER(src2, p, size)
-            PREPROCESSING_DEF_CHECK_POINTER(dst, p, size)
-
-            dst[p] = eve_fp_subtract32(src1[p], src2[p]);
-
-            if (dst[p] == EVE_FP32_NAN)
-            {
-                status = PREPROCESSING_INVALID_NUMBER;
-            }
-        }
+        status = PREPROCESSING_INVALID_NUMBER;
     }
 
     return status;
@@ -122,9 +130,12 @@ int preprocessing_arith_subtractImages(uint32_t sdSrc1, uint32_t sdSrc2,
 int preprocessing_arith_multiplyImages(uint32_t sdSrc1, uint32_t sdSrc2,
         uint16_t rows, uint16_t cols, uint32_t sdDst)
 {
+    PREPROCESSING_PROF_KERNEL(2 * PREPROCESSING_PROF_FRAME(rows, cols),
+            PREPROCESSING_PROF_FRAME(rows, cols),
+            (uint64_t)(rows) * cols, 1);
+
     int status = PREPROCESSING_SUCCESSFUL;
     unsigned int size = (unsigned int)(rows) * cols;
-    unsigned int p = 0;
 
     const int32_t* src1 = preprocessing_vmem_getDataAddress(sdSrc1);
     const int32_t* src2 = preprocessing_vmem_getDataAddress(sdSrc2);
@@ -138,25 +149,15 @@ int preprocessing_arith_multiplyImages(uint32_t sdSrc1, uint32_t sdSrc2,
         return PREPROCESSING_INVALID_SIZE;
     }
 
+    // Check for valid pointer position.
+    PREPROCESSING_DEF_CHECK_POINTER(src1, 0, size)
+    PREPROCESSING_DEF_CHECK_POINTER(src2, 0, size)
+    PREPROCESSING_DEF_CHECK_POINTER(dst, 0, size)
+
     // Process.
-    for (unsigned int r = 0; r < rows; r++)
+    if (preprocessing_kernel_backend()->multiply(src1, src2, dst, size))
     {
-        for (unsigned int c = 0; c < cols; c++)
-        {
-            p = r * cols + c;
-
-            // Check for valid pointer position.
-            PREPROCESSING_DEF_CHECK_POINTER(src1, p, size)
-            PREPROCESSING_DEF_CHECK_POINTER(src2, p, size)
-            PREPROCESSING_DEF_CHECK_POINTER(dst, p, size)
-
-            dst[p] = eve_fp_multiply32(src1[p], src2[p], FP32_FWL);
-
-            if (dst[p] == EVE_FP32_NAN)
-            {
-                status = PREPROCESSING_INVALID_NUMBER;
-            }
-        }
+        status = PREPROCESSING_INVALID_NUMBER;
     }
 
     return status;
@@ -167,6 +168,10 @@ int preprocessing_arith_multiplyImages(uint32_t sdSrc1, uint32_t sdSrc2,
 int preprocessing_arith_divideImages(uint32_t sdSrc1, uint32_t sdSrc2,
         uint16_t rows, uint16_t cols, uint32_t sdDst)
 {
+    PREPROCESSING_PROF_KERNEL(2 * PREPROCESSING_PROF_FRAME(rows, cols),
+            PREPROCESSING_PROF_FRAME(rows, cols),
+            (uint64_t)(rows) * cols, 1);
+
     int status = PREPROCESSING_SUCCESSFUL;
     unsigned int size = (unsigned int)(rows) * cols;
     unsigned int p = 0;
@@ -212,9 +217,12 @@ int preprocessing_arith_divideImages(uint32_t sdSrc1, uint32_t sdSrc2,
 int preprocessing_arith_addScalar(uint32_t sdSrc, uint16_t rows, uint16_t cols,
         int32_t scalar, uint32_t sdDst)
 {
+    PREPROCESSING_PROF_KERNEL(PREPROCESSING_PROF_FRAME(rows, cols),
+            PREPROCESSING_PROF_FRAME(rows, cols),
+            (uint64_t)(rows) * cols, 1);
+
     int status = PREPROCESSING_SUCCESSFUL;
     unsigned int size = (unsigned int)(rows) * cols;
-    unsigned int p = 0;
 
     const int32_t* src = preprocessing_vmem_getDataAddress(sdSrc);
     int32_t* dst = preprocessing_vmem_getDataAddress(sdDst);
@@ -226,26 +234,14 @@ int preprocessing_arith_addScalar(uint32_t sdSrc, uint16_t rows, uint16_t cols,
         return PREPROCESSING_INVALID_SIZE;
     }
 
+    // Check for valid pointer position.
+    PREPROCESSING_DEF_CHECK_POINTER(src, 0, size)
+    PREPROCESSING_DEF_CHECK_POINTER(dst, 0, size)
+
     // Process.
-    for (unsigned int r = 0; r < rows; r++)
+    if (preprocessing_kernel_backend()->addScalar(src, scalar, dst, size))
     {
-        for (unsigned int c = 0; c < cols; c++)
-        {
-            p = r * cols + c;
-
-            // Check for valid pointer position.
-            PREPROCESSING_DEF_CHECK_POINTER(src, p, size)
-            PREPROCESSING_DEF_CHECK_POINTER(dst, p, size)
-
-            dst[p] = eve_fp_add32(src[p], scalar);
-
-
-
-            if (dst[p] == EVE_FP32_NAN)
-            {
-                status = PREPROCESSING_INVALID_NUMBER;
-            }
-        }
+        status = PREPROCESSING_INVALID_NUMBER;
     }
 
     return status;
@@ -256,9 +252,12 @@ int preprocessing_arith_addScalar(uint32_t sdSrc, uint16_t rows, uint16_t cols,
 int preprocessing_arith_subtractScalar(uint32_t sdSrc, uint16_t rows,
         uint16_t cols, int32_t scalar, uint32_t sdDst)
 {
+    PREPROCESSING_PROF_KERNEL(PREPROCESSING_PROF_FRAME(rows, cols),
+            PREPROCESSING_PROF_FRAME(rows, cols),
+            (uint64_t)(rows) * cols, 1);
+
     int status = PREPROCESSING_SUCCESSFUL;
     unsigned int size = (unsigned int)(rows) * cols;
-    unsigned int p = 0;
 
     const int32_t* src = preprocessing_vmem_getDataAddress(sdSrc);
     int32_t* dst = preprocessing_vmem_getDataAddress(sdDst);
@@ -270,24 +269,14 @@ int preprocessing_arith_subtractScalar(uint32_t sdSrc, uint16_t rows,
         return PREPROCESSING_INVALID_SIZE;
     }
 
+    // Check for valid pointer position.
+    PREPROCESSING_DEF_CHECK_POINTER(src, 0, size)
+    PREPROCESSING_DEF_CHECK_POINTER(dst, 0, size)
+
     // Process.
-    for (unsigned int r = 0; r < rows; r++)
+    if (preprocessing_kernel_backend()->subtractScalar(src, scalar, dst, size))
     {
-        for (unsigned int c = 0; c < cols; c++)
-        {
-            p = r * cols + c;
-
-            // Check for valid pointer position.
-            PREPROCESSING_DEF_CHECK_POINTER(src, p, size)
-            PREPROCESSING_DEF_CHECK_POINTER(dst, p, size)
-
-            dst[p] = eve_fp_subtract32(src[p], scalar);
-
-            if (dst[p] == EVE_FP32_NAN)
-            {
-                status = PREPROCESSING_INVALID_NUMBER;
-            }
-        }
+        status = PREPROCESSING_INVALID_NUMBER;
     }
 
     return status;
@@ -298,9 +287,12 @@ int preprocessing_arith_subtractScalar(uint32_t sdSrc, uint16_t rows,
 int preprocessing_arith_multiplyScalar(uint32_t sdSrc, uint16_t rows,
         uint16_t cols, int32_t scalar, uint32_t sdDst)
 {
+    PREPROCESSING_PROF_KERNEL(PREPROCESSING_PROF_FRAME(rows, cols),
+            PREPROCESSING_PROF_FRAME(rows, cols),
+            (uint64_t)(rows) * cols, 1);
+
     int status = PREPROCESSING_SUCCESSFUL;
     unsigned int size = (unsigned int)(rows) * cols;
-    unsigned int p = 0;
 
     const int32_t* src = preprocessing_vmem_getDataAddress(sdSrc);
     int32_t* dst = preprocessing_vmem_getDataAddress(sdDst);
@@ -312,24 +304,14 @@ int preprocessing_arith_multiplyScalar(uint32_t sdSrc, uint16_t rows,
         return PREPROCESSING_INVALID_SIZE;
     }
 
+    // Check for valid pointer position.
+    PREPROCESSING_DEF_CHECK_POINTER(src, 0, size)
+    PREPROCESSING_DEF_CHECK_POINTER(dst, 0, size)
+
     // Process.
-    for (unsigned int r = 0; r < rows; r++)
+    if (preprocessing_kernel_backend()->multiplyScalar(src, scalar, dst, size))
     {
-        for (unsigned int c = 0; c < cols; c++)
-        {
-            p = r * cols + c;
-
-            // Check for valid pointer position.
-            PREPROCESSING_DEF_CHECK_POINTER(src, p, size)
-            PREPROCESSING_DEF_CHECK_POINTER(dst, p, size)
-
-            dst[p] = eve_fp_multiply32(src[p], scalar, FP32_FWL);
-
-            if (dst[p] == EVE_FP32_NAN)
-            {
-                status = PREPROCESSING_INVALID_NUMBER;
-            }
-        }
+        status = PREPROCESSING_INVALID_NUMBER;
     }
 
     return status;
@@ -340,6 +322,10 @@ int preprocessing_arith_multiplyScalar(uint32_t sdSrc, uint16_t rows,
 int preprocessing_arith_divideScalar(uint32_t sdSrc, uint16_t rows,
         uint16_t cols, int32_t scalar, uint32_t sdDst)
 {
+    PREPROCESSING_PROF_KERNEL(PREPROCESSING_PROF_FRAME(rows, cols),
+            PREPROCESSING_PROF_FRAME(rows, cols),
+            (uint64_t)(rows) * cols, 1);
+
     int status = PREPROCESSING_SUCCESSFUL;
     unsigned int size = (unsigned int)(rows) * cols;
     unsigned int p = 0;
@@ -388,6 +374,8 @@ int preprocessing_arith_divideScalar(uint32_t sdSrc, uint16_t rows,
 int preprocessing_arith_meanImage(uint32_t sdSrc, uint16_t rows, uint16_t cols,
         uint32_t sdDst)
 {
+    PREPROCESSING_PROF_OPERATION(0, 0);
+
     int status = PREPROCESSING_SUCCESSFUL;
     int32_t* dst = preprocessing_vmem_getDataAddress(sdDst);
     
@@ -414,9 +402,12 @@ int preprocessing_arith_meanImage(uint32_t sdSrc, uint16_t rows, uint16_t cols,
 int preprocessing_arith_sumImage(uint32_t sdSrc, uint16_t rows, uint16_t cols,
         uint32_t sdDst)
 {
+    PREPROCESSING_PROF_KERNEL(PREPROCESSING_PROF_FRAME(rows, cols),
+            sizeof(int32_t),
+            (uint64_t)(rows) * cols, 1);
+
     int status = PREPROCESSING_SUCCESSFUL;
     unsigned int size = (unsigned int)(rows) * cols;
-    unsigned int p = 0;
  
     const int32_t* src = preprocessing_vmem_getDataAddress(sdSrc);
     int32_t* dst = preprocessing_vmem_getDataAddress(sdDst);
@@ -433,27 +424,13 @@ int preprocessing_arith_sumImage(uint32_t sdSrc, uint16_t rows, uint16_t cols,
         return PREPROCESSING_INVALID_ADDRESS;
     }
 
+    // Check for valid pointer position.
+    PREPROCESSING_DEF_CHECK_POINTER(src, 0, size)
+
     // Process.
-    for (unsigned int r = 0; r < rows; r++)
+    if (preprocessing_kernel_backend()->sum(src, size, dst))
     {
-        for (unsigned int c = 0; c < cols; c++)
-        {
-            p = r * cols + c;
-
-            // Check for valid pointer position.
-            PREPROCESSING_DEF_CHECK_POINTER(src, p, size)
-
-            dst[0] = eve_fp_add32(dst[0], src[p]);
-           // printf("numero  = %d\n",  dst[0]);
-            //printf("destino y[%d] = %f\n", p, eve_fp_signed32ToDouble(dst[0], FP32_FWL));
-
-            if (dst[0] == EVE_FP32_NAN)
-
-            {
-
-                return PREPROCESSING_INVALID_NUMBER;
-            }
-        }
+        return PREPROCESSING_INVALID_NUMBER;
     }
 
     return status;
@@ -464,6 +441,8 @@ int preprocessing_arith_sumImage(uint32_t sdSrc, uint16_t rows, uint16_t cols,
 int preprocessing_arith_meanColumns(uint32_t sdSrc, uint16_t rows,
         uint16_t cols, uint32_t sdDst)
 {
+    PREPROCESSING_PROF_OPERATION(0, 0);
+
     int status = 0;
 
     int32_t* dst = preprocessing_vmem_getDataAddress(sdDst);
@@ -494,6 +473,10 @@ int preprocessing_arith_meanColumns(uint32_t sdSrc, uint16_t rows,
 int preprocessing_arith_sumColumns(uint32_t sdSrc, uint16_t rows,
         uint16_t cols, uint32_t sdDst)
 {
+    PREPROCESSING_PROF_KERNEL(PREPROCESSING_PROF_FRAME(rows, cols),
+            PREPROCESSING_PROF_FRAME(1, cols),
+            (uint64_t)(rows) * cols, 1);
+
     int status = PREPROCESSING_SUCCESSFUL;
     unsigned int size = (unsigned int)(rows) * cols;
     unsigned int p = 0;
@@ -537,6 +520,10 @@ int preprocessing_arith_sumColumns(uint32_t sdSrc, uint16_t rows,
 int preprocessing_arith_rootMeanSquare(uint32_t sdSrc, uint16_t rows,
         uint16_t cols, uint32_t sdDst)
 {
+    PREPROCESSING_PROF_KERNEL(PREPROCESSING_PROF_FRAME(rows, cols),
+            sizeof(int32_t),
+            (uint64_t)(rows) * cols, 2);
+
     unsigned int size = (unsigned int)(rows) * cols;
     unsigned int p = 0;
     int32_t square = 0;
@@ -596,6 +583,10 @@ int preprocessing_arith_rootMeanSquare(uint32_t sdSrc, uint16_t rows,
 int preprocessing_arith_squareRootImage(uint32_t sdSrc, uint16_t rows,
         uint16_t cols, uint32_t sdDst)
 {
+    PREPROCESSING_PROF_KERNEL(PREPROCESSING_PROF_FRAME(rows, cols),
+            PREPROCESSING_PROF_FRAME(rows, cols),
+            (uint64_t)(rows) * cols, 1);
+
     int status = PREPROCESSING_SUCCESSFUL;
     unsigned int size = (unsigned int)(rows) * cols;
     unsigned int p = 0;
@@ -646,9 +637,12 @@ int preprocessing_arith_squareRootImage(uint32_t sdSrc, uint16_t rows,
 int preprocessing_arith_logarithm10Image(uint32_t sdSrc, uint16_t rows,
         uint16_t cols, uint32_t sdDst)
 {
+    PREPROCESSING_PROF_KERNEL(PREPROCESSING_PROF_FRAME(rows, cols),
+            PREPROCESSING_PROF_FRAME(rows, cols),
+            (uint64_t)(rows) * cols, 1);
+
     int status = PREPROCESSING_SUCCESSFUL;
     unsigned int size = (unsigned int)(rows) * cols;
-    unsigned int p = 0;
 
     const int32_t* src = preprocessing_vmem_getDataAddress(sdSrc);
     int32_t* dst = preprocessing_vmem_getDataAddress(sdDst);
@@ -660,32 +654,14 @@ int preprocessing_arith_logarithm10Image(uint32_t sdSrc, uint16_t rows,
         return PREPROCESSING_INVALID_SIZE;
     }
 
+    // Check for valid pointer position.
+    PREPROCESSING_DEF_CHECK_POINTER(src, 0, size)
+    PREPROCESSING_DEF_CHECK_POINTER(dst, 0, size)
+
     // Process.
-    for (unsigned int r = 0; r < rows; r++)
+    if (preprocessing_kernel_backend()->log10(src, dst, size))
     {
-        for (unsigned int c = 0; c < cols; c++)
-        {
-            p = r * cols + c;
-
-            // Check for valid pointer position.
-            PREPROCESSING_DEF_CHECK_POINTER(src, p, size)
-            PREPROCESSING_DEF_CHECK_POINTER(dst, p, size)
-
-            // Note: Here we use real numbers and so the logarithm is defined
-            //       for positive numbers only. For negative numbers we can use
-            //       the complex logarithm clog10 in complex.h (C99).
-            if (src[p] <= 0)
-            {
-                dst[p] = EVE_FP32_NAN;
-                status = PREPROCESSING_INVALID_NUMBER;
-            }
-            else
-            {
-                dst[p] = eve_fp_double2s32(
-                        log10(eve_fp_signed32ToDouble(src[p], FP32_FWL)),
-                        FP32_FWL);
-            }
-        }
+        status = PREPROCESSING_INVALID_NUMBER;
     }
 
     return status;
@@ -697,70 +673,110 @@ int preprocessing_arith_multiplyMatrices(uint32_t sdSrc1, uint16_t rows1,
         uint16_t cols1, uint32_t sdSrc2, uint16_t rows2, uint16_t cols2,
         uint32_t sdDst)
 {
-    int status = PREPROCESSING_SUCCESSFUL;
-    unsigned int size1 = (unsigned int)(rows1) * cols1;
-    unsigned int size2 = (unsigned int)(rows2) * cols2;
-    unsigned int sizeDst = (unsigned int)(rows1) * cols2;
-    unsigned int p1 = 0;
-    unsigned int p2 = 0;
-    unsigned int pDst = 0;
-    int32_t prod = 0;
+    PREPROCESSING_PROF_KERNEL(PREPROCESSING_PROF_FRAME(rows1, cols1)
+            + PREPROCESSING_PROF_FRAME(rows2, cols2),
+            PREPROCESSING_PROF_FRAME(rows1, cols2),
+            (uint64_t)(rows1) * cols2, 2 * cols1);
+
+    unsigned int tileRows = (rows1 + PREPROCESSING_ARITH_TILE_ROWS - 1)
+            / PREPROCESSING_ARITH_TILE_ROWS;
+    unsigned int tileCols = (cols2 + PREPROCESSING_ARITH_TILE_COLS - 1)
+            / PREPROCESSING_ARITH_TILE_COLS;
+    int invalid = 0;
 
     const int32_t* src1 = preprocessing_vmem_getDataAddress(sdSrc1);
     const int32_t* src2 = preprocessing_vmem_getDataAddress(sdSrc2);
     int32_t* dst = preprocessing_vmem_getDataAddress(sdDst);
-    
+
     // Check whether given rows and columns are in a valid range.
     if ((!preprocessing_vmem_isProcessingSizeValid(sdSrc1, rows1, cols1))
             || (!preprocessing_vmem_isProcessingSizeValid(sdSrc2, rows2,
                     cols2))
             || (!preprocessing_vmem_isProcessingSizeValid(sdDst, rows1,
-                    cols2)))
+                    cols2))
+            || (cols1 != rows2))
     {
         return PREPROCESSING_INVALID_SIZE;
     }
 
-    // Process.
-    for (unsigned int r1 = 0; r1 < rows1; r1++)
+    // Process, one tile of the result at a time.
+    PREPROCESSING_DEF_PARALLEL_FOR_OR(invalid)
+    for (unsigned int t = 0; t < tileRows * tileCols; t++)
     {
-        for (unsigned int c1 = 0; c1 < cols2; c1++)
-        {
-            pDst = r1 * cols2 + c1;
+        invalid |= arith_multiplyTile(src1, cols1, src2, cols2,
+                (t / tileCols) * PREPROCESSING_ARITH_TILE_ROWS,
+                (t % tileCols) * PREPROCESSING_ARITH_TILE_COLS, rows1, dst);
+    }
 
-            PREPROCESSING_DEF_CHECK_POINTER(dst, pDst, sizeDst)
+    return invalid ? PREPROCESSING_INVALID_NUMBER : PREPROCESSING_SUCCESSFUL;
+}
 
-            if (dst[pDst] == EVE_FP32_NAN)
-            {
-                break;
-            }
+/* PRIVATE IMPLEMENTATION ****************************************************/
 
-            for (unsigned int r2 = 0; r2 < rows2; r2++)
-            {
-                p1 = r1 * cols1 + r2;
-                p2 = r2 * cols2 + c1;
+static int arith_multiplyTile(const int32_t* src1, uint16_t cols1,
+        const int32_t* src2, uint16_t cols2, unsigned int row0,
+        unsigned int col0, uint16_t rows1, int32_t* dst)
+{
+    int64_t sum[PREPROCESSING_ARITH_TILE_ROWS][PREPROCESSING_ARITH_TILE_COLS];
+    int64_t bad[PREPROCESSING_ARITH_TILE_ROWS][PREPROCESSING_ARITH_TILE_COLS];
+    unsigned int h = rows1 - row0;
+    unsigned int w = cols2 - col0;
+    int invalid = 0;
 
-                PREPROCESSING_DEF_CHECK_POINTER(src1, p1, size1)
-                PREPROCESSING_DEF_CHECK_POINTER(src2, p2, size2)
+    h = (h > PREPROCESSING_ARITH_TILE_ROWS) ? PREPROCESSING_ARITH_TILE_ROWS : h;
+    w = (w > PREPROCESSING_ARITH_TILE_COLS) ? PREPROCESSING_ARITH_TILE_COLS : w;
 
-                prod = eve_fp_multiply32(src1[p1], src2[p2], FP32_FWL);
+    // The result is added to the destination. A NaN destination stays NaN.
+    for (unsigned int i = 0; i < h; i++)
+    {
+        for (unsigned int j = 0; j < w; j++)
+        {
+            sum[i][j] = dst[(size_t)(row0 + i) * cols2 + col0 + j];
+            bad[i][j] = (sum[i][j] == EVE_FP32_NAN);
+        }
+    }
 
-                if (prod == EVE_FP32_NAN)
-                {
-                    status = PREPROCESSING_INVALID_NUMBER;
-                    dst[pDst] = EVE_FP32_NAN;
-                    break;
-                }
+    // The terms are added in the order of the inner index, as
+    // eve_fp_add32() would, so every partial sum is checked for overflow.
+    for (unsigned int k0 = 0; k0 < cols1; k0 += PREPROCESSING_ARITH_TILE_DEPTH)
+    {
+        unsigned int k1 = k0 + PREPROCESSING_ARITH_TILE_DEPTH;
 
-                dst[pDst] = eve_fp_add32(dst[pDst], prod);
+        k1 = (k1 > cols1) ? cols1 : k1;
 
-                if (dst[pDst] == EVE_FP32_NAN)
+        for (unsigned int i = 0; i < h; i++)
+        {
+            const int32_t* a = src1 + (size_t)(row0 + i) * cols1;
+            int64_t* s = sum[i];
+            int64_t* b = bad[i];
+
+            for (unsigned int k = k0; k < k1; k++)
+            {
+                const int32_t* row = src2 + (size_t)(k) * cols2 + col0;
+                int64_t factor = a[k];
+
+                for (unsigned int j = 0; j < w; j++)
                 {
-                    status = PREPROCESSING_INVALID_NUMBER;
-                    break;
+                    int64_t prod = (factor * row[j]) >> FP32_FWL;
+
+                    s[j] += prod;
+                    b[j] |= (prod < EVE_FP32_MIN) | (prod > EVE_FP32_MAX)
+                            | (s[j] < EVE_FP32_MIN) | (s[j] > EVE_FP32_MAX);
                 }
             }
         }
     }
 
-    return status;
+    for (unsigned int i = 0; i < h; i++)
+    {
+        for (unsigned int j = 0; j < w; j++)
+        {
+            int32_t* d = dst + (size_t)(row0 + i) * cols2 + col0 + j;
+
+            invalid |= (bad[i][j] != 0) && (*d != EVE_FP32_NAN);
+            *d = bad[i][j] ? EVE_FP32_NAN : (int32_t)(sum[i][j]);
+        }
+    }
+
+    return invalid;
 }
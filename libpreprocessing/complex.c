@@ -0,0 +1,250 @@
+/*
+ * Project: Solar Orbiter - PHI (SO/PHI)
+ * Module:  Preprocessing - a library for image pre-processing.
+ *
+ * Copyright (C) 2016, Max Planck Institute for Solar System Research
+ */
+
+/**
+ * @file
+ *
+ * This file contains implementation of pixel by pixel operations on complex
+ * images.
+ */
+
+#include "preprocessing/complex.h"
+
+#include "preprocessing/def.h"
+#include "preprocessing/prof.h"
+#include "preprocessing/vmem.h"
+
+/* from libeve */
+#include "../libeve/eve/fixed_point.h"
+
+/* from std c */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* PRIVATE INTERFACE *********************************************************/
+
+/**
+ * Multiply two complex images pixel by pixel.
+ *
+ * @param re1       the real part of image 1.
+ * @param im1       the imaginary part of image 1.
+ * @param re2       the real part of image 2.
+ * @param im2       the imaginary part of image 2.
+ * @param size      the number of pixels.
+ * @param conjugate 1 to multiply by the complex conjugate of image 2.
+ * @param dstRe     the real part of result image.
+ * @param dstIm     the imaginary part of result image.
+ *
+ * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+ */
+static int complex_multiply(const int32_t* re1, const int32_t* im1,
+        const int32_t* re2, const int32_t* im2, unsigned int size,
+        int conjugate, int32_t* dstRe, int32_t* dstIm);
+
+/**
+ * Round a value to a 24.8 fixed point pixel.
+ *
+ * @param value the value in units of the 24.8 fractional part.
+ *
+ * @return the pixel, NaN if out of range.
+ */
+static int32_t complex_toFixed(double value);
+
+/* PUBLIC IMPLEMENTATION *****************************************************/
+
+int preprocessing_complex_multiply(uint32_t sdSrcRe1, uint32_t sdSrcIm1,
+        uint32_t sdSrcRe2, uint32_t sdSrcIm2, uint16_t rows, uint16_t cols,
+        uint32_t sdDstRe, uint32_t sdDstIm)
+{
+    PREPROCESSING_PROF_OPERATION(4 * PREPROCESSING_PROF_FRAME(rows, cols),
+            2 * PREPROCESSING_PROF_FRAME(rows, cols));
+
+    const int32_t* re1 = preprocessing_vmem_getDataAddress(sdSrcRe1);
+    const int32_t* im1 = preprocessing_vmem_getDataAddress(sdSrcIm1);
+    const int32_t* re2 = preprocessing_vmem_getDataAddress(sdSrcRe2);
+    const int32_t* im2 = preprocessing_vmem_getDataAddress(sdSrcIm2);
+    int32_t* dstRe = preprocessing_vmem_getDataAddress(sdDstRe);
+    int32_t* dstIm = preprocessing_vmem_getDataAddress(sdDstIm);
+
+    // Check whether given rows and columns are in a valid range.
+    if ((!preprocessing_vmem_isProcessingSizeValid(sdSrcRe1, rows, cols))
+            || (!preprocessing_vmem_isProcessingSizeValid(sdSrcIm1, rows, cols))
+            || (!preprocessing_vmem_isProcessingSizeValid(sdSrcRe2, rows, cols))
+            || (!preprocessing_vmem_isProcessingSizeValid(sdSrcIm2, rows, cols))
+            || (!preprocessing_vmem_isProcessingSizeValid(sdDstRe, rows, cols))
+            || (!preprocessing_vmem_isProcessingSizeValid(sdDstIm, rows, cols)))
+    {
+        return PREPROCESSING_INVALID_SIZE;
+    }
+
+    return complex_multiply(re1, im1, re2, im2, (unsigned int)(rows) * cols,
+            0, dstRe, dstIm);
+}
+
+/*****************************************************************************/
+
+int preprocessing_complex_multiplyConjugate(uint32_t sdSrcRe1,
+        uint32_t sdSrcIm1, uint32_t sdSrcRe2, uint32_t sdSrcIm2,
+        uint16_t rows, uint16_t cols, uint32_t sdDstRe, uint32_t sdDstIm)
+{
+    PREPROCESSING_PROF_OPERATION(4 * PREPROCESSING_PROF_FRAME(rows, cols),
+            2 * PREPROCESSING_PROF_FRAME(rows, cols));
+
+    const int32_t* re1 = preprocessing_vmem_getDataAddress(sdSrcRe1);
+    const int32_t* im1 = preprocessing_vmem_getDataAddress(sdSrcIm1);
+    const int32_t* re2 = preprocessing_vmem_getDataAddress(sdSrcRe2);
+    const int32_t* im2 = preprocessing_vmem_getDataAddress(sdSrcIm2);
+    int32_t* dstRe = preprocessing_vmem_getDataAddress(sdDstRe);
+    int32_t* dstIm = preprocessing_vmem_getDataAddress(sdDstIm);
+
+    // Check whether given rows and columns are in a valid range.
+    if ((!preprocessing_vmem_isProcessingSizeValid(sdSrcRe1, rows, cols))
+            || (!preprocessing_vmem_isProcessingSizeValid(sdSrcIm1, rows, cols))
+            || (!preprocessing_vmem_isProcessingSizeValid(sdSrcRe2, rows, cols))
+            || (!preprocessing_vmem_isProcessingSizeValid(sdSrcIm2, rows, cols))
+            || (!preprocessing_vmem_isProcessingSizeValid(sdDstRe, rows, cols))
+            || (!preprocessing_vmem_isProcessingSizeValid(sdDstIm, rows, cols)))
+    {
+        return PREPROCESSING_INVALID_SIZE;
+    }
+
+    return complex_multiply(re1, im1, re2, im2, (unsigned int)(rows) * cols,
+            1, dstRe, dstIm);
+}
+
+/*****************************************************************************/
+
+int preprocessing_complex_abs(uint32_t sdSrcRe, uint32_t sdSrcIm,
+        uint16_t rows, uint16_t cols, uint32_t sdDst)
+{
+    PREPROCESSING_PROF_OPERATION(2 * PREPROCESSING_PROF_FRAME(rows, cols),
+            PREPROCESSING_PROF_FRAME(rows, cols));
+
+    unsigned int size = (unsigned int)(rows) * cols;
+    int invalid = 0;
+
+    const int32_t* re = preprocessing_vmem_getDataAddress(sdSrcRe);
+    const int32_t* im = preprocessing_vmem_getDataAddress(sdSrcIm);
+    int32_t* dst = preprocessing_vmem_getDataAddress(sdDst);
+
+    // Check whether given rows and columns are in a valid range.
+    if ((!preprocessing_vmem_isProcessingSizeValid(sdSrcRe, rows, cols))
+            || (!preprocessing_vmem_isProcessingSizeValid(sdSrcIm, rows, cols))
+            || (!preprocessing_vmem_isProcessingSizeValid(sdDst, rows, cols)))
+    {
+        return PREPROCESSING_INVALID_SIZE;
+    }
+
+    // Process.
+    PREPROCESSING_DEF_PARALLEL_FOR_OR(invalid)
+    for (unsigned int p = 0; p < size; p++)
+    {
+        if ((re[p] == EVE_FP32_NAN) || (im[p] == EVE_FP32_NAN))
+        {
+            dst[p] = EVE_FP32_NAN;
+        }
+        else
+        {
+            dst[p] = complex_toFixed(hypot((double)(re[p]), (double)(im[p])));
+        }
+
+        invalid |= (dst[p] == EVE_FP32_NAN);
+    }
+
+    return invalid ? PREPROCESSING_INVALID_NUMBER : PREPROCESSING_SUCCESSFUL;
+}
+
+/*****************************************************************************/
+
+int preprocessing_complex_phase(uint32_t sdSrcRe, uint32_t sdSrcIm,
+        uint16_t rows, uint16_t cols, uint32_t sdDst)
+{
+    PREPROCESSING_PROF_OPERATION(2 * PREPROCESSING_PROF_FRAME(rows, cols),
+            PREPROCESSING_PROF_FRAME(rows, cols));
+
+    unsigned int size = (unsigned int)(rows) * cols;
+    int invalid = 0;
+
+    const int32_t* re = preprocessing_vmem_getDataAddress(sdSrcRe);
+    const int32_t* im = preprocessing_vmem_getDataAddress(sdSrcIm);
+    int32_t* dst = preprocessing_vmem_getDataAddress(sdDst);
+
+    // Check whether given rows and columns are in a valid range.
+    if ((!preprocessing_vmem_isProcessingSizeValid(sdSrcRe, rows, cols))
+            || (!preprocessing_vmem_isProcessingSizeValid(sdSrcIm, rows, cols))
+            || (!preprocessing_vmem_isProcessingSizeValid(sdDst, rows, cols)))
+    {
+        return PREPROCESSING_INVALID_SIZE;
+    }
+
+    // Process.
+    PREPROCESSING_DEF_PARALLEL_FOR_OR(invalid)
+    for (unsigned int p = 0; p < size; p++)
+    {
+        if ((re[p] == EVE_FP32_NAN) || (im[p] == EVE_FP32_NAN))
+        {
+            dst[p] = EVE_FP32_NAN;
+            invalid |= 1;
+        }
+        else
+        {
+            dst[p] = complex_toFixed(atan2((double)(im[p]), (double)(re[p]))
+                    * (double)(1 << FP32_FWL));
+        }
+    }
+
+    return invalid ? PREPROCESSING_INVALID_NUMBER : PREPROCESSING_SUCCESSFUL;
+}
+
+/* PRIVATE IMPLEMENTATION ****************************************************/
+
+static int complex_multiply(const int32_t* re1, const int32_t* im1,
+        const int32_t* re2, const int32_t* im2, unsigned int size,
+        int conjugate, int32_t* dstRe, int32_t* dstIm)
+{
+    int invalid = 0;
+    int64_t sign = conjugate ? -1 : 1;
+
+    // Process.
+    PREPROCESSING_DEF_PARALLEL_FOR_OR(invalid)
+    for (unsigned int p = 0; p < size; p++)
+    {
+        // (a + ib)(c + id) = (ac - bd) + i(ad + bc), d negated for conjugate
+        int64_t a = re1[p];
+        int64_t b = im1[p];
+        int64_t c = re2[p];
+        int64_t d = sign * im2[p];
+        int nan = (re1[p] == EVE_FP32_NAN) || (im1[p] == EVE_FP32_NAN)
+                || (re2[p] == EVE_FP32_NAN) || (im2[p] == EVE_FP32_NAN);
+
+        int64_t re = ((a * c) >> FP32_FWL) - ((b * d) >> FP32_FWL);
+        int64_t im = ((a * d) >> FP32_FWL) + ((b * c) >> FP32_FWL);
+
+        dstRe[p] = (nan || (re < EVE_FP32_MIN) || (re > EVE_FP32_MAX))
+                ? EVE_FP32_NAN : (int32_t)(re);
+        dstIm[p] = (nan || (im < EVE_FP32_MIN) || (im > EVE_FP32_MAX))
+                ? EVE_FP32_NAN : (int32_t)(im);
+        invalid |= (dstRe[p] == EVE_FP32_NAN) | (dstIm[p] == EVE_FP32_NAN);
+    }
+
+    return invalid ? PREPROCESSING_INVALID_NUMBER : PREPROCESSING_SUCCESSFUL;
+}
+
+/*****************************************************************************/
+
+static int32_t complex_toFixed(double value)
+{
+    value = floor(value + 0.5);
+
+    if ((value < EVE_FP32_MIN) || (value > EVE_FP32_MAX))
+    {
+        return EVE_FP32_NAN;
+    }
+
+    return (int32_t)(value);
+}
@@ -0,0 +1,555 @@
+/*
+ * Project: Solar Orbiter - PHI (SO/PHI)
+ * Module:  Preprocessing - a library for image pre-processing.
+ *
+ * Copyright (C) 2016, Max Planck Institute for Solar System Research
+ */
+
+/**
+ * @file
+ *
+ * This file contains implementation of the lazily evaluated elementwise
+ * expressions.
+ *
+ * A row of the window is evaluated block by block. The nodes of a block are
+ * run in the order they were added, each one on the values of its operands
+ * in the block, the node evaluated writes straight to the result. Frames are
+ * read in place and constants are filled once per row.
+ */
+
+#include "preprocessing/expr.h"
+
+#include "preprocessing/def.h"
+#include "preprocessing/kernel.h"
+#include "preprocessing/prof.h"
+#include "preprocessing/vmem.h"
+
+/* from libeve */
+#include "../libeve/eve/fixed_point.h"
+
+/* from std c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* PRIVATE INTERFACE *********************************************************/
+
+/**
+ * Add a node.
+ *
+ * @param expr the expression.
+ * @param op   the operation.
+ * @param a    the first operand, -1 for none.
+ * @param b    the second operand, -1 for none.
+ * @param c    the third operand, -1 for none.
+ * @param n    the number of operands.
+ *
+ * @return the node, -1 on failure.
+ */
+static int expr_add(struct preprocessing_expr_Expr* expr, int op, int a,
+        int b, int c, unsigned int n);
+
+/**
+ * Evaluate one row of the window.
+ *
+ * @param expr   the expression.
+ * @param node   the node to evaluate.
+ * @param needed 1 for the nodes the node depends on, 0 otherwise.
+ * @param src    the pixel at the window start of each frame node.
+ * @param y      the row of the window.
+ * @param dst    the pixel at the window start of the result.
+ *
+ * @return 1 if a node gave a NaN pixel, 0 otherwise.
+ */
+static int expr_evaluateRow(const struct preprocessing_expr_Expr* expr,
+        int node, const unsigned char* needed, const int32_t* const* src,
+        unsigned int y, int32_t* dst);
+
+/**
+ * Evaluate one node of a block.
+ *
+ * @param backend the kernel backend.
+ * @param n       the node.
+ * @param in      the values of all nodes of the block.
+ * @param nodes   all nodes, a constant second operand is passed as scalar.
+ * @param dst     the value of the node.
+ * @param count   the number of pixels of the block.
+ *
+ * @return 1 if a result pixel became NaN, 0 otherwise.
+ */
+static int expr_evaluateNode(const struct preprocessing_kernel_Backend* backend,
+        const struct preprocessing_expr_Node* n, const int32_t* const* in,
+        const struct preprocessing_expr_Node* nodes, int32_t* dst,
+        unsigned int count);
+
+/* PUBLIC IMPLEMENTATION *****************************************************/
+
+void preprocessing_expr_init(struct preprocessing_expr_Expr* expr,
+        uint16_t rows, uint16_t cols)
+{
+    expr->rows = rows;
+    expr->cols = cols;
+    expr->windowRows = rows;
+    expr->windowCols = cols;
+    expr->status = PREPROCESSING_SUCCESSFUL;
+    expr->nodes = 0;
+}
+
+/*****************************************************************************/
+
+int preprocessing_expr_setWindow(struct preprocessing_expr_Expr* expr,
+        uint16_t rows, uint16_t cols)
+{
+    // Check parameters.
+    if ((rows == 0) || (cols == 0) || (rows > expr->rows)
+            || (cols > expr->cols))
+    {
+        printf("Window %u x %u out of range.\n", rows, cols);
+        return PREPROCESSING_INVALID_SIZE;
+    }
+
+    expr->windowRows = rows;
+    expr->windowCols = cols;
+
+    return PREPROCESSING_SUCCESSFUL;
+}
+
+/*****************************************************************************/
+
+int preprocessing_expr_frame(struct preprocessing_expr_Expr* expr,
+        uint32_t sdSrc, uint16_t row, uint16_t col)
+{
+    int node = expr_add(expr, PREPROCESSING_EXPR_FRAME, -1, -1, -1, 0);
+
+    if (node >= 0)
+    {
+        expr->node[node].sdSrc = sdSrc;
+        expr->node[node].row = row;
+        expr->node[node].col = col;
+    }
+
+    return node;
+}
+
+/*****************************************************************************/
+
+int preprocessing_expr_constant(struct preprocessing_expr_Expr* expr,
+        int32_t value)
+{
+    int node = expr_add(expr, PREPROCESSING_EXPR_CONSTANT, -1, -1, -1, 0);
+
+    if (node >= 0)
+    {
+        expr->node[node].value = value;
+    }
+
+    return node;
+}
+
+/*****************************************************************************/
+
+int preprocessing_expr_add(struct preprocessing_expr_Expr* expr, int a, int b)
+{
+    return expr_add(expr, PREPROCESSING_EXPR_ADD, a, b, -1, 2);
+}
+
+/*****************************************************************************/
+
+int preprocessing_expr_subtract(struct preprocessing_expr_Expr* expr, int a,
+        int b)
+{
+    return expr_add(expr, PREPROCESSING_EXPR_SUBTRACT, a, b, -1, 2);
+}
+
+/*****************************************************************************/
+
+int preprocessing_expr_multiply(struct preprocessing_expr_Expr* expr, int a,
+        int b)
+{
+    return expr_add(expr, PREPROCESSING_EXPR_MULTIPLY, a, b, -1, 2);
+}
+
+/*****************************************************************************/
+
+int preprocessing_expr_divide(struct preprocessing_expr_Expr* expr, int a,
+        int b)
+{
+    return expr_add(expr, PREPROCESSING_EXPR_DIVIDE, a, b, -1, 2);
+}
+
+/*****************************************************************************/
+
+int preprocessing_expr_addScalar(struct preprocessing_expr_Expr* expr, int a,
+        int32_t scalar)
+{
+    return preprocessing_expr_add(expr, a,
+            preprocessing_expr_constant(expr, scalar));
+}
+
+/*****************************************************************************/
+
+int preprocessing_expr_subtractScalar(struct preprocessing_expr_Expr* expr,
+        int a, int32_t scalar)
+{
+    return preprocessing_expr_subtract(expr, a,
+            preprocessing_expr_constant(expr, scalar));
+}
+
+/*****************************************************************************/
+
+int preprocessing_expr_multiplyScalar(struct preprocessing_expr_Expr* expr,
+        int a, int32_t scalar)
+{
+    return preprocessing_expr_multiply(expr, a,
+            preprocessing_expr_constant(expr, scalar));
+}
+
+/*****************************************************************************/
+
+int preprocessing_expr_divideScalar(struct preprocessing_expr_Expr* expr,
+        int a, int32_t scalar)
+{
+    // Like preprocessing_arith_divideScalar().
+    if (scalar == 0)
+    {
+        printf("Divison by 0 is not allowed.\n");
+
+        if (expr->status == PREPROCESSING_SUCCESSFUL)
+        {
+            expr->status = PREPROCESSING_INVALID_NUMBER;
+        }
+
+        return -1;
+    }
+
+    return preprocessing_expr_divide(expr, a,
+            preprocessing_expr_constant(expr, scalar));
+}
+
+/*****************************************************************************/
+
+int preprocessing_expr_underThresh(struct preprocessing_expr_Expr* expr,
+        int a, int32_t thresh)
+{
+    return expr_add(expr, PREPROCESSING_EXPR_UNDER, a,
+            preprocessing_expr_constant(expr, thresh), -1, 2);
+}
+
+/*****************************************************************************/
+
+int preprocessing_expr_equalThresh(struct preprocessing_expr_Expr* expr,
+        int a, int32_t thresh)
+{
+    return expr_add(expr, PREPROCESSING_EXPR_EQUAL, a,
+            preprocessing_expr_constant(expr, thresh), -1, 2);
+}
+
+/*****************************************************************************/
+
+int preprocessing_expr_overThresh(struct preprocessing_expr_Expr* expr,
+        int a, int32_t thresh)
+{
+    return expr_add(expr, PREPROCESSING_EXPR_OVER, a,
+            preprocessing_expr_constant(expr, thresh), -1, 2);
+}
+
+/*****************************************************************************/
+
+int preprocessing_expr_select(struct preprocessing_expr_Expr* expr, int mask,
+        int a, int b)
+{
+    return expr_add(expr, PREPROCESSING_EXPR_SELECT, mask, a, b, 3);
+}
+
+/*****************************************************************************/
+
+int preprocessing_expr_evaluate(const struct preprocessing_expr_Expr* expr,
+        int node, uint32_t sdDst, uint16_t row, uint16_t col)
+{
+    unsigned char needed[PREPROCESSING_EXPR_MAX_NODES];
+    const int32_t* src[PREPROCESSING_EXPR_MAX_NODES];
+    unsigned int frames = 0;
+    unsigned int ops = 0;
+    int invalid = 0;
+
+    if (expr->status != PREPROCESSING_SUCCESSFUL)
+    {
+        return expr->status;
+    }
+
+    // Check parameters.
+    if ((node < 0) || ((unsigned int)(node) >= expr->nodes))
+    {
+        printf("Invalid expression node: %d.\n", node);
+        return PREPROCESSING_INVALID_NUMBER;
+    }
+
+    int32_t* dst = preprocessing_vmem_getDataAddress(sdDst);
+
+    // Check whether given rows and columns are in a valid range.
+    if ((!preprocessing_vmem_isProcessingSizeValid(sdDst, expr->rows,
+            expr->cols)) || (row + expr->windowRows > expr->rows)
+            || (col + expr->windowCols > expr->cols))
+    {
+        return PREPROCESSING_INVALID_SIZE;
+    }
+
+    if (dst == 0)
+    {
+        return PREPROCESSING_INVALID_ADDRESS;
+    }
+
+    // The operands come before a node, so one pass from the node down
+    // finds all nodes it depends on.
+    memset(needed, 0, sizeof(needed));
+    needed[node] = 1;
+
+    for (int i = node; i >= 0; i--)
+    {
+        const struct preprocessing_expr_Node* n = expr->node + i;
+
+        if (!needed[i])
+        {
+            continue;
+        }
+
+        for (unsigned int o = 0; o < 3; o++)
+        {
+            if (n->operand[o] >= 0)
+            {
+                needed[n->operand[o]] = 1;
+            }
+        }
+
+        if (n->op == PREPROCESSING_EXPR_FRAME)
+        {
+            const int32_t* frame = preprocessing_vmem_getDataAddress(
+                    n->sdSrc);
+
+            if ((!preprocessing_vmem_isProcessingSizeValid(n->sdSrc,
+                    expr->rows, expr->cols))
+                    || (n->row + expr->windowRows > expr->rows)
+                    || (n->col + expr->windowCols > expr->cols))
+            {
+                return PREPROCESSING_INVALID_SIZE;
+            }
+
+            if (frame == 0)
+            {
+                return PREPROCESSING_INVALID_ADDRESS;
+            }
+
+            src[i] = frame + (size_t)(n->row) * expr->cols + n->col;
+            frames++;
+        }
+        else if (n->op != PREPROCESSING_EXPR_CONSTANT)
+        {
+            ops++;
+        }
+    }
+
+    PREPROCESSING_PROF_KERNEL((uint64_t)(frames) * PREPROCESSING_PROF_FRAME(
+            expr->windowRows, expr->windowCols),
+            PREPROCESSING_PROF_FRAME(expr->windowRows, expr->windowCols),
+            (uint64_t)(expr->windowRows) * expr->windowCols, ops);
+
+    dst += (size_t)(row) * expr->cols + col;
+
+    // Process, the rows are spread over all cores.
+    PREPROCESSING_DEF_PARALLEL_FOR_OR(invalid)
+    for (unsigned int y = 0; y < expr->windowRows; y++)
+    {
+        invalid |= expr_evaluateRow(expr, node, needed, src, y, dst);
+    }
+
+    return invalid ? PREPROCESSING_INVALID_NUMBER : PREPROCESSING_SUCCESSFUL;
+}
+
+/* PRIVATE IMPLEMENTATION ****************************************************/
+
+static int expr_add(struct preprocessing_expr_Expr* expr, int op, int a,
+        int b, int c, unsigned int n)
+{
+    int operand[3] = { a, b, c };
+
+    for (unsigned int o = 0; o < n; o++)
+    {
+        // A failed operand has been reported already.
+        if (operand[o] < 0)
+        {
+            return -1;
+        }
+
+        if ((unsigned int)(operand[o]) >= expr->nodes)
+        {
+            printf("Invalid expression node: %d.\n", operand[o]);
+
+            if (expr->status == PREPROCESSING_SUCCESSFUL)
+            {
+                expr->status = PREPROCESSING_INVALID_NUMBER;
+            }
+
+            return -1;
+        }
+    }
+
+    if (expr->nodes >= PREPROCESSING_EXPR_MAX_NODES)
+    {
+        printf("Too many expression nodes: %u.\n", expr->nodes + 1);
+
+        if (expr->status == PREPROCESSING_SUCCESSFUL)
+        {
+            expr->status = PREPROCESSING_NO_MEMORY;
+        }
+
+        return -1;
+    }
+
+    struct preprocessing_expr_Node* node = expr->node + expr->nodes;
+
+    node->op = op;
+    node->operand[0] = a;
+    node->operand[1] = b;
+    node->operand[2] = c;
+    node->sdSrc = 0;
+    node->row = 0;
+    node->col = 0;
+    node->value = 0;
+
+    return (int)(expr->nodes++);
+}
+
+/*****************************************************************************/
+
+static int expr_evaluateRow(const struct preprocessing_expr_Expr* expr,
+        int node, const unsigned char* needed, const int32_t* const* src,
+        unsigned int y, int32_t* dst)
+{
+    const struct preprocessing_kernel_Backend* backend =
+            preprocessing_kernel_backend();
+    int32_t values[PREPROCESSING_EXPR_MAX_NODES][PREPROCESSING_EXPR_BLOCK];
+    const int32_t* in[PREPROCESSING_EXPR_MAX_NODES];
+    size_t stride = (size_t)(y) * expr->cols;
+    int nan = 0;
+
+    for (int i = 0; i <= node; i++)
+    {
+        if (needed[i] && (expr->node[i].op == PREPROCESSING_EXPR_CONSTANT))
+        {
+            for (unsigned int p = 0; p < PREPROCESSING_EXPR_BLOCK; p++)
+            {
+                values[i][p] = expr->node[i].value;
+            }
+
+            in[i] = values[i];
+        }
+    }
+
+    for (unsigned int x = 0; x < expr->windowCols;
+            x += PREPROCESSING_EXPR_BLOCK)
+    {
+        unsigned int count = expr->windowCols - x;
+        int32_t* out = dst + stride + x;
+
+        count = (count > PREPROCESSING_EXPR_BLOCK) ? PREPROCESSING_EXPR_BLOCK
+                : count;
+
+        for (int i = 0; i <= node; i++)
+        {
+            const struct preprocessing_expr_Node* n = expr->node + i;
+
+            if (!needed[i] || (n->op == PREPROCESSING_EXPR_CONSTANT))
+            {
+                continue;
+            }
+
+            if (n->op == PREPROCESSING_EXPR_FRAME)
+            {
+                in[i] = src[i] + stride + x;
+                continue;
+            }
+
+            nan |= expr_evaluateNode(backend, n, in, expr->node,
+                    (i == node) ? out : values[i], count);
+            in[i] = (i == node) ? out : values[i];
+        }
+
+        // A frame or a constant on its own is copied.
+        if ((expr->node[node].op == PREPROCESSING_EXPR_FRAME)
+                || (expr->node[node].op == PREPROCESSING_EXPR_CONSTANT))
+        {
+            for (unsigned int p = 0; p < count; p++)
+            {
+                out[p] = in[node][p];
+                nan |= (out[p] == EVE_FP32_NAN);
+            }
+        }
+    }
+
+    return nan;
+}
+
+/*****************************************************************************/
+
+static int expr_evaluateNode(const struct preprocessing_kernel_Backend* backend,
+        const struct preprocessing_expr_Node* n, const int32_t* const* in,
+        const struct preprocessing_expr_Node* nodes, int32_t* dst,
+        unsigned int count)
+{
+    const int32_t* a = in[n->operand[0]];
+    const int32_t* b = (n->operand[1] >= 0) ? in[n->operand[1]] : 0;
+    const int32_t* c = (n->operand[2] >= 0) ? in[n->operand[2]] : 0;
+    int scalar = (n->operand[1] >= 0)
+            && (nodes[n->operand[1]].op == PREPROCESSING_EXPR_CONSTANT);
+    int32_t value = scalar ? nodes[n->operand[1]].value : 0;
+    int nan = 0;
+
+    switch (n->op)
+    {
+    case PREPROCESSING_EXPR_ADD:
+        return scalar ? backend->addScalar(a, value, dst, count)
+                : backend->add(a, b, dst, count);
+    case PREPROCESSING_EXPR_SUBTRACT:
+        return scalar ? backend->subtractScalar(a, value, dst, count)
+                : backend->subtract(a, b, dst, count);
+    case PREPROCESSING_EXPR_MULTIPLY:
+        return scalar ? backend->multiplyScalar(a, value, dst, count)
+                : backend->multiply(a, b, dst, count);
+    case PREPROCESSING_EXPR_DIVIDE:
+        for (unsigned int p = 0; p < count; p++)
+        {
+            dst[p] = eve_fp_divide32(a[p], b[p], FP32_FWL);
+            nan |= (dst[p] == EVE_FP32_NAN);
+        }
+        break;
+    case PREPROCESSING_EXPR_UNDER:
+        for (unsigned int p = 0; p < count; p++)
+        {
+            dst[p] = (a[p] < b[p]) ? FP32_BINARY_TRUE : 0;
+        }
+        break;
+    case PREPROCESSING_EXPR_EQUAL:
+        for (unsigned int p = 0; p < count; p++)
+        {
+            dst[p] = (a[p] == b[p]) ? FP32_BINARY_TRUE : 0;
+        }
+        break;
+    case PREPROCESSING_EXPR_OVER:
+        for (unsigned int p = 0; p < count; p++)
+        {
+            dst[p] = (a[p] > b[p]) ? FP32_BINARY_TRUE : 0;
+        }
+        break;
+    case PREPROCESSING_EXPR_SELECT:
+        for (unsigned int p = 0; p < count; p++)
+        {
+            dst[p] = (a[p] != 0) ? b[p] : c[p];
+            nan |= (dst[p] == EVE_FP32_NAN);
+        }
+        break;
+    default:
+        break;
+    }
+
+    return nan;
+}
@@ -0,0 +1,1253 @@
+/*
+ * Project: Solar Orbiter - PHI (SO/PHI)
+ * Module:  Preprocessing - a library for image pre-processing.
+ *
+ * Copyright (C) 2016, Max Planck Institute for Solar System Research
+ */
+
+/**
+ * @file
+ *
+ * This file contains implementation of the 2-D fast Fourier transform.
+ */
+
+#include "preprocessing/fft.h"
+
+#include "preprocessing/def.h"
+#include "preprocessing/prof.h"
+#include "preprocessing/vmem.h"
+
+/* from libeve */
+#include "../libeve/eve/fixed_point.h"
+
+/* from std c */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * This is the largest magnitude of a block floating point mantissa before a
+ * butterfly stage. A radix-2 stage grows a component by at most 1 + sqrt(2),
+ * so the result stays within 32 bit.
+ */
+#define FFT_HEADROOM (1 << 29)
+
+/**
+ * This is the number of fractional bits of the fixed point twiddle factors.
+ */
+#define FFT_TWIDDLE_FWL 30
+
+/**
+ * This is a FFT plan, the twiddle factors of one transform length.
+ */
+struct fft_Plan
+{
+    unsigned int n;  /**< transform length, 0 if not created yet */
+    double* re;      /**< exp(-2 pi i k / n), k < n, real parts */
+    double* im;      /**< exp(-2 pi i k / n), k < n, imaginary parts */
+    int32_t* fixRe;  /**< fixed point twiddles, k < n / 2, real parts */
+    int32_t* fixIm;  /**< fixed point twiddles, k < n / 2, imaginary parts */
+};
+
+/**
+ * These are the cached plans, indexed by the log2 of the length.
+ */
+static struct fft_Plan fft_plans[PREPROCESSING_FFT_PLANS];
+
+/* PRIVATE INTERFACE *********************************************************/
+
+/**
+ * Check whether a number is a power of 2.
+ *
+ * @param n the number.
+ *
+ * @return 1 if n is a power of 2, 0 otherwise.
+ */
+static int fft_isPowerOf2(unsigned int n);
+
+/**
+ * Get the plan of a transform length, create it on first use.
+ *
+ * @param n the transform length (a power of 2).
+ *
+ * @return the plan, 0 if out of memory.
+ */
+static const struct fft_Plan* fft_getPlan(unsigned int n);
+
+/**
+ * Transform one line of complex data in place (Stockham autosort, radix-4
+ * stages and one radix-2 stage for odd powers of 2).
+ *
+ * @param re      the real parts.
+ * @param im      the imaginary parts.
+ * @param work    a buffer of 2 * n values.
+ * @param plan    the plan of the line length.
+ * @param inverse 1 for the inverse transform (not scaled).
+ */
+static void fft_transform(double* re, double* im, double* work,
+        const struct fft_Plan* plan, int inverse);
+
+/**
+ * Transform all rows of complex data in place, the rows are spread over all
+ * cores.
+ *
+ * @param re      the real parts.
+ * @param im      the imaginary parts.
+ * @param rows    the number of rows.
+ * @param cols    the number of columns (a power of 2).
+ * @param inverse 1 for the inverse transform (not scaled).
+ *
+ * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+ */
+static int fft_transformRows(double* re, double* im, unsigned int rows,
+        unsigned int cols, int inverse);
+
+/**
+ * Transform all columns of complex data in place. The data is transposed so
+ * each column is transformed as a contiguous line.
+ *
+ * @param re      the real parts.
+ * @param im      the imaginary parts.
+ * @param rows    the number of rows (a power of 2).
+ * @param cols    the number of columns.
+ * @param inverse 1 for the inverse transform (not scaled).
+ *
+ * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+ */
+static int fft_transformColumns(double* re, double* im, unsigned int rows,
+        unsigned int cols, int inverse);
+
+/**
+ * Transform one line of fixed point complex data in place (radix-2). Before
+ * each stage the line is shifted down as far as needed to not overflow.
+ *
+ * @param re      the real parts.
+ * @param im      the imaginary parts.
+ * @param plan    the plan of the line length.
+ * @param inverse 1 for the inverse transform (not scaled).
+ *
+ * @return the number of bits the line has been shifted down.
+ */
+static int fft_transformFixed(int32_t* re, int32_t* im,
+        const struct fft_Plan* plan, int inverse);
+
+/**
+ * Transform all rows of fixed point complex data in place and shift them to
+ * a common block exponent.
+ *
+ * @param re      the real parts.
+ * @param im      the imaginary parts.
+ * @param rows    the number of rows.
+ * @param cols    the number of columns (a power of 2).
+ * @param inverse 1 for the inverse transform (not scaled).
+ * @param shift   the number of bits the data has been shifted down.
+ *
+ * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+ */
+static int fft_transformFixedRows(int32_t* re, int32_t* im, unsigned int rows,
+        unsigned int cols, int inverse, int* shift);
+
+/**
+ * Transform all columns of fixed point complex data in place and shift them
+ * to a common block exponent.
+ *
+ * @param re      the real parts.
+ * @param im      the imaginary parts.
+ * @param rows    the number of rows (a power of 2).
+ * @param cols    the number of columns.
+ * @param inverse 1 for the inverse transform (not scaled).
+ * @param shift   the number of bits the data has been shifted down.
+ *
+ * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+ */
+static int fft_transformFixedColumns(int32_t* re, int32_t* im,
+        unsigned int rows, unsigned int cols, int inverse, int* shift);
+
+/**
+ * Shift fixed point complex data down with rounding.
+ *
+ * @param re    the real parts.
+ * @param im    the imaginary parts.
+ * @param n     the number of values.
+ * @param shift the number of bits.
+ */
+static void fft_shiftDown(int32_t* re, int32_t* im, unsigned int n, int shift);
+
+/**
+ * Transpose a matrix in blocks of PREPROCESSING_FFT_BLOCK x
+ * PREPROCESSING_FFT_BLOCK values, the blocks are spread over all cores.
+ *
+ * @param src  the matrix.
+ * @param rows the number of rows of src.
+ * @param cols the number of columns of src.
+ * @param dst  the transposed matrix (cols x rows).
+ * @{
+ */
+static void fft_transpose(const double* src, unsigned int rows,
+        unsigned int cols, double* dst);
+static void fft_transposeFixed(const int32_t* src, unsigned int rows,
+        unsigned int cols, int32_t* dst);
+/**
+ * @}
+ */
+
+/**
+ * Round values to 24.8 fixed point pixels.
+ *
+ * @param src   the values.
+ * @param n     the number of values.
+ * @param scale the factor the values are scaled with.
+ * @param dst   the pixels.
+ *
+ * @return 1 if a pixel is out of range (NaN), 0 otherwise.
+ */
+static int fft_toFixed(const double* src, unsigned int n, double scale,
+        int32_t* dst);
+
+/**
+ * Convert 24.8 fixed point pixels to values.
+ *
+ * @param src the pixels.
+ * @param n   the number of pixels.
+ * @param dst the values.
+ *
+ * @return 1 if a pixel is NaN, 0 otherwise.
+ */
+static int fft_toDouble(const int32_t* src, unsigned int n, double* dst);
+
+/* PUBLIC IMPLEMENTATION *****************************************************/
+
+int preprocessing_fft_forward(uint32_t sdSrc, uint16_t rows, uint16_t cols,
+        uint32_t sdDstRe, uint32_t sdDstIm)
+{
+    PREPROCESSING_PROF_OPERATION(PREPROCESSING_PROF_FRAME(rows, cols),
+            2 * PREPROCESSING_PROF_FRAME(rows, cols));
+
+    int status = PREPROCESSING_SUCCESSFUL;
+    unsigned int size = (unsigned int)(rows) * cols;
+    unsigned int half = (unsigned int)(rows) * PREPROCESSING_FFT_COLS(cols);
+
+    const int32_t* src = preprocessing_vmem_getDataAddress(sdSrc);
+    int32_t* dstRe = preprocessing_vmem_getDataAddress(sdDstRe);
+    int32_t* dstIm = preprocessing_vmem_getDataAddress(sdDstIm);
+
+    // Check whether given rows and columns are in a valid range.
+    if ((!fft_isPowerOf2(rows)) || (!fft_isPowerOf2(cols))
+            || (!preprocessing_vmem_isProcessingSizeValid(sdSrc, rows, cols))
+            || (!preprocessing_vmem_isProcessingSizeValid(sdDstRe, rows,
+                    PREPROCESSING_FFT_COLS(cols)))
+            || (!preprocessing_vmem_isProcessingSizeValid(sdDstIm, rows,
+                    PREPROCESSING_FFT_COLS(cols))))
+    {
+        return PREPROCESSING_INVALID_SIZE;
+    }
+
+    double* data = malloc(((size_t)(size) + 2 * (size_t)(half))
+            * sizeof(double));
+
+    if (data == 0)
+    {
+        return PREPROCESSING_NO_MEMORY;
+    }
+
+    double* re = data + size;
+    double* im = re + half;
+
+    // A NaN pixel spoils the whole spectrum.
+    if (fft_toDouble(src, size, data))
+    {
+        for (unsigned int p = 0; p < half; p++)
+        {
+            dstRe[p] = EVE_FP32_NAN;
+            dstIm[p] = EVE_FP32_NAN;
+        }
+
+        free(data);
+        return PREPROCESSING_INVALID_NUMBER;
+    }
+
+    status = preprocessing_fft_real2D(data, rows, cols, re, im);
+
+    if (status == PREPROCESSING_SUCCESSFUL)
+    {
+        double scale = 1.0 / (double)(size);
+
+        if (fft_toFixed(re, half, scale, dstRe)
+                | fft_toFixed(im, half, scale, dstIm))
+        {
+            status = PREPROCESSING_INVALID_NUMBER;
+        }
+    }
+
+    free(data);
+
+    return status;
+}
+
+/*****************************************************************************/
+
+int preprocessing_fft_inverse(uint32_t sdSrcRe, uint32_t sdSrcIm,
+        uint16_t rows, uint16_t cols, uint32_t sdDst)
+{
+    PREPROCESSING_PROF_OPERATION(2 * PREPROCESSING_PROF_FRAME(rows, cols),
+            PREPROCESSING_PROF_FRAME(rows, cols));
+
+    int status = PREPROCESSING_SUCCESSFUL;
+    unsigned int size = (unsigned int)(rows) * cols;
+    unsigned int half = (unsigned int)(rows) * PREPROCESSING_FFT_COLS(cols);
+
+    const int32_t* srcRe = preprocessing_vmem_getDataAddress(sdSrcRe);
+    const int32_t* srcIm = preprocessing_vmem_getDataAddress(sdSrcIm);
+    int32_t* dst = preprocessing_vmem_getDataAddress(sdDst);
+
+    // Check whether given rows and columns are in a valid range.
+    if ((!fft_isPowerOf2(rows)) || (!fft_isPowerOf2(cols))
+            || (!preprocessing_vmem_isProcessingSizeValid(sdSrcRe, rows,
+                    PREPROCESSING_FFT_COLS(cols)))
+            || (!preprocessing_vmem_isProcessingSizeValid(sdSrcIm, rows,
+                    PREPROCESSING_FFT_COLS(cols)))
+            || (!preprocessing_vmem_isProcessingSizeValid(sdDst, rows, cols)))
+    {
+        return PREPROCESSING_INVALID_SIZE;
+    }
+
+    double* data = malloc(((size_t)(size) + 2 * (size_t)(half))
+            * sizeof(double));
+
+    if (data == 0)
+    {
+        return PREPROCESSING_NO_MEMORY;
+    }
+
+    double* re = data + size;
+    double* im = re + half;
+
+    if (fft_toDouble(srcRe, half, re) | fft_toDouble(srcIm, half, im))
+    {
+        for (unsigned int p = 0; p < size; p++)
+        {
+            dst[p] = EVE_FP32_NAN;
+        }
+
+        status = PREPROCESSING_INVALID_NUMBER;
+    }
+    else
+    {
+        status = preprocessing_fft_realInverse2D(re, im, rows, cols, data);
+
+        if ((status == PREPROCESSING_SUCCESSFUL)
+                && fft_toFixed(data, size, 1.0, dst))
+        {
+            status = PREPROCESSING_INVALID_NUMBER;
+        }
+    }
+
+    free(data);
+
+    return status;
+}
+
+/*****************************************************************************/
+
+int preprocessing_fft_forwardBlock(uint32_t sdSrc, uint16_t rows,
+        uint16_t cols, uint32_t sdDstRe, uint32_t sdDstIm, int16_t* exponent)
+{
+    PREPROCESSING_PROF_OPERATION(PREPROCESSING_PROF_FRAME(rows, cols),
+            2 * PREPROCESSING_PROF_FRAME(rows, cols));
+
+    int status = PREPROCESSING_SUCCESSFUL;
+    unsigned int size = (unsigned int)(rows) * cols;
+    unsigned int colsHalf = PREPROCESSING_FFT_COLS(cols);
+    int shiftRows = 0;
+    int shiftCols = 0;
+    int invalid = 0;
+
+    const int32_t* src = preprocessing_vmem_getDataAddress(sdSrc);
+    int32_t* dstRe = preprocessing_vmem_getDataAddress(sdDstRe);
+    int32_t* dstIm = preprocessing_vmem_getDataAddress(sdDstIm);
+
+    if (exponent == 0)
+    {
+        printf("Invalid data pointer: %p.\n", (void*)(exponent));
+        return PREPROCESSING_INVALID_ADDRESS;
+    }
+
+    // Check whether given rows and columns are in a valid range.
+    if ((!fft_isPowerOf2(rows)) || (!fft_isPowerOf2(cols))
+            || (!preprocessing_vmem_isProcessingSizeValid(sdSrc, rows, cols))
+            || (!preprocessing_vmem_isProcessingSizeValid(sdDstRe, rows,
+                    colsHalf))
+            || (!preprocessing_vmem_isProcessingSizeValid(sdDstIm, rows,
+                    colsHalf)))
+    {
+        return PREPROCESSING_INVALID_SIZE;
+    }
+
+    int32_t* re = malloc(2 * (size_t)(size) * sizeof(int32_t));
+
+    if (re == 0)
+    {
+        return PREPROCESSING_NO_MEMORY;
+    }
+
+    int32_t* im = re + size;
+
+    for (unsigned int p = 0; p < size; p++)
+    {
+        re[p] = src[p];
+        im[p] = 0;
+        invalid |= (src[p] == EVE_FP32_NAN);
+    }
+
+    if (invalid)
+    {
+        free(re);
+        return PREPROCESSING_INVALID_NUMBER;
+    }
+
+    // Row pass on the full rows, column pass on the non-redundant half.
+    status = fft_transformFixedRows(re, im, rows, cols, 0, &shiftRows);
+
+    if (status == PREPROCESSING_SUCCESSFUL)
+    {
+        for (unsigned int r = 0; r < rows; r++)
+        {
+            memcpy(dstRe + r * colsHalf, re + r * cols,
+                    colsHalf * sizeof(int32_t));
+            memcpy(dstIm + r * colsHalf, im + r * cols,
+                    colsHalf * sizeof(int32_t));
+        }
+
+        status = fft_transformFixedColumns(dstRe, dstIm, rows, colsHalf, 0,
+                &shiftCols);
+        *exponent = (int16_t)(shiftRows + shiftCols);
+    }
+
+    free(re);
+
+    return status;
+}
+
+/*****************************************************************************/
+
+int preprocessing_fft_inverseBlock(uint32_t sdSrcRe, uint32_t sdSrcIm,
+        uint16_t rows, uint16_t cols, int16_t exponent, uint32_t sdDst)
+{
+    PREPROCESSING_PROF_OPERATION(2 * PREPROCESSING_PROF_FRAME(rows, cols),
+            PREPROCESSING_PROF_FRAME(rows, cols));
+
+    int status = PREPROCESSING_SUCCESSFUL;
+    unsigned int size = (unsigned int)(rows) * cols;
+    unsigned int colsHalf = PREPROCESSING_FFT_COLS(cols);
+    unsigned int half = (unsigned int)(rows) * colsHalf;
+    int shiftRows = 0;
+    int shiftCols = 0;
+    int invalid = 0;
+
+    const int32_t* srcRe = preprocessing_vmem_getDataAddress(sdSrcRe);
+    const int32_t* srcIm = preprocessing_vmem_getDataAddress(sdSrcIm);
+    int32_t* dst = preprocessing_vmem_getDataAddress(sdDst);
+
+    // Check whether given rows and columns are in a valid range.
+    if ((!fft_isPowerOf2(rows)) || (!fft_isPowerOf2(cols))
+            || (!preprocessing_vmem_isProcessingSizeValid(sdSrcRe, rows,
+                    colsHalf))
+            || (!preprocessing_vmem_isProcessingSizeValid(sdSrcIm, rows,
+                    colsHalf))
+            || (!preprocessing_vmem_isProcessingSizeValid(sdDst, rows, cols)))
+    {
+        return PREPROCESSING_INVALID_SIZE;
+    }
+
+    int32_t* re = malloc(2 * ((size_t)(size) + half) * sizeof(int32_t));
+
+    if (re == 0)
+    {
+        return PREPROCESSING_NO_MEMORY;
+    }
+
+    int32_t* im = re + size;
+    int32_t* halfRe = im + size;
+    int32_t* halfIm = halfRe + half;
+
+    for (unsigned int p = 0; p < half; p++)
+    {
+        halfRe[p] = srcRe[p];
+        halfIm[p] = srcIm[p];
+        invalid |= (srcRe[p] == EVE_FP32_NAN) | (srcIm[p] == EVE_FP32_NAN);
+    }
+
+    if (invalid)
+    {
+        free(re);
+        return PREPROCESSING_INVALID_NUMBER;
+    }
+
+    status = fft_transformFixedColumns(halfRe, halfIm, rows, colsHalf, 1,
+            &shiftCols);
+
+    if (status == PREPROCESSING_SUCCESSFUL)
+    {
+        // Complete the rows from the symmetry of a real image's spectrum.
+        for (unsigned int r = 0; r < rows; r++)
+        {
+            for (unsigned int c = 0; c < cols; c++)
+            {
+                unsigned int p = r * cols + c;
+
+                if (c < colsHalf)
+                {
+                    re[p] = halfRe[r * colsHalf + c];
+                    im[p] = halfIm[r * colsHalf + c];
+                }
+                else
+                {
+                    re[p] = halfRe[r * colsHalf + cols - c];
+                    im[p] = 0 - halfIm[r * colsHalf + cols - c];
+                }
+            }
+        }
+
+        status = fft_transformFixedRows(re, im, rows, cols, 1, &shiftRows);
+    }
+
+    if (status == PREPROCESSING_SUCCESSFUL)
+    {
+        // Undo the block scaling and scale by 1 / (rows * cols).
+        int shift = exponent + shiftCols + shiftRows;
+
+        for (unsigned int n = 1; n < size; n <<= 1)
+        {
+            shift--;
+        }
+
+        for (unsigned int p = 0; p < size; p++)
+        {
+            int64_t value = re[p];
+
+            if (shift >= 0)
+            {
+                value = (shift < 32) ? value * ((int64_t)(1) << shift)
+                        : ((value != 0) ? INT64_MAX : 0);
+            }
+            else
+            {
+                value = (shift > -63) ? (value + ((int64_t)(1) << (-shift - 1)))
+                        >> (-shift) : 0;
+            }
+
+            if ((value < EVE_FP32_MIN) || (value > EVE_FP32_MAX))
+            {
+                dst[p] = EVE_FP32_NAN;
+                status = PREPROCESSING_INVALID_NUMBER;
+            }
+            else
+            {
+                dst[p] = (int32_t)(value);
+            }
+        }
+    }
+
+    free(re);
+
+    return status;
+}
+
+/*****************************************************************************/
+
+int preprocessing_fft_complex2D(double* re, double* im, unsigned int rows,
+        unsigned int cols, int inverse)
+{
+    PREPROCESSING_PROF_OPERATION(2 * (uint64_t)(rows) * cols * sizeof(double),
+            2 * (uint64_t)(rows) * cols * sizeof(double));
+
+    int status = PREPROCESSING_SUCCESSFUL;
+
+    if ((re == 0) || (im == 0))
+    {
+        printf("Invalid data pointer: %p.\n", (void*)(re));
+        return PREPROCESSING_INVALID_ADDRESS;
+    }
+
+    if ((!fft_isPowerOf2(rows)) || (!fft_isPowerOf2(cols)))
+    {
+        return PREPROCESSING_INVALID_SIZE;
+    }
+
+    status = fft_transformRows(re, im, rows, cols, inverse);
+
+    if (status == PREPROCESSING_SUCCESSFUL)
+    {
+        status = fft_transformColumns(re, im, rows, cols, inverse);
+    }
+
+    return status;
+}
+
+/*****************************************************************************/
+
+int preprocessing_fft_real2D(const double* src, unsigned int rows,
+        unsigned int cols, double* re, double* im)
+{
+    PREPROCESSING_PROF_OPERATION((uint64_t)(rows) * cols * sizeof(double),
+            2 * (uint64_t)(rows) * PREPROCESSING_FFT_COLS(cols)
+            * sizeof(double));
+
+    unsigned int colsHalf = PREPROCESSING_FFT_COLS(cols);
+    int invalid = 0;
+
+    if ((src == 0) || (re == 0) || (im == 0))
+    {
+        printf("Invalid data pointer: %p.\n", (const void*)(src));
+        return PREPROCESSING_INVALID_ADDRESS;
+    }
+
+    if ((!fft_isPowerOf2(rows)) || (!fft_isPowerOf2(cols)))
+    {
+        return PREPROCESSING_INVALID_SIZE;
+    }
+
+    const struct fft_Plan* plan = fft_getPlan(cols);
+
+    if (plan == 0)
+    {
+        return PREPROCESSING_NO_MEMORY;
+    }
+
+    // Two real rows are transformed at once as real and imaginary part of
+    // one complex row, and separated by symmetry afterwards.
+    PREPROCESSING_DEF_PARALLEL_FOR_OR(invalid)
+    for (unsigned int r = 0; r < rows; r += 2)
+    {
+        double* z = malloc(4 * (size_t)(cols) * sizeof(double));
+
+        if (z == 0)
+        {
+            invalid |= 1;
+            continue;
+        }
+
+        double* zRe = z;
+        double* zIm = z + cols;
+        const double* b = (r + 1 < rows) ? src + (r + 1) * cols : 0;
+
+        for (unsigned int c = 0; c < cols; c++)
+        {
+            zRe[c] = src[r * cols + c];
+            zIm[c] = (b != 0) ? b[c] : 0.0;
+        }
+
+        fft_transform(zRe, zIm, z + 2 * cols, plan, 0);
+
+        for (unsigned int k = 0; k < colsHalf; k++)
+        {
+            unsigned int nk = (cols - k) & (cols - 1);
+            unsigned int p = r * colsHalf + k;
+
+            re[p] = 0.5 * (zRe[k] + zRe[nk]);
+            im[p] = 0.5 * (zIm[k] - zIm[nk]);
+
+            if (b != 0)
+            {
+                re[p + colsHalf] = 0.5 * (zIm[k] + zIm[nk]);
+                im[p + colsHalf] = 0.5 * (zRe[nk] - zRe[k]);
+            }
+        }
+
+        free(z);
+    }
+
+    if (invalid)
+    {
+        return PREPROCESSING_NO_MEMORY;
+    }
+
+    return fft_transformColumns(re, im, rows, colsHalf, 0);
+}
+
+/*****************************************************************************/
+
+int preprocessing_fft_realInverse2D(const double* re, const double* im,
+        unsigned int rows, unsigned int cols, double* dst)
+{
+    PREPROCESSING_PROF_OPERATION(2 * (uint64_t)(rows)
+            * PREPROCESSING_FFT_COLS(cols) * sizeof(double),
+            (uint64_t)(rows) * cols * sizeof(double));
+
+    int status = PREPROCESSING_SUCCESSFUL;
+    unsigned int colsHalf = PREPROCESSING_FFT_COLS(cols);
+    size_t half = (size_t)(rows) * colsHalf;
+    int invalid = 0;
+
+    if ((re == 0) || (im == 0) || (dst == 0))
+    {
+        printf("Invalid data pointer: %p.\n", (const void*)(re));
+        return PREPROCESSING_INVALID_ADDRESS;
+    }
+
+    if ((!fft_isPowerOf2(rows)) || (!fft_isPowerOf2(cols)))
+    {
+        return PREPROCESSING_INVALID_SIZE;
+    }
+
+    const struct fft_Plan* plan = fft_getPlan(cols);
+    double* a = malloc(2 * half * sizeof(double));
+
+    if ((plan == 0) || (a == 0))
+    {
+        free(a);
+        return PREPROCESSING_NO_MEMORY;
+    }
+
+    double* aIm = a + half;
+
+    memcpy(a, re, half * sizeof(double));
+    memcpy(aIm, im, half * sizeof(double));
+    status = fft_transformColumns(a, aIm, rows, colsHalf, 1);
+
+    if (status != PREPROCESSING_SUCCESSFUL)
+    {
+        free(a);
+        return status;
+    }
+
+    // Two rows are completed by symmetry and transformed at once as real and
+    // imaginary part of one complex row.
+    PREPROCESSING_DEF_PARALLEL_FOR_OR(invalid)
+    for (unsigned int r = 0; r < rows; r += 2)
+    {
+        double* z = malloc(4 * (size_t)(cols) * sizeof(double));
+
+        if (z == 0)
+        {
+            invalid |= 1;
+            continue;
+        }
+
+        double* zRe = z;
+        double* zIm = z + cols;
+        int second = (r + 1 < rows);
+
+        for (unsigned int c = 0; c < cols; c++)
+        {
+            unsigned int k = (c < colsHalf) ? c : cols - c;
+            double sign = (c < colsHalf) ? 1.0 : -1.0;
+            size_t p = (size_t)(r) * colsHalf + k;
+            double bRe = second ? a[p + colsHalf] : 0.0;
+            double bIm = second ? sign * aIm[p + colsHalf] : 0.0;
+
+            zRe[c] = a[p] - bIm;
+            zIm[c] = sign * aIm[p] + bRe;
+        }
+
+        fft_transform(zRe, zIm, z + 2 * cols, plan, 1);
+
+        memcpy(dst + (size_t)(r) * cols, zRe, cols * sizeof(double));
+
+        if (second)
+        {
+            memcpy(dst + (size_t)(r + 1) * cols, zIm, cols * sizeof(double));
+        }
+
+        free(z);
+    }
+
+    free(a);
+
+    return invalid ? PREPROCESSING_NO_MEMORY : PREPROCESSING_SUCCESSFUL;
+}
+
+/*****************************************************************************/
+
+void preprocessing_fft_clearPlans(void)
+{
+    for (unsigned int i = 0; i < PREPROCESSING_FFT_PLANS; i++)
+    {
+        free(fft_plans[i].re);
+        free(fft_plans[i].fixRe);
+        memset(&fft_plans[i], 0, sizeof(fft_plans[i]));
+    }
+}
+
+/* PRIVATE IMPLEMENTATION ****************************************************/
+
+static int fft_isPowerOf2(unsigned int n)
+{
+    return (n != 0) && ((n & (n - 1)) == 0);
+}
+
+/*****************************************************************************/
+
+static const struct fft_Plan* fft_getPlan(unsigned int n)
+{
+    unsigned int log2n = 0;
+    struct fft_Plan* plan = 0;
+
+    while ((1u << log2n) < n)
+    {
+        log2n++;
+    }
+
+    PREPROCESSING_DEF_CRITICAL(fft_plan)
+    {
+        plan = &fft_plans[log2n];
+
+        if (plan->n == 0)
+        {
+            unsigned int halfN = (n > 1) ? n / 2 : 1;
+
+            plan->re = malloc(2 * (size_t)(n) * sizeof(double));
+            plan->fixRe = malloc(2 * (size_t)(halfN) * sizeof(int32_t));
+
+            if ((plan->re == 0) || (plan->fixRe == 0))
+            {
+                free(plan->re);
+                free(plan->fixRe);
+                memset(plan, 0, sizeof(*plan));
+                plan = 0;
+            }
+            else
+            {
+                plan->im = plan->re + n;
+                plan->fixIm = plan->fixRe + halfN;
+
+                for (unsigned int k = 0; k < n; k++)
+                {
+                    double angle = -2.0 * PI * (double)(k) / (double)(n);
+
+                    plan->re[k] = cos(angle);
+                    plan->im[k] = sin(angle);
+
+                    if (k < halfN)
+                    {
+                        plan->fixRe[k] = (int32_t)(lround(plan->re[k]
+                                * (double)(1 << FFT_TWIDDLE_FWL)));
+                        plan->fixIm[k] = (int32_t)(lround(plan->im[k]
+                                * (double)(1 << FFT_TWIDDLE_FWL)));
+                    }
+                }
+
+                plan->n = n;
+            }
+        }
+    }
+
+    return plan;
+}
+
+/*****************************************************************************/
+
+static void fft_transform(double* re, double* im, double* work,
+        const struct fft_Plan* plan, int inverse)
+{
+    unsigned int n = plan->n;
+    unsigned int s = 1;
+    unsigned int len = n;
+    double sign = inverse ? -1.0 : 1.0;
+    double* xRe = re;
+    double* xIm = im;
+    double* yRe = work;
+    double* yIm = work + n;
+    double* t = 0;
+
+    // Radix-4 stages, the output of each stage is in natural order for the
+    // next one so no bit reversal is needed.
+    for (; len >= 4; len /= 4, s *= 4)
+    {
+        unsigned int quarter = len / 4;
+
+        for (unsigned int p = 0; p < quarter; p++)
+        {
+            double w1Re = plan->re[p * s];
+            double w1Im = sign * plan->im[p * s];
+            double w2Re = plan->re[2 * p * s];
+            double w2Im = sign * plan->im[2 * p * s];
+            double w3Re = plan->re[3 * p * s];
+            double w3Im = sign * plan->im[3 * p * s];
+
+            for (unsigned int q = 0; q < s; q++)
+            {
+                unsigned int a = q + s * p;
+                unsigned int b = a + s * quarter;
+                unsigned int c = b + s * quarter;
+                unsigned int d = c + s * quarter;
+                unsigned int o = q + 4 * s * p;
+
+                double apcRe = xRe[a] + xRe[c];
+                double apcIm = xIm[a] + xIm[c];
+                double amcRe = xRe[a] - xRe[c];
+                double amcIm = xIm[a] - xIm[c];
+                double bpdRe = xRe[b] + xRe[d];
+                double bpdIm = xIm[b] + xIm[d];
+
+                // j (b - d) forward, -j (b - d) inverse
+                double jbmdRe = sign * (xIm[d] - xIm[b]);
+                double jbmdIm = sign * (xRe[b] - xRe[d]);
+
+                double tRe = amcRe - jbmdRe;
+                double tIm = amcIm - jbmdIm;
+
+                yRe[o] = apcRe + bpdRe;
+                yIm[o] = apcIm + bpdIm;
+                yRe[o + s] = w1Re * tRe - w1Im * tIm;
+                yIm[o + s] = w1Re * tIm + w1Im * tRe;
+
+                tRe = apcRe - bpdRe;
+                tIm = apcIm - bpdIm;
+                yRe[o + 2 * s] = w2Re * tRe - w2Im * tIm;
+                yIm[o + 2 * s] = w2Re * tIm + w2Im * tRe;
+
+                tRe = amcRe + jbmdRe;
+                tIm = amcIm + jbmdIm;
+                yRe[o + 3 * s] = w3Re * tRe - w3Im * tIm;
+                yIm[o + 3 * s] = w3Re * tIm + w3Im * tRe;
+            }
+        }
+
+        t = xRe;
+        xRe = yRe;
+        yRe = t;
+        t = xIm;
+        xIm = yIm;
+        yIm = t;
+    }
+
+    // Radix-2 stage for odd powers of 2.
+    if (len == 2)
+    {
+        for (unsigned int q = 0; q < s; q++)
+        {
+            yRe[q] = xRe[q] + xRe[q + s];
+            yIm[q] = xIm[q] + xIm[q + s];
+            yRe[q + s] = xRe[q] - xRe[q + s];
+            yIm[q + s] = xIm[q] - xIm[q + s];
+        }
+
+        xRe = yRe;
+        xIm = yIm;
+    }
+
+    if (xRe != re)
+    {
+        memcpy(re, xRe, n * sizeof(double));
+        memcpy(im, xIm, n * sizeof(double));
+    }
+}
+
+/*****************************************************************************/
+
+static int fft_transformRows(double* re, double* im, unsigned int rows,
+        unsigned int cols, int inverse)
+{
+    int invalid = 0;
+    const struct fft_Plan* plan = fft_getPlan(cols);
+
+    if (plan == 0)
+    {
+        return PREPROCESSING_NO_MEMORY;
+    }
+
+    // Process.
+    PREPROCESSING_DEF_PARALLEL_FOR_OR(invalid)
+    for (unsigned int r = 0; r < rows; r++)
+    {
+        double* work = malloc(2 * (size_t)(cols) * sizeof(double));
+
+        if (work == 0)
+        {
+            invalid |= 1;
+            continue;
+        }
+
+        fft_transform(re + (size_t)(r) * cols, im + (size_t)(r) * cols, work,
+                plan, inverse);
+        free(work);
+    }
+
+    return invalid ? PREPROCESSING_NO_MEMORY : PREPROCESSING_SUCCESSFUL;
+}
+
+/*****************************************************************************/
+
+static int fft_transformColumns(double* re, double* im, unsigned int rows,
+        unsigned int cols, int inverse)
+{
+    int status = PREPROCESSING_SUCCESSFUL;
+    size_t size = (size_t)(rows) * cols;
+
+    // A single column is contiguous already.
+    if (cols == 1)
+    {
+        return fft_transformRows(re, im, 1, rows, inverse);
+    }
+
+    double* tRe = malloc(2 * size * sizeof(double));
+
+    if (tRe == 0)
+    {
+        return PREPROCESSING_NO_MEMORY;
+    }
+
+    double* tIm = tRe + size;
+
+    fft_transpose(re, rows, cols, tRe);
+    fft_transpose(im, rows, cols, tIm);
+    status = fft_transformRows(tRe, tIm, cols, rows, inverse);
+    fft_transpose(tRe, cols, rows, re);
+    fft_transpose(tIm, cols, rows, im);
+
+    free(tRe);
+
+    return status;
+}
+
+/*****************************************************************************/
+
+static int fft_transformFixed(int32_t* re, int32_t* im,
+        const struct fft_Plan* plan, int inverse)
+{
+    unsigned int n = plan->n;
+    int shifts = 0;
+
+    // Bit reversal.
+    for (unsigned int i = 1, j = 0; i < n; i++)
+    {
+        unsigned int bit = n >> 1;
+
+        for (; j & bit; bit >>= 1)
+        {
+            j ^= bit;
+        }
+
+        j ^= bit;
+
+        if (i < j)
+        {
+            int32_t t = re[i];
+            re[i] = re[j];
+            re[j] = t;
+            t = im[i];
+            im[i] = im[j];
+            im[j] = t;
+        }
+    }
+
+    for (unsigned int len = 2; len <= n; len <<= 1)
+    {
+        unsigned int step = n / len;
+        int64_t max = 0;
+        int shift = 0;
+
+        // Block scaling: make room for the growth of this stage.
+        for (unsigned int i = 0; i < n; i++)
+        {
+            int64_t a = llabs((int64_t)(re[i]));
+            int64_t b = llabs((int64_t)(im[i]));
+
+            max = (a > max) ? a : max;
+            max = (b > max) ? b : max;
+        }
+
+        while ((max >> shift) >= FFT_HEADROOM)
+        {
+            shift++;
+        }
+
+        fft_shiftDown(re, im, n, shift);
+        shifts += shift;
+
+        // Butterflies.
+        for (unsigned int i = 0; i < n; i += len)
+        {
+            for (unsigned int j = 0; j < len / 2; j++)
+            {
+                unsigned int a = i + j;
+                unsigned int b = a + len / 2;
+                int64_t wRe = plan->fixRe[j * step];
+                int64_t wIm = inverse ? -plan->fixIm[j * step]
+                        : plan->fixIm[j * step];
+                int64_t round = (int64_t)(1) << (FFT_TWIDDLE_FWL - 1);
+                int32_t tRe = (int32_t)((re[b] * wRe - im[b] * wIm + round)
+                        >> FFT_TWIDDLE_FWL);
+                int32_t tIm = (int32_t)((re[b] * wIm + im[b] * wRe + round)
+                        >> FFT_TWIDDLE_FWL);
+
+                re[b] = re[a] - tRe;
+                im[b] = im[a] - tIm;
+                re[a] = re[a] + tRe;
+                im[a] = im[a] + tIm;
+            }
+        }
+    }
+
+    return shifts;
+}
+
+/*****************************************************************************/
+
+static int fft_transformFixedRows(int32_t* re, int32_t* im, unsigned int rows,
+        unsigned int cols, int inverse, int* shift)
+{
+    int max = 0;
+    const struct fft_Plan* plan = fft_getPlan(cols);
+    int* shifts = malloc(rows * sizeof(int));
+
+    if ((plan == 0) || (shifts == 0))
+    {
+        free(shifts);
+        return PREPROCESSING_NO_MEMORY;
+    }
+
+    // Process.
+    PREPROCESSING_DEF_PARALLEL_FOR
+    for (unsigned int r = 0; r < rows; r++)
+    {
+        shifts[r] = fft_transformFixed(re + (size_t)(r) * cols,
+                im + (size_t)(r) * cols, plan, inverse);
+    }
+
+    // All rows share one block exponent.
+    for (unsigned int r = 0; r < rows; r++)
+    {
+        max = (shifts[r] > max) ? shifts[r] : max;
+    }
+
+    PREPROCESSING_DEF_PARALLEL_FOR
+    for (unsigned int r = 0; r < rows; r++)
+    {
+        fft_shiftDown(re + (size_t)(r) * cols, im + (size_t)(r) * cols, cols,
+                max - shifts[r]);
+    }
+
+    free(shifts);
+    *shift = max;
+
+    return PREPROCESSING_SUCCESSFUL;
+}
+
+/*****************************************************************************/
+
+static int fft_transformFixedColumns(int32_t* re, int32_t* im,
+        unsigned int rows, unsigned int cols, int inverse, int* shift)
+{
+    int status = PREPROCESSING_SUCCESSFUL;
+    size_t size = (size_t)(rows) * cols;
+    int32_t* tRe = malloc(2 * size * sizeof(int32_t));
+
+    if (tRe == 0)
+    {
+        return PREPROCESSING_NO_MEMORY;
+    }
+
+    int32_t* tIm = tRe + size;
+
+    fft_transposeFixed(re, rows, cols, tRe);
+    fft_transposeFixed(im, rows, cols, tIm);
+    status = fft_transformFixedRows(tRe, tIm, cols, rows, inverse, shift);
+    fft_transposeFixed(tRe, cols, rows, re);
+    fft_transposeFixed(tIm, cols, rows, im);
+
+    free(tRe);
+
+    return status;
+}
+
+/*****************************************************************************/
+
+static void fft_shiftDown(int32_t* re, int32_t* im, unsigned int n, int shift)
+{
+    if (shift <= 0)
+    {
+        return;
+    }
+
+    if (shift > 32)
+    {
+        shift = 32;
+    }
+
+    int64_t round = (int64_t)(1) << (shift - 1);
+
+    for (unsigned int i = 0; i < n; i++)
+    {
+        re[i] = (int32_t)(((int64_t)(re[i]) + round) >> shift);
+        im[i] = (int32_t)(((int64_t)(im[i]) + round) >> shift);
+    }
+}
+
+/*****************************************************************************/
+
+/**
+ * This macro defines a blocked transpose for one element type.
+ */
+#define FFT_DEFINE_TRANSPOSE(name, type) \
+static void name(const type* src, unsigned int rows, unsigned int cols, \
+        type* dst) \
+{ \
+    PREPROCESSING_DEF_PARALLEL_FOR \
+    for (unsigned int r0 = 0; r0 < rows; r0 += PREPROCESSING_FFT_BLOCK) \
+    { \
+        unsigned int r1 = (r0 + PREPROCESSING_FFT_BLOCK < rows) \
+                ? r0 + PREPROCESSING_FFT_BLOCK : rows; \
+        \
+        for (unsigned int c0 = 0; c0 < cols; c0 += PREPROCESSING_FFT_BLOCK) \
+        { \
+            unsigned int c1 = (c0 + PREPROCESSING_FFT_BLOCK < cols) \
+                    ? c0 + PREPROCESSING_FFT_BLOCK : cols; \
+            \
+            for (unsigned int r = r0; r < r1; r++) \
+            { \
+                for (unsigned int c = c0; c < c1; c++) \
+                { \
+                    dst[(size_t)(c) * rows + r] = src[(size_t)(r) * cols + c]; \
+                } \
+            } \
+        } \
+    } \
+}
+
+FFT_DEFINE_TRANSPOSE(fft_transpose, double)
+FFT_DEFINE_TRANSPOSE(fft_transposeFixed, int32_t)
+
+/*****************************************************************************/
+
+static int fft_toFixed(const double* src, unsigned int n, double scale,
+        int32_t* dst)
+{
+    int invalid = 0;
+
+    PREPROCESSING_DEF_PARALLEL_FOR_OR(invalid)
+    for (unsigned int p = 0; p < n; p++)
+    {
+        double value = floor(src[p] * scale + 0.5);
+
+        if ((value < EVE_FP32_MIN) || (value > EVE_FP32_MAX))
+        {
+            dst[p] = EVE_FP32_NAN;
+            invalid |= 1;
+        }
+        else
+        {
+            dst[p] = (int32_t)(value);
+        }
+    }
+
+    return invalid;
+}
+
+/*****************************************************************************/
+
+static int fft_toDouble(const int32_t* src, unsigned int n, double* dst)
+{
+    int invalid = 0;
+
+    PREPROCESSING_DEF_PARALLEL_FOR_OR(invalid)
+    for (unsigned int p = 0; p < n; p++)
+    {
+        dst[p] = src[p];
+        invalid |= (src[p] == EVE_FP32_NAN);
+    }
+
+    return invalid;
+}
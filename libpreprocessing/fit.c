@@ -0,0 +1,492 @@
+/*
+ * Project: Solar Orbiter - PHI (SO/PHI)
+ * Module:  Preprocessing - a library for image pre-processing.
+ *
+ * Copyright (C) 2016, Max Planck Institute for Solar System Research
+ */
+
+/**
+ * @file
+ *
+ * This file contains implementation of linear least squares fits.
+ */
+
+#include "preprocessing/fit.h"
+
+#include "preprocessing/def.h"
+#include "preprocessing/prof.h"
+#include "preprocessing/vmem.h"
+
+/* from libeve */
+#include "../libeve/eve/fixed_point.h"
+
+/* from std c */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * This is the number of bands of image rows whose normal equations are
+ * assembled in parallel and summed afterwards.
+ */
+#define FIT_BANDS 16
+
+/* PRIVATE INTERFACE *********************************************************/
+
+/**
+ * Get the terms of a polynomial surface at a point.
+ *
+ * @param u      the scaled column.
+ * @param v      the scaled row.
+ * @param degree the total degree of the polynomial.
+ * @param terms  the terms.
+ * @param stride the distance between two terms in the terms buffer.
+ */
+static void fit_terms(double u, double v, unsigned int degree, double* terms,
+        unsigned int stride);
+
+/**
+ * Assemble the normal equations of a polynomial surface over a band of
+ * image rows.
+ *
+ * @param src    the image.
+ * @param cols   the number of image columns.
+ * @param row0   the first row of the band.
+ * @param row1   the row after the band.
+ * @param rows   the number of image rows.
+ * @param degree the total degree of the polynomial.
+ * @param ata    the normal matrix.
+ * @param atb    the right hand side.
+ *
+ * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+ */
+static int fit_surfaceBand(const int32_t* src, uint16_t cols,
+        unsigned int row0, unsigned int row1, uint16_t rows,
+        unsigned int degree, double* ata, double* atb);
+
+/**
+ * Scale a coordinate to [-1, 1].
+ *
+ * @param c the coordinate.
+ * @param n the number of coordinates.
+ *
+ * @return the scaled coordinate.
+ */
+static double fit_scale(unsigned int c, unsigned int n);
+
+/* PUBLIC IMPLEMENTATION *****************************************************/
+
+int preprocessing_fit_surface(uint32_t sdSrc, uint16_t rows,
+        uint16_t cols, uint16_t degree, uint32_t sdDst,
+        double* coefficients)
+{
+    PREPROCESSING_PROF_OPERATION(PREPROCESSING_PROF_FRAME(rows, cols),
+            PREPROCESSING_PROF_FRAME(rows, cols));
+
+    int status = PREPROCESSING_SUCCESSFUL;
+    unsigned int terms = PREPROCESSING_FIT_TERMS(degree);
+    size_t square = (size_t)(terms) * terms;
+    unsigned int used = 0;
+    int failed = 0;
+    int invalid = 0;
+
+    const int32_t* src = preprocessing_vmem_getDataAddress(sdSrc);
+    int32_t* dst = preprocessing_vmem_getDataAddress(sdDst);
+
+    // Check whether given rows and columns are in a valid range.
+    if ((!preprocessing_vmem_isProcessingSizeValid(sdSrc, rows, cols))
+            || (!preprocessing_vmem_isProcessingSizeValid(sdDst, rows, cols)))
+    {
+        return PREPROCESSING_INVALID_SIZE;
+    }
+
+    // Check parameters.
+    if (degree > PREPROCESSING_FIT_MAX_DEGREE)
+    {
+        printf("Polynomial degrees above %u are not allowed: %u.\n",
+                PREPROCESSING_FIT_MAX_DEGREE, degree);
+        return PREPROCESSING_INVALID_NUMBER;
+    }
+
+    double* bands = calloc(FIT_BANDS * (square + terms) + terms,
+            sizeof(double));
+
+    if (bands == 0)
+    {
+        return PREPROCESSING_NO_MEMORY;
+    }
+
+    double* solution = bands + FIT_BANDS * (square + terms);
+
+    PREPROCESSING_DEF_PARALLEL_FOR_OR(failed)
+    for (unsigned int b = 0; b < FIT_BANDS; b++)
+    {
+        double* ata = bands + b * (square + terms);
+
+        failed |= (fit_surfaceBand(src, cols,
+                (unsigned int)(rows) * b / FIT_BANDS,
+                (unsigned int)(rows) * (b + 1) / FIT_BANDS, rows, degree, ata,
+                ata + square) != PREPROCESSING_SUCCESSFUL);
+    }
+
+    if (failed)
+    {
+        free(bands);
+        return PREPROCESSING_NO_MEMORY;
+    }
+
+    // Sum the bands in order, so the result does not depend on the threads.
+    for (unsigned int b = 1; b < FIT_BANDS; b++)
+    {
+        const double* ata = bands + b * (square + terms);
+
+        for (size_t i = 0; i < square + terms; i++)
+        {
+            bands[i] += ata[i];
+        }
+    }
+
+    for (unsigned int r = 0; r < rows; r++)
+    {
+        for (unsigned int c = 0; c < cols; c++)
+        {
+            used += (src[(size_t)(r) * cols + c] != EVE_FP32_NAN);
+        }
+    }
+
+    if (used < terms)
+    {
+        printf("Too few pixels for %u terms: %u.\n", terms, used);
+        free(bands);
+        return PREPROCESSING_INVALID_NUMBER;
+    }
+
+    status = preprocessing_fit_solve(bands, bands + square, terms, solution);
+
+    if (status != PREPROCESSING_SUCCESSFUL)
+    {
+        free(bands);
+        return status;
+    }
+
+    // Evaluate the surface.
+    PREPROCESSING_DEF_PARALLEL_FOR_OR(invalid)
+    for (unsigned int r = 0; r < rows; r++)
+    {
+        double t[PREPROCESSING_FIT_TERMS(PREPROCESSING_FIT_MAX_DEGREE)];
+        double v = fit_scale(r, rows);
+
+        for (unsigned int c = 0; c < cols; c++)
+        {
+            double value = 0.0;
+
+            fit_terms(fit_scale(c, cols), v, degree, t, 1);
+
+            for (unsigned int i = 0; i < terms; i++)
+            {
+                value += solution[i] * t[i];
+            }
+
+            value = floor(value * (double)(1 << FP32_FWL) + 0.5);
+
+            if ((value < EVE_FP32_MIN) || (value > EVE_FP32_MAX))
+            {
+                dst[(size_t)(r) * cols + c] = EVE_FP32_NAN;
+                invalid |= 1;
+            }
+            else
+            {
+                dst[(size_t)(r) * cols + c] = (int32_t)(value);
+            }
+        }
+    }
+
+    if (coefficients != 0)
+    {
+        memcpy(coefficients, solution, terms * sizeof(double));
+    }
+
+    free(bands);
+
+    return invalid ? PREPROCESSING_INVALID_NUMBER : PREPROCESSING_SUCCESSFUL;
+}
+
+/*****************************************************************************/
+
+int preprocessing_fit_circle(const double* y, const double* x,
+        unsigned int n, double* cy, double* cx, double* r)
+{
+    PREPROCESSING_PROF_OPERATION(2 * (uint64_t)(n) * sizeof(double), 0);
+
+    double design[3 * PREPROCESSING_FIT_BLOCK];
+    double values[PREPROCESSING_FIT_BLOCK];
+    double ata[9] = { 0.0 };
+    double atb[3] = { 0.0 };
+    double solution[3];
+    double my = 0.0;
+    double mx = 0.0;
+    unsigned int m = 0;
+
+    if ((y == 0) || (x == 0) || (cy == 0) || (cx == 0) || (r == 0))
+    {
+        printf("Invalid pointer: %p\n", (const void*)(y));
+        return PREPROCESSING_INVALID_ADDRESS;
+    }
+
+    if (n < 3)
+    {
+        printf("Too few points for a circle: %u.\n", n);
+        return PREPROCESSING_INVALID_NUMBER;
+    }
+
+    // Around the mean of the points, which keeps the equations well
+    // conditioned: u^2 + v^2 + a u + b v + c = 0.
+    for (unsigned int p = 0; p < n; p++)
+    {
+        my += y[p];
+        mx += x[p];
+    }
+
+    my /= n;
+    mx /= n;
+
+    for (unsigned int p = 0; p < n; p++)
+    {
+        double u = x[p] - mx;
+        double v = y[p] - my;
+
+        design[m] = u;
+        design[PREPROCESSING_FIT_BLOCK + m] = v;
+        design[2 * PREPROCESSING_FIT_BLOCK + m] = 1.0;
+        values[m] = -(u * u + v * v);
+        m++;
+
+        if ((m == PREPROCESSING_FIT_BLOCK) || (p + 1 == n))
+        {
+            // Close the gap between the terms of a partial block.
+            memmove(design + m, design + PREPROCESSING_FIT_BLOCK,
+                    m * sizeof(double));
+            memmove(design + 2 * m, design + 2 * PREPROCESSING_FIT_BLOCK,
+                    m * sizeof(double));
+            preprocessing_fit_accumulate(design, values, m, 3, ata, atb);
+            m = 0;
+        }
+    }
+
+    if (preprocessing_fit_solve(ata, atb, 3, solution)
+            != PREPROCESSING_SUCCESSFUL)
+    {
+        return PREPROCESSING_INVALID_NUMBER;
+    }
+
+    double r2 = 0.25 * (solution[0] * solution[0]
+            + solution[1] * solution[1]) - solution[2];
+
+    if (r2 <= 0.0)
+    {
+        return PREPROCESSING_INVALID_NUMBER;
+    }
+
+    *cx = mx - 0.5 * solution[0];
+    *cy = my - 0.5 * solution[1];
+    *r = sqrt(r2);
+
+    return PREPROCESSING_SUCCESSFUL;
+}
+
+/*****************************************************************************/
+
+void preprocessing_fit_accumulate(const double* design,
+        const double* values, unsigned int n, unsigned int terms,
+        double* ata, double* atb)
+{
+    PREPROCESSING_PROF_OPERATION((uint64_t)(terms + 1) * n * sizeof(double), 0);
+
+    for (unsigned int i = 0; i < terms; i++)
+    {
+        const double* di = design + (size_t)(i) * n;
+        double sum = 0.0;
+
+        for (unsigned int p = 0; p < n; p++)
+        {
+            sum += di[p] * values[p];
+        }
+
+        atb[i] += sum;
+
+        for (unsigned int j = i; j < terms; j++)
+        {
+            const double* dj = design + (size_t)(j) * n;
+
+            sum = 0.0;
+
+            for (unsigned int p = 0; p < n; p++)
+            {
+                sum += di[p] * dj[p];
+            }
+
+            ata[i * terms + j] += sum;
+        }
+    }
+}
+
+/*****************************************************************************/
+
+int preprocessing_fit_solve(double* ata, const double* atb,
+        unsigned int terms, double* solution)
+{
+    PREPROCESSING_PROF_OPERATION((uint64_t)(terms + 1) * terms * sizeof(double),
+            terms * sizeof(double));
+
+    // ata = U^T U, U in the upper triangle.
+    for (unsigned int i = 0; i < terms; i++)
+    {
+        double diagonal = ata[i * terms + i];
+
+        for (unsigned int j = i; j < terms; j++)
+        {
+            double sum = ata[i * terms + j];
+
+            for (unsigned int k = 0; k < i; k++)
+            {
+                sum -= ata[k * terms + i] * ata[k * terms + j];
+            }
+
+            if (j == i)
+            {
+                if (!(sum > 1e-12 * diagonal))
+                {
+                    return PREPROCESSING_INVALID_NUMBER;
+                }
+
+                ata[i * terms + i] = sqrt(sum);
+            }
+            else
+            {
+                ata[i * terms + j] = sum / ata[i * terms + i];
+            }
+        }
+    }
+
+    // U^T z = atb, then U solution = z.
+    for (unsigned int i = 0; i < terms; i++)
+    {
+        double sum = atb[i];
+
+        for (unsigned int k = 0; k < i; k++)
+        {
+            sum -= ata[k * terms + i] * solution[k];
+        }
+
+        solution[i] = sum / ata[i * terms + i];
+    }
+
+    for (unsigned int i = terms; i-- > 0;)
+    {
+        double sum = solution[i];
+
+        for (unsigned int k = i + 1; k < terms; k++)
+        {
+            sum -= ata[i * terms + k] * solution[k];
+        }
+
+        solution[i] = sum / ata[i * terms + i];
+    }
+
+    return PREPROCESSING_SUCCESSFUL;
+}
+
+/* PRIVATE IMPLEMENTATION ****************************************************/
+
+static void fit_terms(double u, double v, unsigned int degree, double* terms,
+        unsigned int stride)
+{
+    double pu[PREPROCESSING_FIT_MAX_DEGREE + 1];
+    double pv[PREPROCESSING_FIT_MAX_DEGREE + 1];
+    unsigned int t = 0;
+
+    pu[0] = 1.0;
+    pv[0] = 1.0;
+
+    for (unsigned int d = 1; d <= degree; d++)
+    {
+        pu[d] = pu[d - 1] * u;
+        pv[d] = pv[d - 1] * v;
+    }
+
+    for (unsigned int d = 0; d <= degree; d++)
+    {
+        for (unsigned int j = 0; j <= d; j++)
+        {
+            terms[(size_t)(t) * stride] = pu[d - j] * pv[j];
+            t++;
+        }
+    }
+}
+
+/*****************************************************************************/
+
+static int fit_surfaceBand(const int32_t* src, uint16_t cols,
+        unsigned int row0, unsigned int row1, uint16_t rows,
+        unsigned int degree, double* ata, double* atb)
+{
+    unsigned int terms = PREPROCESSING_FIT_TERMS(degree);
+    unsigned int m = 0;
+
+    double* design = malloc((size_t)(terms + 1) * PREPROCESSING_FIT_BLOCK
+            * sizeof(double));
+
+    if (design == 0)
+    {
+        return PREPROCESSING_NO_MEMORY;
+    }
+
+    double* values = design + (size_t)(terms) * PREPROCESSING_FIT_BLOCK;
+
+    for (unsigned int r = row0; r < row1; r++)
+    {
+        double v = fit_scale(r, rows);
+
+        for (unsigned int c = 0; c < cols; c++)
+        {
+            int32_t pixel = src[(size_t)(r) * cols + c];
+
+            if (pixel != EVE_FP32_NAN)
+            {
+                fit_terms(fit_scale(c, cols), v, degree, design + m,
+                        PREPROCESSING_FIT_BLOCK);
+                values[m] = (double)(pixel) / (double)(1 << FP32_FWL);
+                m++;
+            }
+
+            if ((m == PREPROCESSING_FIT_BLOCK)
+                    || ((m > 0) && (r + 1 == row1) && (c + 1 == cols)))
+            {
+                // A partial block keeps the stride of a full one.
+                for (unsigned int t = 1; (m < PREPROCESSING_FIT_BLOCK)
+                        && (t < terms); t++)
+                {
+                    memmove(design + (size_t)(t) * m,
+                            design + (size_t)(t) * PREPROCESSING_FIT_BLOCK,
+                            m * sizeof(double));
+                }
+
+                preprocessing_fit_accumulate(design, values, m, terms, ata,
+                        atb);
+                m = 0;
+            }
+        }
+    }
+
+    free(design);
+
+    return PREPROCESSING_SUCCESSFUL;
+}
+
+/*****************************************************************************/
+
+static double fit_scale(unsigned int c, unsigned int n)
+{
+    return (n > 1) ? (2.0 * c - (double)(n - 1)) / (double)(n - 1) : 0.0;
+}
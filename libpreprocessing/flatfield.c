@@ -6,10 +6,13 @@
  */
 
 
+#include "preprocessing/align.h"
 #include "preprocessing/ana.h"
 #include "preprocessing/arith.h"
 
 #include "preprocessing/def.h"
+#include "preprocessing/expr.h"
+#include "preprocessing/prof.h"
 #include "preprocessing/vmem.h"
 #include "preprocessing/flatfield.h"
 /* from libeve */
@@ -25,33 +28,359 @@
 #include "preprocessing/def_flatfield.h"
 #include "../udp/udp.h"
 
-int preprocessing_arith_doGetConst(uint32_t sdTmp1, uint32_t sdTmp2, uint32_t sdTmp3,
-		uint16_t rows, uint16_t cols, int16_t dx, int16_t dy, int16_t iq, int16_t ir, uint32_t sdDst1, uint32_t sdDst2){
+/* PRIVATE INTERFACE *********************************************************/
+
+/**
+ * Extract the masks of two frames from the mask of all frames in NAND,
+ * directly as ROIs of the overlap window of the shift dx, dy.
+ *
+ * @param job    the flatfield job.
+ * @param iq     the index of frame iq, its ROI starts at -dx, -dy.
+ * @param ir     the index of frame ir, its ROI starts at dx, dy.
+ * @param dx     the offset X.
+ * @param dy     the offset Y.
+ * @param sdDst1 the VMEM (SDRAM) address of the mask ROI of frame iq.
+ * @param sdDst2 the VMEM (SDRAM) address of the mask ROI of frame ir.
+ *
+ * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+ */
+static int flatfield_getMaskROIs(const struct preprocessing_flatfield_Job* job,
+		uint16_t iq, uint16_t ir, int16_t dx, int16_t dy, uint32_t sdDst1,
+		uint32_t sdDst2);
+
+/**
+ * Get the shift of frame iq against frame ir from the disp table in VMEM.
+ *
+ * @param job    the flatfield job.
+ * @param iq     the index of frame iq.
+ * @param ir     the index of frame ir.
+ * @param dx     the offset X.
+ * @param dy     the offset Y.
+ *
+ * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+ */
+static int flatfield_getShift(const struct preprocessing_flatfield_Job* job,
+		uint16_t iq, uint16_t ir, int16_t* dx, int16_t* dy);
+
+/**
+ * Store the contribution of pair iq, ir left by preprocessing_arith_doGetConst
+ * in sdTmp[0] (masked diff) and sdTmp[2] (mskDouble) in NAND, together with
+ * its shift.
+ *
+ * @param job    the flatfield job.
+ * @param iq     the index of frame iq.
+ * @param ir     the index of frame ir.
+ * @param dx     the offset X.
+ * @param dy     the offset Y.
+ *
+ * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+ */
+static int flatfield_storePair(const struct preprocessing_flatfield_Job* job,
+		uint16_t iq, uint16_t ir, int16_t dx, int16_t dy);
+
+/**
+ * Take the stored contribution of pair iq, ir back out of const (sdTmp[3])
+ * and pixCount (sdTmp[4]).
+ *
+ * @param job    the flatfield job.
+ * @param iq     the index of frame iq.
+ * @param ir     the index of frame ir.
+ *
+ * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+ */
+static int flatfield_removePair(const struct preprocessing_flatfield_Job* job,
+		uint16_t iq, uint16_t ir);
+
+/**
+ * Reset the bit of frame index in the mask of all frames to the input mask.
+ *
+ * @param job    the flatfield job.
+ * @param index  the index of the frame.
+ * @param sdDst  the VMEM (SDRAM) address of the mask of all frames.
+ *
+ * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+ */
+static int flatfield_resetMaskBit(const struct preprocessing_flatfield_Job* job,
+		uint16_t index, uint32_t sdDst);
+
+/**
+ * Mask ROI extraction kernels. Besides the generic one, there is one kernel
+ * per common frame width (binned 512, 1024 and 2048) so the compiler sees a
+ * constant row stride.
+ */
+#define FLATFIELD_DEFINE_GET_MASK_ROI(name, stride) \
+	static void name(const int32_t* restrict src, unsigned int cols, \
+			const struct udp_Overlap* w, uint16_t index, \
+			int32_t* restrict dst) \
+	{ \
+		const unsigned int n = ((stride) != 0) ? (unsigned int)(stride) : cols; \
+		const int32_t bit = FP32_BINARY_TRUE << index; \
+		for (unsigned int y = 0; y < w->rows; y++) \
+		{ \
+			const int32_t* s = src + (y + w->jyl) * n + w->jxl; \
+			int32_t* d = dst + y * n; \
+			for (unsigned int x = 0; x < w->cols; x++) \
+			{ \
+				d[x] = (s[x] & bit) >> index; \
+			} \
+		} \
+	}
+
+FLATFIELD_DEFINE_GET_MASK_ROI(flatfield_getMaskROIAny, 0)
+FLATFIELD_DEFINE_GET_MASK_ROI(flatfield_getMaskROI512, 512)
+FLATFIELD_DEFINE_GET_MASK_ROI(flatfield_getMaskROI1024, 1024)
+FLATFIELD_DEFINE_GET_MASK_ROI(flatfield_getMaskROI2048, 2048)
+
+/* PUBLIC IMPLEMENTATION *****************************************************/
+
+void preprocessing_flatfield_initJob(struct preprocessing_flatfield_Job* job,
+		int32_t** entriesOfNAND, uint16_t rows, uint16_t cols, uint16_t images,
+		uint16_t capacity){
+
+	memset(job, 0, sizeof(*job));
+
+	job->rows = rows;
+	job->cols = cols;
+	job->images = images;
+	job->capacity = capacity;
+	job->loops = LOOPS_ITERA;
+	job->checkpointEvery = CHECKPOINT_EVERY;
+	job->clip = CLIP_MODE;
+	job->iMin = IMIN;
+	job->iMax = IMAX;
+
+	job->frames = entriesOfNAND;
+	job->mask = entriesOfNAND[NAND_MASK_INDEX(capacity)];
+	job->maskTmp = entriesOfNAND[NAND_MASK_TMP_INDEX(capacity)];
+	job->cons = entriesOfNAND[NAND_CONS_INDEX(capacity)];
+	job->gain = entriesOfNAND[NAND_GAIN_INDEX(capacity)];
+	job->pixCount = entriesOfNAND[NAND_PIXCOUNT_INDEX(capacity)];
+	job->disp = entriesOfNAND[NAND_DISP_INDEX(capacity)];
+	job->logGain = entriesOfNAND[NAND_LOG_GAIN_INDEX(capacity)];
+	job->pairDisp = entriesOfNAND[NAND_PAIR_DISP_INDEX(capacity)];
+	job->pairs = entriesOfNAND + NAND_PAIR_INDEX(capacity, 0);
+}
+
+int preprocessing_flatfield_getDisp(const struct preprocessing_flatfield_Job* job,
+		uint16_t reference, uint16_t binning){
+
+	PREPROCESSING_PROF_OPERATION(0, 0);
+
+	// Integer shifts, the pair windows are whole pixels.
+	return preprocessing_align_phaseCorrelateNAND((const int32_t* const*)job->frames,
+			job->images, reference, job->rows, job->cols, binning, 0, job->disp);
+}
+
+int preprocessing_flatfield_maskImages(const struct preprocessing_flatfield_Job* job){
+
+	PREPROCESSING_PROF_OPERATION(0, 0);
 
 	int status = PREPROCESSING_SUCCESSFUL;
 
-	//Calculate Mask of each image
-	udp_loadImage(entriesOfNAND[MASK_TMP_INDEX], ROWS, COLS, sdTmp1);
-	CHECK_STATUS(udp_getMask(sdTmp1, ROWS, COLS, ir, sdTmp2))
-	CHECK_STATUS(udp_getMask(sdTmp1, ROWS, COLS, iq, sdTmp1))
+	// Each frame owns one bit of the 24.8 mask of all frames.
+	if (job->images > PREPROCESSING_FLATFIELD_MAX_IMAGES){
+		printf("Number of frames %u exceeds mask bits %u.\n",
+				(unsigned int)job->images, (unsigned int)PREPROCESSING_FLATFIELD_MAX_IMAGES);
+		return PREPROCESSING_INVALID_SIZE;
+	}
 
-	//Calculate ROIs of masks
-	CHECK_STATUS(udp_createROI(sdTmp1 , rows, cols, -dx, -dy, sdTmp1))
-	CHECK_STATUS(udp_createROI(sdTmp2 , rows, cols,  dx,  dy, sdTmp2))
+	udp_loadImage(job->disp, job->images, DISP_COLS, job->sdDisp);
 
-	//Multiply ROIs to obtain mksDouble
-	CHECK_STATUS(preprocessing_arith_multiplyImages(sdTmp1, sdTmp2, rows, cols, sdTmp3))
+	udp_loadImage(job->mask, job->rows, job->cols, job->sdTmp[0]);
+	for(uint16_t i = 0; i < job->images; i++){
+		udp_loadImage(job->frames[i], job->rows, job->cols, job->sdTmp[1]);
+		CHECK_STATUS(udp_maskImagesLog10(job->sdTmp[1], job->rows, job->cols, i, job->iMin, job->iMax, job->sdTmp[0]))
+		udp_storeImage(job->sdTmp[1], job->rows, job->cols, job->frames[i]);
+	}
 
-	udp_loadImage(entriesOfNAND[iq], ROWS, COLS, sdTmp1);
-	udp_loadImage(entriesOfNAND[ir], ROWS, COLS, sdTmp2);
+	udp_storeImage(job->sdTmp[0], job->rows, job->cols, job->maskTmp);
 
-	//Calculate ROI of images
-	CHECK_STATUS(udp_createROI(sdTmp1 , rows, cols, -dx, -dy, sdTmp1))
-	CHECK_STATUS(udp_createROI(sdTmp2 , rows, cols,  dx,  dy, sdTmp2))
+	return status;
+}
+
+int preprocessing_flatfield_getConst(const struct preprocessing_flatfield_Job* job){
+
+	PREPROCESSING_PROF_OPERATION(0, 0);
+
+	int status = PREPROCESSING_SUCCESSFUL;
+	unsigned int size = (unsigned int)(job->rows) * job->cols;
+	int16_t dx = 0;
+	int16_t dy = 0;
+
+	int32_t* cons = preprocessing_vmem_getDataAddress(job->sdTmp[3]);
+	int32_t* pixCount = preprocessing_vmem_getDataAddress(job->sdTmp[4]);
+
+	// Check whether given rows and columns are in a valid range.
+	if ((!preprocessing_vmem_isProcessingSizeValid(job->sdTmp[3], job->rows, job->cols))
+			|| (!preprocessing_vmem_isProcessingSizeValid(job->sdTmp[4], job->rows, job->cols)))
+	{
+		return PREPROCESSING_INVALID_SIZE;
+	}
 
-	//Calculate Diff
-	CHECK_STATUS(preprocessing_arith_subtractImages(sdTmp1, sdTmp2, rows, cols, sdTmp1))
-	CHECK_STATUS(preprocessing_arith_multiplyImages(sdTmp1, sdTmp3, rows, cols, sdTmp1))
+	// Const and pixCount are accumulated over all pairs.
+	memset(cons, 0, size * sizeof(int32_t));
+	memset(pixCount, 0, size * sizeof(int32_t));
+
+	for(unsigned int iq = 1; iq < job->images; iq++) {
+		printf("--------------------------\n");
+		printf("Calculate image %d with:\n", iq);
+		printf("--------------------------\n");
+
+		for(unsigned int ir = 0; ir < iq; ir++) {
+			printf("\t -Image %d\n", ir);
+
+			//Calculate Disp
+			CHECK_STATUS(flatfield_getShift(job, iq, ir, &dx, &dy))
+
+			CHECK_STATUS(preprocessing_arith_doGetConst(job, job->sdTmp[0], job->sdTmp[1], job->sdTmp[2],
+					dx, dy, iq, ir, job->sdTmp[3], job->sdTmp[4]))
+
+			//Keep the contribution of the pair for later updates
+			CHECK_STATUS(flatfield_storePair(job, iq, ir, dx, dy))
+		}
+	}
+
+	udp_storeImage(job->sdTmp[3], job->rows, job->cols, job->cons);
+	udp_storeImage(job->sdTmp[4], job->rows, job->cols, job->pixCount);
+
+	return status;
+}
+
+int preprocessing_flatfield_updateFrame(struct preprocessing_flatfield_Job* job,
+		uint16_t index){
+
+	PREPROCESSING_PROF_OPERATION(0, 0);
+
+	int status = PREPROCESSING_SUCCESSFUL;
+	int16_t dx = 0;
+	int16_t dy = 0;
+
+	if ((index > job->images) || (index >= job->capacity)
+			|| (index >= PREPROCESSING_FLATFIELD_MAX_IMAGES)){
+		printf("Frame %u can not be updated in a set of %u (room for %u).\n",
+				(unsigned int)index, (unsigned int)job->images, (unsigned int)job->capacity);
+		return PREPROCESSING_INVALID_SIZE;
+	}
+
+	if ((job->pairs == NULL) || (job->pairDisp == NULL)){
+		return PREPROCESSING_INVALID_ADDRESS;
+	}
+
+	// Check whether given rows and columns are in a valid range.
+	if ((!preprocessing_vmem_isProcessingSizeValid(job->sdTmp[3], job->rows, job->cols))
+			|| (!preprocessing_vmem_isProcessingSizeValid(job->sdTmp[4], job->rows, job->cols)))
+	{
+		return PREPROCESSING_INVALID_SIZE;
+	}
+
+	udp_loadImage(job->cons, job->rows, job->cols, job->sdTmp[3]);
+	udp_loadImage(job->pixCount, job->rows, job->cols, job->sdTmp[4]);
+
+	//Take the old pairs of a replaced frame out of const and pixCount
+	for(uint16_t i = 0; (index < job->images) && (i < job->images); i++){
+		if (i != index){
+			CHECK_STATUS(flatfield_removePair(job, udp_max16(index, i), udp_min16(index, i)))
+		}
+	}
+
+	if (index == job->images){
+		job->images++;
+	}
+
+	udp_loadImage(job->disp, job->images, DISP_COLS, job->sdDisp);
+
+	//Mask and log10 of the new frame
+	udp_loadImage(job->maskTmp, job->rows, job->cols, job->sdTmp[0]);
+	CHECK_STATUS(flatfield_resetMaskBit(job, index, job->sdTmp[0]))
+	udp_loadImage(job->frames[index], job->rows, job->cols, job->sdTmp[1]);
+	CHECK_STATUS(udp_maskImagesLog10(job->sdTmp[1], job->rows, job->cols, index, job->iMin, job->iMax, job->sdTmp[0]))
+	udp_storeImage(job->sdTmp[1], job->rows, job->cols, job->frames[index]);
+	udp_storeImage(job->sdTmp[0], job->rows, job->cols, job->maskTmp);
+
+	//New pairs of the frame
+	for(uint16_t i = 0; i < job->images; i++){
+		if (i == index){
+			continue;
+		}
+
+		uint16_t iq = udp_max16(index, i);
+		uint16_t ir = udp_min16(index, i);
+
+		printf("\t -Image %d with %d\n", iq, ir);
+
+		CHECK_STATUS(flatfield_getShift(job, iq, ir, &dx, &dy))
+
+		CHECK_STATUS(preprocessing_arith_doGetConst(job, job->sdTmp[0], job->sdTmp[1], job->sdTmp[2],
+				dx, dy, iq, ir, job->sdTmp[3], job->sdTmp[4]))
+
+		CHECK_STATUS(flatfield_storePair(job, iq, ir, dx, dy))
+	}
+
+	udp_storeImage(job->sdTmp[3], job->rows, job->cols, job->cons);
+	udp_storeImage(job->sdTmp[4], job->rows, job->cols, job->pixCount);
+
+	return status;
+}
+
+int preprocessing_flatfield_initGain(const struct preprocessing_flatfield_Job* job,
+		uint32_t sdTmp, uint32_t sdDst){
+
+	PREPROCESSING_PROF_OPERATION(0, 0);
+
+	int status = PREPROCESSING_SUCCESSFUL;
+
+	udp_loadImage(job->cons, job->rows, job->cols, sdDst);
+	udp_loadImage(job->pixCount, job->rows, job->cols, sdTmp);
+	CHECK_STATUS(udp_normalize(sdDst, sdTmp, job->rows, job->cols, sdDst))
+
+	return status;
+}
+
+int preprocessing_flatfield_loadGain(const struct preprocessing_flatfield_Job* job,
+		uint32_t sdDst){
+
+	PREPROCESSING_PROF_OPERATION(0, 0);
+
+	if (job->logGain == NULL){
+		return PREPROCESSING_INVALID_ADDRESS;
+	}
+
+	return udp_loadImage(job->logGain, job->rows, job->cols, sdDst);
+}
+
+int preprocessing_arith_doGetConst(const struct preprocessing_flatfield_Job* job,
+		uint32_t sdTmp1, uint32_t sdTmp2, uint32_t sdTmp3,
+		int16_t dx, int16_t dy, int16_t iq, int16_t ir, uint32_t sdDst1, uint32_t sdDst2){
+
+	PREPROCESSING_PROF_OPERATION(2 * PREPROCESSING_PROF_FRAME(job->rows, job->cols),
+			2 * PREPROCESSING_PROF_FRAME(job->rows, job->cols));
+
+	int status = PREPROCESSING_SUCCESSFUL;
+	uint16_t rows = job->rows;
+	uint16_t cols = job->cols;
+	struct udp_Overlap w;
+	struct preprocessing_expr_Expr diff;
+
+	//Calculate Mask ROIs of each image
+	CHECK_STATUS(flatfield_getMaskROIs(job, iq, ir, dx, dy, sdTmp1, sdTmp2))
+
+	//Multiply ROIs to obtain mksDouble
+	CHECK_STATUS(udp_multiplyOverlap(sdTmp1, sdTmp2, rows, cols, dx, dy, sdTmp3))
+
+	//Calculate ROI of images
+	CHECK_STATUS(udp_loadROI(job->frames[iq], rows, cols, -dx, -dy, sdTmp1))
+	CHECK_STATUS(udp_loadROI(job->frames[ir], rows, cols,  dx,  dy, sdTmp2))
+
+	//Calculate Diff, (ROI iq - ROI ir) * mskDouble in one pass over the window
+	CHECK_STATUS(udp_getOverlap(rows, cols, dx, dy, &w))
+	preprocessing_expr_init(&diff, rows, cols);
+	CHECK_STATUS(preprocessing_expr_setWindow(&diff, (uint16_t)w.rows, (uint16_t)w.cols))
+	int node = preprocessing_expr_multiply(&diff,
+			preprocessing_expr_subtract(&diff,
+					preprocessing_expr_frame(&diff, sdTmp1, 0, 0),
+					preprocessing_expr_frame(&diff, sdTmp2, 0, 0)),
+			preprocessing_expr_frame(&diff, sdTmp3, 0, 0));
+	CHECK_STATUS(preprocessing_expr_evaluate(&diff, node, sdTmp1, 0, 0))
 
 	//Apply diff to const
 	CHECK_STATUS(udp_addROI(sdDst1, sdTmp1, rows, cols, -dx, -dy, sdDst1))
@@ -64,41 +393,263 @@ int preprocessing_arith_doGetConst(uint32_t sdTmp1, uint32_t sdTmp2, uint32_t sd
 	return status;
  }
 
-int preprocessing_arith_iterate(uint32_t sdSrc, uint32_t sdTmp1, uint32_t sdTmp2, uint32_t sdTmp3,
-		uint16_t rows, uint16_t cols, uint16_t loops, uint32_t sdDst){
+int preprocessing_flatfield_seedGain(const struct preprocessing_flatfield_Job* job,
+		const int32_t* gain, uint32_t sdDst){
+
+	PREPROCESSING_PROF_OPERATION(PREPROCESSING_PROF_FRAME(job->rows, job->cols),
+			PREPROCESSING_PROF_FRAME(job->rows, job->cols));
+
+	int status = PREPROCESSING_SUCCESSFUL;
+	unsigned int size = (unsigned int)(job->rows) * job->cols;
+
+	int32_t* dst = preprocessing_vmem_getDataAddress(sdDst);
+
+	// Check whether given rows and columns are in a valid range.
+	if (!preprocessing_vmem_isProcessingSizeValid(sdDst, job->rows, job->cols))
+	{
+		return PREPROCESSING_INVALID_SIZE;
+	}
+
+	// udp_flatfield only takes pow10 where some frame is valid, elsewhere the
+	// product still holds the log10 gain.
+	for (unsigned int p = 0; p < size; p++){
+		if ((job->maskTmp[p] != 0) && (gain[p] > 0)){
+			dst[p] = eve_fp_double2s32(
+						log10(eve_fp_signed32ToDouble(gain[p], FP32_FWL)),
+						FP32_FWL);
+		}
+		else if (job->maskTmp[p] != 0){
+			dst[p] = 0;
+		}
+		else{
+			dst[p] = gain[p];
+		}
+
+		if (dst[p] == EVE_FP32_NAN){
+			status = PREPROCESSING_INVALID_NUMBER;
+		}
+	}
+
+	return status;
+}
+
+int preprocessing_flatfield_writeCheckpoint(const struct preprocessing_flatfield_Job* job,
+		uint32_t sdSrc, uint16_t iteration){
+
+	PREPROCESSING_PROF_OPERATION(PREPROCESSING_PROF_FRAME(job->rows, job->cols),
+			PREPROCESSING_PROF_FRAME(job->rows, job->cols));
+
+	unsigned int size = (unsigned int)(job->rows) * job->cols;
+	unsigned int disps = (unsigned int)(job->images) * DISP_COLS;
+	struct preprocessing_flatfield_Checkpoint header;
+	char tmpName[256];
+
+	const int32_t* src = preprocessing_vmem_getDataAddress(sdSrc);
+
+	// Check whether given rows and columns are in a valid range.
+	if (!preprocessing_vmem_isProcessingSizeValid(sdSrc, job->rows, job->cols))
+	{
+		return PREPROCESSING_INVALID_SIZE;
+	}
+
+	if ((job->checkpoint == NULL)
+			|| (snprintf(tmpName, sizeof(tmpName), "%s.tmp", job->checkpoint) >= (int)sizeof(tmpName))){
+		return PREPROCESSING_INVALID_ADDRESS;
+	}
+
+	memset(&header, 0, sizeof(header));
+	header.magic = PREPROCESSING_FLATFIELD_CHECKPOINT_MAGIC;
+	header.version = PREPROCESSING_FLATFIELD_CHECKPOINT_VERSION;
+	header.rows = job->rows;
+	header.cols = job->cols;
+	header.images = job->images;
+	header.clip = job->clip;
+	header.iteration = iteration;
+	header.loops = job->loops;
+	for (unsigned int p = 0; p < size; p++){
+		header.checksum += (uint32_t)src[p];
+	}
+
+	// Write a new file and rename it, a crash never leaves a torn checkpoint.
+	FILE* fp = fopen(tmpName, "wb");
+	if (fp == NULL){
+		printf("Could not open file %s\n", tmpName);
+		return PREPROCESSING_INVALID_ADDRESS;
+	}
+
+	int ok = (fwrite(&header, sizeof(header), 1, fp) == 1)
+			&& (fwrite(job->disp, sizeof(int32_t), disps, fp) == disps)
+			&& (fwrite(src, sizeof(int32_t), size, fp) == size);
+	ok = (fclose(fp) == 0) && ok;
+
+	if (!ok || (rename(tmpName, job->checkpoint) != 0)){
+		printf("Could not write checkpoint %s\n", job->checkpoint);
+		remove(tmpName);
+		return PREPROCESSING_INVALID_ADDRESS;
+	}
+
+	return PREPROCESSING_SUCCESSFUL;
+}
+
+int preprocessing_flatfield_resume(struct preprocessing_flatfield_Job* job,
+		uint32_t sdDst, uint16_t* iteration){
+
+	PREPROCESSING_PROF_OPERATION(PREPROCESSING_PROF_FRAME(job->rows, job->cols),
+			PREPROCESSING_PROF_FRAME(job->rows, job->cols));
+
+	unsigned int size = (unsigned int)(job->rows) * job->cols;
+	unsigned int disps = (unsigned int)(job->images) * DISP_COLS;
+	struct preprocessing_flatfield_Checkpoint header;
+	int32_t disp[PREPROCESSING_FLATFIELD_MAX_IMAGES * DISP_COLS];
+	uint32_t checksum = 0;
+
+	int32_t* dst = preprocessing_vmem_getDataAddress(sdDst);
+
+	// Check whether given rows and columns are in a valid range.
+	if (!preprocessing_vmem_isProcessingSizeValid(sdDst, job->rows, job->cols))
+	{
+		return PREPROCESSING_INVALID_SIZE;
+	}
+
+	if (job->checkpoint == NULL){
+		return PREPROCESSING_INVALID_ADDRESS;
+	}
+
+	if (job->images > PREPROCESSING_FLATFIELD_MAX_IMAGES){
+		return PREPROCESSING_INVALID_SIZE;
+	}
+
+	FILE* fp = fopen(job->checkpoint, "rb");
+	if (fp == NULL){
+		return PREPROCESSING_INVALID_ADDRESS;
+	}
+
+	int ok = (fread(&header, sizeof(header), 1, fp) == 1)
+			&& (header.magic == PREPROCESSING_FLATFIELD_CHECKPOINT_MAGIC)
+			&& (header.version == PREPROCESSING_FLATFIELD_CHECKPOINT_VERSION)
+			&& (header.rows == job->rows) && (header.cols == job->cols)
+			&& (header.images == job->images) && (header.clip == job->clip)
+			&& (header.iteration < header.loops)
+			&& (fread(disp, sizeof(int32_t), disps, fp) == disps)
+			&& (memcmp(disp, job->disp, disps * sizeof(int32_t)) == 0)
+			&& (fread(dst, sizeof(int32_t), size, fp) == size);
+	fclose(fp);
+
+	for (unsigned int p = 0; ok && (p < size); p++){
+		checksum += (uint32_t)dst[p];
+	}
+
+	if (!ok || (checksum != header.checksum)){
+		printf("Checkpoint %s does not match the job.\n", job->checkpoint);
+		return PREPROCESSING_INVALID_SIZE;
+	}
+
+	// The run goes on to the loops it was started with, e.g. the few loops of
+	// a warm start.
+	printf("Resume from %s after %u of %u loops.\n", job->checkpoint,
+			(unsigned int)header.iteration, (unsigned int)header.loops);
+	*iteration = header.iteration;
+	job->loops = header.loops;
+
+	return PREPROCESSING_SUCCESSFUL;
+}
+
+int preprocessing_arith_iterate(const struct preprocessing_flatfield_Job* job,
+		uint32_t sdTmp1, uint32_t sdTmp2, uint32_t sdTmp3, uint32_t sdDst){
+
+	PREPROCESSING_PROF_OPERATION(0, 0);
+
+	return preprocessing_arith_iterateFrom(job, 0, sdTmp1, sdTmp2, sdTmp3, sdDst);
+}
+
+int preprocessing_arith_iterateFrom(const struct preprocessing_flatfield_Job* job,
+		uint16_t first, uint32_t sdTmp1, uint32_t sdTmp2, uint32_t sdTmp3, uint32_t sdDst){
+
+	PREPROCESSING_PROF_OPERATION(0, 0);
 
 	int status = PREPROCESSING_SUCCESSFUL;
+	unsigned int size = (unsigned int)(job->rows) * job->cols;
 
-	for(uint16_t i = 0; i < loops; i++) {
+	const int32_t* gain = preprocessing_vmem_getDataAddress(sdDst);
 
-		printf("\tItera %d of %d\n", i+1, loops);
+	// Check whether given rows and columns are in a valid range.
+	if (!preprocessing_vmem_isProcessingSizeValid(sdDst, job->rows, job->cols))
+	{
+		return PREPROCESSING_INVALID_SIZE;
+	}
 
-		CHECK_STATUS(preprocessing_arith_doIteration(sdSrc, sdTmp1, sdTmp2, sdTmp3,
-										rows, cols, sdDst))
+	//The tolerance compares against the gain of the last loop in logGain
+	if ((job->tolerance > 0) && (job->logGain == NULL)){
+		return PREPROCESSING_INVALID_ADDRESS;
 	}
 
-	udp_loadImage(entriesOfNAND[MASK_TMP_INDEX], ROWS, COLS, sdTmp1);
-	CHECK_STATUS(udp_flatfield(sdDst, sdTmp1, rows, cols, sdDst))
+	if (job->tolerance > 0){
+		udp_storeImage(sdDst, job->rows, job->cols, job->logGain);
+	}
+
+	for(uint16_t i = first; i < job->loops; i++) {
+
+		printf("\tItera %d of %d\n", i+1, job->loops);
+
+		CHECK_STATUS(preprocessing_arith_doIteration(job, sdTmp1, sdTmp2, sdTmp3, sdDst))
+
+		if ((job->checkpoint != NULL) && (job->checkpointEvery > 0)
+				&& (((i + 1) % job->checkpointEvery) == 0) && (i + 1 < job->loops)){
+			CHECK_STATUS(preprocessing_flatfield_writeCheckpoint(job, sdDst, i + 1))
+		}
+
+		if (job->tolerance > 0){
+			int64_t change = 0;
+			for (unsigned int p = 0; p < size; p++){
+				int64_t d = (int64_t)gain[p] - job->logGain[p];
+				d = (d < 0) ? -d : d;
+				change = (d > change) ? d : change;
+			}
+			udp_storeImage(sdDst, job->rows, job->cols, job->logGain);
+
+			if (change <= job->tolerance){
+				printf("\tConverged after %d loops\n", i+1);
+				break;
+			}
+		}
+	}
+
+	//Keep the log10 gain as warm start
+	if (job->logGain != NULL){
+		udp_storeImage(sdDst, job->rows, job->cols, job->logGain);
+	}
+
+	udp_loadImage(job->maskTmp, job->rows, job->cols, sdTmp1);
+	CHECK_STATUS(udp_flatfield(sdDst, sdTmp1, job->rows, job->cols, sdDst))
+
+	//The run is complete, the checkpoint is not needed anymore
+	if (job->checkpoint != NULL){
+		remove(job->checkpoint);
+	}
 
 	return status;
 }
 
-int preprocessing_arith_doIteration(uint32_t sdSrc, uint32_t sdTmp1, uint32_t sdTmp2, uint32_t sdTmp3,
-		uint16_t rows, uint16_t cols, uint32_t sdDst){
+int preprocessing_arith_doIteration(const struct preprocessing_flatfield_Job* job,
+		uint32_t sdTmp1, uint32_t sdTmp2, uint32_t sdTmp3, uint32_t sdDst){
+
+	PREPROCESSING_PROF_OPERATION(0, 0);
 
 	int status = PREPROCESSING_SUCCESSFUL;
 
+	uint16_t rows = job->rows;
+	uint16_t cols = job->cols;
 	unsigned int size = (unsigned int)(rows) * cols;
-	unsigned int sizeDisp = DISP_ROWS * DISP_COLS;
+	unsigned int sizeDisp = (unsigned int)(job->images) * DISP_COLS;
 	unsigned int piq = 0;
 	unsigned int pir = 0;
 
-	const int32_t* src = preprocessing_vmem_getDataAddress(sdSrc); 		//Disp
+	const int32_t* src = preprocessing_vmem_getDataAddress(job->sdDisp); 		//Disp
 	int32_t* tmp2 = preprocessing_vmem_getDataAddress(sdTmp2);
 	int32_t* tmp3 = preprocessing_vmem_getDataAddress(sdTmp3);
 
 	// Check whether given rows and columns are in a valid range.
-	if ((!preprocessing_vmem_isProcessingSizeValid(sdSrc, DISP_ROWS, DISP_COLS))
+	if ((!preprocessing_vmem_isProcessingSizeValid(job->sdDisp, job->images, DISP_COLS))
 			|| (!preprocessing_vmem_isProcessingSizeValid(sdTmp2, rows, cols))
 			|| (!preprocessing_vmem_isProcessingSizeValid(sdTmp3, rows, cols)))
 	{
@@ -106,9 +657,9 @@ int preprocessing_arith_doIteration(uint32_t sdSrc, uint32_t sdTmp1, uint32_t sd
 	}
 
 	//Read Const from NAND (GainTmp)
-	udp_loadImage(entriesOfNAND[CONS_INDEX], ROWS, COLS, sdTmp1);
+	udp_loadImage(job->cons, rows, cols, sdTmp1);
 
-	for(unsigned int iq = 1; iq < NUMBER_OF_IMAGES; iq++) {
+	for(unsigned int iq = 1; iq < job->images; iq++) {
 
 		for(unsigned int ir = 0; ir < iq; ir++) {
 
@@ -125,12 +676,12 @@ int preprocessing_arith_doIteration(uint32_t sdSrc, uint32_t sdTmp1, uint32_t sd
 			int dy = (int)eve_fp_subtract32(src[piq], src[pir])/FP32_BINARY_TRUE;
 			int dx = (int)eve_fp_subtract32(src[piq + 1], src[pir + 1])/FP32_BINARY_TRUE;
 
-			CHECK_STATUS(preprocessing_arith_doIterationTwoImages(sdDst, sdTmp2, sdTmp3, rows, cols, dx, dy, iq, ir, sdTmp1))
+			CHECK_STATUS(preprocessing_arith_doIterationTwoImages(job, sdDst, sdTmp2, sdTmp3, dx, dy, iq, ir, sdTmp1))
 		}
 	}
 
 	//Normalize GainTmp
-	udp_loadImage(entriesOfNAND[PIXCOUNT_INDEX], ROWS, COLS, sdTmp2);
+	udp_loadImage(job->pixCount, rows, cols, sdTmp2);
 	CHECK_STATUS(udp_normalize(sdTmp1, sdTmp2, rows, cols, sdTmp1))
 
 	//Calculates mean (5-sigma)
@@ -144,6 +695,16 @@ int preprocessing_arith_doIteration(uint32_t sdSrc, uint32_t sdTmp1, uint32_t sd
 	uint32_t mean = tmp3[0];
 	uint32_t fiveSigma = tmp3[1];
 
+	//Median and MAD of the valid pixels instead
+	if (job->clip == PREPROCESSING_FLATFIELD_CLIP_MAD){
+		int32_t median = 0;
+		int32_t mad = 0;
+
+		CHECK_STATUS(preprocessing_ana_mad(sdTmp1, sdTmp2, rows, cols, &median, &mad))
+		mean = median;
+		fiveSigma = eve_fp_multiply32(MAD_FIVESIGMA, mad, FP32_FWL);
+	}
+
 	CHECK_STATUS(udp_fivesigma(sdTmp1, rows, cols, mean, fiveSigma, sdTmp2))
 
 	PREPROCESSING_DEF_CHECK_POINTER(tmp2, 0, size);
@@ -160,33 +721,197 @@ int preprocessing_arith_doIteration(uint32_t sdSrc, uint32_t sdTmp1, uint32_t sd
 	return status;
 }
 
-int preprocessing_arith_doIterationTwoImages(uint32_t Src, uint32_t sdTmp1, uint32_t sdTmp2,
-		uint16_t rows, uint16_t cols, int16_t dx, int16_t dy, int16_t iq, int16_t ir, uint32_t sdDst){
+int preprocessing_arith_doIterationTwoImages(const struct preprocessing_flatfield_Job* job,
+		uint32_t Src, uint32_t sdTmp1, uint32_t sdTmp2,
+		int16_t dx, int16_t dy, int16_t iq, int16_t ir, uint32_t sdDst){
 
-	int status = PREPROCESSING_SUCCESSFUL;
+	PREPROCESSING_PROF_OPERATION(2 * PREPROCESSING_PROF_FRAME(job->rows, job->cols),
+			2 * PREPROCESSING_PROF_FRAME(job->rows, job->cols));
 
-	//Obtain Mask iq, ir
-	udp_loadImage(entriesOfNAND[MASK_TMP_INDEX], ROWS, COLS, sdTmp1);
-	CHECK_STATUS(udp_getMask(sdTmp1, rows, cols, ir, sdTmp2))
-	CHECK_STATUS(udp_getMask(sdTmp1, rows, cols, iq, sdTmp1))
+	int status = PREPROCESSING_SUCCESSFUL;
+	uint16_t rows = job->rows;
+	uint16_t cols = job->cols;
 
-	//Calculate ROI masks
-	CHECK_STATUS(udp_createROI(sdTmp1 , rows, cols, -dx, -dy, sdTmp1))
-	CHECK_STATUS(udp_createROI(sdTmp2 , rows, cols,  dx,  dy, sdTmp2))
+	//Obtain Mask ROIs iq, ir
+	CHECK_STATUS(flatfield_getMaskROIs(job, iq, ir, dx, dy, sdTmp1, sdTmp2))
 
 	//Calculate mskDouble
-	CHECK_STATUS(preprocessing_arith_multiplyImages(sdTmp1, sdTmp2, rows, cols, sdTmp2))
+	CHECK_STATUS(udp_multiplyOverlap(sdTmp1, sdTmp2, rows, cols, dx, dy, sdTmp2))
 
-	//Modify GainTmp
-	CHECK_STATUS(preprocessing_ana_underThresh(sdTmp1, rows, cols, EVE_FP32_NAN, sdTmp1))
+	//Modify GainTmp, on the overlap window only
 	CHECK_STATUS(udp_createROI(Src, rows, cols, -dx, -dy, sdTmp1))
-	CHECK_STATUS(preprocessing_arith_multiplyImages(sdTmp1, sdTmp2, rows, cols, sdTmp1))
+	CHECK_STATUS(udp_multiplyOverlap(sdTmp1, sdTmp2, rows, cols, dx, dy, sdTmp1))
 	CHECK_STATUS(udp_addROI(sdDst, sdTmp1, rows, cols, dx, dy, sdDst))
 
-	CHECK_STATUS(preprocessing_ana_underThresh(sdTmp1, rows, cols, EVE_FP32_NAN, sdTmp1))
 	CHECK_STATUS(udp_createROI(Src, rows, cols,  dx,  dy, sdTmp1))
-	CHECK_STATUS(preprocessing_arith_multiplyImages(sdTmp1, sdTmp2, rows, cols, sdTmp1))
+	CHECK_STATUS(udp_multiplyOverlap(sdTmp1, sdTmp2, rows, cols, dx, dy, sdTmp1))
 	CHECK_STATUS(udp_addROI(sdDst, sdTmp1, rows, cols,  -dx,  -dy, sdDst))
 
 	return status;
 }
+
+/* PRIVATE IMPLEMENTATION ****************************************************/
+
+static int flatfield_getMaskROIs(const struct preprocessing_flatfield_Job* job,
+		uint16_t iq, uint16_t ir, int16_t dx, int16_t dy, uint32_t sdDst1,
+		uint32_t sdDst2){
+
+	int status = PREPROCESSING_SUCCESSFUL;
+	struct udp_Overlap w;
+
+	int32_t* dst1 = preprocessing_vmem_getDataAddress(sdDst1);
+	int32_t* dst2 = preprocessing_vmem_getDataAddress(sdDst2);
+
+	// Check whether given rows and columns are in a valid range.
+	if ((!preprocessing_vmem_isProcessingSizeValid(sdDst1, job->rows, job->cols))
+			|| (!preprocessing_vmem_isProcessingSizeValid(sdDst2, job->rows, job->cols)))
+	{
+		return PREPROCESSING_INVALID_SIZE;
+	}
+
+	if ((job->maskTmp == 0) || (dst1 == dst2)){
+		return PREPROCESSING_INVALID_ADDRESS;
+	}
+
+	// Both ROIs have the same window size, only the start differs.
+	for (unsigned int n = 0; n < 2; n++){
+		int16_t sign = (n == 0) ? -1 : 1;
+		uint16_t index = (n == 0) ? iq : ir;
+		int32_t* dst = (n == 0) ? dst1 : dst2;
+
+		CHECK_STATUS(udp_getOverlap(job->rows, job->cols, sign * dx, sign * dy, &w))
+
+		// Read the mask of all images directly from NAND.
+		switch (job->cols){
+		case 512:
+			flatfield_getMaskROI512(job->maskTmp, job->cols, &w, index, dst);
+			break;
+		case 1024:
+			flatfield_getMaskROI1024(job->maskTmp, job->cols, &w, index, dst);
+			break;
+		case 2048:
+			flatfield_getMaskROI2048(job->maskTmp, job->cols, &w, index, dst);
+			break;
+		default:
+			flatfield_getMaskROIAny(job->maskTmp, job->cols, &w, index, dst);
+			break;
+		}
+	}
+
+	return status;
+}
+
+/*****************************************************************************/
+
+static int flatfield_getShift(const struct preprocessing_flatfield_Job* job,
+		uint16_t iq, uint16_t ir, int16_t* dx, int16_t* dy){
+
+	unsigned int sizeDisp = (unsigned int)(job->images) * DISP_COLS;
+
+	const int32_t* disp = preprocessing_vmem_getDataAddress(job->sdDisp);
+
+	// Check whether given rows and columns are in a valid range.
+	if (!preprocessing_vmem_isProcessingSizeValid(job->sdDisp, job->images, DISP_COLS))
+	{
+		return PREPROCESSING_INVALID_SIZE;
+	}
+
+	//Calculate point
+	unsigned int piq = iq*(unsigned int)DISP_COLS;
+	unsigned int pir = ir*(unsigned int)DISP_COLS;
+
+	// Check for valid pointer position.
+	PREPROCESSING_DEF_CHECK_POINTER(disp, piq, sizeDisp);
+	PREPROCESSING_DEF_CHECK_POINTER(disp, piq+1, sizeDisp);
+	PREPROCESSING_DEF_CHECK_POINTER(disp, pir, sizeDisp);
+	PREPROCESSING_DEF_CHECK_POINTER(disp, pir+1, sizeDisp);
+
+	*dy = (int16_t)((int)eve_fp_subtract32(disp[piq], disp[pir])/FP32_BINARY_TRUE);
+	*dx = (int16_t)((int)eve_fp_subtract32(disp[piq + 1], disp[pir + 1])/FP32_BINARY_TRUE);
+
+	return PREPROCESSING_SUCCESSFUL;
+}
+
+/*****************************************************************************/
+
+static int flatfield_storePair(const struct preprocessing_flatfield_Job* job,
+		uint16_t iq, uint16_t ir, int16_t dx, int16_t dy){
+
+	int status = PREPROCESSING_SUCCESSFUL;
+	unsigned int p = PREPROCESSING_FLATFIELD_PAIR(iq, ir);
+	struct udp_Overlap w;
+
+	// Persistence is optional.
+	if ((job->pairs == NULL) || (job->pairDisp == NULL)){
+		return status;
+	}
+
+	// The shifts of all pairs must fit into one NAND entry.
+	if ((p + 1) * DISP_COLS > (unsigned int)(job->rows) * job->cols){
+		return PREPROCESSING_INVALID_SIZE;
+	}
+
+	CHECK_STATUS(udp_getOverlap(job->rows, job->cols, dx, dy, &w))
+
+	// Only the rows of the ROI are stored.
+	job->pairDisp[p * DISP_COLS] = dy;
+	job->pairDisp[p * DISP_COLS + 1] = dx;
+	udp_storeImage(job->sdTmp[0], (uint16_t)w.rows, job->cols, job->pairs[2 * p]);
+	udp_storeImage(job->sdTmp[2], (uint16_t)w.rows, job->cols, job->pairs[2 * p + 1]);
+
+	return status;
+}
+
+/*****************************************************************************/
+
+static int flatfield_removePair(const struct preprocessing_flatfield_Job* job,
+		uint16_t iq, uint16_t ir){
+
+	int status = PREPROCESSING_SUCCESSFUL;
+	unsigned int p = PREPROCESSING_FLATFIELD_PAIR(iq, ir);
+	uint16_t rows = job->rows;
+	uint16_t cols = job->cols;
+	struct udp_Overlap w;
+
+	int16_t dy = (int16_t)job->pairDisp[p * DISP_COLS];
+	int16_t dx = (int16_t)job->pairDisp[p * DISP_COLS + 1];
+
+	CHECK_STATUS(udp_getOverlap(rows, cols, dx, dy, &w))
+
+	udp_loadImage(job->pairs[2 * p], (uint16_t)w.rows, cols, job->sdTmp[0]);
+	udp_loadImage(job->pairs[2 * p + 1], (uint16_t)w.rows, cols, job->sdTmp[2]);
+
+	//Undo diff of const
+	CHECK_STATUS(udp_substractROI(job->sdTmp[3], job->sdTmp[0], rows, cols, -dx, -dy, job->sdTmp[3]))
+	CHECK_STATUS(udp_addROI(job->sdTmp[3], job->sdTmp[0], rows, cols, dx, dy, job->sdTmp[3]))
+
+	//Undo mskDouble of pixCount
+	CHECK_STATUS(udp_substractROI(job->sdTmp[4], job->sdTmp[2], rows, cols, -dx, -dy, job->sdTmp[4]))
+	CHECK_STATUS(udp_substractROI(job->sdTmp[4], job->sdTmp[2], rows, cols,  dx,  dy, job->sdTmp[4]))
+
+	return status;
+}
+
+/*****************************************************************************/
+
+static int flatfield_resetMaskBit(const struct preprocessing_flatfield_Job* job,
+		uint16_t index, uint32_t sdDst){
+
+	unsigned int size = (unsigned int)(job->rows) * job->cols;
+	const int32_t bit = FP32_BINARY_TRUE << index;
+
+	int32_t* dst = preprocessing_vmem_getDataAddress(sdDst);
+
+	// Check whether given rows and columns are in a valid range.
+	if (!preprocessing_vmem_isProcessingSizeValid(sdDst, job->rows, job->cols))
+	{
+		return PREPROCESSING_INVALID_SIZE;
+	}
+
+	// The input mask shares its bit with frame 0.
+	for (unsigned int p = 0; p < size; p++){
+		dst[p] = (dst[p] & ~bit) | (job->mask[p] & bit);
+	}
+
+	return PREPROCESSING_SUCCESSFUL;
+}
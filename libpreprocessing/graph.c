@@ -0,0 +1,1334 @@
+/*
+ * Project: Solar Orbiter - PHI (SO/PHI)
+ * Module:  Preprocessing - a library for image pre-processing.
+ *
+ * Copyright (C) 2016, Max Planck Institute for Solar System Research
+ */
+
+/**
+ * @file
+ *
+ * This file contains implementation of the graphs of pre-processing
+ * operations.
+ *
+ * A run is planned first: the nodes the stores and sums depend on, the halo
+ * of each node (the rows above and below a strip its stencil consumers
+ * read) and the height of the strips. Each strip then evaluates the nodes
+ * in the order they were added, node i on the rows of the strip widened by
+ * its halo and cut at the frame border, the stores last. Frames are read in
+ * place, a node stored once and read by nothing else is written straight to
+ * the stored image, all other nodes go to a buffer of the strip. A sum adds
+ * up the pixels of each strip and the strips are added in order afterwards,
+ * so the sum is out of range exactly when the sum of the pixels one after
+ * the other is.
+ */
+
+#include "preprocessing/graph.h"
+
+#include "preprocessing/def.h"
+#include "preprocessing/kernel.h"
+#include "preprocessing/prof.h"
+#include "preprocessing/vmem.h"
+
+#include "median_network.h"
+
+/* from libeve */
+#include "../libeve/eve/fixed_point.h"
+
+/* from std c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* PRIVATE INTERFACE *********************************************************/
+
+/**
+ * This structure is the plan of a run, shared by all strips.
+ */
+struct graph_Plan
+{
+    const struct preprocessing_graph_Graph* graph;
+    const struct preprocessing_kernel_Backend* backend;
+
+    /**
+     * This is 1 for the nodes the stores and sums depend on.
+     */
+    unsigned char needed[PREPROCESSING_GRAPH_MAX_NODES];
+
+    /**
+     * This is 1 for the nodes written straight to the stored image.
+     */
+    unsigned char direct[PREPROCESSING_GRAPH_MAX_NODES];
+
+    /**
+     * This is the number of rows above and below a strip of each node.
+     */
+    unsigned int halo[PREPROCESSING_GRAPH_MAX_NODES];
+
+    /**
+     * This is the image of a frame and the destination of a store, a sum
+     * and a node written straight to it.
+     */
+    int32_t* data[PREPROCESSING_GRAPH_MAX_NODES];
+
+    /**
+     * This is the kernel of a convolution.
+     */
+    const int32_t* kernel[PREPROCESSING_GRAPH_MAX_NODES];
+
+    unsigned int stripRows;
+    unsigned int strips;
+
+    /**
+     * This is the number of pixels of the buffers of a strip and 1 if it
+     * needs a row of accumulators for a convolution.
+     */
+    size_t buffer;
+    int accumulate;
+};
+
+/**
+ * This structure holds the rows of all nodes on one strip.
+ */
+struct graph_Strip
+{
+    unsigned int y0;
+    unsigned int y1;
+
+    /**
+     * Node i has the rows first[i] to last[i] - 1 of the frame, row first[i]
+     * starts at data[i].
+     */
+    int32_t* data[PREPROCESSING_GRAPH_MAX_NODES];
+    unsigned int first[PREPROCESSING_GRAPH_MAX_NODES];
+    unsigned int last[PREPROCESSING_GRAPH_MAX_NODES];
+
+    /**
+     * These are the accumulators of a row of a convolution.
+     */
+    int64_t* acc;
+    uint8_t* bad;
+};
+
+/**
+ * This structure is the part of a sum of one strip: the sum of its pixels
+ * and the smallest and largest sum of its first pixels.
+ */
+struct graph_Partial
+{
+    int64_t total;
+    int64_t low;
+    int64_t high;
+};
+
+/**
+ * Add a node.
+ *
+ * @param graph the graph.
+ * @param op    the operation.
+ * @param a     the first operand, -1 for none.
+ * @param b     the second operand, -1 for none.
+ * @param n     the number of operands.
+ *
+ * @return the node, -1 on failure.
+ */
+static int graph_add(struct preprocessing_graph_Graph* graph, int op, int a,
+        int b, unsigned int n);
+
+/**
+ * Plan a run.
+ *
+ * @param graph the graph.
+ * @param plan  the plan.
+ *
+ * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+ */
+static int graph_plan(const struct preprocessing_graph_Graph* graph,
+        struct graph_Plan* plan);
+
+/**
+ * Evaluate all nodes of one strip.
+ *
+ * @param plan    the plan.
+ * @param s       the strip.
+ * @param partial the parts of the sums of the strip, one per node.
+ *
+ * @return 0 on success, 1 if a node gave a NaN pixel, -1 if the strip is out
+ *         of memory.
+ */
+static int graph_runStrip(const struct graph_Plan* plan, unsigned int s,
+        struct graph_Partial* partial);
+
+/**
+ * Evaluate one node of a strip.
+ *
+ * @param plan    the plan.
+ * @param i       the node.
+ * @param strip   the rows of all nodes.
+ * @param partial the part of the sum of the strip.
+ *
+ * @return 1 if a result pixel is NaN, 0 otherwise.
+ */
+static int graph_evaluate(const struct graph_Plan* plan, unsigned int i,
+        const struct graph_Strip* strip, struct graph_Partial* partial);
+
+/**
+ * Get a row of a node of a strip.
+ *
+ * @param plan  the plan.
+ * @param strip the rows of all nodes.
+ * @param i     the node.
+ * @param r     the row of the frame.
+ *
+ * @return the row.
+ */
+static inline const int32_t* graph_row(const struct graph_Plan* plan,
+        const struct graph_Strip* strip, int i, unsigned int r);
+
+/**
+ * Compute d = a - b like the derivations of ana.c on an image of 0: a NaN
+ * operand or a difference out of range gives NaN.
+ *
+ * @param a the first operand.
+ * @param b the second operand.
+ * @param n the number of pixels.
+ * @param d the result.
+ *
+ * @return 1 if a result pixel is NaN, 0 otherwise.
+ */
+static int graph_difference(const int32_t* restrict a,
+        const int32_t* restrict b, unsigned int n, int32_t* restrict d);
+
+/**
+ * Convolve one row like the direct filter of ana.c on an image of 0.
+ *
+ * @param plan  the plan.
+ * @param strip the rows of all nodes.
+ * @param i     the node.
+ * @param r     the row of the frame.
+ * @param d     the result row.
+ *
+ * @return 1 if a result pixel is NaN, 0 otherwise.
+ */
+static int graph_convolveRow(const struct graph_Plan* plan,
+        const struct graph_Strip* strip, unsigned int i, unsigned int r,
+        int32_t* d);
+
+/**
+ * Median filter one row like the median filters of ana.c.
+ *
+ * @param plan  the plan.
+ * @param strip the rows of all nodes.
+ * @param i     the node.
+ * @param r     the row of the frame.
+ * @param d     the result row.
+ */
+static void graph_medianRow(const struct graph_Plan* plan,
+        const struct graph_Strip* strip, unsigned int i, unsigned int r,
+        int32_t* d);
+
+/**
+ * Find the median of values like the median filters of ana.c, the values
+ * are sorted.
+ *
+ * @param values the values.
+ * @param n      the number of values.
+ *
+ * @return the median.
+ */
+static int32_t graph_medianOfValues(int32_t* values, unsigned int n);
+
+/* PUBLIC IMPLEMENTATION *****************************************************/
+
+void preprocessing_graph_init(struct preprocessing_graph_Graph* graph,
+        uint16_t rows, uint16_t cols)
+{
+    graph->rows = rows;
+    graph->cols = cols;
+    graph->stripRows = 0;
+    graph->status = PREPROCESSING_SUCCESSFUL;
+    graph->nodes = 0;
+}
+
+/*****************************************************************************/
+
+int preprocessing_graph_frame(struct preprocessing_graph_Graph* graph,
+        uint32_t sdSrc)
+{
+    int node = graph_add(graph, PREPROCESSING_GRAPH_FRAME, -1, -1, 0);
+
+    if (node >= 0)
+    {
+        graph->node[node].sdAddress = sdSrc;
+    }
+
+    return node;
+}
+
+/*****************************************************************************/
+
+int preprocessing_graph_add(struct preprocessing_graph_Graph* graph, int a,
+        int b)
+{
+    return graph_add(graph, PREPROCESSING_GRAPH_ADD, a, b, 2);
+}
+
+/*****************************************************************************/
+
+int preprocessing_graph_subtract(struct preprocessing_graph_Graph* graph,
+        int a, int b)
+{
+    return graph_add(graph, PREPROCESSING_GRAPH_SUBTRACT, a, b, 2);
+}
+
+/*****************************************************************************/
+
+int preprocessing_graph_multiply(struct preprocessing_graph_Graph* graph,
+        int a, int b)
+{
+    return graph_add(graph, PREPROCESSING_GRAPH_MULTIPLY, a, b, 2);
+}
+
+/*****************************************************************************/
+
+int preprocessing_graph_divide(struct preprocessing_graph_Graph* graph,
+        int a, int b)
+{
+    return graph_add(graph, PREPROCESSING_GRAPH_DIVIDE, a, b, 2);
+}
+
+/*****************************************************************************/
+
+int preprocessing_graph_addScalar(struct preprocessing_graph_Graph* graph,
+        int a, int32_t scalar)
+{
+    int node = graph_add(graph, PREPROCESSING_GRAPH_ADD_SCALAR, a, -1, 1);
+
+    if (node >= 0)
+    {
+        graph->node[node].value = scalar;
+    }
+
+    return node;
+}
+
+/*****************************************************************************/
+
+int preprocessing_graph_subtractScalar(
+        struct preprocessing_graph_Graph* graph, int a, int32_t scalar)
+{
+    int node = graph_add(graph, PREPROCESSING_GRAPH_SUBTRACT_SCALAR, a, -1,
+            1);
+
+    if (node >= 0)
+    {
+        graph->node[node].value = scalar;
+    }
+
+    return node;
+}
+
+/*****************************************************************************/
+
+int preprocessing_graph_multiplyScalar(
+        struct preprocessing_graph_Graph* graph, int a, int32_t scalar)
+{
+    int node = graph_add(graph, PREPROCESSING_GRAPH_MULTIPLY_SCALAR, a, -1,
+            1);
+
+    if (node >= 0)
+    {
+        graph->node[node].value = scalar;
+    }
+
+    return node;
+}
+
+/*****************************************************************************/
+
+int preprocessing_graph_divideScalar(
+        struct preprocessing_graph_Graph* graph, int a, int32_t scalar)
+{
+    // Like preprocessing_arith_divideScalar().
+    if (scalar == 0)
+    {
+        printf("Divison by 0 is not allowed.\n");
+
+        if (graph->status == PREPROCESSING_SUCCESSFUL)
+        {
+            graph->status = PREPROCESSING_INVALID_NUMBER;
+        }
+
+        return -1;
+    }
+
+    int node = graph_add(graph, PREPROCESSING_GRAPH_DIVIDE_SCALAR, a, -1, 1);
+
+    if (node >= 0)
+    {
+        graph->node[node].value = scalar;
+    }
+
+    return node;
+}
+
+/*****************************************************************************/
+
+int preprocessing_graph_underThresh(struct preprocessing_graph_Graph* graph,
+        int a, int32_t thresh)
+{
+    int node = graph_add(graph, PREPROCESSING_GRAPH_UNDER, a, -1, 1);
+
+    if (node >= 0)
+    {
+        graph->node[node].value = thresh;
+    }
+
+    return node;
+}
+
+/*****************************************************************************/
+
+int preprocessing_graph_equalThresh(struct preprocessing_graph_Graph* graph,
+        int a, int32_t thresh)
+{
+    int node = graph_add(graph, PREPROCESSING_GRAPH_EQUAL, a, -1, 1);
+
+    if (node >= 0)
+    {
+        graph->node[node].value = thresh;
+    }
+
+    return node;
+}
+
+/*****************************************************************************/
+
+int preprocessing_graph_overThresh(struct preprocessing_graph_Graph* graph,
+        int a, int32_t thresh)
+{
+    int node = graph_add(graph, PREPROCESSING_GRAPH_OVER, a, -1, 1);
+
+    if (node >= 0)
+    {
+        graph->node[node].value = thresh;
+    }
+
+    return node;
+}
+
+/*****************************************************************************/
+
+int preprocessing_graph_deriveX(struct preprocessing_graph_Graph* graph,
+        int a)
+{
+    return graph_add(graph, PREPROCESSING_GRAPH_DERIVE_X, a, -1, 1);
+}
+
+/*****************************************************************************/
+
+int preprocessing_graph_deriveY(struct preprocessing_graph_Graph* graph,
+        int a)
+{
+    return graph_add(graph, PREPROCESSING_GRAPH_DERIVE_Y, a, -1, 1);
+}
+
+/*****************************************************************************/
+
+int preprocessing_graph_median(struct preprocessing_graph_Graph* graph,
+        int a, uint16_t size)
+{
+    // Check parameters.
+    if (((size % 2) == 0) || (size > PREPROCESSING_GRAPH_MAX_MEDIAN))
+    {
+        printf("Median filter size %u is not odd or too large.\n",
+                (unsigned int)(size));
+
+        if (graph->status == PREPROCESSING_SUCCESSFUL)
+        {
+            graph->status = PREPROCESSING_INVALID_SIZE;
+        }
+
+        return -1;
+    }
+
+    int node = graph_add(graph, PREPROCESSING_GRAPH_MEDIAN, a, -1, 1);
+
+    if (node >= 0)
+    {
+        graph->node[node].rows = size;
+        graph->node[node].cols = size;
+    }
+
+    return node;
+}
+
+/*****************************************************************************/
+
+int preprocessing_graph_convolve(struct preprocessing_graph_Graph* graph,
+        int a, uint32_t sdKernel, uint16_t rows, uint16_t cols)
+{
+    // Check parameters.
+    if ((rows == 0) || (cols == 0))
+    {
+        printf("Kernel %u x %u is empty.\n", rows, cols);
+
+        if (graph->status == PREPROCESSING_SUCCESSFUL)
+        {
+            graph->status = PREPROCESSING_INVALID_SIZE;
+        }
+
+        return -1;
+    }
+
+    int node = graph_add(graph, PREPROCESSING_GRAPH_CONVOLVE, a, -1, 1);
+
+    if (node >= 0)
+    {
+        graph->node[node].sdAddress = sdKernel;
+        graph->node[node].rows = rows;
+        graph->node[node].cols = cols;
+    }
+
+    return node;
+}
+
+/*****************************************************************************/
+
+int preprocessing_graph_store(struct preprocessing_graph_Graph* graph, int a,
+        uint32_t sdDst)
+{
+    int node = graph_add(graph, PREPROCESSING_GRAPH_STORE, a, -1, 1);
+
+    if (node >= 0)
+    {
+        graph->node[node].sdAddress = sdDst;
+    }
+
+    return node;
+}
+
+/*****************************************************************************/
+
+int preprocessing_graph_sum(struct preprocessing_graph_Graph* graph, int a,
+        uint32_t sdDst)
+{
+    int node = graph_add(graph, PREPROCESSING_GRAPH_SUM, a, -1, 1);
+
+    if (node >= 0)
+    {
+        graph->node[node].sdAddress = sdDst;
+    }
+
+    return node;
+}
+
+/*****************************************************************************/
+
+int preprocessing_graph_run(const struct preprocessing_graph_Graph* graph)
+{
+    struct graph_Plan plan;
+    uint64_t bytesRead = 0;
+    uint64_t bytesWritten = 0;
+    unsigned int ops = 0;
+    int invalid = 0;
+    int failed = 0;
+
+    if (graph->status != PREPROCESSING_SUCCESSFUL)
+    {
+        return graph->status;
+    }
+
+    int status = graph_plan(graph, &plan);
+
+    if ((status != PREPROCESSING_SUCCESSFUL) || (plan.strips == 0))
+    {
+        return status;
+    }
+
+    for (unsigned int i = 0; i < graph->nodes; i++)
+    {
+        int op = graph->node[i].op;
+
+        if (!plan.needed[i])
+        {
+            continue;
+        }
+
+        if (op == PREPROCESSING_GRAPH_FRAME)
+        {
+            bytesRead += PREPROCESSING_PROF_FRAME(graph->rows, graph->cols);
+        }
+        else if (op == PREPROCESSING_GRAPH_STORE)
+        {
+            bytesWritten += PREPROCESSING_PROF_FRAME(graph->rows,
+                    graph->cols);
+        }
+        else
+        {
+            ops++;
+        }
+    }
+
+    PREPROCESSING_PROF_KERNEL(bytesRead, bytesWritten,
+            (uint64_t)(graph->rows) * graph->cols, ops);
+
+    struct graph_Partial* partial = malloc((size_t)(plan.strips)
+            * graph->nodes * sizeof(struct graph_Partial));
+
+    if (partial == 0)
+    {
+        printf("Graph is out of memory.\n");
+        return PREPROCESSING_NO_MEMORY;
+    }
+
+    // Process, the strips are spread over all cores.
+    PREPROCESSING_DEF_PARALLEL_FOR_OR(invalid)
+    for (unsigned int s = 0; s < plan.strips; s++)
+    {
+        int result = graph_runStrip(&plan, s,
+                partial + (size_t)(s) * graph->nodes);
+
+        invalid |= (result > 0);
+        failed |= (result < 0);
+    }
+
+    // Add the strips of each sum in order.
+    for (unsigned int i = 0; (i < graph->nodes) && !failed; i++)
+    {
+        if (!plan.needed[i] || (graph->node[i].op != PREPROCESSING_GRAPH_SUM))
+        {
+            continue;
+        }
+
+        int64_t sum = *plan.data[i];
+
+        for (unsigned int s = 0; s < plan.strips; s++)
+        {
+            const struct graph_Partial* p = partial
+                    + (size_t)(s) * graph->nodes + i;
+
+            if ((sum + p->low < EVE_FP32_MIN) || (sum + p->high > EVE_FP32_MAX))
+            {
+                sum = EVE_FP32_NAN;
+                invalid = 1;
+                break;
+            }
+
+            sum += p->total;
+        }
+
+        *plan.data[i] = (int32_t)(sum);
+    }
+
+    free(partial);
+
+    if (failed)
+    {
+        printf("Graph is out of memory.\n");
+        return PREPROCESSING_NO_MEMORY;
+    }
+
+    return invalid ? PREPROCESSING_INVALID_NUMBER : PREPROCESSING_SUCCESSFUL;
+}
+
+/* PRIVATE IMPLEMENTATION ****************************************************/
+
+static int graph_add(struct preprocessing_graph_Graph* graph, int op, int a,
+        int b, unsigned int n)
+{
+    int operand[2] = { a, b };
+
+    for (unsigned int o = 0; o < n; o++)
+    {
+        // A failed operand has been reported already.
+        if (operand[o] < 0)
+        {
+            return -1;
+        }
+
+        // Stores and sums give no pixels to operate on.
+        if (((unsigned int)(operand[o]) >= graph->nodes)
+                || (graph->node[operand[o]].op == PREPROCESSING_GRAPH_STORE)
+                || (graph->node[operand[o]].op == PREPROCESSING_GRAPH_SUM))
+        {
+            printf("Invalid graph node: %d.\n", operand[o]);
+
+            if (graph->status == PREPROCESSING_SUCCESSFUL)
+            {
+                graph->status = PREPROCESSING_INVALID_NUMBER;
+            }
+
+            return -1;
+        }
+    }
+
+    if (graph->nodes >= PREPROCESSING_GRAPH_MAX_NODES)
+    {
+        printf("Too many graph nodes: %u.\n", graph->nodes + 1);
+
+        if (graph->status == PREPROCESSING_SUCCESSFUL)
+        {
+            graph->status = PREPROCESSING_NO_MEMORY;
+        }
+
+        return -1;
+    }
+
+    struct preprocessing_graph_Node* node = graph->node + graph->nodes;
+
+    node->op = op;
+    node->operand[0] = a;
+    node->operand[1] = b;
+    node->sdAddress = 0;
+    node->rows = 0;
+    node->cols = 0;
+    node->value = 0;
+
+    return (int)(graph->nodes++);
+}
+
+/*****************************************************************************/
+
+static int graph_plan(const struct preprocessing_graph_Graph* graph,
+        struct graph_Plan* plan)
+{
+    unsigned int consumers[PREPROCESSING_GRAPH_MAX_NODES];
+    unsigned int buffers = 0;
+    unsigned int halos = 0;
+
+    memset(plan, 0, sizeof(*plan));
+    memset(consumers, 0, sizeof(consumers));
+    plan->graph = graph;
+    plan->backend = preprocessing_kernel_backend();
+
+    // Check whether given rows and columns are in a valid range.
+    if ((graph->rows == 0) || (graph->cols == 0))
+    {
+        return PREPROCESSING_INVALID_SIZE;
+    }
+
+    // The operands come before a node, so one pass from the last node down
+    // finds all nodes the stores and sums depend on, and the halo of each.
+    for (int i = (int)(graph->nodes) - 1; i >= 0; i--)
+    {
+        const struct preprocessing_graph_Node* n = graph->node + i;
+        unsigned int radius = 0;
+
+        if ((n->op == PREPROCESSING_GRAPH_STORE)
+                || (n->op == PREPROCESSING_GRAPH_SUM))
+        {
+            plan->needed[i] = 1;
+        }
+
+        if (!plan->needed[i])
+        {
+            continue;
+        }
+
+        switch (n->op)
+        {
+        case PREPROCESSING_GRAPH_DERIVE_X:
+            // Like preprocessing_ana_deriveX(), the rows above and below.
+            radius = 1;
+            break;
+        case PREPROCESSING_GRAPH_MEDIAN:
+            radius = n->rows / 2u;
+            break;
+        case PREPROCESSING_GRAPH_CONVOLVE:
+            // Kernel rows below the result pixel, at least those above.
+            radius = n->rows - 1u - (n->rows - 1u) / 2;
+            break;
+        default:
+            break;
+        }
+
+        for (unsigned int o = 0; o < 2; o++)
+        {
+            int a = n->operand[o];
+
+            if (a >= 0)
+            {
+                plan->needed[a] = 1;
+                consumers[a]++;
+
+                if (plan->halo[a] < plan->halo[i] + radius)
+                {
+                    plan->halo[a] = plan->halo[i] + radius;
+                }
+            }
+        }
+    }
+
+    // Map the frames, kernels and destinations.
+    for (unsigned int i = 0; i < graph->nodes; i++)
+    {
+        const struct preprocessing_graph_Node* n = graph->node + i;
+        uint16_t rows = graph->rows;
+        uint16_t cols = graph->cols;
+
+        if (!plan->needed[i])
+        {
+            continue;
+        }
+
+        if (n->op == PREPROCESSING_GRAPH_CONVOLVE)
+        {
+            rows = n->rows;
+            cols = n->cols;
+            plan->accumulate = 1;
+        }
+        else if (n->op == PREPROCESSING_GRAPH_SUM)
+        {
+            rows = 1;
+            cols = 1;
+        }
+        else if ((n->op != PREPROCESSING_GRAPH_FRAME)
+                && (n->op != PREPROCESSING_GRAPH_STORE))
+        {
+            continue;
+        }
+
+        plan->data[i] = preprocessing_vmem_getDataAddress(n->sdAddress);
+
+        if (!preprocessing_vmem_isProcessingSizeValid(n->sdAddress, rows,
+                cols))
+        {
+            return PREPROCESSING_INVALID_SIZE;
+        }
+
+        if (plan->data[i] == 0)
+        {
+            return PREPROCESSING_INVALID_ADDRESS;
+        }
+
+        if (n->op == PREPROCESSING_GRAPH_CONVOLVE)
+        {
+            plan->kernel[i] = plan->data[i];
+            plan->data[i] = 0;
+        }
+    }
+
+    // A store must not overwrite pixels another strip still reads, and a
+    // node is written straight to the image it is stored in when nothing
+    // else reads it and the image is not read by the graph.
+    for (unsigned int i = 0; i < graph->nodes; i++)
+    {
+        const struct preprocessing_graph_Node* n = graph->node + i;
+        int a = n->operand[0];
+        int read = 0;
+
+        if (!plan->needed[i] || (n->op != PREPROCESSING_GRAPH_STORE))
+        {
+            continue;
+        }
+
+        for (unsigned int j = 0; j < graph->nodes; j++)
+        {
+            const struct preprocessing_graph_Node* m = graph->node + j;
+
+            if (!plan->needed[j] || (m->sdAddress != n->sdAddress))
+            {
+                continue;
+            }
+
+            if (((m->op == PREPROCESSING_GRAPH_FRAME) && (plan->halo[j] > 0))
+                    || (m->op == PREPROCESSING_GRAPH_CONVOLVE))
+            {
+                printf("Graph stores to SDRAM address %u it reads around "
+                        "the strips.\n", (unsigned int)(n->sdAddress));
+                return PREPROCESSING_INVALID_ADDRESS;
+            }
+
+            read |= (m->op == PREPROCESSING_GRAPH_FRAME);
+        }
+
+        if (!read && (consumers[a] == 1) && (plan->halo[a] == 0)
+                && (graph->node[a].op != PREPROCESSING_GRAPH_FRAME))
+        {
+            plan->direct[a] = 1;
+            plan->data[a] = plan->data[i];
+        }
+    }
+
+    for (unsigned int i = 0; i < graph->nodes; i++)
+    {
+        int op = graph->node[i].op;
+
+        if (plan->needed[i] && !plan->direct[i]
+                && (op != PREPROCESSING_GRAPH_FRAME)
+                && (op != PREPROCESSING_GRAPH_STORE)
+                && (op != PREPROCESSING_GRAPH_SUM))
+        {
+            buffers++;
+            halos += 2 * plan->halo[i];
+        }
+    }
+
+    // Size the strips so the buffers of a strip fit into the cache.
+    plan->stripRows = graph->stripRows;
+
+    if (plan->stripRows == 0)
+    {
+        unsigned int budget = PREPROCESSING_GRAPH_CACHE
+                / (graph->cols * sizeof(int32_t));
+
+        plan->stripRows = budget;
+
+        if (buffers > 0)
+        {
+            plan->stripRows = (budget > halos) ? (budget - halos) / buffers
+                    : 0;
+        }
+
+        if (plan->stripRows < PREPROCESSING_GRAPH_MIN_STRIP)
+        {
+            plan->stripRows = PREPROCESSING_GRAPH_MIN_STRIP;
+        }
+    }
+
+    if (plan->stripRows > graph->rows)
+    {
+        plan->stripRows = graph->rows;
+    }
+
+    plan->strips = (graph->rows + plan->stripRows - 1) / plan->stripRows;
+
+    for (unsigned int i = 0; i < graph->nodes; i++)
+    {
+        int op = graph->node[i].op;
+        unsigned int rows = plan->stripRows + 2 * plan->halo[i];
+
+        if (plan->needed[i] && !plan->direct[i]
+                && (op != PREPROCESSING_GRAPH_FRAME)
+                && (op != PREPROCESSING_GRAPH_STORE)
+                && (op != PREPROCESSING_GRAPH_SUM))
+        {
+            rows = (rows < graph->rows) ? rows : graph->rows;
+            plan->buffer += (size_t)(rows) * graph->cols;
+        }
+    }
+
+    return PREPROCESSING_SUCCESSFUL;
+}
+
+/*****************************************************************************/
+
+static int graph_runStrip(const struct graph_Plan* plan, unsigned int s,
+        struct graph_Partial* partial)
+{
+    const struct preprocessing_graph_Graph* graph = plan->graph;
+    struct graph_Strip strip;
+    int nan = 0;
+
+    size_t accumulators = plan->accumulate ? graph->cols : 0;
+
+    // The accumulators of a convolution first, so they are aligned, then
+    // the buffers and the flags of the accumulators.
+    int64_t* buffer = malloc(accumulators * (sizeof(int64_t) + 1)
+            + plan->buffer * sizeof(int32_t));
+
+    if ((buffer == 0) && ((plan->buffer > 0) || plan->accumulate))
+    {
+        return -1;
+    }
+
+    strip.y0 = s * plan->stripRows;
+    strip.y1 = strip.y0 + plan->stripRows;
+    strip.y1 = (strip.y1 < graph->rows) ? strip.y1 : graph->rows;
+    strip.acc = buffer;
+
+    int32_t* next = (int32_t*)(buffer + accumulators);
+
+    for (unsigned int i = 0; i < graph->nodes; i++)
+    {
+        int op = graph->node[i].op;
+        unsigned int halo = plan->halo[i];
+
+        if (!plan->needed[i])
+        {
+            continue;
+        }
+
+        strip.first[i] = (strip.y0 > halo) ? strip.y0 - halo : 0;
+        strip.last[i] = (strip.y1 + halo < graph->rows) ? strip.y1 + halo
+                : graph->rows;
+
+        if ((op == PREPROCESSING_GRAPH_FRAME) || plan->direct[i])
+        {
+            strip.data[i] = plan->data[i]
+                    + (size_t)(strip.first[i]) * graph->cols;
+        }
+        else if ((op != PREPROCESSING_GRAPH_STORE)
+                && (op != PREPROCESSING_GRAPH_SUM))
+        {
+            strip.data[i] = next;
+            next += (size_t)(strip.last[i] - strip.first[i]) * graph->cols;
+        }
+    }
+
+    strip.bad = (uint8_t*)(next);
+
+    // The stores come last, so a frame stored to is read first.
+    for (unsigned int i = 0; i < graph->nodes; i++)
+    {
+        if (plan->needed[i]
+                && (graph->node[i].op != PREPROCESSING_GRAPH_STORE))
+        {
+            nan |= graph_evaluate(plan, i, &strip, partial + i);
+        }
+    }
+
+    for (unsigned int i = 0; i < graph->nodes; i++)
+    {
+        if (plan->needed[i]
+                && (graph->node[i].op == PREPROCESSING_GRAPH_STORE))
+        {
+            nan |= graph_evaluate(plan, i, &strip, partial + i);
+        }
+    }
+
+    free(buffer);
+
+    return nan;
+}
+
+/*****************************************************************************/
+
+static int graph_evaluate(const struct graph_Plan* plan, unsigned int i,
+        const struct graph_Strip* strip, struct graph_Partial* partial)
+{
+    const struct preprocessing_graph_Graph* graph = plan->graph;
+    const struct preprocessing_kernel_Backend* backend = plan->backend;
+    const struct preprocessing_graph_Node* n = graph->node + i;
+    unsigned int first = strip->first[i];
+    unsigned int last = strip->last[i];
+    unsigned int count = (last - first) * graph->cols;
+    const int32_t* a = (n->operand[0] >= 0) ? graph_row(plan, strip,
+            n->operand[0], first) : 0;
+    const int32_t* b = (n->operand[1] >= 0) ? graph_row(plan, strip,
+            n->operand[1], first) : 0;
+    int32_t* d = strip->data[i];
+    int32_t value = n->value;
+    int nan = 0;
+
+    switch (n->op)
+    {
+    case PREPROCESSING_GRAPH_ADD:
+        return backend->add(a, b, d, count);
+    case PREPROCESSING_GRAPH_SUBTRACT:
+        return backend->subtract(a, b, d, count);
+    case PREPROCESSING_GRAPH_MULTIPLY:
+        return backend->multiply(a, b, d, count);
+    case PREPROCESSING_GRAPH_ADD_SCALAR:
+        return backend->addScalar(a, value, d, count);
+    case PREPROCESSING_GRAPH_SUBTRACT_SCALAR:
+        return backend->subtractScalar(a, value, d, count);
+    case PREPROCESSING_GRAPH_MULTIPLY_SCALAR:
+        return backend->multiplyScalar(a, value, d, count);
+    case PREPROCESSING_GRAPH_DIVIDE:
+        for (unsigned int p = 0; p < count; p++)
+        {
+            d[p] = eve_fp_divide32(a[p], b[p], FP32_FWL);
+            nan |= (d[p] == EVE_FP32_NAN);
+        }
+        break;
+    case PREPROCESSING_GRAPH_DIVIDE_SCALAR:
+        for (unsigned int p = 0; p < count; p++)
+        {
+            d[p] = eve_fp_divide32(a[p], value, FP32_FWL);
+            nan |= (d[p] == EVE_FP32_NAN);
+        }
+        break;
+    case PREPROCESSING_GRAPH_UNDER:
+        for (unsigned int p = 0; p < count; p++)
+        {
+            d[p] = (a[p] < value) ? FP32_BINARY_TRUE : 0;
+        }
+        break;
+    case PREPROCESSING_GRAPH_EQUAL:
+        for (unsigned int p = 0; p < count; p++)
+        {
+            d[p] = (a[p] == value) ? FP32_BINARY_TRUE : 0;
+        }
+        break;
+    case PREPROCESSING_GRAPH_OVER:
+        for (unsigned int p = 0; p < count; p++)
+        {
+            d[p] = (a[p] > value) ? FP32_BINARY_TRUE : 0;
+        }
+        break;
+    case PREPROCESSING_GRAPH_DERIVE_X:
+        for (unsigned int r = first; r < last; r++)
+        {
+            int32_t* t = d + (size_t)(r - first) * graph->cols;
+
+            // A single row has no neighbours, the border is mirrored.
+            if (graph->rows == 1)
+            {
+                memset(t, 0, graph->cols * sizeof(int32_t));
+                continue;
+            }
+
+            nan |= graph_difference(
+                    graph_row(plan, strip, n->operand[0],
+                            (r > 0) ? r - 1 : r + 1),
+                    graph_row(plan, strip, n->operand[0],
+                            (r + 1 < graph->rows) ? r + 1 : r - 1),
+                    graph->cols, t);
+        }
+        break;
+    case PREPROCESSING_GRAPH_DERIVE_Y:
+        for (unsigned int r = first; r < last; r++)
+        {
+            const int32_t* s = graph_row(plan, strip, n->operand[0], r);
+            int32_t* t = d + (size_t)(r - first) * graph->cols;
+            unsigned int c = graph->cols;
+
+            // A single column has no neighbours, the border is mirrored.
+            if (c == 1)
+            {
+                t[0] = 0;
+                continue;
+            }
+
+            nan |= graph_difference(s + 1, s + 1, 1, t);
+            nan |= graph_difference(s, s + 2, c - 2u, t + 1);
+            nan |= graph_difference(s + c - 2, s + c - 2, 1, t + c - 1);
+        }
+        break;
+    case PREPROCESSING_GRAPH_MEDIAN:
+        for (unsigned int r = first; r < last; r++)
+        {
+            graph_medianRow(plan, strip, i, r,
+                    d + (size_t)(r - first) * graph->cols);
+        }
+        break;
+    case PREPROCESSING_GRAPH_CONVOLVE:
+        for (unsigned int r = first; r < last; r++)
+        {
+            nan |= graph_convolveRow(plan, strip, i, r,
+                    d + (size_t)(r - first) * graph->cols);
+        }
+        break;
+    case PREPROCESSING_GRAPH_STORE:
+        if (!plan->direct[n->operand[0]])
+        {
+            memcpy(plan->data[i] + (size_t)(first) * graph->cols, a,
+                    count * sizeof(int32_t));
+        }
+        break;
+    case PREPROCESSING_GRAPH_SUM:
+        partial->total = 0;
+        partial->low = 0;
+        partial->high = 0;
+
+        for (unsigned int p = 0; p < count; p++)
+        {
+            partial->total += a[p];
+            partial->low = (partial->total < partial->low) ? partial->total
+                    : partial->low;
+            partial->high = (partial->total > partial->high)
+                    ? partial->total : partial->high;
+        }
+        break;
+    default:
+        break;
+    }
+
+    return nan;
+}
+
+/*****************************************************************************/
+
+static inline const int32_t* graph_row(const struct graph_Plan* plan,
+        const struct graph_Strip* strip, int i, unsigned int r)
+{
+    return strip->data[i]
+            + (size_t)(r - strip->first[i]) * plan->graph->cols;
+}
+
+/*****************************************************************************/
+
+static int graph_difference(const int32_t* restrict a,
+        const int32_t* restrict b, unsigned int n, int32_t* restrict d)
+{
+    int nan = 0;
+
+    for (unsigned int i = 0; i < n; i++)
+    {
+        int64_t difference = (int64_t)(a[i]) - b[i];
+        int bad = (a[i] == EVE_FP32_NAN) | (b[i] == EVE_FP32_NAN)
+                | (difference < EVE_FP32_MIN) | (difference > EVE_FP32_MAX);
+
+        d[i] = bad ? EVE_FP32_NAN : (int32_t)(difference);
+        nan |= bad;
+    }
+
+    return nan;
+}
+
+/*****************************************************************************/
+
+static int graph_convolveRow(const struct graph_Plan* plan,
+        const struct graph_Strip* strip, unsigned int i, unsigned int r,
+        int32_t* d)
+{
+    const struct preprocessing_graph_Node* n = plan->graph->node + i;
+    const int32_t* w = plan->kernel[i];
+    unsigned int size2 = (unsigned int)(n->rows) * n->cols;
+    unsigned int cols = plan->graph->cols;
+    unsigned int kr = (n->rows - 1u) / 2;
+    unsigned int kc = (n->cols - 1u) / 2;
+    int64_t* acc = strip->acc;
+    uint8_t* bad = strip->bad;
+    int nan = 0;
+
+    memset(acc, 0, cols * sizeof(int64_t));
+    memset(bad, 0, cols);
+
+    // Tap by tap over the row like ana_filterDirect(), the kernel rotated
+    // by 180 degrees. Taps on the zero padding add nothing and are left
+    // out.
+    for (unsigned int i2 = 0; i2 < n->rows; i2++)
+    {
+        long y = (long)(r) + (long)(i2) - (long)(kr);
+
+        if ((y < 0) || (y >= (long)(plan->graph->rows)))
+        {
+            continue;
+        }
+
+        const int32_t* s = graph_row(plan, strip, n->operand[0],
+                (unsigned int)(y));
+
+        for (unsigned int j = 0; j < n->cols; j++)
+        {
+            int64_t k = w[size2 - 1 - (i2 * n->cols + j)];
+            unsigned int x0 = (j < kc) ? kc - j : 0;
+            unsigned int x1 = (cols + kc > j) ? cols + kc - j : 0;
+            const int32_t* t = s + (long)(j) - (long)(kc);
+
+            x1 = (x1 < cols) ? x1 : cols;
+
+            for (unsigned int x = x0; x < x1; x++)
+            {
+                int64_t prod = (t[x] * k) >> FP32_FWL;
+                int okProd = (prod >= EVE_FP32_MIN) & (prod <= EVE_FP32_MAX);
+                int64_t sum = acc[x] + (okProd ? prod : 0);
+                int okSum = (sum >= EVE_FP32_MIN) & (sum <= EVE_FP32_MAX);
+
+                acc[x] = okSum ? sum : 0;
+                bad[x] |= (uint8_t)(!(okProd & okSum));
+            }
+        }
+    }
+
+    for (unsigned int x = 0; x < cols; x++)
+    {
+        d[x] = bad[x] ? EVE_FP32_NAN : (int32_t)(acc[x]);
+        nan |= bad[x];
+    }
+
+    return nan;
+}
+
+/*****************************************************************************/
+
+static void graph_medianRow(const struct graph_Plan* plan,
+        const struct graph_Strip* strip, unsigned int i, unsigned int r,
+        int32_t* d)
+{
+    const struct preprocessing_graph_Node* n = plan->graph->node + i;
+    const int32_t* s[PREPROCESSING_GRAPH_MAX_MEDIAN];
+    unsigned int rows = plan->graph->rows;
+    unsigned int cols = plan->graph->cols;
+    unsigned int radius = n->rows / 2u;
+    unsigned int r0 = (r > radius) ? r - radius : 0;
+    unsigned int r1 = (r + radius < rows) ? r + radius + 1 : rows;
+    int inner = (r1 - r0 == n->rows);
+
+    for (unsigned int y = r0; y < r1; y++)
+    {
+        s[y - r0] = graph_row(plan, strip, n->operand[0], y);
+    }
+
+    for (unsigned int c = 0; c < cols; c++)
+    {
+        int32_t values[PREPROCESSING_GRAPH_MAX_MEDIAN
+                * PREPROCESSING_GRAPH_MAX_MEDIAN];
+        unsigned int c0 = (c > radius) ? c - radius : 0;
+        unsigned int c1 = (c + radius < cols) ? c + radius + 1 : cols;
+        unsigned int m = 0;
+
+        // Whole 3 x 3 and 5 x 5 windows go through the sorting networks
+        // like in ana.c, the windows cut at the border are sorted.
+        if (inner && (c1 - c0 == 3u) && (n->rows == 3))
+        {
+            for (unsigned int y = 0; y < 3; y++)
+            {
+                for (unsigned int x = 0; x < 3; x++)
+                {
+                    values[y * 3 + x] = s[y][c0 + x];
+                }
+            }
+
+            d[c] = median_network9(values);
+            continue;
+        }
+
+        if (inner && (c1 - c0 == 5u) && (n->rows == 5))
+        {
+            for (unsigned int y = 0; y < 5; y++)
+            {
+                for (unsigned int x = 0; x < 5; x++)
+                {
+                    values[y * 5 + x] = s[y][c0 + x];
+                }
+            }
+
+            d[c] = median_network25(values);
+            continue;
+        }
+
+        for (unsigned int y = 0; y < r1 - r0; y++)
+        {
+            for (unsigned int x = c0; x < c1; x++)
+            {
+                values[m++] = s[y][x];
+            }
+        }
+
+        d[c] = graph_medianOfValues(values, m);
+    }
+}
+
+/*****************************************************************************/
+
+static int32_t graph_medianOfValues(int32_t* values, unsigned int n)
+{
+    // Insertion sort, the windows are small.
+    for (unsigned int i = 1; i < n; i++)
+    {
+        int32_t v = values[i];
+        unsigned int j = i;
+
+        while ((j > 0) && (values[j - 1] > v))
+        {
+            values[j] = values[j - 1];
+            j--;
+        }
+
+        values[j] = v;
+    }
+
+    // Choose median value differently depending on even or odd number of
+    // elements.
+    if ((n % 2) == 0)
+    {
+        int32_t median = eve_fp_add32(values[(n / 2) - 1], values[n / 2]);
+        return eve_fp_divide32(median, eve_fp_int2s32(2, FP32_FWL), FP32_FWL);
+    }
+
+    return values[n / 2];
+}
@@ -0,0 +1,628 @@
+/*
+ * Project: Solar Orbiter - PHI (SO/PHI)
+ * Module:  Preprocessing - a library for image pre-processing.
+ *
+ * Copyright (C) 2016, Max Planck Institute for Solar System Research
+ */
+
+/**
+ * @file
+ *
+ * This file contains implementation of the detection of the solar limb by a
+ * circle Hough transform.
+ */
+
+#include "preprocessing/hough.h"
+
+#include "preprocessing/ana.h"
+#include "preprocessing/def.h"
+#include "preprocessing/fit.h"
+#include "preprocessing/prof.h"
+#include "preprocessing/vmem.h"
+
+/* from libeve */
+#include "../libeve/eve/fixed_point.h"
+
+/* from std c */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * This is the distance in pixels from the detected circle within which edge
+ * points take part in the final fit.
+ */
+#define HOUGH_FIT_BAND 3.0
+
+/**
+ * This is the half edge length of the window over which the gradient of an
+ * edge point is summed. The gradient of a single pixel of a sharp limb
+ * points along the pixel grid rather than to the center.
+ */
+#define HOUGH_SMOOTH 2
+
+/**
+ * This is an edge point with the unit vector of its gradient.
+ */
+struct hough_Edge
+{
+    double y;  /**< row */
+    double x;  /**< column */
+    double uy; /**< row part of the direction towards the center */
+    double ux; /**< column part of the direction towards the center */
+};
+
+/**
+ * This is the part of the center plane covered by an accumulator.
+ */
+struct hough_Grid
+{
+    double y0;         /**< row of the first cell */
+    double x0;         /**< column of the first cell */
+    double cell;       /**< edge length of a cell in pixels */
+    unsigned int rows; /**< number of cell rows */
+    unsigned int cols; /**< number of cell columns */
+};
+
+/* PRIVATE INTERFACE *********************************************************/
+
+/**
+ * Collect the strongest pixels of the gradient as edge points.
+ *
+ * @param dY    the row derivation (preprocessing_ana_gradient()).
+ * @param dX    the column derivation (preprocessing_ana_gradient()).
+ * @param rows  the number of image rows.
+ * @param cols  the number of image columns.
+ * @param count the largest number of edge points.
+ * @param edges the edge points.
+ * @param found the number of edge points.
+ *
+ * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+ */
+static int hough_edges(const int32_t* dY, const int32_t* dX, uint16_t rows,
+        uint16_t cols, unsigned int count, struct hough_Edge* edges,
+        unsigned int* found);
+
+/**
+ * Get the k-th largest of a number of values. The values are reordered.
+ *
+ * @param values the values.
+ * @param n      the number of values.
+ * @param k      the rank, starting at 0 for the largest value.
+ *
+ * @return the k-th largest value.
+ */
+static double hough_select(double* values, unsigned int n, unsigned int k);
+
+/**
+ * Let each edge point vote for the centers along its gradient. The edge
+ * points are split into PREPROCESSING_HOUGH_SLICES parts that vote in
+ * parallel into their own accumulators.
+ *
+ * @param edges     the edge points.
+ * @param n         the number of edge points.
+ * @param radiusMin the smallest radius.
+ * @param radiusMax the largest radius.
+ * @param grid      the part of the center plane.
+ * @param acc       the accumulator (grid rows x grid columns).
+ *
+ * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+ */
+static int hough_vote(const struct hough_Edge* edges, unsigned int n,
+        double radiusMin, double radiusMax, const struct hough_Grid* grid,
+        uint32_t* acc);
+
+/**
+ * Find the cell of an accumulator with the most votes in its 3 x 3
+ * neighbourhood.
+ *
+ * @param acc  the accumulator.
+ * @param grid the part of the center plane.
+ * @param cy   the row of the center of the cell.
+ * @param cx   the column of the center of the cell.
+ */
+static void hough_peak(const uint32_t* acc, const struct hough_Grid* grid,
+        double* cy, double* cx);
+
+/**
+ * Find the most frequent distance of the edge points from a center.
+ *
+ * @param edges     the edge points.
+ * @param n         the number of edge points.
+ * @param cy        the row of the center.
+ * @param cx        the column of the center.
+ * @param radiusMin the smallest radius.
+ * @param radiusMax the largest radius.
+ * @param width     the width in pixels over which distances are summed.
+ *
+ * @return the radius.
+ */
+static double hough_radius(const struct hough_Edge* edges, unsigned int n,
+        double cy, double cx, unsigned int radiusMin, unsigned int radiusMax,
+        unsigned int width);
+
+/**
+ * Fit a circle to the edge points close to a circle with
+ * preprocessing_fit_circle().
+ *
+ * @param edges the edge points.
+ * @param n     the number of edge points.
+ * @param band  the largest distance of an edge point from the circle.
+ * @param cy    the row of the center.
+ * @param cx    the column of the center.
+ * @param r     the radius.
+ *
+ * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+ */
+static int hough_fit(const struct hough_Edge* edges, unsigned int n,
+        double band, double* cy, double* cx, double* r);
+
+/* PUBLIC IMPLEMENTATION *****************************************************/
+
+int preprocessing_hough_circle(uint32_t sdSrc, uint16_t rows,
+        uint16_t cols, uint32_t sdTmpY, uint32_t sdTmpX,
+        uint16_t radiusMin, uint16_t radiusMax, int32_t* centerY,
+        int32_t* centerX, int32_t* radius)
+{
+    PREPROCESSING_PROF_OPERATION(2 * PREPROCESSING_PROF_FRAME(rows, cols), 0);
+
+    int status = PREPROCESSING_SUCCESSFUL;
+    unsigned int found = 0;
+    struct hough_Grid grid;
+    double cy = 0.0;
+    double cx = 0.0;
+    double r = 0.0;
+
+    const int32_t* dY = preprocessing_vmem_getDataAddress(sdTmpY);
+    const int32_t* dX = preprocessing_vmem_getDataAddress(sdTmpX);
+
+    // Check whether given rows and columns are in a valid range.
+    if ((!preprocessing_vmem_isProcessingSizeValid(sdSrc, rows, cols))
+            || (!preprocessing_vmem_isProcessingSizeValid(sdTmpY, rows, cols))
+            || (!preprocessing_vmem_isProcessingSizeValid(sdTmpX, rows, cols)))
+    {
+        return PREPROCESSING_INVALID_SIZE;
+    }
+
+    // Check parameters.
+    if ((centerY == 0) || (centerX == 0) || (radius == 0))
+    {
+        printf("Invalid pointer: %p\n", (void*)(centerY));
+        return PREPROCESSING_INVALID_ADDRESS;
+    }
+
+    if ((radiusMin == 0) || (radiusMin > radiusMax))
+    {
+        printf("Invalid radius prior: %u to %u.\n", radiusMin, radiusMax);
+        return PREPROCESSING_INVALID_NUMBER;
+    }
+
+    // Edge maps. NaN pixels of the image stay NaN and are skipped below.
+    status = preprocessing_ana_gradient(sdSrc, rows, cols,
+            PREPROCESSING_ANA_STENCIL_CENTRAL, sdTmpY, sdTmpX);
+
+    if ((status != PREPROCESSING_SUCCESSFUL)
+            && (status != PREPROCESSING_INVALID_NUMBER))
+    {
+        return status;
+    }
+
+    unsigned int size = (unsigned int)(rows) * cols;
+    unsigned int count = (unsigned int)(2.0 * PI * radiusMax)
+            * PREPROCESSING_HOUGH_EDGE_WIDTH;
+
+    count = (count > size / 2) ? size / 2 : count;
+
+    unsigned int coarseRows = 2 * rows / PREPROCESSING_HOUGH_COARSE + 1;
+    unsigned int coarseCols = 2 * cols / PREPROCESSING_HOUGH_COARSE + 1;
+    unsigned int fine = 4 * PREPROCESSING_HOUGH_COARSE + 1;
+
+    struct hough_Edge* edges = malloc(count * sizeof(struct hough_Edge));
+    uint32_t* acc = malloc((size_t)(coarseRows) * coarseCols
+            * sizeof(uint32_t));
+
+    if ((edges == 0) || (acc == 0))
+    {
+        free(edges);
+        free(acc);
+        return PREPROCESSING_NO_MEMORY;
+    }
+
+    status = hough_edges(dY, dX, rows, cols, count, edges, &found);
+
+    // Coarse: cells of PREPROCESSING_HOUGH_COARSE pixels over the frame and
+    // half a frame around it, all radii of the prior.
+    if (status == PREPROCESSING_SUCCESSFUL)
+    {
+        grid.y0 = -(double)(rows / 2);
+        grid.x0 = -(double)(cols / 2);
+        grid.cell = PREPROCESSING_HOUGH_COARSE;
+        grid.rows = coarseRows;
+        grid.cols = coarseCols;
+
+        status = hough_vote(edges, found, radiusMin, radiusMax, &grid, acc);
+    }
+
+    if (status == PREPROCESSING_SUCCESSFUL)
+    {
+        hough_peak(acc, &grid, &cy, &cx);
+        r = hough_radius(edges, found, cy, cx, radiusMin, radiusMax,
+                PREPROCESSING_HOUGH_COARSE);
+
+        // Fine: pixels within two coarse cells, radii within two coarse
+        // cells of the coarse radius.
+        double rMin = r - 2.0 * PREPROCESSING_HOUGH_COARSE;
+        double rMax = r + 2.0 * PREPROCESSING_HOUGH_COARSE;
+
+        grid.y0 = floor(cy) - 2.0 * PREPROCESSING_HOUGH_COARSE;
+        grid.x0 = floor(cx) - 2.0 * PREPROCESSING_HOUGH_COARSE;
+        grid.cell = 1.0;
+        grid.rows = fine;
+        grid.cols = fine;
+
+        status = hough_vote(edges, found, (rMin < radiusMin) ? radiusMin : rMin,
+                (rMax > radiusMax) ? radiusMax : rMax, &grid, acc);
+    }
+
+    if (status == PREPROCESSING_SUCCESSFUL)
+    {
+        hough_peak(acc, &grid, &cy, &cx);
+        r = hough_radius(edges, found, cy, cx, radiusMin, radiusMax, 3);
+
+        // The fit pulls a center that is a few pixels off onto the limb, so
+        // the band shrinks from the fine window to the limb width.
+        status = hough_fit(edges, found, 2.0 * PREPROCESSING_HOUGH_COARSE,
+                &cy, &cx, &r);
+
+        if (status == PREPROCESSING_SUCCESSFUL)
+        {
+            status = hough_fit(edges, found, HOUGH_FIT_BAND, &cy, &cx, &r);
+        }
+
+        if (status == PREPROCESSING_SUCCESSFUL)
+        {
+            status = hough_fit(edges, found, HOUGH_FIT_BAND, &cy, &cx, &r);
+        }
+    }
+
+    free(edges);
+    free(acc);
+
+    if (status != PREPROCESSING_SUCCESSFUL)
+    {
+        return status;
+    }
+
+    *centerY = (int32_t)(lround(cy * (double)(1 << FP32_FWL)));
+    *centerX = (int32_t)(lround(cx * (double)(1 << FP32_FWL)));
+    *radius = (int32_t)(lround(r * (double)(1 << FP32_FWL)));
+
+    return PREPROCESSING_SUCCESSFUL;
+}
+
+/* PRIVATE IMPLEMENTATION ****************************************************/
+
+static int hough_edges(const int32_t* dY, const int32_t* dX, uint16_t rows,
+        uint16_t cols, unsigned int count, struct hough_Edge* edges,
+        unsigned int* found)
+{
+    unsigned int size = (unsigned int)(rows) * cols;
+    unsigned int n = 0;
+
+    double* magnitude = malloc(2 * (size_t)(size) * sizeof(double));
+
+    if (magnitude == 0)
+    {
+        return PREPROCESSING_NO_MEMORY;
+    }
+
+    double* sorted = magnitude + size;
+
+    PREPROCESSING_DEF_PARALLEL_FOR
+    for (unsigned int p = 0; p < size; p++)
+    {
+        double gy = (double)(dY[p]);
+        double gx = (double)(dX[p]);
+
+        magnitude[p] = ((dY[p] == EVE_FP32_NAN) || (dX[p] == EVE_FP32_NAN))
+                ? -1.0 : gy * gy + gx * gx;
+        sorted[p] = magnitude[p];
+    }
+
+    double threshold = hough_select(sorted, size, count - 1);
+
+    // Both derivations are the negated central difference, so the negated
+    // gradient points into a disc that is brighter than the background.
+    for (unsigned int p = 0; (p < size) && (n < count); p++)
+    {
+        if ((magnitude[p] >= threshold) && (magnitude[p] > 0.0))
+        {
+            unsigned int y = p / cols;
+            unsigned int x = p % cols;
+            double sy = 0.0;
+            double sx = 0.0;
+
+            for (long i = (long)(y) - HOUGH_SMOOTH;
+                    i <= (long)(y) + HOUGH_SMOOTH; i++)
+            {
+                for (long j = (long)(x) - HOUGH_SMOOTH;
+                        j <= (long)(x) + HOUGH_SMOOTH; j++)
+                {
+                    if ((i >= 0) && (j >= 0) && (i < rows) && (j < cols)
+                            && (magnitude[i * cols + j] >= 0.0))
+                    {
+                        sy += (double)(dY[i * cols + j]);
+                        sx += (double)(dX[i * cols + j]);
+                    }
+                }
+            }
+
+            double norm = hypot(sy, sx);
+
+            edges[n].y = (double)(y);
+            edges[n].x = (double)(x);
+            edges[n].uy = (norm > 0.0) ? -sy / norm : 0.0;
+            edges[n].ux = (norm > 0.0) ? -sx / norm : 0.0;
+            n++;
+        }
+    }
+
+    free(magnitude);
+    *found = n;
+
+    if (n < 3)
+    {
+        printf("Too few edge points: %u.\n", n);
+        return PREPROCESSING_INVALID_NUMBER;
+    }
+
+    return PREPROCESSING_SUCCESSFUL;
+}
+
+/*****************************************************************************/
+
+static double hough_select(double* values, unsigned int n, unsigned int k)
+{
+    unsigned int lo = 0;
+    unsigned int hi = n - 1;
+
+    // Quickselect for descending order.
+    while (lo < hi)
+    {
+        double pivot = values[lo + (hi - lo) / 2];
+        unsigned int i = lo;
+        unsigned int j = hi;
+
+        while (i <= j)
+        {
+            while (values[i] > pivot)
+            {
+                i++;
+            }
+
+            while (values[j] < pivot)
+            {
+                j--;
+            }
+
+            if (i <= j)
+            {
+                double swap = values[i];
+
+                values[i] = values[j];
+                values[j] = swap;
+                i++;
+
+                if (j == 0)
+                {
+                    break;
+                }
+
+                j--;
+            }
+        }
+
+        if (k <= j)
+        {
+            hi = j;
+        }
+        else if (k >= i)
+        {
+            lo = i;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    return values[k];
+}
+
+/*****************************************************************************/
+
+static int hough_vote(const struct hough_Edge* edges, unsigned int n,
+        double radiusMin, double radiusMax, const struct hough_Grid* grid,
+        uint32_t* acc)
+{
+    size_t cells = (size_t)(grid->rows) * grid->cols;
+
+    uint32_t* slices = calloc(cells * PREPROCESSING_HOUGH_SLICES,
+            sizeof(uint32_t));
+
+    if (slices == 0)
+    {
+        return PREPROCESSING_NO_MEMORY;
+    }
+
+    PREPROCESSING_DEF_PARALLEL_FOR
+    for (unsigned int s = 0; s < PREPROCESSING_HOUGH_SLICES; s++)
+    {
+        uint32_t* slice = slices + s * cells;
+        unsigned int first = (unsigned int)((uint64_t)(n) * s
+                / PREPROCESSING_HOUGH_SLICES);
+        unsigned int last = (unsigned int)((uint64_t)(n) * (s + 1)
+                / PREPROCESSING_HOUGH_SLICES);
+
+        for (unsigned int e = first; e < last; e++)
+        {
+            // One vote per cell crossed by the ray, about.
+            for (double r = radiusMin; r <= radiusMax; r += grid->cell)
+            {
+                double y = (edges[e].y + r * edges[e].uy - grid->y0)
+                        / grid->cell;
+                double x = (edges[e].x + r * edges[e].ux - grid->x0)
+                        / grid->cell;
+
+                if ((y >= 0.0) && (x >= 0.0) && (y < grid->rows)
+                        && (x < grid->cols))
+                {
+                    slice[(size_t)(y) * grid->cols + (size_t)(x)]++;
+                }
+            }
+        }
+    }
+
+    PREPROCESSING_DEF_PARALLEL_FOR
+    for (size_t c = 0; c < cells; c++)
+    {
+        uint32_t sum = 0;
+
+        for (unsigned int s = 0; s < PREPROCESSING_HOUGH_SLICES; s++)
+        {
+            sum += slices[s * cells + c];
+        }
+
+        acc[c] = sum;
+    }
+
+    free(slices);
+
+    return PREPROCESSING_SUCCESSFUL;
+}
+
+/*****************************************************************************/
+
+static void hough_peak(const uint32_t* acc, const struct hough_Grid* grid,
+        double* cy, double* cx)
+{
+    uint64_t best = 0;
+    unsigned int by = 0;
+    unsigned int bx = 0;
+
+    for (unsigned int y = 1; y + 1 < grid->rows; y++)
+    {
+        for (unsigned int x = 1; x + 1 < grid->cols; x++)
+        {
+            uint64_t sum = 0;
+
+            for (unsigned int i = y - 1; i <= y + 1; i++)
+            {
+                const uint32_t* a = acc + (size_t)(i) * grid->cols + x - 1;
+
+                sum += (uint64_t)(a[0]) + a[1] + a[2];
+            }
+
+            if (sum > best)
+            {
+                best = sum;
+                by = y;
+                bx = x;
+            }
+        }
+    }
+
+    *cy = grid->y0 + ((double)(by) + 0.5) * grid->cell;
+    *cx = grid->x0 + ((double)(bx) + 0.5) * grid->cell;
+}
+
+/*****************************************************************************/
+
+static double hough_radius(const struct hough_Edge* edges, unsigned int n,
+        double cy, double cx, unsigned int radiusMin, unsigned int radiusMax,
+        unsigned int width)
+{
+    unsigned int bins = radiusMax - radiusMin + 1;
+    unsigned int best = 0;
+    unsigned int sum = 0;
+    unsigned int bestBin = 0;
+
+    unsigned int* histogram = calloc(bins, sizeof(unsigned int));
+
+    if (histogram == 0)
+    {
+        return 0.5 * (radiusMin + radiusMax);
+    }
+
+    for (unsigned int e = 0; e < n; e++)
+    {
+        double d = hypot(edges[e].y - cy, edges[e].x - cx) - radiusMin;
+
+        if ((d >= 0.0) && (d < bins))
+        {
+            histogram[(unsigned int)(d)]++;
+        }
+    }
+
+    // Sliding sum over width bins.
+    for (unsigned int b = 0; b < bins; b++)
+    {
+        sum += histogram[b];
+        sum -= (b >= width) ? histogram[b - width] : 0;
+
+        if (sum > best)
+        {
+            best = sum;
+            bestBin = b;
+        }
+    }
+
+    free(histogram);
+
+    width = (bestBin + 1 < width) ? bestBin + 1 : width;
+
+    return (double)(radiusMin) + (double)(bestBin) + 1.0
+            - 0.5 * (double)(width);
+}
+
+/*****************************************************************************/
+
+static int hough_fit(const struct hough_Edge* edges, unsigned int n,
+        double band, double* cy, double* cx, double* r)
+{
+    unsigned int m = 0;
+    double y = 0.0;
+    double x = 0.0;
+    double radius = 0.0;
+
+    double* points = malloc(2 * (size_t)(n) * sizeof(double));
+
+    if (points == 0)
+    {
+        return PREPROCESSING_NO_MEMORY;
+    }
+
+    for (unsigned int e = 0; e < n; e++)
+    {
+        if (fabs(hypot(edges[e].y - *cy, edges[e].x - *cx) - *r) <= band)
+        {
+            points[m] = edges[e].y;
+            points[n + m] = edges[e].x;
+            m++;
+        }
+    }
+
+    // Too few points or all on a line, keep the Hough estimate.
+    if ((m >= 3) && (preprocessing_fit_circle(points, points + n, m, &y, &x,
+            &radius) == PREPROCESSING_SUCCESSFUL))
+    {
+        *cy = y;
+        *cx = x;
+        *r = radius;
+    }
+
+    free(points);
+
+    return PREPROCESSING_SUCCESSFUL;
+}
@@ -0,0 +1,493 @@
+/*
+ * Project: Solar Orbiter - PHI (SO/PHI)
+ * Module:  Preprocessing - a library for image pre-processing.
+ *
+ * Copyright (C) 2016, Max Planck Institute for Solar System Research
+ */
+
+/**
+ * @file
+ *
+ * This file contains implementation of the kernel backends and of the
+ * selection of a backend.
+ *
+ * The SIMD backends are instances of kernel_simd.h for each instruction set,
+ * compiled with the target attribute so the library needs no special
+ * compiler flags. Kernels without an exact SIMD form (divisions and the
+ * functions of libm) are the reference ones in all backends.
+ */
+
+#include "preprocessing/kernel.h"
+
+#include "preprocessing/def.h"
+
+#include "median_network.h"
+
+/* from libeve */
+#include "../libeve/eve/fixed_point.h"
+
+/* from std c */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* PRIVATE INTERFACE *********************************************************/
+
+/**
+ * This is defined if the SIMD backends are built.
+ */
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) \
+        && !defined(PREPROCESSING_KERNEL_SCALAR)
+#define KERNEL_X86
+#endif
+
+/**
+ * This is the backend in use, 0 before the first use.
+ */
+static const struct preprocessing_kernel_Backend* kernel_current = 0;
+
+/**
+ * The reference kernels (see preprocessing_kernel_Backend).
+ * @{
+ */
+static int kernel_referenceAdd(const int32_t* src1, const int32_t* src2,
+        int32_t* dst, unsigned int n);
+static int kernel_referenceSubtract(const int32_t* src1, const int32_t* src2,
+        int32_t* dst, unsigned int n);
+static int kernel_referenceMultiply(const int32_t* src1, const int32_t* src2,
+        int32_t* dst, unsigned int n);
+static int kernel_referenceAddScalar(const int32_t* src, int32_t scalar,
+        int32_t* dst, unsigned int n);
+static int kernel_referenceSubtractScalar(const int32_t* src, int32_t scalar,
+        int32_t* dst, unsigned int n);
+static int kernel_referenceMultiplyScalar(const int32_t* src, int32_t scalar,
+        int32_t* dst, unsigned int n);
+static int kernel_referenceNormalize(const int32_t* src1, const int32_t* src2,
+        int32_t* dst, unsigned int n);
+static int kernel_referenceMask(const int32_t* src, unsigned int index,
+        int32_t* dst, unsigned int n);
+static int kernel_referenceSum(const int32_t* src, unsigned int n,
+        int32_t* sum);
+static int kernel_referenceLog10(const int32_t* src, int32_t* dst,
+        unsigned int n);
+static int kernel_referencePow10(const int32_t* src, const int32_t* mask,
+        int32_t* dst, unsigned int n);
+static int kernel_referenceMedian9(const int32_t* const* rows, int32_t* dst,
+        unsigned int n);
+static int kernel_referenceMedian25(const int32_t* const* rows, int32_t* dst,
+        unsigned int n);
+/**
+ * @}
+ */
+
+/**
+ * This is the scalar reference backend.
+ */
+static const struct preprocessing_kernel_Backend kernel_reference =
+{
+    "reference",
+    kernel_referenceAdd,
+    kernel_referenceSubtract,
+    kernel_referenceMultiply,
+    kernel_referenceAddScalar,
+    kernel_referenceSubtractScalar,
+    kernel_referenceMultiplyScalar,
+    kernel_referenceNormalize,
+    kernel_referenceMask,
+    kernel_referenceSum,
+    kernel_referenceLog10,
+    kernel_referencePow10,
+    kernel_referenceMedian9,
+    kernel_referenceMedian25
+};
+
+#ifdef KERNEL_X86
+#define KERNEL_CAT3_(a, b, c) a##b##c
+#define KERNEL_CAT3(a, b, c) KERNEL_CAT3_(a, b, c)
+#define KERNEL_STRING_(a) #a
+#define KERNEL_STRING(a) KERNEL_STRING_(a)
+
+/**
+ * These are the pixels of a chunk of a vector sum, the bound of their
+ * magnitude and the bound of the magnitude of the sum before the chunk, so
+ * no prefix of the chunk can overflow (64 * 2^24 + 2^30 <= 2^31).
+ */
+#define KERNEL_SUM_CHUNK 64
+#define KERNEL_SUM_PIXEL (1 << 24)
+#define KERNEL_SUM_LIMIT (1 << 30)
+
+#define KERNEL_SIMD_NAME sse42
+#define KERNEL_SIMD_TARGET "sse4.2"
+#define KERNEL_SIMD_LANES 4
+#include "kernel_simd.h"
+
+#define KERNEL_SIMD_NAME avx2
+#define KERNEL_SIMD_TARGET "avx2"
+#define KERNEL_SIMD_LANES 8
+#include "kernel_simd.h"
+
+#define KERNEL_SIMD_NAME avx512
+#define KERNEL_SIMD_TARGET "avx512f"
+#define KERNEL_SIMD_LANES 16
+#include "kernel_simd.h"
+#endif
+
+/**
+ * Round a number to a 24.8 fixed point number, like udp_double2s32rounded().
+ *
+ * @param value the number.
+ *
+ * @return the fixed point number.
+ */
+static int32_t kernel_double2s32rounded(double value);
+
+/* PUBLIC IMPLEMENTATION *****************************************************/
+
+const struct preprocessing_kernel_Backend* preprocessing_kernel_backend(void)
+{
+    const struct preprocessing_kernel_Backend* backend = __atomic_load_n(
+            &kernel_current, __ATOMIC_ACQUIRE);
+
+    if (backend == 0)
+    {
+        const char* name = getenv("PREPROCESSING_BACKEND");
+
+        if ((name == 0)
+                || (preprocessing_kernel_select(name)
+                        != PREPROCESSING_SUCCESSFUL))
+        {
+            preprocessing_kernel_select(0);
+        }
+
+        backend = __atomic_load_n(&kernel_current, __ATOMIC_ACQUIRE);
+    }
+
+    return backend;
+}
+
+/*****************************************************************************/
+
+int preprocessing_kernel_select(const char* name)
+{
+    const struct preprocessing_kernel_Backend* backends[
+            PREPROCESSING_KERNEL_BACKENDS];
+    unsigned int count = preprocessing_kernel_supported(backends);
+
+    // The last supported backend is the best one.
+    if (name == 0)
+    {
+        __atomic_store_n(&kernel_current, backends[count - 1],
+                __ATOMIC_RELEASE);
+        return PREPROCESSING_SUCCESSFUL;
+    }
+
+    for (unsigned int b = 0; b < count; b++)
+    {
+        if (strcmp(backends[b]->name, name) == 0)
+        {
+            __atomic_store_n(&kernel_current, backends[b], __ATOMIC_RELEASE);
+            return PREPROCESSING_SUCCESSFUL;
+        }
+    }
+
+    printf("Kernel backend not supported: %s.\n", name);
+    return PREPROCESSING_INVALID_NUMBER;
+}
+
+/*****************************************************************************/
+
+unsigned int preprocessing_kernel_supported(
+        const struct preprocessing_kernel_Backend** backends)
+{
+    unsigned int count = 0;
+
+    backends[count++] = &kernel_reference;
+
+#ifdef KERNEL_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("sse4.2"))
+    {
+        backends[count++] = &kernel_sse42;
+    }
+    if (__builtin_cpu_supports("avx2"))
+    {
+        backends[count++] = &kernel_avx2;
+    }
+    if (__builtin_cpu_supports("avx512f"))
+    {
+        backends[count++] = &kernel_avx512;
+    }
+#endif
+
+    return count;
+}
+
+/* PRIVATE IMPLEMENTATION ****************************************************/
+
+static int kernel_referenceAdd(const int32_t* src1, const int32_t* src2,
+        int32_t* dst, unsigned int n)
+{
+    int nan = 0;
+
+    for (unsigned int p = 0; p < n; p++)
+    {
+        dst[p] = eve_fp_add32(src1[p], src2[p]);
+        nan |= (dst[p] == EVE_FP32_NAN);
+    }
+
+    return nan;
+}
+
+/*****************************************************************************/
+
+static int kernel_referenceSubtract(const int32_t* src1, const int32_t* src2,
+        int32_t* dst, unsigned int n)
+{
+    int nan = 0;
+
+    for (unsigned int p = 0; p < n; p++)
+    {
+        dst[p] = eve_fp_subtract32(src1[p], src2[p]);
+        nan |= (dst[p] == EVE_FP32_NAN);
+    }
+
+    return nan;
+}
+
+/*****************************************************************************/
+
+static int kernel_referenceMultiply(const int32_t* src1, const int32_t* src2,
+        int32_t* dst, unsigned int n)
+{
+    int nan = 0;
+
+    for (unsigned int p = 0; p < n; p++)
+    {
+        dst[p] = eve_fp_multiply32(src1[p], src2[p], FP32_FWL);
+        nan |= (dst[p] == EVE_FP32_NAN);
+    }
+
+    return nan;
+}
+
+/*****************************************************************************/
+
+static int kernel_referenceAddScalar(const int32_t* src, int32_t scalar,
+        int32_t* dst, unsigned int n)
+{
+    int nan = 0;
+
+    for (unsigned int p = 0; p < n; p++)
+    {
+        dst[p] = eve_fp_add32(src[p], scalar);
+        nan |= (dst[p] == EVE_FP32_NAN);
+    }
+
+    return nan;
+}
+
+/*****************************************************************************/
+
+static int kernel_referenceSubtractScalar(const int32_t* src, int32_t scalar,
+        int32_t* dst, unsigned int n)
+{
+    int nan = 0;
+
+    for (unsigned int p = 0; p < n; p++)
+    {
+        dst[p] = eve_fp_subtract32(src[p], scalar);
+        nan |= (dst[p] == EVE_FP32_NAN);
+    }
+
+    return nan;
+}
+
+/*****************************************************************************/
+
+static int kernel_referenceMultiplyScalar(const int32_t* src, int32_t scalar,
+        int32_t* dst, unsigned int n)
+{
+    int nan = 0;
+
+    for (unsigned int p = 0; p < n; p++)
+    {
+        dst[p] = eve_fp_multiply32(src[p], scalar, FP32_FWL);
+        nan |= (dst[p] == EVE_FP32_NAN);
+    }
+
+    return nan;
+}
+
+/*****************************************************************************/
+
+static int kernel_referenceNormalize(const int32_t* src1, const int32_t* src2,
+        int32_t* dst, unsigned int n)
+{
+    int nan = 0;
+
+    for (unsigned int p = 0; p < n; p++)
+    {
+        if (src2[p] > FP32_BINARY_TRUE)
+        {
+            dst[p] = eve_fp_divide32(src1[p], src2[p], FP32_FWL);
+        }
+        nan |= (dst[p] == EVE_FP32_NAN);
+    }
+
+    return nan;
+}
+
+/*****************************************************************************/
+
+static int kernel_referenceMask(const int32_t* src, unsigned int index,
+        int32_t* dst, unsigned int n)
+{
+    int nan = 0;
+
+    for (unsigned int p = 0; p < n; p++)
+    {
+        dst[p] = (src[p] & (FP32_BINARY_TRUE << index)) >> index;
+        nan |= (dst[p] == EVE_FP32_NAN);
+    }
+
+    return nan;
+}
+
+/*****************************************************************************/
+
+static int kernel_referenceSum(const int32_t* src, unsigned int n,
+        int32_t* sum)
+{
+    for (unsigned int p = 0; p < n; p++)
+    {
+        *sum = eve_fp_add32(*sum, src[p]);
+
+        if (*sum == EVE_FP32_NAN)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/*****************************************************************************/
+
+static int kernel_referenceLog10(const int32_t* src, int32_t* dst,
+        unsigned int n)
+{
+    int nan = 0;
+
+    for (unsigned int p = 0; p < n; p++)
+    {
+        // Note: Here we use real numbers and so the logarithm is defined
+        //       for positive numbers only.
+        if (src[p] <= 0)
+        {
+            dst[p] = EVE_FP32_NAN;
+            nan = 1;
+        }
+        else
+        {
+            dst[p] = eve_fp_double2s32(
+                    log10(eve_fp_signed32ToDouble(src[p], FP32_FWL)),
+                    FP32_FWL);
+        }
+    }
+
+    return nan;
+}
+
+/*****************************************************************************/
+
+static int kernel_referencePow10(const int32_t* src, const int32_t* mask,
+        int32_t* dst, unsigned int n)
+{
+    int nan = 0;
+
+    for (unsigned int p = 0; p < n; p++)
+    {
+        if (mask[p] != 0)
+        {
+            dst[p] = kernel_double2s32rounded(pow(10.0,
+                    eve_fp_signed32ToDouble(src[p], FP32_FWL)));
+        }
+        nan |= (dst[p] == EVE_FP32_NAN);
+    }
+
+    return nan;
+}
+
+/*****************************************************************************/
+
+static int kernel_referenceMedian9(const int32_t* const* rows, int32_t* dst,
+        unsigned int n)
+{
+    int nan = 0;
+    const int32_t* window[3];
+
+    memcpy(window, rows, sizeof(window));
+
+    for (unsigned int p = 0; p < n; p++)
+    {
+        int32_t values[9];
+
+        for (unsigned int i = 0; i < 3; i++)
+        {
+            for (unsigned int j = 0; j < 3; j++)
+            {
+                values[i * 3 + j] = window[i][p + j];
+            }
+        }
+
+        dst[p] = median_network9(values);
+        nan |= (dst[p] == EVE_FP32_NAN);
+    }
+
+    return nan;
+}
+
+/*****************************************************************************/
+
+static int kernel_referenceMedian25(const int32_t* const* rows, int32_t* dst,
+        unsigned int n)
+{
+    int nan = 0;
+    const int32_t* window[5];
+
+    memcpy(window, rows, sizeof(window));
+
+    for (unsigned int p = 0; p < n; p++)
+    {
+        int32_t values[25];
+
+        for (unsigned int i = 0; i < 5; i++)
+        {
+            for (unsigned int j = 0; j < 5; j++)
+            {
+                values[i * 5 + j] = window[i][p + j];
+            }
+        }
+
+        dst[p] = median_network25(values);
+        nan |= (dst[p] == EVE_FP32_NAN);
+    }
+
+    return nan;
+}
+
+/*****************************************************************************/
+
+static int32_t kernel_double2s32rounded(double value)
+{
+    int32_t result = (int32_t)(round(fabs(value) * FP32_BINARY_TRUE));
+
+    if (value < 0)
+    {
+        result = (int32_t)(-result);
+    }
+
+    return result;
+}
@@ -0,0 +1,331 @@
+/*
+ * Project: Solar Orbiter - PHI (SO/PHI)
+ * Module:  Preprocessing - a library for image pre-processing.
+ *
+ * Copyright (C) 2016, Max Planck Institute for Solar System Research
+ */
+
+/**
+ * @file
+ *
+ * This file is the template of a SIMD kernel backend, it is included by
+ * kernel.c once per instruction set. Define before including it:
+ *
+ * - KERNEL_SIMD_NAME:   the name of the backend (an identifier).
+ * - KERNEL_SIMD_TARGET: the target of the compiler (a string).
+ * - KERNEL_SIMD_LANES:  the number of 32 bit lanes of a register.
+ *
+ * The kernels use the vector extensions of the compiler and give the same
+ * results as the reference kernels: an overflow is detected in each lane
+ * and gives NaN, the pixels left over at the end of a row are done by the
+ * reference kernels.
+ */
+
+/* No include guard, this file is included several times. */
+
+#define KERNEL_SIMD(name) KERNEL_CAT3(kernel_, KERNEL_SIMD_NAME, name)
+#define KERNEL_SIMD_ATTRIBUTE \
+    __attribute__((target(KERNEL_SIMD_TARGET)))
+#define KERNEL_SIMD_INLINE \
+    static inline __attribute__((always_inline, target(KERNEL_SIMD_TARGET)))
+
+/**
+ * These are the vectors of 32 bit and 64 bit lanes.
+ */
+typedef int32_t KERNEL_SIMD(_Vector)
+        __attribute__((vector_size(4 * KERNEL_SIMD_LANES)));
+typedef uint32_t KERNEL_SIMD(_UnsignedVector)
+        __attribute__((vector_size(4 * KERNEL_SIMD_LANES)));
+typedef int64_t KERNEL_SIMD(_WideVector)
+        __attribute__((vector_size(8 * KERNEL_SIMD_LANES)));
+
+/**
+ * Load and store a vector of pixels without alignment.
+ * @{
+ */
+KERNEL_SIMD_INLINE KERNEL_SIMD(_Vector) KERNEL_SIMD(_load)(const int32_t* src)
+{
+    KERNEL_SIMD(_Vector) v;
+
+    memcpy(&v, src, sizeof(v));
+
+    return v;
+}
+
+KERNEL_SIMD_INLINE void KERNEL_SIMD(_store)(int32_t* dst,
+        KERNEL_SIMD(_Vector) v)
+{
+    memcpy(dst, &v, sizeof(v));
+}
+/**
+ * @}
+ */
+
+/**
+ * Check whether any lane of a comparison is true.
+ *
+ * @param v the result of the comparison.
+ *
+ * @return 1 if a lane is true, 0 otherwise.
+ */
+KERNEL_SIMD_INLINE int KERNEL_SIMD(_any)(KERNEL_SIMD(_Vector) v)
+{
+    int32_t any = 0;
+
+    for (unsigned int l = 0; l < KERNEL_SIMD_LANES; l++)
+    {
+        any |= v[l];
+    }
+
+    return (any != 0);
+}
+
+/**
+ * The per-lane fixed point operations, like eve_fp_add32(),
+ * eve_fp_subtract32() and eve_fp_multiply32(). The sum and difference wrap
+ * in unsigned lanes and an overflow is detected from the signs.
+ * @{
+ */
+KERNEL_SIMD_INLINE KERNEL_SIMD(_Vector) KERNEL_SIMD(_add)(
+        KERNEL_SIMD(_Vector) a, KERNEL_SIMD(_Vector) b)
+{
+    KERNEL_SIMD(_Vector) s = (KERNEL_SIMD(_Vector))(
+            (KERNEL_SIMD(_UnsignedVector))(a)
+            + (KERNEL_SIMD(_UnsignedVector))(b));
+    KERNEL_SIMD(_Vector) overflow = ((a ^ s) & (b ^ s)) < 0;
+
+    return (s & ~overflow) | (overflow & EVE_FP32_NAN);
+}
+
+KERNEL_SIMD_INLINE KERNEL_SIMD(_Vector) KERNEL_SIMD(_subtract)(
+        KERNEL_SIMD(_Vector) a, KERNEL_SIMD(_Vector) b)
+{
+    KERNEL_SIMD(_Vector) d = (KERNEL_SIMD(_Vector))(
+            (KERNEL_SIMD(_UnsignedVector))(a)
+            - (KERNEL_SIMD(_UnsignedVector))(b));
+    KERNEL_SIMD(_Vector) overflow = ((a ^ b) & (a ^ d)) < 0;
+
+    return (d & ~overflow) | (overflow & EVE_FP32_NAN);
+}
+
+KERNEL_SIMD_INLINE KERNEL_SIMD(_Vector) KERNEL_SIMD(_multiply)(
+        KERNEL_SIMD(_Vector) a, KERNEL_SIMD(_Vector) b)
+{
+    KERNEL_SIMD(_WideVector) p = (__builtin_convertvector(a,
+            KERNEL_SIMD(_WideVector)) * __builtin_convertvector(b,
+            KERNEL_SIMD(_WideVector))) >> FP32_FWL;
+    KERNEL_SIMD(_Vector) inRange = __builtin_convertvector(
+            (p >= EVE_FP32_MIN) & (p <= EVE_FP32_MAX),
+            KERNEL_SIMD(_Vector));
+
+    return (__builtin_convertvector(p, KERNEL_SIMD(_Vector)) & inRange)
+            | (~inRange & EVE_FP32_NAN);
+}
+/**
+ * @}
+ */
+
+/**
+ * Compare-exchange two vectors lane by lane: a gets the smaller and b the
+ * larger values.
+ *
+ * @param a the first values.
+ * @param b the second values.
+ */
+KERNEL_SIMD_INLINE void KERNEL_SIMD(_sort)(KERNEL_SIMD(_Vector)* a,
+        KERNEL_SIMD(_Vector)* b)
+{
+    KERNEL_SIMD(_Vector) less = *a < *b;
+    KERNEL_SIMD(_Vector) lo = (*a & less) | (*b & ~less);
+    KERNEL_SIMD(_Vector) hi = (*b & less) | (*a & ~less);
+
+    *a = lo;
+    *b = hi;
+}
+
+/**
+ * These macros are the loop of a binary kernel over all vectors, the
+ * pixels left over are done by the reference kernel.
+ * @{
+ */
+#define KERNEL_SIMD_BINARY(op, reference) \
+    KERNEL_SIMD_ATTRIBUTE static int KERNEL_SIMD(_##op##Pixels)( \
+            const int32_t* src1, const int32_t* src2, int32_t* dst, \
+            unsigned int n) \
+    { \
+        unsigned int end = n - n % KERNEL_SIMD_LANES; \
+        KERNEL_SIMD(_Vector) nan = { 0 }; \
+        for (unsigned int p = 0; p < end; p += KERNEL_SIMD_LANES) \
+        { \
+            KERNEL_SIMD(_Vector) v = KERNEL_SIMD(_##op)( \
+                    KERNEL_SIMD(_load)(src1 + p), \
+                    KERNEL_SIMD(_load)(src2 + p)); \
+            KERNEL_SIMD(_store)(dst + p, v); \
+            nan |= (v == EVE_FP32_NAN); \
+        } \
+        return reference(src1 + end, src2 + end, dst + end, n - end) \
+                | KERNEL_SIMD(_any)(nan); \
+    }
+
+#define KERNEL_SIMD_SCALAR(op, reference) \
+    KERNEL_SIMD_ATTRIBUTE static int KERNEL_SIMD(_##op##ScalarPixels)( \
+            const int32_t* src, int32_t scalar, int32_t* dst, \
+            unsigned int n) \
+    { \
+        unsigned int end = n - n % KERNEL_SIMD_LANES; \
+        KERNEL_SIMD(_Vector) b = { 0 }; \
+        KERNEL_SIMD(_Vector) nan = { 0 }; \
+        b += scalar; \
+        for (unsigned int p = 0; p < end; p += KERNEL_SIMD_LANES) \
+        { \
+            KERNEL_SIMD(_Vector) v = KERNEL_SIMD(_##op)( \
+                    KERNEL_SIMD(_load)(src + p), b); \
+            KERNEL_SIMD(_store)(dst + p, v); \
+            nan |= (v == EVE_FP32_NAN); \
+        } \
+        return reference(src + end, scalar, dst + end, n - end) \
+                | KERNEL_SIMD(_any)(nan); \
+    }
+/**
+ * @}
+ */
+
+/**
+ * This macro is a median kernel of the windows of edge x edge (values)
+ * pixels. The sorting network runs on the windows of a vector of pixels at
+ * once, one vector per value of the window, so each compare-exchange sorts
+ * all lanes. The pixels left over are done by the reference kernel.
+ */
+#define KERNEL_SIMD_MEDIAN(values, edge, reference) \
+    KERNEL_SIMD_ATTRIBUTE static int KERNEL_SIMD(_median##values##Pixels)( \
+            const int32_t* const* rows, int32_t* dst, unsigned int n) \
+    { \
+        unsigned int end = n - n % KERNEL_SIMD_LANES; \
+        const int32_t* rest[edge]; \
+        KERNEL_SIMD(_Vector) nan = { 0 }; \
+        for (unsigned int p = 0; p < end; p += KERNEL_SIMD_LANES) \
+        { \
+            KERNEL_SIMD(_Vector) v[values]; \
+            for (unsigned int i = 0; i < values; i++) \
+            { \
+                v[i] = KERNEL_SIMD(_load)(rows[i / edge] + p + i % edge); \
+            } \
+            MEDIAN_NETWORK##values(KERNEL_SIMD_SORT) \
+            KERNEL_SIMD(_store)(dst + p, v[values / 2]); \
+            nan |= (v[values / 2] == EVE_FP32_NAN); \
+        } \
+        for (unsigned int i = 0; i < edge; i++) \
+        { \
+            rest[i] = rows[i] + end; \
+        } \
+        return reference(rest, dst + end, n - end) | KERNEL_SIMD(_any)(nan); \
+    }
+#define KERNEL_SIMD_SORT(a, b) KERNEL_SIMD(_sort)(&v[a], &v[b]);
+
+KERNEL_SIMD_BINARY(add, kernel_referenceAdd)
+KERNEL_SIMD_BINARY(subtract, kernel_referenceSubtract)
+KERNEL_SIMD_BINARY(multiply, kernel_referenceMultiply)
+KERNEL_SIMD_SCALAR(add, kernel_referenceAddScalar)
+KERNEL_SIMD_SCALAR(subtract, kernel_referenceSubtractScalar)
+KERNEL_SIMD_SCALAR(multiply, kernel_referenceMultiplyScalar)
+KERNEL_SIMD_MEDIAN(9, 3, kernel_referenceMedian9)
+KERNEL_SIMD_MEDIAN(25, 5, kernel_referenceMedian25)
+
+/*****************************************************************************/
+
+KERNEL_SIMD_ATTRIBUTE static int KERNEL_SIMD(_maskPixels)(const int32_t* src,
+        unsigned int index, int32_t* dst, unsigned int n)
+{
+    unsigned int end = n - n % KERNEL_SIMD_LANES;
+    KERNEL_SIMD(_Vector) bit = { 0 };
+
+    bit += FP32_BINARY_TRUE << index;
+
+    // A bit of the mask is never NaN.
+    for (unsigned int p = 0; p < end; p += KERNEL_SIMD_LANES)
+    {
+        KERNEL_SIMD(_store)(dst + p,
+                (KERNEL_SIMD(_load)(src + p) & bit) >> (int)(index));
+    }
+
+    return kernel_referenceMask(src + end, index, dst + end, n - end);
+}
+
+/*****************************************************************************/
+
+KERNEL_SIMD_ATTRIBUTE static int KERNEL_SIMD(_sumPixels)(const int32_t* src,
+        unsigned int n, int32_t* sum)
+{
+    int64_t total = *sum;
+    unsigned int p = 0;
+
+    // A chunk of pixels below KERNEL_SUM_PIXEL added to a sum below
+    // KERNEL_SUM_LIMIT cannot overflow on the way, so it is added at once
+    // and gives the same sum as adding pixel by pixel. Otherwise the rest is
+    // added by the reference kernel, which detects the overflow.
+    while ((n - p >= KERNEL_SUM_CHUNK) && (total > -KERNEL_SUM_LIMIT)
+            && (total < KERNEL_SUM_LIMIT))
+    {
+        KERNEL_SIMD(_UnsignedVector) chunk = { 0 };
+        KERNEL_SIMD(_Vector) large = { 0 };
+
+        for (unsigned int c = 0; c < KERNEL_SUM_CHUNK;
+                c += KERNEL_SIMD_LANES)
+        {
+            KERNEL_SIMD(_Vector) v = KERNEL_SIMD(_load)(src + p + c);
+
+            chunk += (KERNEL_SIMD(_UnsignedVector))(v);
+            large |= (v >= KERNEL_SUM_PIXEL) | (v <= -KERNEL_SUM_PIXEL);
+        }
+
+        if (KERNEL_SIMD(_any)(large))
+        {
+            break;
+        }
+
+        for (unsigned int l = 0; l < KERNEL_SIMD_LANES; l++)
+        {
+            total += (int32_t)(chunk[l]);
+        }
+
+        p += KERNEL_SUM_CHUNK;
+    }
+
+    *sum = (int32_t)(total);
+
+    return kernel_referenceSum(src + p, n - p, sum);
+}
+
+/*****************************************************************************/
+
+/**
+ * This is the backend.
+ */
+static const struct preprocessing_kernel_Backend KERNEL_SIMD() =
+{
+    KERNEL_STRING(KERNEL_SIMD_NAME),
+    KERNEL_SIMD(_addPixels),
+    KERNEL_SIMD(_subtractPixels),
+    KERNEL_SIMD(_multiplyPixels),
+    KERNEL_SIMD(_addScalarPixels),
+    KERNEL_SIMD(_subtractScalarPixels),
+    KERNEL_SIMD(_multiplyScalarPixels),
+    kernel_referenceNormalize,
+    KERNEL_SIMD(_maskPixels),
+    KERNEL_SIMD(_sumPixels),
+    kernel_referenceLog10,
+    kernel_referencePow10,
+    KERNEL_SIMD(_median9Pixels),
+    KERNEL_SIMD(_median25Pixels)
+};
+
+#undef KERNEL_SIMD_SORT
+#undef KERNEL_SIMD_MEDIAN
+#undef KERNEL_SIMD_SCALAR
+#undef KERNEL_SIMD_BINARY
+#undef KERNEL_SIMD_INLINE
+#undef KERNEL_SIMD_ATTRIBUTE
+#undef KERNEL_SIMD
+#undef KERNEL_SIMD_LANES
+#undef KERNEL_SIMD_TARGET
+#undef KERNEL_SIMD_NAME
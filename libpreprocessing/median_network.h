@@ -0,0 +1,108 @@
+/*
+ * Project: Solar Orbiter - PHI (SO/PHI)
+ * Module:  Preprocessing - a library for image pre-processing.
+ *
+ * Copyright (C) 2016, Max Planck Institute for Solar System Research
+ */
+
+/**
+ * @file
+ *
+ * This file contains the sorting networks of the median kernels of kernel.c
+ * and of the median filter of graph.c. They find the median of the 3 x 3 and
+ * 5 x 5 windows inside the image without a branch.
+ */
+
+#ifndef PREPROCESSING_MEDIAN_NETWORK_H
+#define PREPROCESSING_MEDIAN_NETWORK_H
+
+/* from std c */
+#include <stdint.h>
+
+/**
+ * These are the compare-exchanges of the median of 9 values (19) and of the
+ * median of 25 values (99). The median ends up in value 4 and in value 12.
+ */
+#define MEDIAN_NETWORK9(SORT) \
+    SORT(1, 2) SORT(4, 5) SORT(7, 8) \
+    SORT(0, 1) SORT(3, 4) SORT(6, 7) \
+    SORT(1, 2) SORT(4, 5) SORT(7, 8) \
+    SORT(0, 3) SORT(5, 8) SORT(4, 7) \
+    SORT(3, 6) SORT(1, 4) SORT(2, 5) \
+    SORT(4, 7) SORT(4, 2) SORT(6, 4) \
+    SORT(4, 2)
+
+#define MEDIAN_NETWORK25(SORT) \
+    SORT(0, 1)   SORT(3, 4)   SORT(2, 4) \
+    SORT(2, 3)   SORT(6, 7)   SORT(5, 7) \
+    SORT(5, 6)   SORT(9, 10)  SORT(8, 10) \
+    SORT(8, 9)   SORT(12, 13) SORT(11, 13) \
+    SORT(11, 12) SORT(15, 16) SORT(14, 16) \
+    SORT(14, 15) SORT(18, 19) SORT(17, 19) \
+    SORT(17, 18) SORT(21, 22) SORT(20, 22) \
+    SORT(20, 21) SORT(23, 24) SORT(2, 5) \
+    SORT(3, 6)   SORT(0, 6)   SORT(0, 3) \
+    SORT(4, 7)   SORT(1, 7)   SORT(1, 4) \
+    SORT(11, 14) SORT(8, 14)  SORT(8, 11) \
+    SORT(12, 15) SORT(9, 15)  SORT(9, 12) \
+    SORT(13, 16) SORT(10, 16) SORT(10, 13) \
+    SORT(20, 23) SORT(17, 23) SORT(17, 20) \
+    SORT(21, 24) SORT(18, 24) SORT(18, 21) \
+    SORT(19, 22) SORT(8, 17)  SORT(9, 18) \
+    SORT(0, 18)  SORT(0, 9)   SORT(10, 19) \
+    SORT(1, 19)  SORT(1, 10)  SORT(11, 20) \
+    SORT(2, 20)  SORT(2, 11)  SORT(12, 21) \
+    SORT(3, 21)  SORT(3, 12)  SORT(13, 22) \
+    SORT(4, 22)  SORT(4, 13)  SORT(14, 23) \
+    SORT(5, 23)  SORT(5, 14)  SORT(15, 24) \
+    SORT(6, 24)  SORT(6, 15)  SORT(7, 16) \
+    SORT(7, 19)  SORT(13, 21) SORT(15, 23) \
+    SORT(7, 13)  SORT(7, 15)  SORT(1, 9) \
+    SORT(3, 11)  SORT(5, 17)  SORT(11, 17) \
+    SORT(9, 17)  SORT(4, 10)  SORT(6, 12) \
+    SORT(7, 14)  SORT(4, 6)   SORT(4, 7) \
+    SORT(12, 14) SORT(10, 14) SORT(6, 7) \
+    SORT(10, 12) SORT(6, 10)  SORT(6, 17) \
+    SORT(12, 17) SORT(7, 17)  SORT(7, 10) \
+    SORT(12, 18) SORT(7, 12)  SORT(10, 18) \
+    SORT(12, 20) SORT(10, 20) SORT(10, 12)
+
+/**
+ * This is one compare-exchange of the median sorting networks.
+ */
+#define MEDIAN_SORT(a, b) \
+    { \
+        int32_t t = (p[a] < p[b]) ? p[a] : p[b]; \
+        p[b] = (p[a] < p[b]) ? p[b] : p[a]; \
+        p[a] = t; \
+    }
+
+/**
+ * Find the median of 9 values, the values are reordered.
+ *
+ * @param p the values.
+ *
+ * @return the median.
+ */
+static inline int32_t median_network9(int32_t* p)
+{
+    MEDIAN_NETWORK9(MEDIAN_SORT)
+
+    return p[4];
+}
+
+/**
+ * Find the median of 25 values, the values are reordered.
+ *
+ * @param p the values.
+ *
+ * @return the median.
+ */
+static inline int32_t median_network25(int32_t* p)
+{
+    MEDIAN_NETWORK25(MEDIAN_SORT)
+
+    return p[12];
+}
+
+#endif /* PREPROCESSING_MEDIAN_NETWORK_H */
@@ -0,0 +1,86 @@
+/*
+ * Project: Solar Orbiter - PHI (SO/PHI)
+ * Module:  Preprocessing - a library for image pre-processing.
+ *
+ * Copyright (C) 2016, Max Planck Institute for Solar System Research
+ */
+
+/**
+ * @file
+ *
+ * This file contains declarations of the registration of frames by FFT phase
+ * correlation. A shift (dy, dx) means the content of a frame is moved by dy
+ * rows and dx columns against the reference, frame(y, x) = ref(y - dy, x - dx).
+ *
+ * The shift is first estimated on binned frames, which is cheap and finds
+ * large shifts. It is then refined on the frames at full resolution, with the
+ * peak searched within one bin of the coarse estimate, or everywhere at
+ * binning 1.
+ *
+ * A pattern fixed to the detector (a flat field) correlates at zero shift. A
+ * peak elsewhere at least half as high as the one at zero is taken for the
+ * shift, which finds shifts below one bin. A peak that does not stand out of
+ * the rest of the correlation is reported as PREPROCESSING_INVALID_NUMBER,
+ * with the shift still stored.
+ */
+
+#ifndef PREPROCESSING_ALIGN_H
+#define PREPROCESSING_ALIGN_H
+
+#include <sys/types.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * Estimate the shift of an image against a reference image.
+     *
+     * @param sdSrc    the VMEM (SDRAM) address of image.
+     * @param sdRef    the VMEM (SDRAM) address of reference image.
+     * @param rows     the number of image rows.
+     * @param cols     the number of image columns.
+     * @param binning  the number of pixels binned per axis for the coarse
+     *                 estimate, 1 for a single full resolution pass.
+     * @param subPixel 1 for a sub-pixel shift, 0 for an integer shift.
+     * @param dy       the shift in rows (24.8).
+     * @param dx       the shift in columns (24.8).
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success,
+     *         PREPROCESSING_INVALID_NUMBER if the shift is ambiguous, failure
+     *         code otherwise.
+     */
+    int preprocessing_align_phaseCorrelate(uint32_t sdSrc, uint32_t sdRef,
+            uint16_t rows, uint16_t cols, uint16_t binning, int subPixel,
+            int32_t* dy, int32_t* dx);
+
+    /**
+     * Estimate the shifts of a stack of NAND entries against one of them.
+     * The frames are spread over all cores.
+     *
+     * @param nandSrc   the NAND entries of the frames.
+     * @param frames    the number of frames.
+     * @param reference the index of the reference frame.
+     * @param rows      the number of image rows.
+     * @param cols      the number of image columns.
+     * @param binning   the number of pixels binned per axis for the coarse
+     *                  estimate, 1 for a single full resolution pass.
+     * @param subPixel  1 for sub-pixel shifts, 0 for integer shifts.
+     * @param nandDst   the NAND entry of the shifts, dy and dx (24.8) per
+     *                  frame.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success,
+     *         PREPROCESSING_INVALID_NUMBER if a shift is ambiguous (all shifts
+     *         are stored), failure code otherwise.
+     */
+    int preprocessing_align_phaseCorrelateNAND(const int32_t* const* nandSrc,
+            uint16_t frames, uint16_t reference, uint16_t rows, uint16_t cols,
+            uint16_t binning, int subPixel, int32_t* nandDst);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PREPROCESSING_ALIGN_H */
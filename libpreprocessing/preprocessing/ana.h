@@ -23,6 +23,35 @@ extern "C"
 {
 #endif
 
+/**
+ * This is the number of partial histograms that are counted in parallel and
+ * summed afterwards.
+ */
+#define PREPROCESSING_ANA_HISTOGRAM_SLICES 16
+
+/**
+ * These are the derivative stencils of preprocessing_ana_gradient(): the
+ * central difference and the 3 x 3 Sobel and Scharr operators.
+ */
+#define PREPROCESSING_ANA_STENCIL_CENTRAL 0
+#define PREPROCESSING_ANA_STENCIL_SOBEL 1
+#define PREPROCESSING_ANA_STENCIL_SCHARR 2
+
+/**
+ * This structure holds the extrema of an image: the smallest and largest
+ * pixel value, the number of pixels of each and the first of them (row x
+ * columns + column).
+ */
+struct preprocessing_ana_Extrema
+{
+    int32_t min;
+    int32_t max;
+    uint32_t minCount;
+    uint32_t maxCount;
+    uint32_t minFirst;
+    uint32_t maxFirst;
+};
+
     /**
      * Mark all pixels of an image whose values lie under a certain threshold
      * in a mask.
@@ -70,8 +99,8 @@ extern "C"
 
     /**
      * Find the minimum in all pixels of an image and mark these pixels in an
-     * image mask. We use /a preprocessing_ana_equalThresh to create the image
-     * mask.
+     * image mask. We use /a preprocessing_ana_extrema and
+     * /a preprocessing_ana_extremaMask.
      *
      * @param sdSrc  the VMEM (SDRAM) address of image.
      * @param rows   the number of image rows.
@@ -86,8 +115,8 @@ extern "C"
 
     /**
      * Find the maximum in all pixels of an image and mark these pixels in an
-     * image mask. We use /a preprocessing_ana_equalThreshFP to create the
-     * image mask.
+     * image mask. We use /a preprocessing_ana_extrema and
+     * /a preprocessing_ana_extremaMask.
      *
      * @param sdSrc  the VMEM (SDRAM) address of image.
      * @param rows   the number of image rows.
@@ -101,34 +130,116 @@ extern "C"
             uint16_t cols, uint32_t sdDst, int32_t* dstMax);
 
     /**
-     * Calculate the derivation of the image in x direction.
+     * Find the minimum and the maximum of all pixels of an image, how often
+     * they occur and where they occur first, in one pass. NaN pixels are
+     * compared like the smallest value.
+     *
+     * @param sdSrc   the VMEM (SDRAM) address of image.
+     * @param rows    the number of image rows.
+     * @param cols    the number of image columns.
+     * @param extrema the extrema.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+    int preprocessing_ana_extrema(uint32_t sdSrc, uint16_t rows,
+            uint16_t cols, struct preprocessing_ana_Extrema* extrema);
+
+    /**
+     * Mark the pixels of an image equal to an extremum in a mask, like
+     * preprocessing_ana_equalThresh(). The pixels before the first one and
+     * after the last one of \a count are cleared without being compared.
      *
      * @param sdSrc the VMEM (SDRAM) address of image.
      * @param rows  the number of image rows.
      * @param cols  the number of image columns.
-     * @param sdDst the VMEM (SDRAM) address of result image.
+     * @param value the extremum.
+     * @param first the first pixel equal to \a value.
+     * @param count the number of pixels equal to \a value.
+     * @param sdDst the VMEM (SDRAM) address of result image mask.
      *
      * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
      */
+    int preprocessing_ana_extremaMask(uint32_t sdSrc, uint16_t rows,
+            uint16_t cols, int32_t value, uint32_t first, uint32_t count,
+            uint32_t sdDst);
+
+    /**
+     * Calculate the derivation of the image in x direction, the convolution
+     * with [-1 0 1] with the mirrored border, and add it to the result image.
+     *
+     * @param sdSrc the VMEM (SDRAM) address of image.
+     * @param rows  the number of image rows.
+     * @param cols  the number of image columns.
+     * @param sdDst the VMEM (SDRAM) address of result image.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success,
+     *         PREPROCESSING_INVALID_NUMBER if a result pixel is NaN, failure
+     *         code otherwise. A result pixel is NaN if it was NaN before,
+     *         if a neighbour taken is NaN or if a partial sum leaves the
+     *         24.8 range, as in preprocessing_ana_crossCorrelate().
+     */
     int preprocessing_ana_deriveX(uint32_t sdSrc, uint16_t rows, uint16_t cols,
             uint32_t sdDst);
 
     /**
-     * Calculate the derivation of the image in y direction.
+     * Calculate the derivation of the image in y direction, the same way as
+     * preprocessing_ana_deriveX().
      *
      * @param sdSrc the VMEM (SDRAM) address of image.
      * @param rows  the number of image rows.
      * @param cols  the number of image columns.
      * @param sdDst the VMEM (SDRAM) address of result image.
      *
-     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     * @return PREPROCESSING_SUCCESSFUL on success,
+     *         PREPROCESSING_INVALID_NUMBER if a result pixel is NaN, failure
+     *         code otherwise, see preprocessing_ana_deriveX().
      */
     int preprocessing_ana_deriveY(uint32_t sdSrc, uint16_t rows, uint16_t cols,
             uint32_t sdDst);
 
+    /**
+     * Calculate the gradient of an image with a derivative stencil. Like
+     * preprocessing_ana_deriveX() and preprocessing_ana_deriveY() each
+     * component is the previous minus the next pixel, the Sobel and Scharr
+     * stencils weight the neighbouring rows or columns by 1, 2, 1 and 3, 10,
+     * 3. The border is mirrored. Unlike the derivations the results are
+     * stored, not added, and a NaN neighbour makes the pixel NaN.
+     *
+     * @param sdSrc   the VMEM (SDRAM) address of image.
+     * @param rows    the number of image rows.
+     * @param cols    the number of image columns.
+     * @param stencil the stencil, see PREPROCESSING_ANA_STENCIL_CENTRAL.
+     * @param sdDstY  the VMEM (SDRAM) address of result image (row
+     *                derivation).
+     * @param sdDstX  the VMEM (SDRAM) address of result image (column
+     *                derivation).
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+    int preprocessing_ana_gradient(uint32_t sdSrc, uint16_t rows,
+            uint16_t cols, int stencil, uint32_t sdDstY, uint32_t sdDstX);
+
+    /**
+     * Calculate the magnitude of the gradient of an image, see
+     * preprocessing_ana_gradient(). The components are not stored.
+     *
+     * @param sdSrc   the VMEM (SDRAM) address of image.
+     * @param rows    the number of image rows.
+     * @param cols    the number of image columns.
+     * @param stencil the stencil, see PREPROCESSING_ANA_STENCIL_CENTRAL.
+     * @param sdDst   the VMEM (SDRAM) address of result image.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+    int preprocessing_ana_gradientMagnitude(uint32_t sdSrc, uint16_t rows,
+            uint16_t cols, int stencil, uint32_t sdDst);
+
     /**
      * Create a histrogram of all pixel values of an image. The number of
      * histogram values (or resolution) can be specified with a parameter.
+     * The first row of the result holds the upper bin edges, uniformly
+     * spread over the 24.8 range, the second row the pixel counts, which are
+     * added to the given counts. Pixels above the last edge are not counted.
      *
      * @param sdSrc  the VMEM (SDRAM) address of image.
      * @param rows   the number of image rows.
@@ -142,7 +253,83 @@ extern "C"
             uint16_t cols, unsigned int values, uint32_t sdDst);
 
     /**
-     * Cross-correlate an image with a kernel.
+     * Create a histogram of all pixel values of an image like
+     * preprocessing_ana_createHistogram(), but with the bins spread over the
+     * range of the image. The first bin ends at the smallest pixel value,
+     * the last at or above the largest. NaN pixels are not counted.
+     *
+     * @param sdSrc  the VMEM (SDRAM) address of image.
+     * @param rows   the number of image rows.
+     * @param cols   the number of image columns.
+     * @param values the number of values for histogram resolution.
+     * @param sdDst  the VMEM (SDRAM) address of result histogram.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+    int preprocessing_ana_createHistogramRange(uint32_t sdSrc, uint16_t rows,
+            uint16_t cols, unsigned int values, uint32_t sdDst);
+
+    /**
+     * Find a percentile of the pixel values of an image, between the two
+     * nearest ranks by linear interpolation. Only pixels whose mask value is
+     * greater than 0 and which are not NaN are considered. The pixels are
+     * selected by a two pass radix histogram of the upper and lower 16 bits,
+     * without sorting.
+     *
+     * @param sdSrc    the VMEM (SDRAM) address of image.
+     * @param sdMask   the VMEM (SDRAM) address of image mask.
+     * @param rows     the number of image rows.
+     * @param cols     the number of image columns.
+     * @param percent  the percentile (0 to 100, 24.8).
+     * @param dstValue the pointer to the storage destination of the value.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+    int preprocessing_ana_percentile(uint32_t sdSrc, uint32_t sdMask,
+            uint16_t rows, uint16_t cols, int32_t percent, int32_t* dstValue);
+
+    /**
+     * Find the median of the pixel values of an image, see
+     * preprocessing_ana_percentile(). The median of an even number of pixels
+     * is the average of the two middle ones.
+     *
+     * @param sdSrc     the VMEM (SDRAM) address of image.
+     * @param sdMask    the VMEM (SDRAM) address of image mask.
+     * @param rows      the number of image rows.
+     * @param cols      the number of image columns.
+     * @param dstMedian the pointer to the storage destination of the median.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+    int preprocessing_ana_medianValue(uint32_t sdSrc, uint32_t sdMask,
+            uint16_t rows, uint16_t cols, int32_t* dstMedian);
+
+    /**
+     * Find the median and the median absolute deviation from it of the pixel
+     * values of an image, see preprocessing_ana_percentile(). The deviation
+     * is not scaled, 1.4826 times it estimates the standard deviation of
+     * normally distributed values.
+     *
+     * @param sdSrc     the VMEM (SDRAM) address of image.
+     * @param sdMask    the VMEM (SDRAM) address of image mask.
+     * @param rows      the number of image rows.
+     * @param cols      the number of image columns.
+     * @param dstMedian the pointer to the storage destination of the median.
+     * @param dstMad    the pointer to the storage destination of the median
+     *                  absolute deviation.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+    int preprocessing_ana_mad(uint32_t sdSrc, uint32_t sdMask, uint16_t rows,
+            uint16_t cols, int32_t* dstMedian, int32_t* dstMad);
+
+    /**
+     * Cross-correlate an image with a kernel and add the result to the result
+     * image. Edge handling is done by mirroring at image border. Kernels of
+     * 25 taps or more that are separable run as a row and a column pass,
+     * other kernels of 121 taps or more through the FFT. These paths round
+     * the sum once instead of every product, so the last bits may differ
+     * from the direct sum.
      *
      * @param sdSrc1 the VMEM (SDRAM) address of image 1.
      * @param rows1  the number of image 1 rows.
@@ -152,14 +339,21 @@ extern "C"
      * @param cols2  the number of image 2 or kernel columns.
      * @param sdDst  the VMEM (SDRAM) address of result image.
      *
-     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     * @return PREPROCESSING_SUCCESSFUL on success,
+     *         PREPROCESSING_INVALID_NUMBER if a result pixel is NaN, failure
+     *         code otherwise. A result pixel is NaN if it was NaN before or
+     *         if its sum leaves the 24.8 range, for the direct sum already
+     *         if a product or a partial sum does. The other pixels are
+     *         still written.
      */
     int preprocessing_ana_crossCorrelate(uint32_t sdSrc1, uint16_t rows1,
             uint16_t cols1, uint32_t sdSrc2, uint16_t rows2,
             uint16_t cols2, uint32_t sdDst);
 
     /**
-     * Convolve an image with a kernel.
+     * Convolve an image with a kernel and add the result to the result image.
+     * Edge handling is done by zero padding. Large kernels take the same
+     * separable and FFT paths as preprocessing_ana_crossCorrelate().
      *
      * @param sdSrc1 the VMEM (SDRAM) address of image 1.
      * @param rows1  the number of image 1 rows.
@@ -169,7 +363,9 @@ extern "C"
      * @param cols2  the number of image 2 or kernel columns.
      * @param sdDst  the VMEM (SDRAM) address of result image.
      *
-     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     * @return PREPROCESSING_SUCCESSFUL on success,
+     *         PREPROCESSING_INVALID_NUMBER if a result pixel is NaN, failure
+     *         code otherwise, see preprocessing_ana_crossCorrelate().
      */
     int preprocessing_ana_convolve(uint32_t sdSrc1, uint16_t rows1,
             uint16_t cols1, uint32_t sdSrc2, uint16_t rows2, uint16_t cols2,
@@ -188,6 +384,22 @@ extern "C"
     int preprocessing_ana_median(uint32_t sdSrc, uint16_t rows, uint16_t cols,
             uint32_t sdDst);
 
+    /**
+     * Perform median filtering on an image with a square window of any odd
+     * size. The window is cut at the image border, the median of an even
+     * number of pixels is the average of the two middle ones.
+     *
+     * @param sdSrc the VMEM (SDRAM) address of image.
+     * @param rows  the number of image rows.
+     * @param cols  the number of image columns.
+     * @param size  the window size (odd).
+     * @param sdDst the VMEM (SDRAM) address of result image.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+    int preprocessing_ana_medianFilter(uint32_t sdSrc, uint16_t rows,
+            uint16_t cols, uint16_t size, uint32_t sdDst);
+
     /**
      * Cast all pixels of an image of float data type to 32 bit float data
      * type.
@@ -23,6 +23,19 @@ extern "C"
 {
 #endif
 
+/**
+ * These are the rows and columns of a tile of the result of
+ * preprocessing_arith_multiplyMatrices(), and the length of the inner index
+ * run over per pass (32 x 64 x 4 B = 8 KiB of matrix 2).
+ * @{
+ */
+#define PREPROCESSING_ARITH_TILE_ROWS 16
+#define PREPROCESSING_ARITH_TILE_COLS 64
+#define PREPROCESSING_ARITH_TILE_DEPTH 32
+/**
+ * @}
+ */
+
     /**
      * Add two images pixel by pixel.
      *
@@ -227,7 +240,9 @@ extern "C"
             uint16_t cols, uint32_t sdDst);
 
     /**
-     * Multiply two matrices.
+     * Multiply two matrices and add the product to the result matrix. The
+     * result is computed in tiles, a result pixel is NaN when a product or
+     * a partial sum leaves the 24.8 range.
      *
      * @param sdSrc1 the VMEM (SDRAM) address of matrix 1.
      * @param rows1  the number of matrix 1 rows.
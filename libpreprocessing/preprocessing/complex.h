@@ -0,0 +1,99 @@
+/*
+ * Project: Solar Orbiter - PHI (SO/PHI)
+ * Module:  Preprocessing - a library for image pre-processing.
+ *
+ * Copyright (C) 2016, Max Planck Institute for Solar System Research
+ */
+
+/**
+ * @file
+ *
+ * This file contains declarations of pixel by pixel operations on complex
+ * images. A complex image is a pair of 24.8 fixed point images holding the
+ * real and the imaginary parts, as written by the functions in
+ * "preprocessing/fft.h".
+ */
+
+#ifndef PREPROCESSING_COMPLEX_H
+#define PREPROCESSING_COMPLEX_H
+
+#include <sys/types.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * Multiply two complex images pixel by pixel.
+     *
+     * @param sdSrcRe1 the VMEM (SDRAM) address of real part of image 1.
+     * @param sdSrcIm1 the VMEM (SDRAM) address of imaginary part of image 1.
+     * @param sdSrcRe2 the VMEM (SDRAM) address of real part of image 2.
+     * @param sdSrcIm2 the VMEM (SDRAM) address of imaginary part of image 2.
+     * @param rows     the number of image rows.
+     * @param cols     the number of image columns.
+     * @param sdDstRe  the VMEM (SDRAM) address of real part of result image.
+     * @param sdDstIm  the VMEM (SDRAM) address of imaginary part of result
+     *                 image.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+    int preprocessing_complex_multiply(uint32_t sdSrcRe1, uint32_t sdSrcIm1,
+            uint32_t sdSrcRe2, uint32_t sdSrcIm2, uint16_t rows, uint16_t cols,
+            uint32_t sdDstRe, uint32_t sdDstIm);
+
+    /**
+     * Multiply a complex image by the complex conjugate of another pixel by
+     * pixel, as needed for cross-correlation in frequency domain.
+     *
+     * @param sdSrcRe1 the VMEM (SDRAM) address of real part of image 1.
+     * @param sdSrcIm1 the VMEM (SDRAM) address of imaginary part of image 1.
+     * @param sdSrcRe2 the VMEM (SDRAM) address of real part of image 2.
+     * @param sdSrcIm2 the VMEM (SDRAM) address of imaginary part of image 2.
+     * @param rows     the number of image rows.
+     * @param cols     the number of image columns.
+     * @param sdDstRe  the VMEM (SDRAM) address of real part of result image.
+     * @param sdDstIm  the VMEM (SDRAM) address of imaginary part of result
+     *                 image.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+    int preprocessing_complex_multiplyConjugate(uint32_t sdSrcRe1,
+            uint32_t sdSrcIm1, uint32_t sdSrcRe2, uint32_t sdSrcIm2,
+            uint16_t rows, uint16_t cols, uint32_t sdDstRe, uint32_t sdDstIm);
+
+    /**
+     * Calculate the magnitude of a complex image pixel by pixel.
+     *
+     * @param sdSrcRe the VMEM (SDRAM) address of real part of image.
+     * @param sdSrcIm the VMEM (SDRAM) address of imaginary part of image.
+     * @param rows    the number of image rows.
+     * @param cols    the number of image columns.
+     * @param sdDst   the VMEM (SDRAM) address of result image.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+    int preprocessing_complex_abs(uint32_t sdSrcRe, uint32_t sdSrcIm,
+            uint16_t rows, uint16_t cols, uint32_t sdDst);
+
+    /**
+     * Calculate the phase of a complex image pixel by pixel in radian.
+     *
+     * @param sdSrcRe the VMEM (SDRAM) address of real part of image.
+     * @param sdSrcIm the VMEM (SDRAM) address of imaginary part of image.
+     * @param rows    the number of image rows.
+     * @param cols    the number of image columns.
+     * @param sdDst   the VMEM (SDRAM) address of result image.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+    int preprocessing_complex_phase(uint32_t sdSrcRe, uint32_t sdSrcIm,
+            uint16_t rows, uint16_t cols, uint32_t sdDst);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PREPROCESSING_COMPLEX_H */
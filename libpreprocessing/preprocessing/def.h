@@ -72,6 +72,38 @@
         return PREPROCESSING_INVALID_ADDRESS; \
     }
 
+/**
+ * These macros run the following for loop on all cores when the library is
+ * built with OpenMP, and as a plain loop otherwise. The loop body must not
+ * return, so a failure is collected in a flag that is or-ed over all
+ * threads.
+ * @{
+ */
+#define PREPROCESSING_DEF_PRAGMA(x) _Pragma(#x)
+#ifdef _OPENMP
+#define PREPROCESSING_DEF_PARALLEL_FOR \
+    PREPROCESSING_DEF_PRAGMA(omp parallel for schedule(static))
+#define PREPROCESSING_DEF_PARALLEL_FOR_OR(flag) \
+    PREPROCESSING_DEF_PRAGMA(omp parallel for schedule(static) reduction(|:flag))
+#else
+#define PREPROCESSING_DEF_PARALLEL_FOR
+#define PREPROCESSING_DEF_PARALLEL_FOR_OR(flag)
+#endif
+/**
+ * @}
+ */
+
+/**
+ * This macro runs the following statement on one core at a time when the
+ * library is built with OpenMP (shared caches).
+ */
+#ifdef _OPENMP
+#define PREPROCESSING_DEF_CRITICAL(name) \
+    PREPROCESSING_DEF_PRAGMA(omp critical(name))
+#else
+#define PREPROCESSING_DEF_CRITICAL(name)
+#endif
+
 /**
  * These are the reserved return values of the operation functions.
  */
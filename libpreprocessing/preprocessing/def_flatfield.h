@@ -8,6 +8,11 @@
 #ifndef LIBPREPROCESSING_PREPROCESSING_DEF_FLATFIELD_H_
 #define LIBPREPROCESSING_PREPROCESSING_DEF_FLATFIELD_H_
 
+/*
+ * Default job configuration. The flatfield functions take their dimensions
+ * from struct preprocessing_flatfield_Job, these values are only used to
+ * set up a job when nothing else is given.
+ */
 #define ROWS 2048
 #define COLS 2048
 
@@ -16,15 +21,30 @@
 #define IMIN 	0 << FP32_FWL
 #define IMAX  	82000 << FP32_FWL
 #define LOOPS_ITERA 10
+#define LOOPS_ITERA_UPDATE 3
+#define CHECKPOINT_EVERY 1
+#define CLIP_MODE PREPROCESSING_FLATFIELD_CLIP_SIGMA
+#define MAD_FIVESIGMA 	1898	/* 5 x 1.4826 (24.8) */
+
+/*
+ * NAND layout for up to n offset frames: frames 0..n-1 followed by the shared
+ * entries below and two entries (masked diff and mskDouble) per frame pair.
+ */
+#define NAND_MASK_INDEX(n)  		(n)
+#define NAND_MASK_TMP_INDEX(n)		(NAND_MASK_INDEX(n) + 1)
+#define NAND_CONS_INDEX(n)			(NAND_MASK_TMP_INDEX(n) + 1)
+#define NAND_GAIN_INDEX(n)	 		(NAND_CONS_INDEX(n) + 1)
+#define NAND_PIXCOUNT_INDEX(n) 		(NAND_GAIN_INDEX(n) + 1)
+#define NAND_DISP_INDEX(n) 			(NAND_PIXCOUNT_INDEX(n) + 1)
+#define NAND_LOG_GAIN_INDEX(n)		(NAND_DISP_INDEX(n) + 1)
+#define NAND_PAIR_DISP_INDEX(n)		(NAND_LOG_GAIN_INDEX(n) + 1)
+#define NAND_PAIR_INDEX(n, p)		(NAND_PAIR_DISP_INDEX(n) + 1 + 2 * (p))
+#define NAND_ENTRIES(n)				NAND_PAIR_INDEX(n, NAND_PAIRS(n))
+
+#define NAND_PAIRS(n)				((n) * ((n) - 1) / 2)
 
-#define MASK_INDEX  	NUMBER_OF_IMAGES
-#define MASK_TMP_INDEX	(MASK_INDEX + 1)
-#define CONS_INDEX		(MASK_TMP_INDEX + 1)
-#define GAIN_INDEX	 	(CONS_INDEX + 1)
-#define PIXCOUNT_INDEX 	(GAIN_INDEX + 1)
-#define DISP_INDEX 		(PIXCOUNT_INDEX + 1)
-#define DISP_ROWS   	NUMBER_OF_IMAGES
 #define DISP_COLS		2
+#define DISP_BINNING	4
 
 #define CHECK_STATUS(x) 	if((status = x ) != PREPROCESSING_SUCCESSFUL){ printf("Status Error\n");  return status;}
 
@@ -0,0 +1,263 @@
+/*
+ * Project: Solar Orbiter - PHI (SO/PHI)
+ * Module:  Preprocessing - a library for image pre-processing.
+ *
+ * Copyright (C) 2016, Max Planck Institute for Solar System Research
+ */
+
+/**
+ * @file
+ *
+ * This file contains declarations of lazily evaluated elementwise
+ * expressions over 24.8 fixed point frames. A chain of operations like
+ * (a - b) * mask is built node by node first and then evaluated in one pass
+ * over the pixels, so no intermediate frame is written. The pixels are
+ * processed in blocks that stay in cache, each node of a block runs on the
+ * kernel backend (see preprocessing/kernel.h), and the rows are spread over
+ * all cores.
+ *
+ * The results are the same as those of the corresponding operations of
+ * arith.h and ana.h run one after the other. An expression is evaluated on
+ * a window of the frames, each frame may start at its own offset, like the
+ * ROIs of udp.h.
+ *
+ * For C++ there are expression templates over the same frames in
+ * "preprocessing/expr.hpp".
+ */
+
+#ifndef PREPROCESSING_EXPR_H
+#define PREPROCESSING_EXPR_H
+
+#include <sys/types.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * This is the maximum number of nodes of an expression.
+ */
+#define PREPROCESSING_EXPR_MAX_NODES 32
+
+/**
+ * This is the number of pixels of a block. The values of all nodes of a
+ * block stay in cache (32 nodes x 1 KiB = 32 KiB).
+ */
+#define PREPROCESSING_EXPR_BLOCK 256
+
+    /**
+     * These are the operations of the nodes of an expression.
+     */
+    enum preprocessing_expr_Op
+    {
+        PREPROCESSING_EXPR_FRAME = 0,
+        PREPROCESSING_EXPR_CONSTANT,
+        PREPROCESSING_EXPR_ADD,
+        PREPROCESSING_EXPR_SUBTRACT,
+        PREPROCESSING_EXPR_MULTIPLY,
+        PREPROCESSING_EXPR_DIVIDE,
+        PREPROCESSING_EXPR_UNDER,
+        PREPROCESSING_EXPR_EQUAL,
+        PREPROCESSING_EXPR_OVER,
+        PREPROCESSING_EXPR_SELECT
+    };
+
+    /**
+     * This structure is one node of an expression. The operands are
+     * indices of earlier nodes.
+     */
+    struct preprocessing_expr_Node
+    {
+        int op;
+        int operand[3];
+
+        /**
+         * This is the frame of a frame node and the row and column the
+         * window starts at in it.
+         */
+        uint32_t sdSrc;
+        uint16_t row;
+        uint16_t col;
+
+        /**
+         * This is the value of a constant node.
+         */
+        int32_t value;
+    };
+
+    /**
+     * This structure is an expression. Its frames have rows x cols pixels,
+     * it is evaluated on a window of windowRows x windowCols pixels.
+     */
+    struct preprocessing_expr_Expr
+    {
+        uint16_t rows;
+        uint16_t cols;
+        uint16_t windowRows;
+        uint16_t windowCols;
+
+        /**
+         * This is the first failure while the expression was built, it is
+         * returned by preprocessing_expr_evaluate().
+         */
+        int status;
+
+        unsigned int nodes;
+        struct preprocessing_expr_Node node[PREPROCESSING_EXPR_MAX_NODES];
+    };
+
+    /**
+     * Start an empty expression on frames of rows x cols pixels. The window
+     * is the whole frame.
+     *
+     * @param expr the expression.
+     * @param rows the number of image rows.
+     * @param cols the number of image columns.
+     */
+    void preprocessing_expr_init(struct preprocessing_expr_Expr* expr,
+            uint16_t rows, uint16_t cols);
+
+    /**
+     * Set the window the expression is evaluated on.
+     *
+     * @param expr the expression.
+     * @param rows the number of window rows.
+     * @param cols the number of window columns.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+    int preprocessing_expr_setWindow(struct preprocessing_expr_Expr* expr,
+            uint16_t rows, uint16_t cols);
+
+    /**
+     * Add the pixels of a frame. The node, like all others, returns the
+     * index of the new node, or -1 if it could not be added (the failure is
+     * kept in expr->status). A node with an operand of -1 is -1.
+     *
+     * @param expr  the expression.
+     * @param sdSrc the VMEM (SDRAM) address of image.
+     * @param row   the row the window starts at in the image.
+     * @param col   the column the window starts at in the image.
+     *
+     * @return the node, -1 on failure.
+     */
+    int preprocessing_expr_frame(struct preprocessing_expr_Expr* expr,
+            uint32_t sdSrc, uint16_t row, uint16_t col);
+
+    /**
+     * Add a constant.
+     *
+     * @param expr  the expression.
+     * @param value the value (24.8).
+     *
+     * @return the node, -1 on failure.
+     */
+    int preprocessing_expr_constant(struct preprocessing_expr_Expr* expr,
+            int32_t value);
+
+    /**
+     * Add a node that adds, subtracts, multiplies or divides two nodes
+     * pixel by pixel, like preprocessing_arith_addImages() and the others.
+     *
+     * @param expr the expression.
+     * @param a    the first operand.
+     * @param b    the second operand.
+     *
+     * @return the node, -1 on failure.
+     * @{
+     */
+    int preprocessing_expr_add(struct preprocessing_expr_Expr* expr, int a,
+            int b);
+    int preprocessing_expr_subtract(struct preprocessing_expr_Expr* expr,
+            int a, int b);
+    int preprocessing_expr_multiply(struct preprocessing_expr_Expr* expr,
+            int a, int b);
+    int preprocessing_expr_divide(struct preprocessing_expr_Expr* expr,
+            int a, int b);
+    /**
+     * @}
+     */
+
+    /**
+     * Add a node that adds, subtracts, multiplies or divides a node by a
+     * scalar, like preprocessing_arith_addScalar() and the others.
+     *
+     * @param expr   the expression.
+     * @param a      the operand.
+     * @param scalar the scalar (24.8).
+     *
+     * @return the node, -1 on failure.
+     * @{
+     */
+    int preprocessing_expr_addScalar(struct preprocessing_expr_Expr* expr,
+            int a, int32_t scalar);
+    int preprocessing_expr_subtractScalar(
+            struct preprocessing_expr_Expr* expr, int a, int32_t scalar);
+    int preprocessing_expr_multiplyScalar(
+            struct preprocessing_expr_Expr* expr, int a, int32_t scalar);
+    int preprocessing_expr_divideScalar(struct preprocessing_expr_Expr* expr,
+            int a, int32_t scalar);
+    /**
+     * @}
+     */
+
+    /**
+     * Add a node that marks the pixels of a node under, equal to or over a
+     * threshold with 1 and the others with 0, like
+     * preprocessing_ana_underThresh() and the others.
+     *
+     * @param expr   the expression.
+     * @param a      the operand.
+     * @param thresh the threshold (24.8).
+     *
+     * @return the node, -1 on failure.
+     * @{
+     */
+    int preprocessing_expr_underThresh(struct preprocessing_expr_Expr* expr,
+            int a, int32_t thresh);
+    int preprocessing_expr_equalThresh(struct preprocessing_expr_Expr* expr,
+            int a, int32_t thresh);
+    int preprocessing_expr_overThresh(struct preprocessing_expr_Expr* expr,
+            int a, int32_t thresh);
+    /**
+     * @}
+     */
+
+    /**
+     * Add a node that takes the pixels of a where a mask is not 0 and the
+     * pixels of b elsewhere.
+     *
+     * @param expr the expression.
+     * @param mask the mask.
+     * @param a    the pixels where the mask is not 0.
+     * @param b    the pixels where the mask is 0.
+     *
+     * @return the node, -1 on failure.
+     */
+    int preprocessing_expr_select(struct preprocessing_expr_Expr* expr,
+            int mask, int a, int b);
+
+    /**
+     * Evaluate a node of an expression on its window. Only the nodes the
+     * node depends on are evaluated. The destination may be one of the
+     * frames at the same offset, but must not overlap it otherwise.
+     *
+     * @param expr  the expression.
+     * @param node  the node.
+     * @param sdDst the VMEM (SDRAM) address of result image.
+     * @param row   the row the window starts at in the result image.
+     * @param col   the column the window starts at in the result image.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     *         PREPROCESSING_INVALID_NUMBER if a node gave a NaN pixel.
+     */
+    int preprocessing_expr_evaluate(const struct preprocessing_expr_Expr* expr,
+            int node, uint32_t sdDst, uint16_t row, uint16_t col);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PREPROCESSING_EXPR_H */
@@ -0,0 +1,451 @@
+/*
+ * Project: Solar Orbiter - PHI (SO/PHI)
+ * Module:  Preprocessing - a library for image pre-processing.
+ *
+ * Copyright (C) 2016, Max Planck Institute for Solar System Research
+ */
+
+/**
+ * @file
+ *
+ * This file contains C++ expression templates over 24.8 fixed point frames
+ * in VMEM (SDRAM), the C++ counterpart of "preprocessing/expr.h". An
+ * expression like (a - b) * mask + 384 is a type that holds its operands,
+ * nothing is computed until it is evaluated into a view. Then the compiler
+ * inlines the whole expression into one loop over the pixels, the rows are
+ * spread over all cores.
+ *
+ * The pixels have the semantics of the libeve operations: +, -, * and / are
+ * eve_fp_add32(), eve_fp_subtract32(), eve_fp_multiply32() and
+ * eve_fp_divide32(), a division by 0 gives NaN. The results are the same as
+ * those of the operations of arith.h and ana.h run one after the other.
+ *
+ *     using namespace preprocessing::expr;
+ *
+ *     View a(sdA, rows, cols), b(sdB, rows, cols), mask(sdMask, rows, cols);
+ *     int status = evaluate(select(mask, (a - b) * 384, 0),
+ *             View(sdDst, rows, cols));
+ */
+
+#ifndef PREPROCESSING_EXPR_HPP
+#define PREPROCESSING_EXPR_HPP
+
+#include "def.h"
+#include "prof.h"
+#include "vmem.h"
+
+/* from libeve */
+#include "../../libeve/eve/fixed_point.h"
+
+/* from std c */
+#include <stddef.h>
+#include <stdint.h>
+
+namespace preprocessing
+{
+namespace expr
+{
+
+    /**
+     * This is the base of all expressions, E is the expression itself.
+     */
+    template<class E>
+    struct Expr
+    {
+        const E& self() const
+        {
+            return static_cast<const E&>(*this);
+        }
+    };
+
+    /**
+     * This is a window of a frame in VMEM (SDRAM) that starts at row, col.
+     * A view of an invalid frame is not valid, an expression on it is not
+     * evaluated.
+     */
+    class View : public Expr<View>
+    {
+    public:
+        static const unsigned int frames = 1;
+        static const unsigned int ops = 0;
+
+        /**
+         * Make a view.
+         *
+         * @param sdAddress the VMEM (SDRAM) address of image.
+         * @param rows      the number of image rows.
+         * @param cols      the number of image columns.
+         * @param row       the row the window starts at.
+         * @param col       the column the window starts at.
+         */
+        View(uint32_t sdAddress, uint16_t rows, uint16_t cols,
+                uint16_t row = 0, uint16_t col = 0) :
+                data_(0), rows_(rows), cols_(cols), row_(row), col_(col)
+        {
+            if (preprocessing_vmem_isProcessingSizeValid(sdAddress, rows,
+                    cols))
+            {
+                data_ = static_cast<int32_t*>(
+                        preprocessing_vmem_getDataAddress(sdAddress));
+            }
+        }
+
+        /**
+         * Check whether a window of rows x cols pixels fits.
+         */
+        bool valid(unsigned int rows, unsigned int cols) const
+        {
+            return (data_ != 0) && (row_ + rows <= rows_)
+                    && (col_ + cols <= cols_);
+        }
+
+        /**
+         * Get the pixel y, x of the window.
+         */
+        int32_t at(size_t y, size_t x, int& nan) const
+        {
+            (void)(nan);
+            return data_[(row_ + y) * cols_ + col_ + x];
+        }
+
+        /**
+         * Get a pointer to row y of the window.
+         */
+        int32_t* row(size_t y) const
+        {
+            return data_ + (row_ + y) * cols_ + col_;
+        }
+
+        uint16_t rows() const
+        {
+            return (uint16_t)(rows_ - row_);
+        }
+
+        uint16_t cols() const
+        {
+            return (uint16_t)(cols_ - col_);
+        }
+
+    private:
+        int32_t* data_;
+        uint16_t rows_;
+        uint16_t cols_;
+        uint16_t row_;
+        uint16_t col_;
+    };
+
+    /**
+     * This is a constant (24.8).
+     */
+    class Scalar : public Expr<Scalar>
+    {
+    public:
+        static const unsigned int frames = 0;
+        static const unsigned int ops = 0;
+
+        explicit Scalar(int32_t value) :
+                value_(value)
+        {
+        }
+
+        bool valid(unsigned int, unsigned int) const
+        {
+            return true;
+        }
+
+        int32_t at(size_t, size_t, int&) const
+        {
+            return value_;
+        }
+
+    private:
+        int32_t value_;
+    };
+
+    /**
+     * These are the operations on two pixels.
+     * @{
+     */
+    struct Add
+    {
+        static int32_t apply(int32_t a, int32_t b)
+        {
+            return eve_fp_add32(a, b);
+        }
+    };
+
+    struct Subtract
+    {
+        static int32_t apply(int32_t a, int32_t b)
+        {
+            return eve_fp_subtract32(a, b);
+        }
+    };
+
+    struct Multiply
+    {
+        static int32_t apply(int32_t a, int32_t b)
+        {
+            return eve_fp_multiply32(a, b, FP32_FWL);
+        }
+    };
+
+    struct Divide
+    {
+        static int32_t apply(int32_t a, int32_t b)
+        {
+            return eve_fp_divide32(a, b, FP32_FWL);
+        }
+    };
+
+    struct Under
+    {
+        static int32_t apply(int32_t a, int32_t b)
+        {
+            return (a < b) ? FP32_BINARY_TRUE : 0;
+        }
+    };
+
+    struct Equal
+    {
+        static int32_t apply(int32_t a, int32_t b)
+        {
+            return (a == b) ? FP32_BINARY_TRUE : 0;
+        }
+    };
+
+    struct Over
+    {
+        static int32_t apply(int32_t a, int32_t b)
+        {
+            return (a > b) ? FP32_BINARY_TRUE : 0;
+        }
+    };
+    /**
+     * @}
+     */
+
+    /**
+     * This is an operation on the pixels of two expressions.
+     */
+    template<class Op, class L, class R>
+    class Binary : public Expr<Binary<Op, L, R> >
+    {
+    public:
+        static const unsigned int frames = L::frames + R::frames;
+        static const unsigned int ops = 1 + L::ops + R::ops;
+
+        Binary(const L& l, const R& r) :
+                l_(l), r_(r)
+        {
+        }
+
+        bool valid(unsigned int rows, unsigned int cols) const
+        {
+            return l_.valid(rows, cols) && r_.valid(rows, cols);
+        }
+
+        int32_t at(size_t y, size_t x, int& nan) const
+        {
+            int32_t value = Op::apply(l_.at(y, x, nan), r_.at(y, x, nan));
+
+            nan |= (value == EVE_FP32_NAN);
+
+            return value;
+        }
+
+    private:
+        L l_;
+        R r_;
+    };
+
+    /**
+     * This takes the pixels of a where mask is not 0 and of b elsewhere.
+     */
+    template<class M, class A, class B>
+    class Select : public Expr<Select<M, A, B> >
+    {
+    public:
+        static const unsigned int frames = M::frames + A::frames
+                + B::frames;
+        static const unsigned int ops = 1 + M::ops + A::ops + B::ops;
+
+        Select(const M& mask, const A& a, const B& b) :
+                mask_(mask), a_(a), b_(b)
+        {
+        }
+
+        bool valid(unsigned int rows, unsigned int cols) const
+        {
+            return mask_.valid(rows, cols) && a_.valid(rows, cols)
+                    && b_.valid(rows, cols);
+        }
+
+        int32_t at(size_t y, size_t x, int& nan) const
+        {
+            // Both sides are evaluated, like two operations one after the
+            // other, and the selection has no branch.
+            int32_t m = mask_.at(y, x, nan);
+            int32_t a = a_.at(y, x, nan);
+            int32_t b = b_.at(y, x, nan);
+            int32_t value = (m != 0) ? a : b;
+
+            nan |= (value == EVE_FP32_NAN);
+
+            return value;
+        }
+
+    private:
+        M mask_;
+        A a_;
+        B b_;
+    };
+
+    /**
+     * These build the operations on two expressions, or on an expression
+     * and a constant.
+     * @{
+     */
+#define PREPROCESSING_EXPR_OPERATOR(symbol, Op) \
+    template<class L, class R> \
+    Binary<Op, L, R> operator symbol(const Expr<L>& l, const Expr<R>& r) \
+    { \
+        return Binary<Op, L, R>(l.self(), r.self()); \
+    } \
+    template<class L> \
+    Binary<Op, L, Scalar> operator symbol(const Expr<L>& l, int32_t r) \
+    { \
+        return Binary<Op, L, Scalar>(l.self(), Scalar(r)); \
+    } \
+    template<class R> \
+    Binary<Op, Scalar, R> operator symbol(int32_t l, const Expr<R>& r) \
+    { \
+        return Binary<Op, Scalar, R>(Scalar(l), r.self()); \
+    }
+
+    PREPROCESSING_EXPR_OPERATOR(+, Add)
+    PREPROCESSING_EXPR_OPERATOR(-, Subtract)
+    PREPROCESSING_EXPR_OPERATOR(*, Multiply)
+    PREPROCESSING_EXPR_OPERATOR(/, Divide)
+
+#undef PREPROCESSING_EXPR_OPERATOR
+    /**
+     * @}
+     */
+
+    /**
+     * These mark the pixels under, equal to or over a threshold with 1 and
+     * the others with 0, like preprocessing_ana_underThresh() and the
+     * others.
+     * @{
+     */
+    template<class E>
+    Binary<Under, E, Scalar> under(const Expr<E>& e, int32_t thresh)
+    {
+        return Binary<Under, E, Scalar>(e.self(), Scalar(thresh));
+    }
+
+    template<class E>
+    Binary<Equal, E, Scalar> equal(const Expr<E>& e, int32_t thresh)
+    {
+        return Binary<Equal, E, Scalar>(e.self(), Scalar(thresh));
+    }
+
+    template<class E>
+    Binary<Over, E, Scalar> over(const Expr<E>& e, int32_t thresh)
+    {
+        return Binary<Over, E, Scalar>(e.self(), Scalar(thresh));
+    }
+    /**
+     * @}
+     */
+
+    /**
+     * These select the pixels of a where mask is not 0 and of b elsewhere.
+     * @{
+     */
+    template<class M, class A, class B>
+    Select<M, A, B> select(const Expr<M>& mask, const Expr<A>& a,
+            const Expr<B>& b)
+    {
+        return Select<M, A, B>(mask.self(), a.self(), b.self());
+    }
+
+    template<class M, class A>
+    Select<M, A, Scalar> select(const Expr<M>& mask, const Expr<A>& a,
+            int32_t b)
+    {
+        return Select<M, A, Scalar>(mask.self(), a.self(), Scalar(b));
+    }
+    /**
+     * @}
+     */
+
+    /**
+     * Evaluate an expression on a window of rows x cols pixels. The
+     * destination may be one of the views at the same offset, but must not
+     * overlap it otherwise.
+     *
+     * @param e    the expression.
+     * @param dst  the view of the result image.
+     * @param rows the number of window rows.
+     * @param cols the number of window columns.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     *         PREPROCESSING_INVALID_NUMBER if an operation gave a NaN pixel.
+     */
+    template<class E>
+    int evaluate(const Expr<E>& e, const View& dst, uint16_t rows,
+            uint16_t cols)
+    {
+        const E& expr = e.self();
+        int invalid = 0;
+
+        // Check whether given rows and columns are in a valid range.
+        if ((!expr.valid(rows, cols)) || (!dst.valid(rows, cols)))
+        {
+            return PREPROCESSING_INVALID_SIZE;
+        }
+
+        PREPROCESSING_PROF_KERNEL(E::frames
+                * PREPROCESSING_PROF_FRAME(rows, cols),
+                PREPROCESSING_PROF_FRAME(rows, cols),
+                (uint64_t)(rows) * cols, E::ops);
+
+        // Process, the rows are spread over all cores.
+        PREPROCESSING_DEF_PARALLEL_FOR_OR(invalid)
+        for (unsigned int y = 0; y < rows; y++)
+        {
+            int32_t* d = dst.row(y);
+            int nan = 0;
+
+            for (unsigned int x = 0; x < cols; x++)
+            {
+                d[x] = expr.at(y, x, nan);
+            }
+
+            invalid |= nan;
+        }
+
+        return invalid ? PREPROCESSING_INVALID_NUMBER
+                : PREPROCESSING_SUCCESSFUL;
+    }
+
+    /**
+     * Evaluate an expression on the whole window of the destination.
+     *
+     * @param e   the expression.
+     * @param dst the view of the result image.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+    template<class E>
+    int evaluate(const Expr<E>& e, const View& dst)
+    {
+        return evaluate(e, dst, dst.rows(), dst.cols());
+    }
+
+} /* namespace expr */
+} /* namespace preprocessing */
+
+#endif /* PREPROCESSING_EXPR_HPP */
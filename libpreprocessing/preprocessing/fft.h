@@ -0,0 +1,176 @@
+/*
+ * Project: Solar Orbiter - PHI (SO/PHI)
+ * Module:  Preprocessing - a library for image pre-processing.
+ *
+ * Copyright (C) 2016, Max Planck Institute for Solar System Research
+ */
+
+/**
+ * @file
+ *
+ * This file contains declarations of the 2-D fast Fourier transform. Rows and
+ * columns must be powers of 2. A real image of r x c pixels has a spectrum of
+ * r x (c / 2 + 1) complex pixels, the other half follows from symmetry.
+ *
+ * The 24.8 functions come in two flavours. preprocessing_fft_forward() scales
+ * the spectrum by 1 / (rows * cols) so it fits 24.8, at the cost of the
+ * resolution of small frequency components. preprocessing_fft_forwardBlock()
+ * emulates the block floating point FFT of the RFPGA: the spectrum is stored
+ * as mantissas that share one exponent, shifted down only when a butterfly
+ * stage would overflow.
+ */
+
+#ifndef PREPROCESSING_FFT_H
+#define PREPROCESSING_FFT_H
+
+#include <sys/types.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * This is the number of cached FFT plans, one per power of 2 length.
+ */
+#define PREPROCESSING_FFT_PLANS 32
+
+/**
+ * This is the edge length of the blocks in which complex images are
+ * transposed between the row and the column pass.
+ */
+#define PREPROCESSING_FFT_BLOCK 32
+
+/**
+ * This macro is the number of complex columns of the spectrum of a real image
+ * of cols columns.
+ */
+#define PREPROCESSING_FFT_COLS(cols) ((cols) / 2 + 1)
+
+    /**
+     * Transform a real image to its spectrum, scaled by 1 / (rows * cols).
+     *
+     * @param sdSrc   the VMEM (SDRAM) address of image.
+     * @param rows    the number of image rows.
+     * @param cols    the number of image columns.
+     * @param sdDstRe the VMEM (SDRAM) address of real part of spectrum
+     *                (rows x PREPROCESSING_FFT_COLS(cols)).
+     * @param sdDstIm the VMEM (SDRAM) address of imaginary part of spectrum
+     *                (rows x PREPROCESSING_FFT_COLS(cols)).
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+    int preprocessing_fft_forward(uint32_t sdSrc, uint16_t rows, uint16_t cols,
+            uint32_t sdDstRe, uint32_t sdDstIm);
+
+    /**
+     * Transform a spectrum back to a real image, without scaling. This is the
+     * inverse of preprocessing_fft_forward().
+     *
+     * @param sdSrcRe the VMEM (SDRAM) address of real part of spectrum
+     *                (rows x PREPROCESSING_FFT_COLS(cols)).
+     * @param sdSrcIm the VMEM (SDRAM) address of imaginary part of spectrum
+     *                (rows x PREPROCESSING_FFT_COLS(cols)).
+     * @param rows    the number of image rows.
+     * @param cols    the number of image columns.
+     * @param sdDst   the VMEM (SDRAM) address of result image.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+    int preprocessing_fft_inverse(uint32_t sdSrcRe, uint32_t sdSrcIm,
+            uint16_t rows, uint16_t cols, uint32_t sdDst);
+
+    /**
+     * Transform a real image to its spectrum in block floating point. The
+     * spectrum is the result pixels times 2^exponent.
+     *
+     * @param sdSrc    the VMEM (SDRAM) address of image.
+     * @param rows     the number of image rows.
+     * @param cols     the number of image columns.
+     * @param sdDstRe  the VMEM (SDRAM) address of real part of spectrum
+     *                 (rows x PREPROCESSING_FFT_COLS(cols)).
+     * @param sdDstIm  the VMEM (SDRAM) address of imaginary part of spectrum
+     *                 (rows x PREPROCESSING_FFT_COLS(cols)).
+     * @param exponent the block exponent of the spectrum.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+    int preprocessing_fft_forwardBlock(uint32_t sdSrc, uint16_t rows,
+            uint16_t cols, uint32_t sdDstRe, uint32_t sdDstIm,
+            int16_t* exponent);
+
+    /**
+     * Transform a block floating point spectrum back to a real image, scaled
+     * by 1 / (rows * cols). This is the inverse of
+     * preprocessing_fft_forwardBlock().
+     *
+     * @param sdSrcRe  the VMEM (SDRAM) address of real part of spectrum
+     *                 (rows x PREPROCESSING_FFT_COLS(cols)).
+     * @param sdSrcIm  the VMEM (SDRAM) address of imaginary part of spectrum
+     *                 (rows x PREPROCESSING_FFT_COLS(cols)).
+     * @param rows     the number of image rows.
+     * @param cols     the number of image columns.
+     * @param exponent the block exponent of the spectrum.
+     * @param sdDst    the VMEM (SDRAM) address of result image.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+    int preprocessing_fft_inverseBlock(uint32_t sdSrcRe, uint32_t sdSrcIm,
+            uint16_t rows, uint16_t cols, int16_t exponent, uint32_t sdDst);
+
+    /**
+     * Transform complex data of rows x cols points in place, without scaling.
+     * This works on plain buffers for use inside the library.
+     *
+     * @param re      the real parts.
+     * @param im      the imaginary parts.
+     * @param rows    the number of rows (a power of 2).
+     * @param cols    the number of columns (a power of 2).
+     * @param inverse 1 for the inverse transform, 0 otherwise.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+    int preprocessing_fft_complex2D(double* re, double* im, unsigned int rows,
+            unsigned int cols, int inverse);
+
+    /**
+     * Transform real data of rows x cols points to its spectrum of
+     * rows x PREPROCESSING_FFT_COLS(cols) points, without scaling.
+     *
+     * @param src  the real data.
+     * @param rows the number of rows (a power of 2).
+     * @param cols the number of columns (a power of 2).
+     * @param re   the real parts of the spectrum.
+     * @param im   the imaginary parts of the spectrum.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+    int preprocessing_fft_real2D(const double* src, unsigned int rows,
+            unsigned int cols, double* re, double* im);
+
+    /**
+     * Transform a spectrum of rows x PREPROCESSING_FFT_COLS(cols) points back
+     * to real data of rows x cols points, without scaling.
+     *
+     * @param re   the real parts of the spectrum.
+     * @param im   the imaginary parts of the spectrum.
+     * @param rows the number of rows (a power of 2).
+     * @param cols the number of columns (a power of 2).
+     * @param dst  the real data.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+    int preprocessing_fft_realInverse2D(const double* re, const double* im,
+            unsigned int rows, unsigned int cols, double* dst);
+
+    /**
+     * Release all cached FFT plans.
+     */
+    void preprocessing_fft_clearPlans(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PREPROCESSING_FFT_H */
@@ -0,0 +1,115 @@
+/*
+ * Project: Solar Orbiter - PHI (SO/PHI)
+ * Module:  Preprocessing - a library for image pre-processing.
+ *
+ * Copyright (C) 2016, Max Planck Institute for Solar System Research
+ */
+
+/**
+ * @file
+ *
+ * This file contains declarations of linear least squares fits: polynomial
+ * surfaces to images (large scale trends of a gain) and circles to points
+ * (the solar limb).
+ *
+ * The normal equations are assembled from blocks of PREPROCESSING_FIT_BLOCK
+ * observations. The design matrix of a block is stored term by term, so each
+ * element of the normal matrix is a dot product of two contiguous rows.
+ */
+
+#ifndef PREPROCESSING_FIT_H
+#define PREPROCESSING_FIT_H
+
+#include <sys/types.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * This is the number of observations of a block of the design matrix.
+ */
+#define PREPROCESSING_FIT_BLOCK 256
+
+/**
+ * This is the largest degree of a polynomial surface.
+ */
+#define PREPROCESSING_FIT_MAX_DEGREE 8
+
+/**
+ * This macro is the number of terms of a polynomial surface of a degree.
+ */
+#define PREPROCESSING_FIT_TERMS(degree) (((degree) + 1) * ((degree) + 2) / 2)
+
+    /**
+     * Fit a polynomial surface to an image and store the surface. NaN pixels
+     * are left out of the fit. The coordinates are scaled to [-1, 1], the
+     * terms are ordered by total degree t and within t by the power of y:
+     * 1, x, y, x^2, x y, y^2, ...
+     *
+     * @param sdSrc        the VMEM (SDRAM) address of image.
+     * @param rows         the number of image rows.
+     * @param cols         the number of image columns.
+     * @param degree       the total degree of the polynomial.
+     * @param sdDst        the VMEM (SDRAM) address of result image.
+     * @param coefficients the coefficients in pixel units, or 0
+     *                     (PREPROCESSING_FIT_TERMS(degree) values).
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+    int preprocessing_fit_surface(uint32_t sdSrc, uint16_t rows,
+            uint16_t cols, uint16_t degree, uint32_t sdDst,
+            double* coefficients);
+
+    /**
+     * Fit a circle to points (Kasa fit).
+     *
+     * @param y  the rows of the points.
+     * @param x  the columns of the points.
+     * @param n  the number of points.
+     * @param cy the row of the center.
+     * @param cx the column of the center.
+     * @param r  the radius.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+    int preprocessing_fit_circle(const double* y, const double* x,
+            unsigned int n, double* cy, double* cx, double* r);
+
+    /**
+     * Add a block of observations to the normal equations. Only the upper
+     * triangle of the normal matrix is updated.
+     *
+     * @param design the design matrix, term by term (terms x n).
+     * @param values the observed values (n).
+     * @param n      the number of observations.
+     * @param terms  the number of terms.
+     * @param ata    the normal matrix (terms x terms).
+     * @param atb    the right hand side (terms).
+     */
+    void preprocessing_fit_accumulate(const double* design,
+            const double* values, unsigned int n, unsigned int terms,
+            double* ata, double* atb);
+
+    /**
+     * Solve normal equations by Cholesky decomposition. The upper triangle of
+     * the normal matrix is used and overwritten.
+     *
+     * @param ata      the normal matrix (terms x terms).
+     * @param atb      the right hand side (terms).
+     * @param terms    the number of terms.
+     * @param solution the solution (terms).
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, PREPROCESSING_INVALID_NUMBER
+     *         if the matrix is singular.
+     */
+    int preprocessing_fit_solve(double* ata, const double* atb,
+            unsigned int terms, double* solution);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PREPROCESSING_FIT_H */
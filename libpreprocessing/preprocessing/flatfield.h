@@ -5,24 +5,267 @@
  *      Author: zaca
  */
 
-#ifndef LIBPREPROCESSING_PREPROCESSING_HOUGH_H_
-#define LIBPREPROCESSING_PREPROCESSING_HOUGH_H_
+#ifndef LIBPREPROCESSING_PREPROCESSING_FLATFIELD_H_
+#define LIBPREPROCESSING_PREPROCESSING_FLATFIELD_H_
 
 #include <sys/types.h>
 #include <stdint.h>
 #include "../../fits/FITS_Interface.h"
 
-int32_t **entriesOfNAND;
+/**
+ * This is the number of VMEM (SDRAM) frames a flatfield job works on.
+ */
+#define PREPROCESSING_FLATFIELD_TMP_FRAMES 5
+
+/**
+ * This is the maximum number of offset frames. Each frame owns one bit of the
+ * 24.8 mask of all frames.
+ */
+#define PREPROCESSING_FLATFIELD_MAX_IMAGES 23
+
+/**
+ * This is the magic number and version of a gain checkpoint file.
+ */
+#define PREPROCESSING_FLATFIELD_CHECKPOINT_MAGIC 0x4B434646u
+#define PREPROCESSING_FLATFIELD_CHECKPOINT_VERSION 2
+
+/**
+ * This is the header of a gain checkpoint file. It is followed by the disp
+ * table of the run (images x 2 offsets) and rows x cols log10 gain values,
+ * both 24.8 fixed point in host byte order.
+ */
+struct preprocessing_flatfield_Checkpoint
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t rows;
+    uint16_t cols;
+    uint16_t images;
+
+    /**
+     * This is the outlier rejection of the run.
+     */
+    uint16_t clip;
+
+    /**
+     * This is the number of loops done so far.
+     */
+    uint16_t iteration;
+    uint16_t loops;
+
+    /**
+     * This is the sum of all gain values, to detect a torn file.
+     */
+    uint32_t checksum;
+};
+
+/**
+ * These are the outlier rejections of a gain iteration: pixels further than
+ * 5 sigma from the mean, or further than 5 sigma estimated by the median
+ * absolute deviation from the median.
+ */
+#define PREPROCESSING_FLATFIELD_CLIP_SIGMA 0
+#define PREPROCESSING_FLATFIELD_CLIP_MAD 1
+
+/**
+ * This is the index of the frame pair iq, ir (iq > ir) in the per-pair
+ * contributions.
+ */
+#define PREPROCESSING_FLATFIELD_PAIR(iq, ir) ((iq) * ((iq) - 1) / 2 + (ir))
+
+/**
+ * This structure describes one flatfield (KLL) job. It carries the frame
+ * geometry, the number of offset frames and the NAND and VMEM (SDRAM) buffers
+ * so that jobs of different sizes can be processed by the same binary.
+ */
+struct preprocessing_flatfield_Job
+{
+    /**
+     * These are the number of image rows and columns.
+     */
+    uint16_t rows;
+    uint16_t cols;
+
+    /**
+     * This is the number of offset frames and the number of frames the NAND
+     * layout has room for. Frames up to \a capacity can be appended with
+     * preprocessing_flatfield_updateFrame().
+     */
+    uint16_t images;
+    uint16_t capacity;
+
+    /**
+     * This is the number of gain iterations.
+     */
+    uint16_t loops;
+
+    /**
+     * The iteration stops early once no log10 gain value changes by more than
+     * \a tolerance (24.8 fixed point) in one loop. 0 runs all loops.
+     */
+    int32_t tolerance;
+
+    /**
+     * This is the file the gain is checkpointed to every \a checkpointEvery
+     * loops. NULL disables checkpoints.
+     */
+    const char* checkpoint;
+    uint16_t checkpointEvery;
+
+    /**
+     * This is the outlier rejection of a gain iteration, see
+     * PREPROCESSING_FLATFIELD_CLIP_SIGMA.
+     */
+    uint16_t clip;
+
+    /**
+     * These are the limits of valid pixel intensities (24.8 fixed point).
+     */
+    int32_t iMin;
+    int32_t iMax;
+
+    /**
+     * These are the NAND entries of the job: \a images offset frames, the
+     * input mask, the mask of all frames, const, gain, pixCount and disp.
+     */
+    int32_t** frames;
+    int32_t* mask;
+    int32_t* maskTmp;
+    int32_t* cons;
+    int32_t* gain;
+    int32_t* pixCount;
+    int32_t* disp;
+
+    /**
+     * This is the NAND entry of the log10 gain left by the last iteration.
+     * It is the warm start of a later run. May be NULL.
+     */
+    int32_t* logGain;
+
+    /**
+     * These are the NAND entries of the per-pair contributions to const and
+     * pixCount: the shift (dy, dx) of each pair in \a pairDisp and the masked
+     * diff and mskDouble ROIs of pair p in pairs[2p] and pairs[2p + 1], see
+     * PREPROCESSING_FLATFIELD_PAIR. May be NULL to disable persistence.
+     */
+    int32_t* pairDisp;
+    int32_t** pairs;
+
+    /**
+     * This is the VMEM (SDRAM) address of the disp table (images x 2).
+     */
+    uint32_t sdDisp;
+
+    /**
+     * These are the VMEM (SDRAM) addresses of the frames the job works on.
+     * Each one must hold at least rows x cols pixels.
+     */
+    uint32_t sdTmp[PREPROCESSING_FLATFIELD_TMP_FRAMES];
+};
+
+/**
+     * Set up a job with the default NAND layout of def_flatfield.h.
+     *
+     * @param job   		the job to set up.
+     * @param entriesOfNAND	the NAND entries (see NAND_ENTRIES(capacity)).
+     * @param rows   		the number of image rows.
+     * @param cols   		the number of image columns.
+     * @param images 		the number of offset frames.
+     * @param capacity 		the number of frames the NAND layout has room for.
+     */
+void preprocessing_flatfield_initJob(struct preprocessing_flatfield_Job* job,
+		int32_t** entriesOfNAND, uint16_t rows, uint16_t cols, uint16_t images,
+		uint16_t capacity);
+
+/**
+     * Estimate the disp table by FFT phase correlation of the raw frames
+     * against frame \a reference (see preprocessing/align.h) and store it in
+     * NAND. Call it before preprocessing_flatfield_maskImages(), which
+     * replaces the frames by their log10.
+     *
+     * @param job 		the flatfield job.
+     * @param reference	the index of the reference frame.
+     * @param binning	the number of pixels binned per axis for the coarse
+     * 					estimate (DISP_BINNING).
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success,
+     * 		   PREPROCESSING_INVALID_NUMBER if a shift is ambiguous,
+     * 		   failure code otherwise.
+     */
+int preprocessing_flatfield_getDisp(const struct preprocessing_flatfield_Job* job,
+		uint16_t reference, uint16_t binning);
+
+/**
+     * Load the disp table and build the mask of all frames. Each frame is
+     * replaced by its log10 in NAND.
+     *
+     * @param job 		the flatfield job.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+int preprocessing_flatfield_maskImages(const struct preprocessing_flatfield_Job* job);
+
+/**
+     * Calculate const and pixCount of all frame pairs and store them in NAND.
+     * The contribution of each pair is kept in NAND too, if the job has pair
+     * entries.
+     *
+     * @param job 		the flatfield job.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+int preprocessing_flatfield_getConst(const struct preprocessing_flatfield_Job* job);
+
+/**
+     * Update const, pixCount and the mask of all frames after frame \a index
+     * has been replaced (index < images) or appended (index == images). Only
+     * the pairs with frame \a index are calculated again, the old ones are
+     * taken back out of const and pixCount from their stored contributions.
+     * Being integer sums, the result is the same as a full run.
+     *
+     * Before the call the new raw frame must be in NAND frames[index] and its
+     * offsets in row \a index of the NAND disp table.
+     *
+     * @param job 		the flatfield job, images grows by one on append.
+     * @param index 	the index of the new or changed frame.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+int preprocessing_flatfield_updateFrame(struct preprocessing_flatfield_Job* job,
+		uint16_t index);
 
+/**
+     * Calculate the initial log10 gain (const / pixCount) from NAND.
+     *
+     * @param job 		the flatfield job.
+     * @param sdTmp 	the VMEM (SDRAM) address of temporal image.
+     * @param sdDst  	the VMEM (SDRAM) address of gain.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+int preprocessing_flatfield_initGain(const struct preprocessing_flatfield_Job* job,
+		uint32_t sdTmp, uint32_t sdDst);
+
+/**
+     * Load the log10 gain of the last iteration from NAND as warm start. After
+     * preprocessing_flatfield_updateFrame() a few loops (LOOPS_ITERA_UPDATE)
+     * are usually enough.
+     *
+     * @param job 		the flatfield job.
+     * @param sdDst  	the VMEM (SDRAM) address of gain.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+int preprocessing_flatfield_loadGain(const struct preprocessing_flatfield_Job* job,
+		uint32_t sdDst);
 
 /**
      * Get algorithm's constant term of two images
      *
+     * @param job 		the flatfield job.
      * @param sdTmp1 	the VMEM (SDRAM) address of temporal image.
      * @param sdTmp2 	the VMEM (SDRAM) address of temporal image.
      * @param sdTmp3 	the VMEM (SDRAM) address of temporal image.
-     * @param rows   	the number of image rows.
-     * @param cols   	the number of image columns.
      * @param dx  	 	the offset X.
      * @param dy     	the offset Y.
      * @param iq		index of image iq
@@ -32,50 +275,103 @@ int32_t **entriesOfNAND;
      *
      * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
      */
-int preprocessing_arith_doGetConst(uint32_t sdTmp1, uint32_t sdTmp2, uint32_t sdTmp3,
-		uint16_t rows, uint16_t cols, int16_t dx, int16_t dy, int16_t iq, int16_t ir, uint32_t sdDst1, uint32_t sdDst2);
+int preprocessing_arith_doGetConst(const struct preprocessing_flatfield_Job* job,
+		uint32_t sdTmp1, uint32_t sdTmp2, uint32_t sdTmp3,
+		int16_t dx, int16_t dy, int16_t iq, int16_t ir, uint32_t sdDst1, uint32_t sdDst2);
+
+/**
+     * Seed the log10 gain from a previous gain product (the output of
+     * preprocessing_arith_iterate), as warm start.
+     *
+     * @param job 		the flatfield job.
+     * @param gain 		the previous gain (rows x cols).
+     * @param sdDst  	the VMEM (SDRAM) address of gain.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+int preprocessing_flatfield_seedGain(const struct preprocessing_flatfield_Job* job,
+		const int32_t* gain, uint32_t sdDst);
+
+/**
+     * Write the log10 gain, the disp table and the number of loops done to
+     * the checkpoint file of the job. The file is replaced atomically.
+     *
+     * @param job 		the flatfield job.
+     * @param sdSrc  	the VMEM (SDRAM) address of gain.
+     * @param iteration	the number of loops done.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+int preprocessing_flatfield_writeCheckpoint(const struct preprocessing_flatfield_Job* job,
+		uint32_t sdSrc, uint16_t iteration);
+
+/**
+     * Resume from the checkpoint file of the job. The file must match the
+     * geometry, the outlier rejection and the disp table of the job and have
+     * loops left to do. The number of loops of
+     * the job is set to the one of the interrupted run.
+     *
+     * @param job 		the flatfield job, loops is set.
+     * @param sdDst  	the VMEM (SDRAM) address of gain.
+     * @param iteration	the number of loops done, to continue with.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+int preprocessing_flatfield_resume(struct preprocessing_flatfield_Job* job,
+		uint32_t sdDst, uint16_t* iteration);
+
+/**
+     * Calculates Iterate. The log10 gain is kept in NAND (logGain) before it
+     * is turned into the flatfield.
+     *
+     * @param job 		the flatfield job (disp and number of loops).
+     * @param sdTmp1 	the VMEM (SDRAM) address of temporal image.
+     * @param sdTmp2 	the VMEM (SDRAM) address of temporal image.
+     * @param sdTmp3 	the VMEM (SDRAM) address of temporal image.
+     * @param sdDst  	the VMEM (SDRAM) address of gain.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+int preprocessing_arith_iterate(const struct preprocessing_flatfield_Job* job,
+		uint32_t sdTmp1, uint32_t sdTmp2, uint32_t sdTmp3, uint32_t sdDst);
 
 /**
-     * Calculates Iterate
+     * Calculates Iterate from loop \a first on, e.g. after
+     * preprocessing_flatfield_resume().
      *
-     * @param sdSrc 	the VMEM (SDRAM) address of disp.
+     * @param job 		the flatfield job (disp and number of loops).
+     * @param first 	the number of loops already done.
      * @param sdTmp1 	the VMEM (SDRAM) address of temporal image.
      * @param sdTmp2 	the VMEM (SDRAM) address of temporal image.
      * @param sdTmp3 	the VMEM (SDRAM) address of temporal image.
-     * @param rows   	the number of image rows.
-     * @param cols   	the number of image columns.
-     * @param loops 	the number of inner for loop iterations
      * @param sdDst  	the VMEM (SDRAM) address of gain.
      *
      * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
      */
-int preprocessing_arith_iterate(uint32_t sdSrc, uint32_t sdTmp1, uint32_t sdTmp2, uint32_t sdTmp3,
-		uint16_t rows, uint16_t cols, uint16_t loops, uint32_t sdDst);
+int preprocessing_arith_iterateFrom(const struct preprocessing_flatfield_Job* job,
+		uint16_t first, uint32_t sdTmp1, uint32_t sdTmp2, uint32_t sdTmp3, uint32_t sdDst);
 
 /**
      * Calculates one Iteration
      *
-     * @param sdSrc 	the VMEM (SDRAM) address of disp.
+     * @param job 		the flatfield job.
      * @param sdTmp1 	the VMEM (SDRAM) address of temporal image.
      * @param sdTmp2 	the VMEM (SDRAM) address of temporal image.
      * @param sdTmp3 	the VMEM (SDRAM) address of temporal image.
-     * @param rows   	the number of image rows.
-     * @param cols   	the number of image columns.
      * @param sdDst  	the VMEM (SDRAM) address of gain.
      *
      * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
      */
-int preprocessing_arith_doIteration(uint32_t sdSrc, uint32_t sdTmp1, uint32_t sdTmp2, uint32_t sdTmp3,
-		uint16_t rows, uint16_t cols, uint32_t sdDst);
+int preprocessing_arith_doIteration(const struct preprocessing_flatfield_Job* job,
+		uint32_t sdTmp1, uint32_t sdTmp2, uint32_t sdTmp3, uint32_t sdDst);
 
 /**
      * Calculate gain of two images for doIteration function
      *
+     * @param job 		the flatfield job.
      * @param sdSrc 	the VMEM (SDRAM) address of gain.
      * @param sdTmp1 	the VMEM (SDRAM) address of temporal image.
      * @param sdTmp2 	the VMEM (SDRAM) address of temporal image.
-     * @param rows   	the number of image rows.
-     * @param cols   	the number of image columns.
      * @param dx  	 	the offset X.
      * @param dy     	the offset Y.
      * @param iq		index of image iq
@@ -84,7 +380,8 @@ int preprocessing_arith_doIteration(uint32_t sdSrc, uint32_t sdTmp1, uint32_t sd
      *
      * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
      */
-int preprocessing_arith_doIterationTwoImages(uint32_t Src, uint32_t sdTmp1, uint32_t sdTmp2,
-		uint16_t rows, uint16_t cols, int16_t dx, int16_t dy, int16_t iq, int16_t ir, uint32_t sdDst);
+int preprocessing_arith_doIterationTwoImages(const struct preprocessing_flatfield_Job* job,
+		uint32_t sdSrc, uint32_t sdTmp1, uint32_t sdTmp2,
+		int16_t dx, int16_t dy, int16_t iq, int16_t ir, uint32_t sdDst);
 
-#endif /* LIBPREPROCESSING_PREPROCESSING_HOUGH_H_ */
+#endif /* LIBPREPROCESSING_PREPROCESSING_FLATFIELD_H_ */
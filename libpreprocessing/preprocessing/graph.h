@@ -0,0 +1,321 @@
+/*
+ * Project: Solar Orbiter - PHI (SO/PHI)
+ * Module:  Preprocessing - a library for image pre-processing.
+ *
+ * Copyright (C) 2016, Max Planck Institute for Solar System Research
+ */
+
+/**
+ * @file
+ *
+ * This file contains declarations of graphs of pre-processing operations
+ * that are run strip by strip. A graph mixes elementwise operations,
+ * stencils (derivations, median filters and convolutions) and reductions on
+ * frames of the same size. It is built node by node and run at once: the
+ * frame is cut into horizontal strips that fit into the cache of a core
+ * (PREPROCESSING_GRAPH_CACHE), all nodes are evaluated on one strip before
+ * the next one and the strips are spread over all cores. Only the frames
+ * read and the frames stored go through memory, the other nodes stay in
+ * cache. A stencil node is evaluated on the rows around the strip its
+ * consumers read as well (the halo), so the strips do not depend on each
+ * other.
+ *
+ * The results are the same as those of the corresponding operations of
+ * arith.h and ana.h run one after the other. Where these add to the result
+ * image, the node is the result on an image of 0.
+ */
+
+#ifndef PREPROCESSING_GRAPH_H
+#define PREPROCESSING_GRAPH_H
+
+#include <sys/types.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * This is the maximum number of nodes of a graph.
+ */
+#define PREPROCESSING_GRAPH_MAX_NODES 32
+
+/**
+ * This is the cache of a core the strips are sized to in bytes, the buffers
+ * of all nodes of a strip fit into it.
+ */
+#ifndef PREPROCESSING_GRAPH_CACHE
+#define PREPROCESSING_GRAPH_CACHE (1024 * 1024)
+#endif
+
+/**
+ * This is the smallest number of rows of a strip, whatever the cache.
+ */
+#define PREPROCESSING_GRAPH_MIN_STRIP 8
+
+/**
+ * This is the largest window size of a median node.
+ */
+#define PREPROCESSING_GRAPH_MAX_MEDIAN 7
+
+    /**
+     * These are the operations of the nodes of a graph.
+     */
+    enum preprocessing_graph_Op
+    {
+        PREPROCESSING_GRAPH_FRAME = 0,
+        PREPROCESSING_GRAPH_ADD,
+        PREPROCESSING_GRAPH_SUBTRACT,
+        PREPROCESSING_GRAPH_MULTIPLY,
+        PREPROCESSING_GRAPH_DIVIDE,
+        PREPROCESSING_GRAPH_ADD_SCALAR,
+        PREPROCESSING_GRAPH_SUBTRACT_SCALAR,
+        PREPROCESSING_GRAPH_MULTIPLY_SCALAR,
+        PREPROCESSING_GRAPH_DIVIDE_SCALAR,
+        PREPROCESSING_GRAPH_UNDER,
+        PREPROCESSING_GRAPH_EQUAL,
+        PREPROCESSING_GRAPH_OVER,
+        PREPROCESSING_GRAPH_DERIVE_X,
+        PREPROCESSING_GRAPH_DERIVE_Y,
+        PREPROCESSING_GRAPH_MEDIAN,
+        PREPROCESSING_GRAPH_CONVOLVE,
+        PREPROCESSING_GRAPH_STORE,
+        PREPROCESSING_GRAPH_SUM
+    };
+
+    /**
+     * This structure is one node of a graph. The operands are indices of
+     * earlier nodes.
+     */
+    struct preprocessing_graph_Node
+    {
+        int op;
+        int operand[2];
+
+        /**
+         * This is the frame of a frame node, the kernel of a convolution or
+         * the destination of a store or a sum.
+         */
+        uint32_t sdAddress;
+
+        /**
+         * This is the size of the kernel of a convolution or the window of
+         * a median.
+         */
+        uint16_t rows;
+        uint16_t cols;
+
+        /**
+         * This is the scalar or the threshold (24.8).
+         */
+        int32_t value;
+    };
+
+    /**
+     * This structure is a graph on frames of rows x cols pixels.
+     */
+    struct preprocessing_graph_Graph
+    {
+        uint16_t rows;
+        uint16_t cols;
+
+        /**
+         * This is the number of rows of a strip, 0 to size the strips to
+         * PREPROCESSING_GRAPH_CACHE.
+         */
+        uint16_t stripRows;
+
+        /**
+         * This is the first failure while the graph was built, it is
+         * returned by preprocessing_graph_run().
+         */
+        int status;
+
+        unsigned int nodes;
+        struct preprocessing_graph_Node node[PREPROCESSING_GRAPH_MAX_NODES];
+    };
+
+    /**
+     * Start an empty graph on frames of rows x cols pixels.
+     *
+     * @param graph the graph.
+     * @param rows  the number of image rows.
+     * @param cols  the number of image columns.
+     */
+    void preprocessing_graph_init(struct preprocessing_graph_Graph* graph,
+            uint16_t rows, uint16_t cols);
+
+    /**
+     * Add the pixels of a frame. The node, like all others, returns the
+     * index of the new node, or -1 if it could not be added (the failure is
+     * kept in graph->status). A node with an operand of -1 is -1.
+     *
+     * @param graph the graph.
+     * @param sdSrc the VMEM (SDRAM) address of image.
+     *
+     * @return the node, -1 on failure.
+     */
+    int preprocessing_graph_frame(struct preprocessing_graph_Graph* graph,
+            uint32_t sdSrc);
+
+    /**
+     * Add a node that adds, subtracts, multiplies or divides two nodes
+     * pixel by pixel, like preprocessing_arith_addImages() and the others.
+     *
+     * @param graph the graph.
+     * @param a     the first operand.
+     * @param b     the second operand.
+     *
+     * @return the node, -1 on failure.
+     * @{
+     */
+    int preprocessing_graph_add(struct preprocessing_graph_Graph* graph,
+            int a, int b);
+    int preprocessing_graph_subtract(struct preprocessing_graph_Graph* graph,
+            int a, int b);
+    int preprocessing_graph_multiply(struct preprocessing_graph_Graph* graph,
+            int a, int b);
+    int preprocessing_graph_divide(struct preprocessing_graph_Graph* graph,
+            int a, int b);
+    /**
+     * @}
+     */
+
+    /**
+     * Add a node that adds, subtracts, multiplies or divides a node by a
+     * scalar, like preprocessing_arith_addScalar() and the others.
+     *
+     * @param graph  the graph.
+     * @param a      the operand.
+     * @param scalar the scalar (24.8).
+     *
+     * @return the node, -1 on failure.
+     * @{
+     */
+    int preprocessing_graph_addScalar(struct preprocessing_graph_Graph* graph,
+            int a, int32_t scalar);
+    int preprocessing_graph_subtractScalar(
+            struct preprocessing_graph_Graph* graph, int a, int32_t scalar);
+    int preprocessing_graph_multiplyScalar(
+            struct preprocessing_graph_Graph* graph, int a, int32_t scalar);
+    int preprocessing_graph_divideScalar(
+            struct preprocessing_graph_Graph* graph, int a, int32_t scalar);
+    /**
+     * @}
+     */
+
+    /**
+     * Add a node that marks the pixels of a node under, equal to or over a
+     * threshold with 1 and the others with 0, like
+     * preprocessing_ana_underThresh() and the others.
+     *
+     * @param graph  the graph.
+     * @param a      the operand.
+     * @param thresh the threshold (24.8).
+     *
+     * @return the node, -1 on failure.
+     * @{
+     */
+    int preprocessing_graph_underThresh(
+            struct preprocessing_graph_Graph* graph, int a, int32_t thresh);
+    int preprocessing_graph_equalThresh(
+            struct preprocessing_graph_Graph* graph, int a, int32_t thresh);
+    int preprocessing_graph_overThresh(
+            struct preprocessing_graph_Graph* graph, int a, int32_t thresh);
+    /**
+     * @}
+     */
+
+    /**
+     * Add a node that derives a node in x or y direction, like
+     * preprocessing_ana_deriveX() and preprocessing_ana_deriveY().
+     *
+     * @param graph the graph.
+     * @param a     the operand.
+     *
+     * @return the node, -1 on failure.
+     * @{
+     */
+    int preprocessing_graph_deriveX(struct preprocessing_graph_Graph* graph,
+            int a);
+    int preprocessing_graph_deriveY(struct preprocessing_graph_Graph* graph,
+            int a);
+    /**
+     * @}
+     */
+
+    /**
+     * Add a node that median filters a node, like
+     * preprocessing_ana_medianFilter().
+     *
+     * @param graph the graph.
+     * @param a     the operand.
+     * @param size  the window size (odd, PREPROCESSING_GRAPH_MAX_MEDIAN at
+     *              most).
+     *
+     * @return the node, -1 on failure.
+     */
+    int preprocessing_graph_median(struct preprocessing_graph_Graph* graph,
+            int a, uint16_t size);
+
+    /**
+     * Add a node that convolves a node with a kernel, with zero padding
+     * like preprocessing_ana_convolve(). The kernel is applied tap by tap,
+     * so the results are those of preprocessing_ana_convolve() for the
+     * kernels it does not take the separable or FFT paths for.
+     *
+     * @param graph    the graph.
+     * @param a        the operand.
+     * @param sdKernel the VMEM (SDRAM) address of kernel.
+     * @param rows     the number of kernel rows.
+     * @param cols     the number of kernel columns.
+     *
+     * @return the node, -1 on failure.
+     */
+    int preprocessing_graph_convolve(struct preprocessing_graph_Graph* graph,
+            int a, uint32_t sdKernel, uint16_t rows, uint16_t cols);
+
+    /**
+     * Add a node that stores a node in an image. The image may be a frame
+     * of the graph that no stencil reads, the stores come after all other
+     * nodes, so the frame is read before it is overwritten.
+     *
+     * @param graph the graph.
+     * @param a     the operand.
+     * @param sdDst the VMEM (SDRAM) address of result image.
+     *
+     * @return the node, -1 on failure.
+     */
+    int preprocessing_graph_store(struct preprocessing_graph_Graph* graph,
+            int a, uint32_t sdDst);
+
+    /**
+     * Add a node that adds all pixels of a node to a value, like
+     * preprocessing_arith_sumImage().
+     *
+     * @param graph the graph.
+     * @param a     the operand.
+     * @param sdDst the VMEM (SDRAM) address of result value.
+     *
+     * @return the node, -1 on failure.
+     */
+    int preprocessing_graph_sum(struct preprocessing_graph_Graph* graph,
+            int a, uint32_t sdDst);
+
+    /**
+     * Run a graph. All stores and sums and the nodes they depend on are
+     * evaluated.
+     *
+     * @param graph the graph.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     *         PREPROCESSING_INVALID_NUMBER if a node gave a NaN pixel.
+     */
+    int preprocessing_graph_run(const struct preprocessing_graph_Graph* graph);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PREPROCESSING_GRAPH_H */
@@ -0,0 +1,78 @@
+/*
+ * Project: Solar Orbiter - PHI (SO/PHI)
+ * Module:  Preprocessing - a library for image pre-processing.
+ *
+ * Copyright (C) 2016, Max Planck Institute for Solar System Research
+ */
+
+/**
+ * @file
+ *
+ * This file contains declarations of the detection of the solar limb by a
+ * circle Hough transform.
+ *
+ * The edge points are the strongest pixels of the central difference
+ * gradient given by preprocessing_ana_gradient(). Each edge point votes for
+ * the centers that lie along its gradient at a distance within the radius
+ * prior, on a coarse grid first and then at full resolution around the
+ * coarse peak. The center and radius are finally fitted to the edge points
+ * close to the detected circle.
+ */
+
+#ifndef PREPROCESSING_HOUGH_H
+#define PREPROCESSING_HOUGH_H
+
+#include <sys/types.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * This is the edge length in pixels of a cell of the coarse accumulator.
+ */
+#define PREPROCESSING_HOUGH_COARSE 4
+
+/**
+ * This is the number of edge points per pixel of the circumference of the
+ * largest circle of the radius prior. The limb is about two pixels wide.
+ */
+#define PREPROCESSING_HOUGH_EDGE_WIDTH 2
+
+/**
+ * This is the number of partial accumulators that are voted into in parallel
+ * and summed afterwards.
+ */
+#define PREPROCESSING_HOUGH_SLICES 8
+
+    /**
+     * Detect the limb of a disc that is brighter than the background. The
+     * center may lie up to half a frame outside the image.
+     *
+     * @param sdSrc     the VMEM (SDRAM) address of image.
+     * @param rows      the number of image rows.
+     * @param cols      the number of image columns.
+     * @param sdTmpY    the VMEM (SDRAM) address of temporal image (row
+     *                  derivation).
+     * @param sdTmpX    the VMEM (SDRAM) address of temporal image (column
+     *                  derivation).
+     * @param radiusMin the smallest radius of the prior in pixels.
+     * @param radiusMax the largest radius of the prior in pixels.
+     * @param centerY   the row of the center (24.8).
+     * @param centerX   the column of the center (24.8).
+     * @param radius    the radius (24.8).
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+    int preprocessing_hough_circle(uint32_t sdSrc, uint16_t rows,
+            uint16_t cols, uint32_t sdTmpY, uint32_t sdTmpX,
+            uint16_t radiusMin, uint16_t radiusMax, int32_t* centerY,
+            int32_t* centerX, int32_t* radius);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PREPROCESSING_HOUGH_H */
@@ -0,0 +1,163 @@
+/*
+ * Project: Solar Orbiter - PHI (SO/PHI)
+ * Module:  Preprocessing - a library for image pre-processing.
+ *
+ * Copyright (C) 2016, Max Planck Institute for Solar System Research
+ */
+
+/**
+ * @file
+ *
+ * This file contains declarations of the kernel backends. A backend is a
+ * table of the hot per-pixel kernels of the pre-processing operations, all
+ * backends give bit identical results. The scalar reference backend runs
+ * everywhere, the SSE4.2, AVX2 and AVX-512 backends on x86 processors that
+ * support them.
+ *
+ * The best backend of the processor is selected on first use. The
+ * environment variable PREPROCESSING_BACKEND (reference, sse42, avx2 or
+ * avx512) forces a backend, preprocessing_kernel_select() changes it at run
+ * time.
+ */
+
+#ifndef PREPROCESSING_KERNEL_H
+#define PREPROCESSING_KERNEL_H
+
+#include <sys/types.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * This is the maximum number of backends.
+ */
+#define PREPROCESSING_KERNEL_BACKENDS 4
+
+    /**
+     * This structure is the table of kernels of one backend. The kernels
+     * work on n contiguous 24.8 fixed point pixels with the semantics of the
+     * libeve operations. The destination may be a source, but must not
+     * overlap it otherwise. Each kernel returns 1 if a result pixel is NaN,
+     * 0 otherwise.
+     */
+    struct preprocessing_kernel_Backend
+    {
+        /**
+         * This is the name of the backend.
+         */
+        const char* name;
+
+        /**
+         * These kernels compute dst = src1 op src2 pixel by pixel.
+         * @{
+         */
+        int (*add)(const int32_t* src1, const int32_t* src2, int32_t* dst,
+                unsigned int n);
+        int (*subtract)(const int32_t* src1, const int32_t* src2,
+                int32_t* dst, unsigned int n);
+        int (*multiply)(const int32_t* src1, const int32_t* src2,
+                int32_t* dst, unsigned int n);
+        /**
+         * @}
+         */
+
+        /**
+         * These kernels compute dst = src op scalar pixel by pixel.
+         * @{
+         */
+        int (*addScalar)(const int32_t* src, int32_t scalar, int32_t* dst,
+                unsigned int n);
+        int (*subtractScalar)(const int32_t* src, int32_t scalar,
+                int32_t* dst, unsigned int n);
+        int (*multiplyScalar)(const int32_t* src, int32_t scalar,
+                int32_t* dst, unsigned int n);
+        /**
+         * @}
+         */
+
+        /**
+         * This kernel computes dst = src1 / src2 where src2 is greater than
+         * 1 and leaves dst unchanged elsewhere.
+         */
+        int (*normalize)(const int32_t* src1, const int32_t* src2,
+                int32_t* dst, unsigned int n);
+
+        /**
+         * This kernel extracts bit plane index of a mask of several images,
+         * dst is 1 where the bit is set and 0 elsewhere.
+         */
+        int (*mask)(const int32_t* src, unsigned int index, int32_t* dst,
+                unsigned int n);
+
+        /**
+         * This kernel adds the pixels to *sum. It stops and returns 1 as
+         * soon as the sum is out of range (NaN).
+         */
+        int (*sum)(const int32_t* src, unsigned int n, int32_t* sum);
+
+        /**
+         * This kernel computes the logarithm to base 10, non-positive
+         * pixels give NaN.
+         */
+        int (*log10)(const int32_t* src, int32_t* dst, unsigned int n);
+
+        /**
+         * This kernel computes dst = 10^src rounded where mask is not 0 and
+         * leaves dst unchanged elsewhere.
+         */
+        int (*pow10)(const int32_t* src, const int32_t* mask, int32_t* dst,
+                unsigned int n);
+
+        /**
+         * These kernels compute the medians of the 3 x 3 and 5 x 5 windows
+         * of n neighbouring pixels of a row. rows[i] is the first pixel of
+         * row i of the window of the first pixel, dst must not overlap a
+         * row. NaN is the smallest value.
+         * @{
+         */
+        int (*median9)(const int32_t* const* rows, int32_t* dst,
+                unsigned int n);
+        int (*median25)(const int32_t* const* rows, int32_t* dst,
+                unsigned int n);
+        /**
+         * @}
+         */
+    };
+
+    /**
+     * Get the backend in use, select the best one of the processor on first
+     * use.
+     *
+     * @return the backend.
+     */
+    const struct preprocessing_kernel_Backend* preprocessing_kernel_backend(
+            void);
+
+    /**
+     * Select a backend.
+     *
+     * @param name the name of the backend, 0 for the best one of the
+     *             processor.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+    int preprocessing_kernel_select(const char* name);
+
+    /**
+     * Get the backends the processor supports, the reference backend first.
+     *
+     * @param backends the backends (PREPROCESSING_KERNEL_BACKENDS entries).
+     *
+     * @return the number of backends.
+     */
+    unsigned int preprocessing_kernel_supported(
+            const struct preprocessing_kernel_Backend** backends);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PREPROCESSING_KERNEL_H */
@@ -0,0 +1,254 @@
+/*
+ * Project: Solar Orbiter - PHI (SO/PHI)
+ * Module:  Preprocessing - a library for image pre-processing.
+ *
+ * Copyright (C) 2016, Max Planck Institute for Solar System Research
+ */
+
+/**
+ * @file
+ *
+ * This file contains declarations of the profiling of the pre-processing
+ * operations. Every operation entry counts its calls, its cumulative and
+ * maximum latency and the bytes of the frames it reads and writes, and stages
+ * of a job can be timed by scopes. The latency of an operation includes the
+ * operations it calls, the bytes are only those it touches itself.
+ *
+ * Pixel kernels also count the pixels they process and the arithmetic
+ * operations they do on them, one per fixed point operation or function of
+ * a pixel. preprocessing_prof_dumpRoofline() ranks the kernels by their
+ * distance from the roofline of the host measured by
+ * preprocessing_prof_measureRoof().
+ *
+ * Profiling is off until preprocessing_prof_setMode() is called. In
+ * PREPROCESSING_PROF_COUNTERS mode only the counters of each operation are
+ * kept, in PREPROCESSING_PROF_TRACE mode each call is also recorded as an
+ * event for a Chrome trace. When profiling is off an operation entry costs
+ * one test of the mode. Building with PREPROCESSING_PROF_DISABLE defined (or
+ * a compiler without the cleanup attribute) removes the profiling entirely.
+ */
+
+#ifndef PREPROCESSING_PROF_H
+#define PREPROCESSING_PROF_H
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * These are the profiling modes.
+ */
+#define PREPROCESSING_PROF_OFF 0
+#define PREPROCESSING_PROF_COUNTERS 1
+#define PREPROCESSING_PROF_TRACE 2
+
+/**
+ * This is the number of events kept for a trace. Later events are dropped.
+ */
+#define PREPROCESSING_PROF_EVENTS 65536
+
+    /**
+     * These are the kinds of profiled scopes.
+     */
+    enum preprocessing_prof_Kind
+    {
+        PREPROCESSING_PROF_OP = 0,
+        PREPROCESSING_PROF_STAGE
+    };
+
+    /**
+     * This structure holds the counters of one profiled operation or stage.
+     * There is one static instance per scope in the code.
+     */
+    struct preprocessing_prof_Site
+    {
+        const char* name;
+        int kind;
+
+        uint64_t calls;
+        uint64_t totalNs;
+        uint64_t maxNs;
+        uint64_t bytesRead;
+        uint64_t bytesWritten;
+        uint64_t pixels;
+        uint64_t ops;
+
+        int registered;
+        struct preprocessing_prof_Site* next;
+    };
+
+    /**
+     * This structure describes one running scope. The start time is 0 if the
+     * scope is not profiled.
+     */
+    struct preprocessing_prof_Scope
+    {
+        struct preprocessing_prof_Site* site;
+        uint64_t start;
+    };
+
+    /**
+     * This structure describes the roofline of the host: the bandwidth of the
+     * memory and the peak rate of arithmetic operations on 32 bit integers.
+     */
+    struct preprocessing_prof_Roof
+    {
+        double bytesPerNs;
+        double opsPerNs;
+    };
+
+    /**
+     * This is the profiling mode. Use preprocessing_prof_setMode() to change
+     * it.
+     */
+    extern int preprocessing_prof_mode;
+
+    /**
+     * Set the profiling mode.
+     *
+     * @param mode the mode (see PREPROCESSING_PROF_OFF).
+     */
+    void preprocessing_prof_setMode(int mode);
+
+    /**
+     * Clear all counters and events.
+     */
+    void preprocessing_prof_reset(void);
+
+    /**
+     * Write the counters of all operations and stages called so far as JSON.
+     *
+     * @param fp the file.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+    int preprocessing_prof_dumpJson(FILE* fp);
+
+    /**
+     * Write the recorded events in the Chrome trace event format (load it in
+     * chrome://tracing or Perfetto).
+     *
+     * @param fp the file.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+    int preprocessing_prof_dumpTrace(FILE* fp);
+
+    /**
+     * Measure the roofline of the host, with streaming additions of frames
+     * too large for the caches and with multiply-adds of cache resident
+     * data. This takes about a second.
+     *
+     * @param roof the measured roofline.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+    int preprocessing_prof_measureRoof(struct preprocessing_prof_Roof* roof);
+
+    /**
+     * Write the achieved bandwidth and arithmetic intensity of all kernels
+     * called so far as JSON, ranked by the fraction of the roofline they
+     * reach. The kernels close to the roofline and bound by memory only gain
+     * from moving less data. A fraction above 1 means the frames were served
+     * by the caches.
+     *
+     * @param fp   the file.
+     * @param roof the roofline of the host.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+    int preprocessing_prof_dumpRoofline(FILE* fp,
+            const struct preprocessing_prof_Roof* roof);
+
+    /**
+     * Start a scope. Used by PREPROCESSING_PROF_ENTER().
+     *
+     * @param site         the counters of the scope.
+     * @param bytesRead    the bytes read by the scope.
+     * @param bytesWritten the bytes written by the scope.
+     * @param pixels       the pixels processed by the scope.
+     * @param ops          the arithmetic operations done by the scope.
+     *
+     * @return the start time in nanoseconds, never 0.
+     */
+    uint64_t preprocessing_prof_enter(struct preprocessing_prof_Site* site,
+            uint64_t bytesRead, uint64_t bytesWritten, uint64_t pixels,
+            uint64_t ops);
+
+    /**
+     * End a scope. Used by PREPROCESSING_PROF_ENTER().
+     *
+     * @param scope the scope.
+     */
+    void preprocessing_prof_leave(const struct preprocessing_prof_Scope* scope);
+
+    /**
+     * End a scope if it has been started. This is the cleanup of the scope
+     * variable.
+     *
+     * @param scope the scope.
+     */
+    static inline void preprocessing_prof_cleanup(
+            const struct preprocessing_prof_Scope* scope)
+    {
+        if (scope->start != 0)
+        {
+            preprocessing_prof_leave(scope);
+        }
+    }
+
+/**
+ * This macro is the number of bytes of a frame of 24.8 pixels.
+ */
+#define PREPROCESSING_PROF_FRAME(rows, cols) \
+    ((uint64_t)(rows) * (uint64_t)(cols) * sizeof(int32_t))
+
+/**
+ * These macros profile the enclosing block from this point until it is left.
+ * PREPROCESSING_PROF_OPERATION() is put at the top of an operation, which is
+ * named after the function, PREPROCESSING_PROF_KERNEL() at the top of an
+ * operation on pixels. PREPROCESSING_PROF_SCOPE() times a named stage.
+ * @{
+ */
+#if defined(__GNUC__) && !defined(PREPROCESSING_PROF_DISABLE)
+#define PREPROCESSING_PROF_CAT2(a, b) a##b
+#define PREPROCESSING_PROF_CAT(a, b) PREPROCESSING_PROF_CAT2(a, b)
+#define PREPROCESSING_PROF_ENTER(name, kind, bytesRead, bytesWritten, \
+        pixels, ops) \
+    static struct preprocessing_prof_Site \
+            PREPROCESSING_PROF_CAT(prof_site_, __LINE__) = { name, kind, \
+            0, 0, 0, 0, 0, 0, 0, 0, 0 }; \
+    struct preprocessing_prof_Scope PREPROCESSING_PROF_CAT(prof_scope_, \
+            __LINE__) __attribute__((cleanup(preprocessing_prof_cleanup))) = \
+            { &PREPROCESSING_PROF_CAT(prof_site_, __LINE__), \
+            (preprocessing_prof_mode != PREPROCESSING_PROF_OFF) \
+            ? preprocessing_prof_enter( \
+            &PREPROCESSING_PROF_CAT(prof_site_, __LINE__), \
+            (bytesRead), (bytesWritten), (pixels), (ops)) : 0 }
+#else
+#define PREPROCESSING_PROF_ENTER(name, kind, bytesRead, bytesWritten, \
+        pixels, ops)
+#endif
+#define PREPROCESSING_PROF_OPERATION(bytesRead, bytesWritten) \
+    PREPROCESSING_PROF_ENTER(__func__, PREPROCESSING_PROF_OP, bytesRead, \
+            bytesWritten, 0, 0)
+#define PREPROCESSING_PROF_KERNEL(bytesRead, bytesWritten, pixels, \
+        opsPerPixel) \
+    PREPROCESSING_PROF_ENTER(__func__, PREPROCESSING_PROF_OP, bytesRead, \
+            bytesWritten, pixels, (uint64_t)(pixels) * (opsPerPixel))
+#define PREPROCESSING_PROF_SCOPE(name) \
+    PREPROCESSING_PROF_ENTER(name, PREPROCESSING_PROF_STAGE, 0, 0, 0, 0)
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PREPROCESSING_PROF_H */
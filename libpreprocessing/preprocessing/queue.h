@@ -0,0 +1,210 @@
+/*
+ * Project: Solar Orbiter - PHI (SO/PHI)
+ * Module:  Preprocessing - a library for image pre-processing.
+ *
+ * Copyright (C) 2016, Max Planck Institute for Solar System Research
+ */
+
+/**
+ * @file
+ *
+ * This file contains declarations of the asynchronous command queue, the
+ * way the DPU software drives the RFPGA. Commands are put into a ring and
+ * run by a worker thread while the caller goes on, each one is the call of
+ * an operation of arith.h, ana.h or graph.h with its VMEM (SDRAM) addresses
+ * and parameters.
+ *
+ * The worker takes all commands waiting in the ring at once. A command that
+ * reads or writes an image an earlier command of the batch writes, or that
+ * writes an image an earlier command reads, runs after it, the others may
+ * run before it or at the same time. Small commands that do not depend on
+ * each other are spread over the cores, large ones run one after the other
+ * with the rows spread over the cores.
+ *
+ * Each command gets a fence, a number that counts the commands submitted.
+ * preprocessing_queue_wait() blocks until a fence is signaled and returns
+ * the first failure up to it, like the error register of the RFPGA, and a
+ * callback of a command is called with its own status when it is done.
+ *
+ * The memory map of vmem.h must not change while commands are pending.
+ */
+
+#ifndef PREPROCESSING_QUEUE_H
+#define PREPROCESSING_QUEUE_H
+
+#include "graph.h"
+
+#include <sys/types.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * This is the number of commands the ring holds, a power of two. Submitting
+ * to a full ring blocks until the worker takes the commands.
+ */
+#ifndef PREPROCESSING_QUEUE_SIZE
+#define PREPROCESSING_QUEUE_SIZE 64
+#endif
+
+/* The slot of a fence is the fence modulo the size, which only carries on
+ * across the wrap of the fences for a power of two. */
+#if (PREPROCESSING_QUEUE_SIZE < 1) \
+        || ((PREPROCESSING_QUEUE_SIZE & (PREPROCESSING_QUEUE_SIZE - 1)) != 0)
+#error "PREPROCESSING_QUEUE_SIZE must be a power of two."
+#endif
+
+/**
+ * This is the number of pixels under which the commands of a batch that do
+ * not depend on each other run at the same time.
+ */
+#ifndef PREPROCESSING_QUEUE_SMALL
+#define PREPROCESSING_QUEUE_SMALL (256 * 256)
+#endif
+
+    /**
+     * These are the operations of the commands.
+     */
+    enum preprocessing_queue_Op
+    {
+        PREPROCESSING_QUEUE_ADD_IMAGES = 0,
+        PREPROCESSING_QUEUE_SUBTRACT_IMAGES,
+        PREPROCESSING_QUEUE_MULTIPLY_IMAGES,
+        PREPROCESSING_QUEUE_DIVIDE_IMAGES,
+        PREPROCESSING_QUEUE_ADD_SCALAR,
+        PREPROCESSING_QUEUE_SUBTRACT_SCALAR,
+        PREPROCESSING_QUEUE_MULTIPLY_SCALAR,
+        PREPROCESSING_QUEUE_DIVIDE_SCALAR,
+        PREPROCESSING_QUEUE_SUM_IMAGE,
+        PREPROCESSING_QUEUE_MEAN_IMAGE,
+        PREPROCESSING_QUEUE_UNDER_THRESH,
+        PREPROCESSING_QUEUE_EQUAL_THRESH,
+        PREPROCESSING_QUEUE_OVER_THRESH,
+        PREPROCESSING_QUEUE_DERIVE_X,
+        PREPROCESSING_QUEUE_DERIVE_Y,
+        PREPROCESSING_QUEUE_MEDIAN_FILTER,
+        PREPROCESSING_QUEUE_CONVOLVE,
+        PREPROCESSING_QUEUE_GRAPH,
+        PREPROCESSING_QUEUE_OPS
+    };
+
+    /**
+     * This is the function called when a command is done.
+     *
+     * @param fence  the fence of the command.
+     * @param status the status of the operation.
+     * @param user   the user pointer of the command.
+     */
+    typedef void (*preprocessing_queue_Callback)(uint32_t fence, int status,
+            void* user);
+
+    /**
+     * This structure is one command, the operation and its arguments.
+     */
+    struct preprocessing_queue_Command
+    {
+        int op;
+
+        /**
+         * These are the images read: sdSrc2 is the second image of the
+         * operations on two images and the kernel of a convolution.
+         */
+        uint32_t sdSrc1;
+        uint32_t sdSrc2;
+        uint16_t rows;
+        uint16_t cols;
+
+        /**
+         * This is the size of the kernel of a convolution, rows2 is the
+         * window size of a median filter.
+         */
+        uint16_t rows2;
+        uint16_t cols2;
+
+        /**
+         * This is the scalar or the threshold (24.8).
+         */
+        int32_t value;
+
+        uint32_t sdDst;
+
+        /**
+         * This is the graph run by PREPROCESSING_QUEUE_GRAPH, it is not
+         * copied and must be kept until the command is done.
+         */
+        const struct preprocessing_graph_Graph* graph;
+
+        /**
+         * This is called with user when the command is done, may be 0. It
+         * is called by the worker thread and must neither submit to nor
+         * wait for the queue.
+         */
+        preprocessing_queue_Callback done;
+        void* user;
+    };
+
+    /**
+     * Start the worker of the queue.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+    int preprocessing_queue_start(void);
+
+    /**
+     * Wait for all commands and stop the worker of the queue.
+     *
+     * @return the first failure not returned by preprocessing_queue_wait().
+     */
+    int preprocessing_queue_stop(void);
+
+    /**
+     * Submit a command, it is copied into the ring. Blocks while the ring is
+     * full.
+     *
+     * @param command the command.
+     * @param fence   the fence of the command, may be 0.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+    int preprocessing_queue_submit(
+            const struct preprocessing_queue_Command* command,
+            uint32_t* fence);
+
+    /**
+     * Check whether a fence is signaled, i.e. its command and all earlier
+     * ones are done.
+     *
+     * @param fence the fence.
+     *
+     * @return true if the fence is signaled, false otherwise.
+     */
+    bool preprocessing_queue_isSignaled(uint32_t fence);
+
+    /**
+     * Wait until a fence is signaled.
+     *
+     * @param fence the fence.
+     *
+     * @return the first failure of the commands up to the fence that was
+     *         not returned yet, PREPROCESSING_SUCCESSFUL otherwise. Later
+     *         failures until it is returned are only seen by the callbacks.
+     */
+    int preprocessing_queue_wait(uint32_t fence);
+
+    /**
+     * Wait until all submitted commands are done.
+     *
+     * @return the first failure that was not returned yet,
+     *         PREPROCESSING_SUCCESSFUL otherwise.
+     */
+    int preprocessing_queue_finish(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PREPROCESSING_QUEUE_H */
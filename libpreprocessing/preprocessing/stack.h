@@ -0,0 +1,110 @@
+/*
+ * Project: Solar Orbiter - PHI (SO/PHI)
+ * Module:  Preprocessing - a library for image pre-processing.
+ *
+ * Copyright (C) 2016, Max Planck Institute for Solar System Research
+ */
+
+/**
+ * @file
+ *
+ * This file contains declarations of per-pixel reductions over a stack of
+ * 24.8 fixed point frames (darks, master flats, dataset QA).
+ */
+
+#ifndef PREPROCESSING_STACK_H
+#define PREPROCESSING_STACK_H
+
+#include <sys/types.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * This is the maximum number of frames of a stack.
+ */
+#define PREPROCESSING_STACK_MAX_FRAMES 256
+
+/**
+ * This is the number of pixels of one tile. A tile of all frames of a stack is
+ * reduced at once so it stays in cache (64 frames x 4 KiB = 256 KiB).
+ */
+#define PREPROCESSING_STACK_TILE 1024
+
+/**
+ * This is the largest number of frames whose median is found by a sorting
+ * network that runs on many pixels at once. The median of a longer stack is
+ * found pixel by pixel.
+ */
+#define PREPROCESSING_STACK_NETWORK 32
+
+    /**
+     * These are the reductions of a stack. NaN pixels are left out, a pixel
+     * that is NaN in all frames is NaN in the result.
+     */
+    enum preprocessing_stack_Mode
+    {
+        PREPROCESSING_STACK_MEAN = 0,
+        PREPROCESSING_STACK_MEDIAN,
+        PREPROCESSING_STACK_SIGMA_CLIP,
+        PREPROCESSING_STACK_MIN,
+        PREPROCESSING_STACK_MAX
+    };
+
+    /**
+     * Reduce a stack of frames pixel by pixel. The median of an even number of
+     * pixels is the average of the two middle ones. The sigma-clipped mean
+     * leaves out pixels more than kappa sigma off the mean and repeats until
+     * nothing changes or \a iterations is reached.
+     *
+     * The mean, minimum and maximum run frame by frame over a tile of pixels
+     * and so on many pixels at once, as does the median of at most
+     * PREPROCESSING_STACK_NETWORK frames. The median of more frames and the
+     * sigma-clipped mean are found pixel by pixel: the clipping keeps a
+     * different set of values per pixel, and a version over many pixels
+     * that marks the values kept was slower.
+     *
+     * @param sdSrc      the VMEM (SDRAM) addresses of the frames.
+     * @param frames     the number of frames.
+     * @param rows       the number of image rows.
+     * @param cols       the number of image columns.
+     * @param mode       the reduction (see preprocessing_stack_Mode).
+     * @param kappa      the clipping factor (24.8), sigma clip only.
+     * @param iterations the maximum number of clipping passes, sigma clip
+     *                   only.
+     * @param sdDst      the VMEM (SDRAM) address of result image.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+    int preprocessing_stack_combine(const uint32_t* sdSrc, uint16_t frames,
+            uint16_t rows, uint16_t cols, int mode, int32_t kappa,
+            uint16_t iterations, uint32_t sdDst);
+
+    /**
+     * Reduce a stack of NAND entries pixel by pixel, see
+     * preprocessing_stack_combine().
+     *
+     * @param nandSrc    the NAND entries of the frames.
+     * @param frames     the number of frames.
+     * @param rows       the number of image rows.
+     * @param cols       the number of image columns.
+     * @param mode       the reduction (see preprocessing_stack_Mode).
+     * @param kappa      the clipping factor (24.8), sigma clip only.
+     * @param iterations the maximum number of clipping passes, sigma clip
+     *                   only.
+     * @param sdDst      the VMEM (SDRAM) address of result image.
+     *
+     * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+     */
+    int preprocessing_stack_combineNAND(const int32_t* const* nandSrc,
+            uint16_t frames, uint16_t rows, uint16_t cols, int mode,
+            int32_t kappa, uint16_t iterations, uint32_t sdDst);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PREPROCESSING_STACK_H */
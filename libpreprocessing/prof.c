@@ -0,0 +1,553 @@
+/*
+ * Project: Solar Orbiter - PHI (SO/PHI)
+ * Module:  Preprocessing - a library for image pre-processing.
+ *
+ * Copyright (C) 2016, Max Planck Institute for Solar System Research
+ */
+
+/**
+ * @file
+ *
+ * This file contains the profiling of the pre-processing operations.
+ *
+ * The counters are updated with atomic operations, so operations may be
+ * profiled from several threads. Each site is put on the list of sites the
+ * first time it is entered with profiling on.
+ *
+ * The roofline of the host is measured with OpenMP threads if available, so
+ * it is the roof of the whole host and not of a single core.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "preprocessing/prof.h"
+
+#include "preprocessing/def.h"
+
+/* from std c */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/* PRIVATE INTERFACE *********************************************************/
+
+/**
+ * These are the pixels of each frame streamed to measure the memory
+ * bandwidth, and the number of times they are streamed.
+ */
+#define PROF_ROOF_STREAM_PIXELS (1u << 23)
+#define PROF_ROOF_STREAM_REPEATS 5
+
+/**
+ * These are the pixels of each cache resident block to measure the peak rate
+ * of operations, the number of blocks and the multiply-adds per pixel.
+ */
+#define PROF_ROOF_BLOCK_PIXELS 1024
+#define PROF_ROOF_BLOCKS 256
+#define PROF_ROOF_BLOCK_REPEATS 2048
+
+/**
+ * This structure describes the position of one kernel on the roofline.
+ */
+struct prof_Kernel
+{
+    const struct preprocessing_prof_Site* site;
+    double bytesPerNs;
+    double intensity;
+    double roofBytesPerNs;
+    double fraction;
+};
+
+/**
+ * This structure describes one recorded event of a trace.
+ */
+struct prof_Event
+{
+    const struct preprocessing_prof_Site* site;
+    uint64_t start;
+    uint64_t duration;
+    int thread;
+};
+
+/**
+ * This is the list of sites entered so far.
+ */
+static struct preprocessing_prof_Site* prof_sites = 0;
+
+/**
+ * These are the recorded events and the number of events claimed so far,
+ * which may exceed PREPROCESSING_PROF_EVENTS.
+ */
+static struct prof_Event prof_events[PREPROCESSING_PROF_EVENTS];
+static uint64_t prof_eventCount = 0;
+
+/**
+ * This keeps the results of the roofline measurement alive.
+ */
+static volatile uint32_t prof_sink = 0;
+
+/**
+ * This is the time the trace starts at.
+ */
+static uint64_t prof_origin = 0;
+
+/**
+ * Get the time of a monotonic clock.
+ *
+ * @return the time in nanoseconds.
+ */
+static uint64_t prof_now(void);
+
+/**
+ * Get the number of the calling thread.
+ *
+ * @return the thread number.
+ */
+static int prof_thread(void);
+
+/**
+ * Compare two kernels by the fraction of the roofline they reach, the
+ * highest first.
+ *
+ * @param a the first kernel.
+ * @param b the second kernel.
+ *
+ * @return the order of the kernels for qsort().
+ */
+static int prof_compareKernels(const void* a, const void* b);
+
+/* PUBLIC IMPLEMENTATION *****************************************************/
+
+int preprocessing_prof_mode = PREPROCESSING_PROF_OFF;
+
+/*****************************************************************************/
+
+void preprocessing_prof_setMode(int mode)
+{
+    if ((mode == PREPROCESSING_PROF_TRACE) && (prof_origin == 0))
+    {
+        prof_origin = prof_now();
+    }
+
+    __atomic_store_n(&preprocessing_prof_mode, mode, __ATOMIC_RELEASE);
+}
+
+/*****************************************************************************/
+
+void preprocessing_prof_reset(void)
+{
+    for (struct preprocessing_prof_Site* site = __atomic_load_n(&prof_sites,
+            __ATOMIC_ACQUIRE); site != 0; site = site->next)
+    {
+        __atomic_store_n(&site->calls, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&site->totalNs, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&site->maxNs, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&site->bytesRead, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&site->bytesWritten, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&site->pixels, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&site->ops, 0, __ATOMIC_RELAXED);
+    }
+
+    __atomic_store_n(&prof_eventCount, 0, __ATOMIC_RELAXED);
+    memset(prof_events, 0, sizeof(prof_events));
+    prof_origin = prof_now();
+}
+
+/*****************************************************************************/
+
+int preprocessing_prof_dumpJson(FILE* fp)
+{
+    int first = 1;
+
+    // Check parameters.
+    if (fp == 0)
+    {
+        printf("Invalid file\n");
+        return PREPROCESSING_INVALID_ADDRESS;
+    }
+
+    fprintf(fp, "{\n  \"ops\": [");
+
+    for (const struct preprocessing_prof_Site* site = __atomic_load_n(
+            &prof_sites, __ATOMIC_ACQUIRE); site != 0; site = site->next)
+    {
+        uint64_t calls = __atomic_load_n(&site->calls, __ATOMIC_RELAXED);
+        uint64_t total = __atomic_load_n(&site->totalNs, __ATOMIC_RELAXED);
+        uint64_t bytesRead = __atomic_load_n(&site->bytesRead,
+                __ATOMIC_RELAXED);
+        uint64_t bytesWritten = __atomic_load_n(&site->bytesWritten,
+                __ATOMIC_RELAXED);
+
+        if (calls == 0)
+        {
+            continue;
+        }
+
+        fprintf(fp, "%s\n    {\"name\": \"%s\", \"kind\": \"%s\", "
+                "\"calls\": %llu, \"total_ns\": %llu, \"max_ns\": %llu, "
+                "\"mean_ns\": %llu, \"bytes_read\": %llu, "
+                "\"bytes_written\": %llu, \"pixels\": %llu, \"ops\": %llu, "
+                "\"gb_per_s\": %.3f}", first ? "" : ",", site->name,
+                (site->kind == PREPROCESSING_PROF_STAGE) ? "stage" : "op",
+                (unsigned long long)(calls), (unsigned long long)(total),
+                (unsigned long long)(__atomic_load_n(&site->maxNs,
+                        __ATOMIC_RELAXED)),
+                (unsigned long long)(total / calls),
+                (unsigned long long)(bytesRead),
+                (unsigned long long)(bytesWritten),
+                (unsigned long long)(__atomic_load_n(&site->pixels,
+                        __ATOMIC_RELAXED)),
+                (unsigned long long)(__atomic_load_n(&site->ops,
+                        __ATOMIC_RELAXED)),
+                (total > 0) ? (double)(bytesRead + bytesWritten) / total
+                        : 0.0);
+        first = 0;
+    }
+
+    fprintf(fp, "\n  ]\n}\n");
+
+    return PREPROCESSING_SUCCESSFUL;
+}
+
+/*****************************************************************************/
+
+int preprocessing_prof_dumpTrace(FILE* fp)
+{
+    uint64_t n = __atomic_load_n(&prof_eventCount, __ATOMIC_ACQUIRE);
+    int first = 1;
+
+    // Check parameters.
+    if (fp == 0)
+    {
+        printf("Invalid file\n");
+        return PREPROCESSING_INVALID_ADDRESS;
+    }
+
+    if (n > PREPROCESSING_PROF_EVENTS)
+    {
+        printf("Trace truncated: %llu events dropped.\n",
+                (unsigned long long)(n - PREPROCESSING_PROF_EVENTS));
+        n = PREPROCESSING_PROF_EVENTS;
+    }
+
+    fprintf(fp, "{\"traceEvents\": [");
+
+    for (uint64_t i = 0; i < n; i++)
+    {
+        const struct prof_Event* e = prof_events + i;
+        const struct preprocessing_prof_Site* site = __atomic_load_n(&e->site,
+                __ATOMIC_ACQUIRE);
+
+        // An event claimed but not yet written is left out.
+        if (site == 0)
+        {
+            continue;
+        }
+
+        fprintf(fp, "%s\n  {\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", "
+                "\"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": %d}",
+                first ? "" : ",", site->name,
+                (site->kind == PREPROCESSING_PROF_STAGE) ? "stage" : "op",
+                (double)(e->start - prof_origin) / 1000.0,
+                (double)(e->duration) / 1000.0, e->thread);
+        first = 0;
+    }
+
+    fprintf(fp, "\n], \"displayTimeUnit\": \"ms\"}\n");
+
+    return PREPROCESSING_SUCCESSFUL;
+}
+
+/*****************************************************************************/
+
+int preprocessing_prof_measureRoof(struct preprocessing_prof_Roof* roof)
+{
+    const unsigned int size = PROF_ROOF_STREAM_PIXELS;
+    uint64_t best = UINT64_MAX;
+    uint64_t start = 0;
+    uint32_t sink = 0;
+
+    // Check parameters.
+    if (roof == 0)
+    {
+        printf("Invalid pointer: %p\n", (void*)(roof));
+        return PREPROCESSING_INVALID_ADDRESS;
+    }
+
+    uint32_t* src1 = malloc(size * sizeof(uint32_t));
+    uint32_t* src2 = malloc(size * sizeof(uint32_t));
+    uint32_t* dst = malloc(size * sizeof(uint32_t));
+
+    if ((src1 == 0) || (src2 == 0) || (dst == 0))
+    {
+        free(src1);
+        free(src2);
+        free(dst);
+        return PREPROCESSING_NO_MEMORY;
+    }
+
+    // Touch the frames once, so page faults are not measured.
+    PREPROCESSING_DEF_PARALLEL_FOR
+    for (unsigned int p = 0; p < size; p++)
+    {
+        src1[p] = p;
+        src2[p] = p ^ 0x5555u;
+        dst[p] = 0;
+    }
+
+    // Bandwidth: the best of several passes of an addition of two frames.
+    for (unsigned int n = 0; n < PROF_ROOF_STREAM_REPEATS; n++)
+    {
+        start = prof_now();
+
+        PREPROCESSING_DEF_PARALLEL_FOR
+        for (unsigned int p = 0; p < size; p++)
+        {
+            dst[p] = src1[p] + src2[p];
+        }
+
+        uint64_t duration = prof_now() - start;
+
+        best = (duration < best) ? duration : best;
+        sink += dst[n];
+    }
+
+    roof->bytesPerNs = 3.0 * sizeof(uint32_t) * size / (double)(best);
+
+    // Peak rate: multiply-adds of blocks small enough for the first level
+    // cache, two operations per pixel and repetition.
+    start = prof_now();
+
+    PREPROCESSING_DEF_PARALLEL_FOR
+    for (unsigned int b = 0; b < PROF_ROOF_BLOCKS; b++)
+    {
+        uint32_t* block = dst + b * PROF_ROOF_BLOCK_PIXELS;
+
+        for (unsigned int n = 0; n < PROF_ROOF_BLOCK_REPEATS; n++)
+        {
+            for (unsigned int p = 0; p < PROF_ROOF_BLOCK_PIXELS; p++)
+            {
+                block[p] = block[p] * 3u + 1u;
+            }
+        }
+    }
+
+    best = prof_now() - start;
+    roof->opsPerNs = 2.0 * PROF_ROOF_BLOCKS * PROF_ROOF_BLOCK_PIXELS
+            * PROF_ROOF_BLOCK_REPEATS / (double)(best);
+
+    // Keep the results alive.
+    for (unsigned int p = 0; p < PROF_ROOF_BLOCKS * PROF_ROOF_BLOCK_PIXELS;
+            p += PROF_ROOF_BLOCK_PIXELS)
+    {
+        sink += dst[p];
+    }
+
+    free(src1);
+    free(src2);
+    free(dst);
+
+    prof_sink = sink;
+
+    return PREPROCESSING_SUCCESSFUL;
+}
+
+/*****************************************************************************/
+
+int preprocessing_prof_dumpRoofline(FILE* fp,
+        const struct preprocessing_prof_Roof* roof)
+{
+    unsigned int count = 0;
+    unsigned int n = 0;
+
+    // Check parameters.
+    if ((fp == 0) || (roof == 0))
+    {
+        printf("Invalid file or roof\n");
+        return PREPROCESSING_INVALID_ADDRESS;
+    }
+    if ((roof->bytesPerNs <= 0.0) || (roof->opsPerNs <= 0.0))
+    {
+        printf("Invalid roof: %f GB/s, %f Gops/s.\n", roof->bytesPerNs,
+                roof->opsPerNs);
+        return PREPROCESSING_INVALID_NUMBER;
+    }
+
+    const struct preprocessing_prof_Site* head = __atomic_load_n(&prof_sites,
+            __ATOMIC_ACQUIRE);
+
+    for (const struct preprocessing_prof_Site* site = head; site != 0;
+            site = site->next)
+    {
+        count++;
+    }
+
+    struct prof_Kernel* kernels = malloc((count + 1)
+            * sizeof(struct prof_Kernel));
+
+    if (kernels == 0)
+    {
+        return PREPROCESSING_NO_MEMORY;
+    }
+
+    // Only kernels that counted their pixels are placed on the roofline.
+    for (const struct preprocessing_prof_Site* site = head; site != 0;
+            site = site->next)
+    {
+        uint64_t total = __atomic_load_n(&site->totalNs, __ATOMIC_RELAXED);
+        uint64_t bytes = __atomic_load_n(&site->bytesRead, __ATOMIC_RELAXED)
+                + __atomic_load_n(&site->bytesWritten, __ATOMIC_RELAXED);
+        uint64_t ops = __atomic_load_n(&site->ops, __ATOMIC_RELAXED);
+        struct prof_Kernel* k = kernels + n;
+
+        if ((total == 0) || (bytes == 0)
+                || (__atomic_load_n(&site->pixels, __ATOMIC_RELAXED) == 0))
+        {
+            continue;
+        }
+
+        k->site = site;
+        k->bytesPerNs = (double)(bytes) / total;
+        k->intensity = (double)(ops) / bytes;
+
+        // The roof is the bandwidth, or the peak rate over the intensity
+        // for kernels right of the ridge point.
+        k->roofBytesPerNs = roof->bytesPerNs;
+        if (k->intensity * roof->bytesPerNs > roof->opsPerNs)
+        {
+            k->roofBytesPerNs = roof->opsPerNs / k->intensity;
+        }
+        k->fraction = k->bytesPerNs / k->roofBytesPerNs;
+        n++;
+    }
+
+    qsort(kernels, n, sizeof(struct prof_Kernel), prof_compareKernels);
+
+    fprintf(fp, "{\n  \"roof\": {\"gb_per_s\": %.3f, \"gops_per_s\": %.3f, "
+            "\"ridge_ops_per_byte\": %.3f},\n  \"kernels\": [",
+            roof->bytesPerNs, roof->opsPerNs,
+            roof->opsPerNs / roof->bytesPerNs);
+
+    for (unsigned int i = 0; i < n; i++)
+    {
+        const struct prof_Kernel* k = kernels + i;
+        uint64_t pixels = __atomic_load_n(&k->site->pixels, __ATOMIC_RELAXED);
+
+        fprintf(fp, "%s\n    {\"name\": \"%s\", \"calls\": %llu, "
+                "\"ops_per_pixel\": %.3f, \"ops_per_byte\": %.3f, "
+                "\"gb_per_s\": %.3f, \"roof_gb_per_s\": %.3f, "
+                "\"roof_fraction\": %.3f, \"bound\": \"%s\"}",
+                (i == 0) ? "" : ",", k->site->name,
+                (unsigned long long)(__atomic_load_n(&k->site->calls,
+                        __ATOMIC_RELAXED)),
+                (double)(__atomic_load_n(&k->site->ops, __ATOMIC_RELAXED))
+                        / pixels, k->intensity, k->bytesPerNs,
+                k->roofBytesPerNs, k->fraction,
+                (k->roofBytesPerNs < roof->bytesPerNs) ? "compute"
+                        : "memory");
+    }
+
+    fprintf(fp, "\n  ]\n}\n");
+
+    free(kernels);
+
+    return PREPROCESSING_SUCCESSFUL;
+}
+
+/*****************************************************************************/
+
+uint64_t preprocessing_prof_enter(struct preprocessing_prof_Site* site,
+        uint64_t bytesRead, uint64_t bytesWritten, uint64_t pixels,
+        uint64_t ops)
+{
+    // Put the site on the list the first time.
+    if (__atomic_exchange_n(&site->registered, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        struct preprocessing_prof_Site* head = __atomic_load_n(&prof_sites,
+                __ATOMIC_ACQUIRE);
+
+        do
+        {
+            site->next = head;
+        }
+        while (!__atomic_compare_exchange_n(&prof_sites, &head, site, 0,
+                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+    }
+
+    __atomic_fetch_add(&site->bytesRead, bytesRead, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&site->bytesWritten, bytesWritten, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&site->pixels, pixels, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&site->ops, ops, __ATOMIC_RELAXED);
+
+    uint64_t start = prof_now();
+
+    return (start != 0) ? start : 1;
+}
+
+/*****************************************************************************/
+
+void preprocessing_prof_leave(const struct preprocessing_prof_Scope* scope)
+{
+    struct preprocessing_prof_Site* site = scope->site;
+    uint64_t end = prof_now();
+    uint64_t duration = end - scope->start;
+    uint64_t max = __atomic_load_n(&site->maxNs, __ATOMIC_RELAXED);
+
+    __atomic_fetch_add(&site->calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&site->totalNs, duration, __ATOMIC_RELAXED);
+
+    while ((duration > max) && !__atomic_compare_exchange_n(&site->maxNs,
+            &max, duration, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+    }
+
+    if (preprocessing_prof_mode == PREPROCESSING_PROF_TRACE)
+    {
+        uint64_t i = __atomic_fetch_add(&prof_eventCount, 1,
+                __ATOMIC_RELAXED);
+
+        if (i < PREPROCESSING_PROF_EVENTS)
+        {
+            prof_events[i].start = scope->start;
+            prof_events[i].duration = duration;
+            prof_events[i].thread = prof_thread();
+            __atomic_store_n(&prof_events[i].site, site, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+/* PRIVATE IMPLEMENTATION ****************************************************/
+
+static uint64_t prof_now(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    return (uint64_t)(t.tv_sec) * 1000000000u + (uint64_t)(t.tv_nsec);
+}
+
+/*****************************************************************************/
+
+static int prof_thread(void)
+{
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+/*****************************************************************************/
+
+static int prof_compareKernels(const void* a, const void* b)
+{
+    double fa = ((const struct prof_Kernel*)(a))->fraction;
+    double fb = ((const struct prof_Kernel*)(b))->fraction;
+
+    return (fa < fb) - (fa > fb);
+}
@@ -0,0 +1,639 @@
+/*
+ * Project: Solar Orbiter - PHI (SO/PHI)
+ * Module:  Preprocessing - a library for image pre-processing.
+ *
+ * Copyright (C) 2016, Max Planck Institute for Solar System Research
+ */
+
+/**
+ * @file
+ *
+ * This file contains implementation of the asynchronous command queue.
+ *
+ * The ring is guarded by one mutex. The worker copies all waiting commands
+ * out of the ring, so the slots are free again at once, and puts each
+ * command of the batch into a wave one after the last wave of the earlier
+ * commands it depends on. The waves run one after the other, the commands
+ * of a wave in fence order or at the same time. A fence is signaled when
+ * its command and all earlier ones of the batch are done.
+ */
+
+#include "preprocessing/queue.h"
+
+#include "preprocessing/ana.h"
+#include "preprocessing/arith.h"
+#include "preprocessing/def.h"
+#include "preprocessing/graph.h"
+
+/* from std c */
+#include <pthread.h>
+#include <stdio.h>
+
+/**
+ * This is the largest number of images a command reads or writes.
+ */
+#define QUEUE_MAX_IMAGES PREPROCESSING_GRAPH_MAX_NODES
+
+/**
+ * This macro runs the following for loop on all cores if a condition holds
+ * when the library is built with OpenMP.
+ */
+#ifdef _OPENMP
+#define QUEUE_PARALLEL_FOR_IF(condition) \
+    PREPROCESSING_DEF_PRAGMA(omp parallel for schedule(dynamic) \
+            if (condition))
+#else
+#define QUEUE_PARALLEL_FOR_IF(condition)
+#endif
+
+/**
+ * This structure holds the images a command reads and writes.
+ */
+struct queue_Access
+{
+    unsigned int reads;
+    unsigned int writes;
+    uint32_t read[QUEUE_MAX_IMAGES];
+    uint32_t write[QUEUE_MAX_IMAGES];
+};
+
+/**
+ * This is the state of the queue, guarded by queue_mutex.
+ */
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_pending = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t queue_space = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t queue_signal = PTHREAD_COND_INITIALIZER;
+static pthread_t queue_thread;
+static int queue_running = 0;
+static int queue_stopping = 0;
+static struct preprocessing_queue_Command queue_ring[PREPROCESSING_QUEUE_SIZE];
+
+/**
+ * These are the last fence submitted, taken by the worker and signaled.
+ */
+static uint32_t queue_submitted = 0;
+static uint32_t queue_taken = 0;
+static uint32_t queue_signaled = 0;
+
+/**
+ * This is the first failure not returned yet and the fence of its command,
+ * 0 if there is none.
+ */
+static uint32_t queue_failedFence = 0;
+static int queue_failedStatus = PREPROCESSING_SUCCESSFUL;
+
+/* PRIVATE INTERFACE *********************************************************/
+
+/**
+ * Check whether a fence is not after another one, across the wrap of the
+ * fences.
+ *
+ * @param a the first fence.
+ * @param b the second fence.
+ *
+ * @return true if a is b or comes before it, false otherwise.
+ */
+static bool queue_notAfter(uint32_t a, uint32_t b);
+
+/**
+ * Run the commands waiting in the ring until the queue is stopped.
+ *
+ * @param arg not used.
+ *
+ * @return 0.
+ */
+static void* queue_work(void* arg);
+
+/**
+ * Run a batch of commands.
+ *
+ * @param batch the commands.
+ * @param n     the number of commands.
+ * @param first the fence of the first command.
+ */
+static void queue_runBatch(const struct preprocessing_queue_Command* batch,
+        unsigned int n, uint32_t first);
+
+/**
+ * Get the images a command reads and writes.
+ *
+ * @param command the command.
+ * @param access  the images.
+ */
+static void queue_getAccess(const struct preprocessing_queue_Command* command,
+        struct queue_Access* access);
+
+/**
+ * Check whether a command depends on an earlier one, i.e. one of them
+ * writes an image the other one reads or writes.
+ *
+ * @param a the later command.
+ * @param b the earlier command.
+ *
+ * @return true if a depends on b, false otherwise.
+ */
+static bool queue_depends(const struct queue_Access* a,
+        const struct queue_Access* b);
+
+/**
+ * Check whether an image is in a list.
+ *
+ * @param sdAddress the VMEM (SDRAM) address of image.
+ * @param list      the list.
+ * @param n         the number of images of the list.
+ *
+ * @return true if the image is in the list, false otherwise.
+ */
+static bool queue_contains(uint32_t sdAddress, const uint32_t* list,
+        unsigned int n);
+
+/**
+ * Run the operation of a command.
+ *
+ * @param command the command.
+ *
+ * @return the status of the operation.
+ */
+static int queue_run(const struct preprocessing_queue_Command* command);
+
+/* PUBLIC IMPLEMENTATION *****************************************************/
+
+int preprocessing_queue_start(void)
+{
+    int status = PREPROCESSING_SUCCESSFUL;
+
+    pthread_mutex_lock(&queue_mutex);
+
+    if (!queue_running)
+    {
+        if (pthread_create(&queue_thread, 0, queue_work, 0) != 0)
+        {
+            printf("Queue worker could not be started.\n");
+            status = PREPROCESSING_NO_MEMORY;
+        }
+        else
+        {
+            queue_running = 1;
+        }
+    }
+
+    pthread_mutex_unlock(&queue_mutex);
+
+    return status;
+}
+
+/*****************************************************************************/
+
+int preprocessing_queue_stop(void)
+{
+    int status;
+
+    pthread_mutex_lock(&queue_mutex);
+
+    if (!queue_running)
+    {
+        pthread_mutex_unlock(&queue_mutex);
+        return PREPROCESSING_SUCCESSFUL;
+    }
+
+    // The worker runs the commands left in the ring before it stops.
+    queue_stopping = 1;
+    pthread_cond_signal(&queue_pending);
+    pthread_mutex_unlock(&queue_mutex);
+
+    pthread_join(queue_thread, 0);
+
+    pthread_mutex_lock(&queue_mutex);
+    queue_running = 0;
+    queue_stopping = 0;
+    status = queue_failedStatus;
+    queue_failedFence = 0;
+    queue_failedStatus = PREPROCESSING_SUCCESSFUL;
+    pthread_mutex_unlock(&queue_mutex);
+
+    return status;
+}
+
+/*****************************************************************************/
+
+int preprocessing_queue_submit(
+        const struct preprocessing_queue_Command* command, uint32_t* fence)
+{
+    // Check parameters.
+    if (command == 0)
+    {
+        printf("Invalid command pointer.\n");
+        return PREPROCESSING_INVALID_ADDRESS;
+    }
+
+    if ((command->op < 0) || (command->op >= PREPROCESSING_QUEUE_OPS))
+    {
+        printf("Invalid queue operation: %d.\n", command->op);
+        return PREPROCESSING_INVALID_NUMBER;
+    }
+
+    if ((command->op == PREPROCESSING_QUEUE_GRAPH) && (command->graph == 0))
+    {
+        printf("Invalid graph pointer.\n");
+        return PREPROCESSING_INVALID_ADDRESS;
+    }
+
+    pthread_mutex_lock(&queue_mutex);
+
+    if ((!queue_running) || queue_stopping)
+    {
+        pthread_mutex_unlock(&queue_mutex);
+        printf("Queue is not started.\n");
+        return PREPROCESSING_INVALID_NUMBER;
+    }
+
+    while (queue_submitted - queue_taken == PREPROCESSING_QUEUE_SIZE)
+    {
+        pthread_cond_wait(&queue_space, &queue_mutex);
+    }
+
+    queue_submitted++;
+    queue_ring[queue_submitted % PREPROCESSING_QUEUE_SIZE] = *command;
+
+    if (fence != 0)
+    {
+        *fence = queue_submitted;
+    }
+
+    pthread_cond_signal(&queue_pending);
+    pthread_mutex_unlock(&queue_mutex);
+
+    return PREPROCESSING_SUCCESSFUL;
+}
+
+/*****************************************************************************/
+
+bool preprocessing_queue_isSignaled(uint32_t fence)
+{
+    bool signaled;
+
+    pthread_mutex_lock(&queue_mutex);
+    signaled = queue_notAfter(fence, queue_signaled);
+    pthread_mutex_unlock(&queue_mutex);
+
+    return signaled;
+}
+
+/*****************************************************************************/
+
+int preprocessing_queue_wait(uint32_t fence)
+{
+    int status = PREPROCESSING_SUCCESSFUL;
+
+    pthread_mutex_lock(&queue_mutex);
+
+    // A fence that was not submitted yet is the last one submitted.
+    if (!queue_notAfter(fence, queue_submitted))
+    {
+        fence = queue_submitted;
+    }
+
+    while (!queue_notAfter(fence, queue_signaled))
+    {
+        pthread_cond_wait(&queue_signal, &queue_mutex);
+    }
+
+    if ((queue_failedFence != 0) && queue_notAfter(queue_failedFence, fence))
+    {
+        status = queue_failedStatus;
+        queue_failedFence = 0;
+        queue_failedStatus = PREPROCESSING_SUCCESSFUL;
+    }
+
+    pthread_mutex_unlock(&queue_mutex);
+
+    return status;
+}
+
+/*****************************************************************************/
+
+int preprocessing_queue_finish(void)
+{
+    uint32_t fence;
+
+    pthread_mutex_lock(&queue_mutex);
+    fence = queue_submitted;
+    pthread_mutex_unlock(&queue_mutex);
+
+    return preprocessing_queue_wait(fence);
+}
+
+/* PRIVATE IMPLEMENTATION ****************************************************/
+
+static bool queue_notAfter(uint32_t a, uint32_t b)
+{
+    return (int32_t)(a - b) <= 0;
+}
+
+/*****************************************************************************/
+
+static void* queue_work(void* arg)
+{
+    static struct preprocessing_queue_Command batch[PREPROCESSING_QUEUE_SIZE];
+
+    (void)(arg);
+
+    pthread_mutex_lock(&queue_mutex);
+
+    for (;;)
+    {
+        while ((queue_taken == queue_submitted) && (!queue_stopping))
+        {
+            pthread_cond_wait(&queue_pending, &queue_mutex);
+        }
+
+        if (queue_taken == queue_submitted)
+        {
+            break;
+        }
+
+        // Take all waiting commands, the ring is free for new ones while
+        // they run.
+        uint32_t first = queue_taken + 1;
+        unsigned int n = queue_submitted - queue_taken;
+
+        for (unsigned int i = 0; i < n; i++)
+        {
+            batch[i] = queue_ring[(first + i) % PREPROCESSING_QUEUE_SIZE];
+        }
+
+        queue_taken = queue_submitted;
+        pthread_cond_broadcast(&queue_space);
+        pthread_mutex_unlock(&queue_mutex);
+
+        queue_runBatch(batch, n, first);
+
+        pthread_mutex_lock(&queue_mutex);
+    }
+
+    pthread_mutex_unlock(&queue_mutex);
+
+    return 0;
+}
+
+/*****************************************************************************/
+
+static void queue_runBatch(const struct preprocessing_queue_Command* batch,
+        unsigned int n, uint32_t first)
+{
+    static struct queue_Access access[PREPROCESSING_QUEUE_SIZE];
+    unsigned int wave[PREPROCESSING_QUEUE_SIZE];
+    unsigned int list[PREPROCESSING_QUEUE_SIZE];
+    int status[PREPROCESSING_QUEUE_SIZE];
+    unsigned char done[PREPROCESSING_QUEUE_SIZE];
+    unsigned int waves = 0;
+    unsigned int signaled = 0;
+
+    // A command goes into the wave after the last one of the commands it
+    // depends on.
+    for (unsigned int i = 0; i < n; i++)
+    {
+        queue_getAccess(batch + i, access + i);
+        wave[i] = 0;
+        done[i] = 0;
+
+        for (unsigned int j = 0; j < i; j++)
+        {
+            if ((wave[j] >= wave[i]) && queue_depends(access + i, access + j))
+            {
+                wave[i] = wave[j] + 1;
+            }
+        }
+
+        if (wave[i] + 1 > waves)
+        {
+            waves = wave[i] + 1;
+        }
+    }
+
+    for (unsigned int w = 0; w < waves; w++)
+    {
+        unsigned int m = 0;
+        int small = 1;
+
+        for (unsigned int i = 0; i < n; i++)
+        {
+            if (wave[i] == w)
+            {
+                const struct preprocessing_queue_Command* c = batch + i;
+                uint64_t pixels = (c->op == PREPROCESSING_QUEUE_GRAPH)
+                        ? (uint64_t)(c->graph->rows) * c->graph->cols
+                        : (uint64_t)(c->rows) * c->cols;
+
+                small &= (pixels < PREPROCESSING_QUEUE_SMALL);
+                list[m++] = i;
+            }
+        }
+
+        // Small commands are spread over the cores, a large one spreads its
+        // rows over the cores itself.
+        QUEUE_PARALLEL_FOR_IF(small && (m > 1))
+        for (unsigned int k = 0; k < m; k++)
+        {
+            status[list[k]] = queue_run(batch + list[k]);
+        }
+
+        for (unsigned int k = 0; k < m; k++)
+        {
+            const struct preprocessing_queue_Command* c = batch + list[k];
+
+            if (c->done != 0)
+            {
+                c->done(first + list[k], status[list[k]], c->user);
+            }
+        }
+
+        // Keep the first failure and signal the fences all of whose
+        // commands are done.
+        pthread_mutex_lock(&queue_mutex);
+
+        for (unsigned int k = 0; k < m; k++)
+        {
+            uint32_t fence = first + list[k];
+
+            done[list[k]] = 1;
+
+            if ((status[list[k]] != PREPROCESSING_SUCCESSFUL)
+                    && ((queue_failedFence == 0)
+                            || queue_notAfter(fence, queue_failedFence)))
+            {
+                queue_failedFence = fence;
+                queue_failedStatus = status[list[k]];
+            }
+        }
+
+        while ((signaled < n) && done[signaled])
+        {
+            signaled++;
+        }
+
+        if (signaled > 0)
+        {
+            queue_signaled = first + signaled - 1;
+            pthread_cond_broadcast(&queue_signal);
+        }
+
+        pthread_mutex_unlock(&queue_mutex);
+    }
+}
+
+/*****************************************************************************/
+
+static void queue_getAccess(const struct preprocessing_queue_Command* command,
+        struct queue_Access* access)
+{
+    access->reads = 0;
+    access->writes = 0;
+
+    if (command->op == PREPROCESSING_QUEUE_GRAPH)
+    {
+        const struct preprocessing_graph_Graph* graph = command->graph;
+
+        for (unsigned int i = 0; i < graph->nodes; i++)
+        {
+            const struct preprocessing_graph_Node* node = graph->node + i;
+
+            if ((node->op == PREPROCESSING_GRAPH_FRAME)
+                    || (node->op == PREPROCESSING_GRAPH_CONVOLVE))
+            {
+                access->read[access->reads++] = node->sdAddress;
+            }
+            else if ((node->op == PREPROCESSING_GRAPH_STORE)
+                    || (node->op == PREPROCESSING_GRAPH_SUM))
+            {
+                access->write[access->writes++] = node->sdAddress;
+            }
+        }
+
+        return;
+    }
+
+    access->read[access->reads++] = command->sdSrc1;
+    access->write[access->writes++] = command->sdDst;
+
+    switch (command->op)
+    {
+    case PREPROCESSING_QUEUE_ADD_IMAGES:
+    case PREPROCESSING_QUEUE_SUBTRACT_IMAGES:
+    case PREPROCESSING_QUEUE_MULTIPLY_IMAGES:
+    case PREPROCESSING_QUEUE_DIVIDE_IMAGES:
+    case PREPROCESSING_QUEUE_CONVOLVE:
+        access->read[access->reads++] = command->sdSrc2;
+        break;
+    default:
+        break;
+    }
+}
+
+/*****************************************************************************/
+
+static bool queue_depends(const struct queue_Access* a,
+        const struct queue_Access* b)
+{
+    for (unsigned int i = 0; i < b->writes; i++)
+    {
+        if (queue_contains(b->write[i], a->read, a->reads)
+                || queue_contains(b->write[i], a->write, a->writes))
+        {
+            return true;
+        }
+    }
+
+    for (unsigned int i = 0; i < a->writes; i++)
+    {
+        if (queue_contains(a->write[i], b->read, b->reads))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*****************************************************************************/
+
+static bool queue_contains(uint32_t sdAddress, const uint32_t* list,
+        unsigned int n)
+{
+    for (unsigned int i = 0; i < n; i++)
+    {
+        if (list[i] == sdAddress)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*****************************************************************************/
+
+static int queue_run(const struct preprocessing_queue_Command* command)
+{
+    const struct preprocessing_queue_Command* c = command;
+
+    switch (c->op)
+    {
+    case PREPROCESSING_QUEUE_ADD_IMAGES:
+        return preprocessing_arith_addImages(c->sdSrc1, c->sdSrc2, c->rows,
+                c->cols, c->sdDst);
+    case PREPROCESSING_QUEUE_SUBTRACT_IMAGES:
+        return preprocessing_arith_subtractImages(c->sdSrc1, c->sdSrc2,
+                c->rows, c->cols, c->sdDst);
+    case PREPROCESSING_QUEUE_MULTIPLY_IMAGES:
+        return preprocessing_arith_multiplyImages(c->sdSrc1, c->sdSrc2,
+                c->rows, c->cols, c->sdDst);
+    case PREPROCESSING_QUEUE_DIVIDE_IMAGES:
+        return preprocessing_arith_divideImages(c->sdSrc1, c->sdSrc2,
+                c->rows, c->cols, c->sdDst);
+    case PREPROCESSING_QUEUE_ADD_SCALAR:
+        return preprocessing_arith_addScalar(c->sdSrc1, c->rows, c->cols,
+                c->value, c->sdDst);
+    case PREPROCESSING_QUEUE_SUBTRACT_SCALAR:
+        return preprocessing_arith_subtractScalar(c->sdSrc1, c->rows,
+                c->cols, c->value, c->sdDst);
+    case PREPROCESSING_QUEUE_MULTIPLY_SCALAR:
+        return preprocessing_arith_multiplyScalar(c->sdSrc1, c->rows,
+                c->cols, c->value, c->sdDst);
+    case PREPROCESSING_QUEUE_DIVIDE_SCALAR:
+        return preprocessing_arith_divideScalar(c->sdSrc1, c->rows, c->cols,
+                c->value, c->sdDst);
+    case PREPROCESSING_QUEUE_SUM_IMAGE:
+        return preprocessing_arith_sumImage(c->sdSrc1, c->rows, c->cols,
+                c->sdDst);
+    case PREPROCESSING_QUEUE_MEAN_IMAGE:
+        return preprocessing_arith_meanImage(c->sdSrc1, c->rows, c->cols,
+                c->sdDst);
+    case PREPROCESSING_QUEUE_UNDER_THRESH:
+        return preprocessing_ana_underThresh(c->sdSrc1, c->rows, c->cols,
+                c->value, c->sdDst);
+    case PREPROCESSING_QUEUE_EQUAL_THRESH:
+        return preprocessing_ana_equalThresh(c->sdSrc1, c->rows, c->cols,
+                c->value, c->sdDst);
+    case PREPROCESSING_QUEUE_OVER_THRESH:
+        return preprocessing_ana_overThresh(c->sdSrc1, c->rows, c->cols,
+                c->value, c->sdDst);
+    case PREPROCESSING_QUEUE_DERIVE_X:
+        return preprocessing_ana_deriveX(c->sdSrc1, c->rows, c->cols,
+                c->sdDst);
+    case PREPROCESSING_QUEUE_DERIVE_Y:
+        return preprocessing_ana_deriveY(c->sdSrc1, c->rows, c->cols,
+                c->sdDst);
+    case PREPROCESSING_QUEUE_MEDIAN_FILTER:
+        return preprocessing_ana_medianFilter(c->sdSrc1, c->rows, c->cols,
+                c->rows2, c->sdDst);
+    case PREPROCESSING_QUEUE_CONVOLVE:
+        return preprocessing_ana_convolve(c->sdSrc1, c->rows, c->cols,
+                c->sdSrc2, c->rows2, c->cols2, c->sdDst);
+    case PREPROCESSING_QUEUE_GRAPH:
+        return preprocessing_graph_run(c->graph);
+    default:
+        return PREPROCESSING_INVALID_NUMBER;
+    }
+}
@@ -0,0 +1,616 @@
+/*
+ * Project: Solar Orbiter - PHI (SO/PHI)
+ * Module:  Preprocessing - a library for image pre-processing.
+ *
+ * Copyright (C) 2016, Max Planck Institute for Solar System Research
+ */
+
+/**
+ * @file
+ *
+ * This file contains implementation of per-pixel reductions over a stack of
+ * 24.8 fixed point frames.
+ */
+
+#include "preprocessing/stack.h"
+
+#include "preprocessing/def.h"
+#include "preprocessing/prof.h"
+#include "preprocessing/vmem.h"
+
+/* from libeve */
+#include "../libeve/eve/fixed_point.h"
+
+/* from std c */
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * This is the number of pixels of a tile that are sorted together by the
+ * median network.
+ */
+#define STACK_CHUNK 256
+
+/**
+ * This is the largest number of compare-exchanges of the sorting network of
+ * a stack of PREPROCESSING_STACK_NETWORK frames.
+ */
+#define STACK_MAX_PAIRS 512
+
+/* PRIVATE INTERFACE *********************************************************/
+
+/**
+ * Reduce a stack tile by tile, the tiles are spread over all cores.
+ *
+ * @param src        the frames.
+ * @param frames     the number of frames.
+ * @param size       the number of pixels of a frame.
+ * @param mode       the reduction.
+ * @param kappa      the clipping factor (24.8).
+ * @param iterations the maximum number of clipping passes.
+ * @param dst        the result image.
+ *
+ * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+ */
+static int stack_combine(const int32_t* const* src, uint16_t frames,
+        unsigned int size, int mode, int32_t kappa, uint16_t iterations,
+        int32_t* dst);
+
+/**
+ * Reduce one tile of all frames.
+ *
+ * @param src        the frames.
+ * @param frames     the number of frames.
+ * @param p0         the first pixel of the tile.
+ * @param n          the number of pixels of the tile.
+ * @param mode       the reduction.
+ * @param kappa      the clipping factor (24.8).
+ * @param iterations the maximum number of clipping passes.
+ * @param pairs      the sorting network of the median, 0 for none.
+ * @param pairCount  the number of compare-exchanges of the network.
+ * @param dst        the result image.
+ *
+ * @return 1 if a result pixel is NaN, 0 otherwise.
+ */
+static int stack_reduceTile(const int32_t* const* src, uint16_t frames,
+        unsigned int p0, unsigned int n, int mode, int32_t kappa,
+        uint16_t iterations, const uint8_t (*pairs)[2], unsigned int pairCount,
+        int32_t* dst);
+
+/**
+ * Get the sorting network of some values (Batcher's odd-even merge sort).
+ *
+ * @param n     the number of values, PREPROCESSING_STACK_NETWORK at most.
+ * @param pairs the compare-exchanges, STACK_MAX_PAIRS at most.
+ *
+ * @return the number of compare-exchanges.
+ */
+static unsigned int stack_network(unsigned int n, uint8_t (*pairs)[2]);
+
+/**
+ * Get the median of a chunk of pixels of all frames by a sorting network
+ * that runs on all pixels at once.
+ *
+ * @param src    the frames.
+ * @param frames the number of frames, PREPROCESSING_STACK_NETWORK at most.
+ * @param p0     the first pixel of the chunk.
+ * @param n      the number of pixels of the chunk, STACK_CHUNK at most.
+ * @param pairs  the sorting network.
+ * @param count  the number of compare-exchanges of the network.
+ * @param dst    the result image.
+ *
+ * @return 1 if a result pixel is NaN, 0 otherwise.
+ */
+static int stack_medianChunk(const int32_t* const* src, uint16_t frames,
+        unsigned int p0, unsigned int n, const uint8_t (*pairs)[2],
+        unsigned int count, int32_t* dst);
+
+/**
+ * Get the median of some values. The values are sorted in place.
+ *
+ * @param values the values.
+ * @param n      the number of values, at least 1.
+ *
+ * @return the median.
+ */
+static int32_t stack_median(int32_t* values, unsigned int n);
+
+/**
+ * Get the sigma-clipped mean of some values. The values are reordered.
+ *
+ * @param values     the values.
+ * @param n          the number of values, at least 1.
+ * @param kappa      the clipping factor (24.8).
+ * @param iterations the maximum number of clipping passes.
+ *
+ * @return the sigma-clipped mean.
+ */
+static int32_t stack_sigmaClip(int32_t* values, unsigned int n, int32_t kappa,
+        uint16_t iterations);
+
+/**
+ * Divide a sum of 24.8 values by a count, rounded to nearest.
+ *
+ * @param sum the sum.
+ * @param n   the count, at least 1.
+ *
+ * @return the quotient.
+ */
+static int32_t stack_divide(int64_t sum, unsigned int n);
+
+/* PUBLIC IMPLEMENTATION *****************************************************/
+
+int preprocessing_stack_combine(const uint32_t* sdSrc, uint16_t frames,
+        uint16_t rows, uint16_t cols, int mode, int32_t kappa,
+        uint16_t iterations, uint32_t sdDst)
+{
+    PREPROCESSING_PROF_OPERATION(frames * PREPROCESSING_PROF_FRAME(rows, cols),
+            PREPROCESSING_PROF_FRAME(rows, cols));
+
+    unsigned int size = (unsigned int)(rows) * cols;
+    const int32_t* src[PREPROCESSING_STACK_MAX_FRAMES];
+
+    int32_t* dst = preprocessing_vmem_getDataAddress(sdDst);
+
+    if ((frames == 0) || (frames > PREPROCESSING_STACK_MAX_FRAMES))
+    {
+        printf("Stack of %u frames is empty or exceeds %u.\n",
+                (unsigned int)(frames),
+                (unsigned int)(PREPROCESSING_STACK_MAX_FRAMES));
+        return PREPROCESSING_INVALID_SIZE;
+    }
+
+    // Check parameters.
+    if (sdSrc == 0)
+    {
+        printf("Invalid stack pointer.\n");
+        return PREPROCESSING_INVALID_ADDRESS;
+    }
+
+    // Check whether given rows and columns are in a valid range.
+    if (!preprocessing_vmem_isProcessingSizeValid(sdDst, rows, cols))
+    {
+        return PREPROCESSING_INVALID_SIZE;
+    }
+
+    for (unsigned int f = 0; f < frames; f++)
+    {
+        if (!preprocessing_vmem_isProcessingSizeValid(sdSrc[f], rows, cols))
+        {
+            return PREPROCESSING_INVALID_SIZE;
+        }
+
+        src[f] = preprocessing_vmem_getDataAddress(sdSrc[f]);
+
+        if (src[f] == 0)
+        {
+            return PREPROCESSING_INVALID_ADDRESS;
+        }
+    }
+
+    if (dst == 0)
+    {
+        return PREPROCESSING_INVALID_ADDRESS;
+    }
+
+    return stack_combine(src, frames, size, mode, kappa, iterations, dst);
+}
+
+/*****************************************************************************/
+
+int preprocessing_stack_combineNAND(const int32_t* const* nandSrc,
+        uint16_t frames, uint16_t rows, uint16_t cols, int mode,
+        int32_t kappa, uint16_t iterations, uint32_t sdDst)
+{
+    PREPROCESSING_PROF_OPERATION(frames * PREPROCESSING_PROF_FRAME(rows, cols),
+            PREPROCESSING_PROF_FRAME(rows, cols));
+
+    unsigned int size = (unsigned int)(rows) * cols;
+
+    int32_t* dst = preprocessing_vmem_getDataAddress(sdDst);
+
+    if ((frames == 0) || (frames > PREPROCESSING_STACK_MAX_FRAMES))
+    {
+        printf("Stack of %u frames is empty or exceeds %u.\n",
+                (unsigned int)(frames),
+                (unsigned int)(PREPROCESSING_STACK_MAX_FRAMES));
+        return PREPROCESSING_INVALID_SIZE;
+    }
+
+    // Check parameters.
+    if (nandSrc == 0)
+    {
+        printf("Invalid stack pointer.\n");
+        return PREPROCESSING_INVALID_ADDRESS;
+    }
+
+    // Check whether given rows and columns are in a valid range.
+    if (!preprocessing_vmem_isProcessingSizeValid(sdDst, rows, cols))
+    {
+        return PREPROCESSING_INVALID_SIZE;
+    }
+
+    for (unsigned int f = 0; f < frames; f++)
+    {
+        if (nandSrc[f] == 0)
+        {
+            return PREPROCESSING_INVALID_ADDRESS;
+        }
+    }
+
+    if (dst == 0)
+    {
+        return PREPROCESSING_INVALID_ADDRESS;
+    }
+
+    return stack_combine(nandSrc, frames, size, mode, kappa, iterations, dst);
+}
+
+/* PRIVATE IMPLEMENTATION ****************************************************/
+
+static int stack_combine(const int32_t* const* src, uint16_t frames,
+        unsigned int size, int mode, int32_t kappa, uint16_t iterations,
+        int32_t* dst)
+{
+    unsigned int tiles = (size + PREPROCESSING_STACK_TILE - 1)
+            / PREPROCESSING_STACK_TILE;
+    uint8_t pairs[STACK_MAX_PAIRS][2];
+    unsigned int count = 0;
+    int invalid = 0;
+
+    if ((mode < PREPROCESSING_STACK_MEAN) || (mode > PREPROCESSING_STACK_MAX))
+    {
+        printf("Invalid stack mode %d.\n", mode);
+        return PREPROCESSING_INVALID_NUMBER;
+    }
+
+    // Short stacks are sorted by a network on all pixels of a chunk.
+    if ((mode == PREPROCESSING_STACK_MEDIAN)
+            && (frames <= PREPROCESSING_STACK_NETWORK))
+    {
+        count = stack_network(frames, pairs);
+    }
+
+    // Process.
+    PREPROCESSING_DEF_PARALLEL_FOR_OR(invalid)
+    for (unsigned int t = 0; t < tiles; t++)
+    {
+        unsigned int p0 = t * PREPROCESSING_STACK_TILE;
+        unsigned int n = size - p0;
+
+        if (n > PREPROCESSING_STACK_TILE)
+        {
+            n = PREPROCESSING_STACK_TILE;
+        }
+
+        invalid |= stack_reduceTile(src, frames, p0, n, mode, kappa,
+                iterations, (count > 0) ? pairs : 0, count, dst);
+    }
+
+    return invalid ? PREPROCESSING_INVALID_NUMBER : PREPROCESSING_SUCCESSFUL;
+}
+
+/*****************************************************************************/
+
+static int stack_reduceTile(const int32_t* const* src, uint16_t frames,
+        unsigned int p0, unsigned int n, int mode, int32_t kappa,
+        uint16_t iterations, const uint8_t (*pairs)[2], unsigned int pairCount,
+        int32_t* dst)
+{
+    int64_t sum[PREPROCESSING_STACK_TILE];
+    int32_t acc[PREPROCESSING_STACK_TILE];
+    uint32_t count[PREPROCESSING_STACK_TILE];
+    int32_t values[PREPROCESSING_STACK_MAX_FRAMES];
+    int invalid = 0;
+
+    switch (mode)
+    {
+    case PREPROCESSING_STACK_MEAN:
+    case PREPROCESSING_STACK_MIN:
+    case PREPROCESSING_STACK_MAX:
+        // Frame by frame over the tile, the inner loops have no branches so
+        // they vectorize across pixels.
+        memset(sum, 0, n * sizeof(int64_t));
+        memset(count, 0, n * sizeof(uint32_t));
+        for (unsigned int x = 0; x < n; x++)
+        {
+            acc[x] = (mode == PREPROCESSING_STACK_MIN) ? INT32_MAX
+                    : EVE_FP32_NAN;
+        }
+
+        for (unsigned int f = 0; f < frames; f++)
+        {
+            const int32_t* s = src[f] + p0;
+
+            if (mode == PREPROCESSING_STACK_MEAN)
+            {
+                for (unsigned int x = 0; x < n; x++)
+                {
+                    int32_t valid = (s[x] != EVE_FP32_NAN);
+                    sum[x] += valid ? s[x] : 0;
+                    count[x] += (uint32_t)valid;
+                }
+            }
+            else if (mode == PREPROCESSING_STACK_MIN)
+            {
+                for (unsigned int x = 0; x < n; x++)
+                {
+                    int32_t valid = (s[x] != EVE_FP32_NAN);
+                    int32_t v = valid ? s[x] : INT32_MAX;
+                    acc[x] = (v < acc[x]) ? v : acc[x];
+                    count[x] += (uint32_t)valid;
+                }
+            }
+            else
+            {
+                // NaN is the smallest 24.8 value and never wins.
+                for (unsigned int x = 0; x < n; x++)
+                {
+                    acc[x] = (s[x] > acc[x]) ? s[x] : acc[x];
+                    count[x] += (uint32_t)(s[x] != EVE_FP32_NAN);
+                }
+            }
+        }
+
+        for (unsigned int x = 0; x < n; x++)
+        {
+            if (count[x] == 0)
+            {
+                dst[p0 + x] = EVE_FP32_NAN;
+            }
+            else if (mode == PREPROCESSING_STACK_MEAN)
+            {
+                dst[p0 + x] = stack_divide(sum[x], count[x]);
+            }
+            else
+            {
+                dst[p0 + x] = acc[x];
+            }
+
+            invalid |= (dst[p0 + x] == EVE_FP32_NAN);
+        }
+        break;
+
+    default:
+        if (pairs != 0)
+        {
+            for (unsigned int c = 0; c < n; c += STACK_CHUNK)
+            {
+                unsigned int m = (n - c < STACK_CHUNK) ? n - c : STACK_CHUNK;
+
+                invalid |= stack_medianChunk(src, frames, p0 + c, m, pairs,
+                        pairCount, dst);
+            }
+            break;
+        }
+
+        // Pixel by pixel, the values of a pixel are gathered from all frames.
+        for (unsigned int x = 0; x < n; x++)
+        {
+            unsigned int valid = 0;
+
+            for (unsigned int f = 0; f < frames; f++)
+            {
+                int32_t v = src[f][p0 + x];
+
+                if (v != EVE_FP32_NAN)
+                {
+                    values[valid] = v;
+                    valid++;
+                }
+            }
+
+            if (valid == 0)
+            {
+                dst[p0 + x] = EVE_FP32_NAN;
+            }
+            else if (mode == PREPROCESSING_STACK_MEDIAN)
+            {
+                dst[p0 + x] = stack_median(values, valid);
+            }
+            else
+            {
+                dst[p0 + x] = stack_sigmaClip(values, valid, kappa,
+                        iterations);
+            }
+            invalid |= (dst[p0 + x] == EVE_FP32_NAN);
+        }
+        break;
+    }
+
+    return invalid;
+}
+
+/*****************************************************************************/
+
+static int32_t stack_median(int32_t* values, unsigned int n)
+{
+    // Insertion sort, stacks are short.
+    for (unsigned int i = 1; i < n; i++)
+    {
+        int32_t v = values[i];
+        unsigned int j = i;
+
+        while ((j > 0) && (values[j - 1] > v))
+        {
+            values[j] = values[j - 1];
+            j--;
+        }
+
+        values[j] = v;
+    }
+
+    // Choose median value differently depending on even or odd number of
+    // elements.
+    if ((n % 2) == 0)
+    {
+        int32_t median = eve_fp_add32(values[(n / 2) - 1], values[n / 2]);
+        return eve_fp_divide32(median, eve_fp_int2s32(2, FP32_FWL), FP32_FWL);
+    }
+
+    return values[n / 2];
+}
+
+/*****************************************************************************/
+
+static unsigned int stack_network(unsigned int n, uint8_t (*pairs)[2])
+{
+    unsigned int count = 0;
+
+    for (unsigned int p = 1; p < n; p <<= 1)
+    {
+        for (unsigned int k = p; k >= 1; k >>= 1)
+        {
+            for (unsigned int j = k % p; j + k < n; j += 2 * k)
+            {
+                for (unsigned int i = 0; (i < k) && (i + j + k < n); i++)
+                {
+                    if ((i + j) / (2 * p) == (i + j + k) / (2 * p))
+                    {
+                        pairs[count][0] = (uint8_t)(i + j);
+                        pairs[count][1] = (uint8_t)(i + j + k);
+                        count++;
+                    }
+                }
+            }
+        }
+    }
+
+    return count;
+}
+
+/*****************************************************************************/
+
+static int stack_medianChunk(const int32_t* const* src, uint16_t frames,
+        unsigned int p0, unsigned int n, const uint8_t (*pairs)[2],
+        unsigned int count, int32_t* dst)
+{
+    int32_t v[PREPROCESSING_STACK_NETWORK][STACK_CHUNK];
+    uint32_t nans[STACK_CHUNK];
+    int invalid = 0;
+
+    memset(nans, 0, n * sizeof(uint32_t));
+
+    for (unsigned int f = 0; f < frames; f++)
+    {
+        memcpy(v[f], src[f] + p0, n * sizeof(int32_t));
+    }
+
+    // Each compare-exchange runs on all pixels, the loops have no branches so
+    // they vectorize.
+    for (unsigned int i = 0; i < count; i++)
+    {
+        int32_t* a = v[pairs[i][0]];
+        int32_t* b = v[pairs[i][1]];
+
+        for (unsigned int x = 0; x < n; x++)
+        {
+            int32_t lo = (a[x] < b[x]) ? a[x] : b[x];
+            int32_t hi = (a[x] < b[x]) ? b[x] : a[x];
+
+            a[x] = lo;
+            b[x] = hi;
+        }
+    }
+
+    // NaN is the smallest 24.8 value, the valid values follow the NaNs.
+    for (unsigned int f = 0; f < frames; f++)
+    {
+        for (unsigned int x = 0; x < n; x++)
+        {
+            nans[x] += (uint32_t)(v[f][x] == EVE_FP32_NAN);
+        }
+    }
+
+    for (unsigned int x = 0; x < n; x++)
+    {
+        unsigned int valid = frames - nans[x];
+        unsigned int middle = nans[x] + valid / 2;
+
+        if (valid == 0)
+        {
+            dst[p0 + x] = EVE_FP32_NAN;
+        }
+        else if ((valid % 2) == 0)
+        {
+            int32_t median = eve_fp_add32(v[middle - 1][x], v[middle][x]);
+            dst[p0 + x] = eve_fp_divide32(median,
+                    eve_fp_int2s32(2, FP32_FWL), FP32_FWL);
+        }
+        else
+        {
+            dst[p0 + x] = v[middle][x];
+        }
+
+        invalid |= (dst[p0 + x] == EVE_FP32_NAN);
+    }
+
+    return invalid;
+}
+
+/*****************************************************************************/
+
+static int32_t stack_sigmaClip(int32_t* values, unsigned int n, int32_t kappa,
+        uint16_t iterations)
+{
+    double k = eve_fp_signed32ToDouble(kappa, FP32_FWL);
+    unsigned int kept = n;
+    int64_t sum = 0;
+
+    for (unsigned int i = 0; i < kept; i++)
+    {
+        sum += values[i];
+    }
+
+    for (uint16_t it = 0; it < iterations; it++)
+    {
+        double mean = (double)(sum) / kept;
+        double var = 0.0;
+
+        for (unsigned int i = 0; i < kept; i++)
+        {
+            double d = values[i] - mean;
+            var += d * d;
+        }
+
+        double limit = k * sqrt(var / kept);
+        unsigned int next = 0;
+        int64_t nextSum = 0;
+
+        // Keep the values within kappa sigma at the front.
+        for (unsigned int i = 0; i < kept; i++)
+        {
+            if (fabs(values[i] - mean) <= limit)
+            {
+                values[next] = values[i];
+                nextSum += values[i];
+                next++;
+            }
+        }
+
+        if ((next == kept) || (next == 0))
+        {
+            break;
+        }
+
+        kept = next;
+        sum = nextSum;
+    }
+
+    return stack_divide(sum, kept);
+}
+
+/*****************************************************************************/
+
+static int32_t stack_divide(int64_t sum, unsigned int n)
+{
+    if (sum >= 0)
+    {
+        return (int32_t)((sum + n / 2) / n);
+    }
+
+    return (int32_t)(-((-sum + n / 2) / n));
+}
@@ -1,8 +1,13 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "libpreprocessing/preprocessing/def.h"
 #include "libpreprocessing/preprocessing/vmem.h"
 #include "libpreprocessing/preprocessing/ana.h"
 #include "libpreprocessing/preprocessing/arith.h"
 #include "libpreprocessing/preprocessing/flatfield.h"
+#include "libpreprocessing/preprocessing/kernel.h"
+#include "libpreprocessing/preprocessing/prof.h"
+#include "libpreprocessing/preprocessing/queue.h"
 
 /* from libeve */
 #include "libeve/eve/fixed_point.h"
@@ -12,6 +17,15 @@
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
+#include <time.h>
+
+/* from posix */
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
 
 #include "fits/FITS_Interface.h"
 #include "libpreprocessing/preprocessing/def_flatfield.h"
@@ -41,6 +55,415 @@ void writeImageToFile(int32_t *img, char *fileName, int positionIndex,  int inde
 	printf("File %s written successfully!\n", file);
 }
 
+//Disp (when there is no im/disp.txt), mask of all images and const of a job
+//whose NAND holds the raw frames
+static int prepareJob(const struct preprocessing_flatfield_Job *job, int dispStatus){
+	int status = PREPROCESSING_SUCCESSFUL;
+
+	//Offsets by phase correlation when there is no im/disp.txt
+	if(dispStatus != PREPROCESSING_SUCCESSFUL){
+		PREPROCESSING_PROF_SCOPE("disp");
+		printf("Estimating disp of all images\n");
+		CHECK_STATUS(preprocessing_flatfield_getDisp(job, 0, DISP_BINNING))
+	}
+
+	//Create Mask of all images
+	{
+		PREPROCESSING_PROF_SCOPE("mask");
+		printf("Creating mask of all images\n");
+		CHECK_STATUS(preprocessing_flatfield_maskImages(job))
+	}
+
+	printf("Mask created successfully!\n");
+
+
+	//CONST
+	printf("\n------------------------------------------------\n");
+	printf("---------------Calculating Const---------------\n");
+	printf("------------------------------------------------\n");
+	{
+		PREPROCESSING_PROF_SCOPE("const");
+		CHECK_STATUS(preprocessing_flatfield_getConst(job))
+	}
+
+	printf("\n------------------------------------------------\n");
+	printf("---------Const calculates successfully----------\n");
+	printf("------------------------------------------------\n");
+	//END CONST
+
+	return status;
+}
+
+
+/*
+ * * * * * * * * *
+ * * SERVICE * * *
+ * * * * * * * * *
+ *
+ * FF24.8 --serve socket [rows cols images [checkpoint]] loads the inputs,
+ * builds the masks and const once and keeps NAND and VMEM for the jobs sent
+ * to the Unix socket, FF24.8 --submit socket request... sends one of them
+ * and prints the reply. A request is one line, the reply is its status,
+ * a message and the time it took:
+ *
+ *   flatfield file [cold|warm [loops]]  gain of the loaded inputs to file,
+ *                                       warm starts from the last gain
+ *   op name frame1 frame2 value frameDst  an operation of the command queue
+ *                                       on tmp frames 0-4 (frame 0 is the
+ *                                       last gain), value in 24.8 or the
+ *                                       window size of median (odd, 3 up
+ *                                       to the frame size)
+ *   save frame file                     a tmp frame to file
+ *   reload                              read the inputs again
+ *   quit                                stop the service
+ *
+ * The socket path must not exist or be a socket left by an earlier service.
+ * A request must arrive within SERVICE_TIMEOUT seconds in all.
+ */
+
+//Seconds a client has to send its request
+#define SERVICE_TIMEOUT 5
+
+//Operations of an op request
+static const struct {
+	const char *name;
+	int op;
+} serviceOps[] = {
+	{"add", PREPROCESSING_QUEUE_ADD_IMAGES},
+	{"subtract", PREPROCESSING_QUEUE_SUBTRACT_IMAGES},
+	{"multiply", PREPROCESSING_QUEUE_MULTIPLY_IMAGES},
+	{"divide", PREPROCESSING_QUEUE_DIVIDE_IMAGES},
+	{"addScalar", PREPROCESSING_QUEUE_ADD_SCALAR},
+	{"subtractScalar", PREPROCESSING_QUEUE_SUBTRACT_SCALAR},
+	{"multiplyScalar", PREPROCESSING_QUEUE_MULTIPLY_SCALAR},
+	{"divideScalar", PREPROCESSING_QUEUE_DIVIDE_SCALAR},
+	{"sum", PREPROCESSING_QUEUE_SUM_IMAGE},
+	{"mean", PREPROCESSING_QUEUE_MEAN_IMAGE},
+	{"under", PREPROCESSING_QUEUE_UNDER_THRESH},
+	{"equal", PREPROCESSING_QUEUE_EQUAL_THRESH},
+	{"over", PREPROCESSING_QUEUE_OVER_THRESH},
+	{"deriveX", PREPROCESSING_QUEUE_DERIVE_X},
+	{"deriveY", PREPROCESSING_QUEUE_DERIVE_Y},
+	{"median", PREPROCESSING_QUEUE_MEDIAN_FILTER}
+};
+
+//Write a VMEM frame to a file
+static int writeFrame(uint32_t sdSrc, uint32_t stdimagesize, const char *fileName){
+	int32_t *frame = (int32_t*) preprocessing_vmem_getDataAddress(sdSrc);
+	FILE *fp = fopen(fileName, "wb");
+
+	if(frame == NULL || fp == NULL || fwrite(frame, sizeof(int32_t), stdimagesize, fp) != stdimagesize){
+		if(fp != NULL) fclose(fp);
+		return PREPROCESSING_INVALID_ADDRESS;
+	}
+
+	fclose(fp);
+	return PREPROCESSING_SUCCESSFUL;
+}
+
+//Get the tmp frame of a request argument
+static int getFrame(const struct preprocessing_flatfield_Job *job, const char *arg, uint32_t *sdFrame){
+	if(arg == NULL || arg[0] < '0' || arg[0] >= '0' + PREPROCESSING_FLATFIELD_TMP_FRAMES || arg[1] != '\0'){
+		return PREPROCESSING_INVALID_NUMBER;
+	}
+
+	*sdFrame = job->sdTmp[arg[0] - '0'];
+	return PREPROCESSING_SUCCESSFUL;
+}
+
+//Parse a whole decimal number from min to max
+static int parseNumber(const char *arg, long min, long max, long *value){
+	char *end;
+
+	errno = 0;
+	*value = strtol(arg, &end, 10);
+	if(end == arg || *end != '\0' || errno == ERANGE || *value < min || *value > max){
+		return PREPROCESSING_INVALID_NUMBER;
+	}
+	return PREPROCESSING_SUCCESSFUL;
+}
+
+//Run one request, the reply message is written to message
+static int runRequest(char *request, struct preprocessing_flatfield_Job *job,
+		int32_t *NANDFLASH, int32_t **entriesOfNAND, uint32_t stdimagesize,
+		int *warm, int *running, char *message, size_t size){
+	int status = PREPROCESSING_SUCCESSFUL;
+	char *verb = strtok(request, " \t\r");
+	char *arg[5];
+
+	for(int i = 0; i < 5; i++)
+		arg[i] = strtok(NULL, " \t\r");
+
+	snprintf(message, size, "failed");
+
+	if(verb == NULL){
+		snprintf(message, size, "empty request");
+		return PREPROCESSING_INVALID_NUMBER;
+	}
+
+	if(strcmp(verb, "flatfield") == 0){
+		//Cold start from const/pixCount in NAND, warm start from the log10
+		//gain the last job left in NAND
+		uint16_t loops = job->loops;
+		int fromGain = (arg[1] != NULL && strcmp(arg[1], "warm") == 0 && *warm);
+		long requested = fromGain ? LOOPS_ITERA_UPDATE : LOOPS_ITERA;
+
+		if(arg[0] == NULL){
+			snprintf(message, size, "no gain file");
+			return PREPROCESSING_INVALID_ADDRESS;
+		}
+		if(arg[2] != NULL && parseNumber(arg[2], 1, UINT16_MAX, &requested) != PREPROCESSING_SUCCESSFUL){
+			snprintf(message, size, "loops %s is not from 1 to %u", arg[2], (unsigned int)UINT16_MAX);
+			return PREPROCESSING_INVALID_NUMBER;
+		}
+
+		job->loops = (uint16_t)requested;
+		if(fromGain){
+			status = preprocessing_flatfield_loadGain(job, job->sdTmp[0]);
+		}else{
+			status = preprocessing_flatfield_initGain(job, job->sdTmp[4], job->sdTmp[0]);
+		}
+		if(status == PREPROCESSING_SUCCESSFUL){
+			PREPROCESSING_PROF_SCOPE("itera");
+			status = preprocessing_arith_iterateFrom(job, 0,
+					job->sdTmp[1], job->sdTmp[2], job->sdTmp[3], job->sdTmp[0]);
+		}
+		job->loops = loops;
+		if(status != PREPROCESSING_SUCCESSFUL){
+			return status;
+		}
+
+		udp_storeImage(job->sdTmp[0], job->rows, job->cols, job->gain);
+		*warm = 1;
+		CHECK_STATUS(writeFrame(job->sdTmp[0], stdimagesize, arg[0]))
+		snprintf(message, size, "gain written to %s (%s start)", arg[0], fromGain ? "warm" : "cold");
+	}else if(strcmp(verb, "op") == 0){
+		//The operations run on the command queue, on the job geometry
+		struct preprocessing_queue_Command command;
+		uint32_t fence;
+		long value;
+
+		memset(&command, 0, sizeof(command));
+		command.op = -1;
+		for(unsigned int i = 0; arg[0] != NULL && i < sizeof(serviceOps) / sizeof(serviceOps[0]); i++)
+			if(strcmp(arg[0], serviceOps[i].name) == 0)
+				command.op = serviceOps[i].op;
+
+		if(command.op < 0 || arg[3] == NULL
+				|| getFrame(job, arg[1], &command.sdSrc1) != PREPROCESSING_SUCCESSFUL
+				|| getFrame(job, arg[2], &command.sdSrc2) != PREPROCESSING_SUCCESSFUL
+				|| getFrame(job, arg[4], &command.sdDst) != PREPROCESSING_SUCCESSFUL){
+			snprintf(message, size, "usage: op name frame1 frame2 value frameDst");
+			return PREPROCESSING_INVALID_NUMBER;
+		}
+		if(parseNumber(arg[3], INT32_MIN, INT32_MAX, &value) != PREPROCESSING_SUCCESSFUL){
+			snprintf(message, size, "value %s is not a 32 bit number", arg[3]);
+			return PREPROCESSING_INVALID_NUMBER;
+		}
+
+		command.rows = job->rows;
+		command.cols = job->cols;
+		command.value = (int32_t)value;
+
+		//The value of median is the window size
+		if(command.op == PREPROCESSING_QUEUE_MEDIAN_FILTER){
+			if(command.value < 3 || command.value % 2 == 0
+					|| command.value > job->rows || command.value > job->cols){
+				snprintf(message, size, "median window %s is not odd or not from 3 to %u",
+						arg[3], (unsigned int)((job->rows < job->cols) ? job->rows : job->cols));
+				return PREPROCESSING_INVALID_SIZE;
+			}
+			command.rows2 = (uint16_t)(command.value);
+		}
+		CHECK_STATUS(preprocessing_queue_submit(&command, &fence))
+		CHECK_STATUS(preprocessing_queue_wait(fence))
+		snprintf(message, size, "%s done", arg[0]);
+	}else if(strcmp(verb, "save") == 0){
+		uint32_t sdFrame;
+
+		if(getFrame(job, arg[0], &sdFrame) != PREPROCESSING_SUCCESSFUL || arg[1] == NULL){
+			snprintf(message, size, "usage: save frame file");
+			return PREPROCESSING_INVALID_NUMBER;
+		}
+
+		CHECK_STATUS(writeFrame(sdFrame, stdimagesize, arg[1]))
+		snprintf(message, size, "frame %s written to %s", arg[0], arg[1]);
+	}else if(strcmp(verb, "reload") == 0){
+		*warm = 0;
+		CHECK_STATUS(prepareJob(job, udp_createNANDFLASH(NANDFLASH, entriesOfNAND, stdimagesize, job->images)))
+		snprintf(message, size, "inputs reloaded");
+	}else if(strcmp(verb, "quit") == 0){
+		*running = 0;
+		snprintf(message, size, "stopping");
+	}else{
+		snprintf(message, size, "unknown request %s", verb);
+		return PREPROCESSING_INVALID_NUMBER;
+	}
+
+	return status;
+}
+
+//Serve the jobs sent to a Unix socket until a quit request
+static int serveJobs(const char *socketPath, struct preprocessing_flatfield_Job *job,
+		int32_t *NANDFLASH, int32_t **entriesOfNAND, uint32_t stdimagesize){
+	struct sockaddr_un address;
+	struct stat info;
+	int warm = 0;
+	int running = 1;
+	int status = PREPROCESSING_SUCCESSFUL;
+	int server = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if(server < 0 || strlen(socketPath) >= sizeof(address.sun_path)){
+		printf("Could not serve on %s\n", socketPath);
+		if(server >= 0) close(server);
+		return PREPROCESSING_INVALID_ADDRESS;
+	}
+	strcpy(address.sun_path, socketPath);
+
+	//A socket left by a service that did not quit is replaced, anything
+	//else at the path is kept
+	if(lstat(socketPath, &info) == 0){
+		if(!S_ISSOCK(info.st_mode)){
+			printf("Could not serve on %s: not a socket\n", socketPath);
+			close(server);
+			return PREPROCESSING_INVALID_ADDRESS;
+		}
+		unlink(socketPath);
+	}
+	if(bind(server, (struct sockaddr*) &address, sizeof(address)) != 0 || listen(server, 8) != 0){
+		printf("Could not serve on %s\n", socketPath);
+		close(server);
+		return PREPROCESSING_INVALID_ADDRESS;
+	}
+
+	if(preprocessing_queue_start() != PREPROCESSING_SUCCESSFUL){
+		close(server);
+		unlink(socketPath);
+		return PREPROCESSING_NO_MEMORY;
+	}
+
+	printf("Serving jobs on %s\n", socketPath);
+
+	while(running){
+		char request[1024];
+		char message[1200];
+		char reply[1300];
+		struct timespec start, end;
+		size_t n = 0;
+		char c;
+
+		int client = accept(server, NULL, NULL);
+		if(client < 0){
+			if(errno == EINTR || errno == ECONNABORTED)
+				continue;
+
+			//Out of descriptors or memory: wait for clients to go away
+			if(errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM){
+				struct timespec backOff = {0, 100000000};
+
+				printf("Could not accept a client: %s\n", strerror(errno));
+				nanosleep(&backOff, NULL);
+				continue;
+			}
+
+			printf("Could not accept a client: %s\n", strerror(errno));
+			status = PREPROCESSING_INVALID_ADDRESS;
+			break;
+		}
+
+		//One line per request, a client that does not send all of it by
+		//the deadline is dropped
+		struct timespec deadline;
+		ssize_t got = 0;
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec += SERVICE_TIMEOUT;
+		while(n + 1 < sizeof(request)){
+			struct pollfd ready = {client, POLLIN, 0};
+			struct timespec now;
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			long left = (long)(deadline.tv_sec - now.tv_sec) * 1000 + (deadline.tv_nsec - now.tv_nsec) / 1000000;
+			int polled = (left > 0) ? poll(&ready, 1, (int)left) : 0;
+
+			if(polled < 0 && errno == EINTR)
+				continue;
+			if(polled <= 0){
+				if(polled == 0) errno = ETIMEDOUT;
+				got = -1;
+				break;
+			}
+			if((got = read(client, &c, 1)) != 1 || c == '\n')
+				break;
+			request[n++] = c;
+		}
+		request[n] = '\0';
+
+		if(got < 0){
+			printf("Could not read the request: %s\n", strerror(errno));
+			close(client);
+			continue;
+		}
+
+		printf("Request: %s\n", request);
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		int requestStatus = runRequest(request, job, NANDFLASH, entriesOfNAND, stdimagesize,
+				&warm, &running, message, sizeof(message));
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		snprintf(reply, sizeof(reply), "%d %s in %.1f ms\n", requestStatus, message,
+				(double)(end.tv_sec - start.tv_sec) * 1e3 + (double)(end.tv_nsec - start.tv_nsec) * 1e-6);
+		printf("Reply: %s", reply);
+		send(client, reply, strlen(reply), MSG_NOSIGNAL);
+		close(client);
+	}
+
+	preprocessing_queue_stop();
+	close(server);
+	unlink(socketPath);
+
+	return status;
+}
+
+//Send one request to a service and print its reply, the exit code is 0 if
+//the request succeeded
+static int submitJob(int argc, char *argv[]){
+	struct sockaddr_un address;
+	char request[1024] = "";
+	char reply[1300];
+	ssize_t n;
+	size_t length = 0;
+	int client = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if(client < 0 || strlen(argv[0]) >= sizeof(address.sun_path)){
+		printf("Could not connect to %s\n", argv[0]);
+		return 2;
+	}
+	strcpy(address.sun_path, argv[0]);
+
+	for(int i = 1; i < argc; i++){
+		snprintf(request + strlen(request), sizeof(request) - strlen(request), "%s%s", (i > 1) ? " " : "", argv[i]);
+	}
+	strncat(request, "\n", sizeof(request) - strlen(request) - 1);
+
+	if(connect(client, (struct sockaddr*) &address, sizeof(address)) != 0){
+		printf("Could not connect to %s\n", argv[0]);
+		close(client);
+		return 2;
+	}
+
+	send(client, request, strlen(request), MSG_NOSIGNAL);
+	while(length + 1 < sizeof(reply) && (n = read(client, reply + length, sizeof(reply) - length - 1)) > 0)
+		length += (size_t)n;
+	reply[length] = '\0';
+	close(client);
+
+	printf("%s", reply);
+	return (length > 0 && atoi(reply) == PREPROCESSING_SUCCESSFUL) ? 0 : 1;
+}
+
 
 
 
@@ -50,7 +473,7 @@ void writeImageToFile(int32_t *img, char *fileName, int positionIndex,  int inde
  * * * * * * *
  */
 
-int main()
+int main(int argc, char *argv[])
 {
 
 	int32_t *SDRAM;
@@ -61,19 +484,64 @@ int main()
 	int32_t *tmp4;
 	int32_t *tmp5;
 
-	uint32_t stdimagesize=ROWS*COLS;
-	uint32_t stdDispSize = DISP_ROWS*DISP_COLS;
+	//Client of a service: FF24.8 --submit socket request...
+	if(argc >= 4 && strcmp(argv[1], "--submit") == 0){
+		return submitJob(argc - 2, argv + 2);
+	}
+
+	//Service: FF24.8 --serve socket, followed by the arguments of a run
+	const char *socketPath = NULL;
+	if(argc >= 3 && strcmp(argv[1], "--serve") == 0){
+		socketPath = argv[2];
+		argc -= 2;
+		argv += 2;
+	}
+
+	//Job geometry: FF24.8 [rows cols images [checkpoint [previousGain]]],
+	//defaults from def_flatfield.h, an empty checkpoint name disables checkpoints
+	uint16_t rows = ROWS;
+	uint16_t cols = COLS;
+	uint16_t images = NUMBER_OF_IMAGES;
+	if(argc >= 4){
+		rows = (uint16_t)atoi(argv[1]);
+		cols = (uint16_t)atoi(argv[2]);
+		images = (uint16_t)atoi(argv[3]);
+	}
+
+	uint32_t stdimagesize=(uint32_t)rows*cols;
+	uint32_t stdDispSize = (uint32_t)images*DISP_COLS;
 	uint32_t numberOfMemoryInput = 16;
 
 	int status = PREPROCESSING_SUCCESSFUL;
 
 	printf ("Start!\n");
 
+	//Profiling: the counters are always on, PREPROCESSING_PROF=trace records
+	//a trace too, PREPROCESSING_PROF=roofline ranks the kernels by their
+	//distance from the roofline of the host and PREPROCESSING_PROF=off
+	//disables all of them
+	const char *prof = getenv("PREPROCESSING_PROF");
+	int profMode = PREPROCESSING_PROF_COUNTERS;
+	int profRoofline = (prof != NULL && strcmp(prof, "roofline") == 0);
+	if(prof != NULL && strcmp(prof, "off") == 0){
+		profMode = PREPROCESSING_PROF_OFF;
+	}else if(prof != NULL && strcmp(prof, "trace") == 0){
+		profMode = PREPROCESSING_PROF_TRACE;
+	}
+	preprocessing_prof_setMode(profMode);
+
+	//Kernel backend: the best one of the processor, PREPROCESSING_BACKEND forces one
+	printf("Kernel backend: %s\n", preprocessing_kernel_backend()->name);
+
 	/*
 	 * Memory allocation
 	 * Corresponds to part of copying images to SDRAM, total size of virtual RAM
 	 */
-	SDRAM = (int32_t*) malloc(numberOfMemoryInput*stdimagesize*sizeof(int32_t));
+	SDRAM = (int32_t*) malloc((size_t)numberOfMemoryInput*stdimagesize*sizeof(int32_t));
+	if(SDRAM == NULL){
+		printf("Could not allocate the virtual RAM\n");
+		return PREPROCESSING_INVALID_ADDRESS;
+	}
 
 	printf("Load images in Virtual RAM!\n");
 
@@ -127,90 +595,106 @@ int main()
 
 	//NAND FLASH Memory
 	int32_t *NANDFLASH;
-	int32_t numberOfEntriesNAND = 128;
+	int32_t **entriesOfNAND;
+	int32_t numberOfEntriesNAND = NAND_ENTRIES(images);
 	entriesOfNAND = (int32_t **) malloc(numberOfEntriesNAND*sizeof(int32_t *));
-	NANDFLASH = (int32_t*) malloc(numberOfEntriesNAND*stdimagesize*sizeof(int32_t));
+	NANDFLASH = (int32_t*) malloc((size_t)numberOfEntriesNAND*stdimagesize*sizeof(int32_t));
+	//The pair planes grow with the square of the images
+	if(entriesOfNAND == NULL || NANDFLASH == NULL){
+		printf("Could not allocate %d NAND entries\n", (int)numberOfEntriesNAND);
+		free(entriesOfNAND);
+		free(NANDFLASH);
+		free(SDRAM);
+		return PREPROCESSING_INVALID_ADDRESS;
+	}
 
-	udp_createNANDFLASH(NANDFLASH, entriesOfNAND, stdimagesize, NUMBER_OF_IMAGES);
+	int dispStatus = udp_createNANDFLASH(NANDFLASH, entriesOfNAND, stdimagesize, images);
 	//END NAND FLASH Memory
 
-	printf("Read Disp from NAND to VRAM\n");
-	udp_loadImage(entriesOfNAND[DISP_INDEX], DISP_ROWS, DISP_COLS, dispSdram);
-
-	//Create Mask of all images
-	printf("Creating mask of all images\n");
-	udp_loadImage(entriesOfNAND[MASK_INDEX], ROWS, COLS, tmp1Sdram);
-	for(int i=0; i < NUMBER_OF_IMAGES; i++){
-		udp_loadImage(entriesOfNAND[i], ROWS, COLS, tmp2Sdram);
-		CHECK_STATUS(udp_maskImagesLog10(tmp2Sdram, ROWS, COLS, i, IMIN, IMAX, tmp1Sdram))
-		udp_storeImage(tmp2Sdram, ROWS, COLS, entriesOfNAND[i]);
+	//Flatfield job
+	struct preprocessing_flatfield_Job job;
+	preprocessing_flatfield_initJob(&job, entriesOfNAND, rows, cols, images, images);
+	job.sdDisp = dispSdram;
+	job.sdTmp[0] = tmp1Sdram;
+	job.sdTmp[1] = tmp2Sdram;
+	job.sdTmp[2] = tmp3Sdram;
+	job.sdTmp[3] = tmp4Sdram;
+	job.sdTmp[4] = tmp5Sdram;
+	if(argc >= 5 && argv[4][0] != '\0'){
+		job.checkpoint = argv[4];
 	}
 
-	udp_storeImage(tmp1Sdram, ROWS, COLS, entriesOfNAND[MASK_TMP_INDEX]);
-
-	printf("Mask created successfully!\n");
-
-
-	//CONST
-	printf("\n------------------------------------------------\n");
-	printf("---------------Calculating Const---------------\n");
-	printf("------------------------------------------------\n");
-	unsigned int sizeDisp = DISP_ROWS * DISP_COLS;
-	unsigned int piq = 0;
-	unsigned int pir = 0;
-
-	for(unsigned int iq = 1; iq < NUMBER_OF_IMAGES; iq++) {
-		printf("--------------------------\n");
-		printf("Calculate image %d with:\n", iq);
-		printf("--------------------------\n");
-
-			for(unsigned int ir = 0; ir < iq; ir++) {
-				printf("\t -Image %d\n", ir);
+	//Disp, mask and const
+	CHECK_STATUS(prepareJob(&job, dispStatus))
 
-				//Calculate point
-				piq = iq*(unsigned int)DISP_COLS;
-				pir = ir*(unsigned int)DISP_COLS;
-
-				// Check for valid pointer position.
-				PREPROCESSING_DEF_CHECK_POINTER(disp, piq, sizeDisp);
-				PREPROCESSING_DEF_CHECK_POINTER(disp, piq+1, sizeDisp);
-				PREPROCESSING_DEF_CHECK_POINTER(disp, pir, sizeDisp);
-				PREPROCESSING_DEF_CHECK_POINTER(disp, pir+1, sizeDisp);
-
-				//Calculate Disp
-				int dy = (int)eve_fp_subtract32(disp[piq], disp[pir])/FP32_BINARY_TRUE;
-				int dx = (int)eve_fp_subtract32(disp[piq + 1], disp[pir + 1])/FP32_BINARY_TRUE;
+	//The service keeps NAND and VMEM for its jobs
+	if(socketPath != NULL){
+		status = serveJobs(socketPath, &job, NANDFLASH, entriesOfNAND, stdimagesize);
+		printf("Done!\n");
+		return status;
+	}
 
-				CHECK_STATUS(preprocessing_arith_doGetConst(tmp1Sdram, tmp2Sdram, tmp3Sdram, ROWS, COLS, dx, dy, iq, ir, tmp4Sdram, tmp5Sdram) )
+	//Start gain: checkpoint of an interrupted run, previous gain or const/pixCount
+	uint16_t firstLoop = 0;
+	if(job.checkpoint == NULL || preprocessing_flatfield_resume(&job, tmp1Sdram, &firstLoop) != PREPROCESSING_SUCCESSFUL){
+		firstLoop = 0;
+		if(argc >= 6){
+			int32_t *previousGain = (int32_t*) malloc(stdimagesize*sizeof(int32_t));
+			FILE *fp = fopen(argv[5], "rb");
+			if(previousGain == NULL || fp == NULL || fread(previousGain, sizeof(int32_t), stdimagesize, fp) != stdimagesize){
+				printf("Could not read previous gain %s\n", argv[5]);
+				if(fp != NULL) fclose(fp);
+				free(previousGain);
+				return PREPROCESSING_INVALID_ADDRESS;
 			}
+			fclose(fp);
+			status = preprocessing_flatfield_seedGain(&job, previousGain, tmp1Sdram);
+			free(previousGain);
+			CHECK_STATUS(status)
+			job.loops = LOOPS_ITERA_UPDATE;
+		}else{
+			CHECK_STATUS(preprocessing_arith_addScalar(tmp4Sdram, rows, cols, 0, tmp1Sdram))
+			CHECK_STATUS(udp_normalize(tmp1Sdram, tmp5Sdram, rows, cols, tmp1Sdram))
+		}
 	}
 
-	udp_storeImage(tmp4Sdram, ROWS, COLS, entriesOfNAND[CONS_INDEX]);
-	udp_storeImage(tmp5Sdram, ROWS, COLS, entriesOfNAND[PIXCOUNT_INDEX]);
-
-	printf("\n------------------------------------------------\n");
-	printf("---------Const calculates successfully----------\n");
-	printf("------------------------------------------------\n");
-	//END CONST
-
-	CHECK_STATUS(preprocessing_arith_addScalar(tmp4Sdram, ROWS, COLS, 0, tmp1Sdram))
-	CHECK_STATUS(udp_normalize(tmp1Sdram, tmp5Sdram, ROWS, COLS, tmp1Sdram))
-
 	//ITERA
 	printf("\n------------------------------------------------\n");
 	printf("-----------------Calculate Itera----------------\n");
 	printf("------------------------------------------------\n");
-	CHECK_STATUS(preprocessing_arith_iterate(dispSdram,
-			tmp2Sdram, tmp3Sdram, tmp4Sdram,
-			ROWS, COLS, LOOPS_ITERA, tmp1Sdram))
+	{
+		PREPROCESSING_PROF_SCOPE("itera");
+		CHECK_STATUS(preprocessing_arith_iterateFrom(&job, firstLoop,
+				tmp2Sdram, tmp3Sdram, tmp4Sdram, tmp1Sdram))
+	}
 	printf("\n------------------------------------------------\n");
 	printf("----------Itera calculated successfully----------\n");
 	printf("------------------------------------------------\n");
 	//END ITERA
 
-	udp_storeImage(tmp1Sdram, ROWS, COLS, entriesOfNAND[GAIN_INDEX]);
+	udp_storeImage(tmp1Sdram, rows, cols, job.gain);
 	writeImageToFile(tmp1, "im/Gain.fits", -1, 0, stdimagesize );
 
+	if(profMode != PREPROCESSING_PROF_OFF){
+		FILE *fp = fopen("im/Profile.json", "w");
+		preprocessing_prof_dumpJson(fp);
+		if(fp != NULL) fclose(fp);
+	}
+	if(profMode == PREPROCESSING_PROF_TRACE){
+		FILE *fp = fopen("im/Trace.json", "w");
+		preprocessing_prof_dumpTrace(fp);
+		if(fp != NULL) fclose(fp);
+	}
+	if(profRoofline){
+		struct preprocessing_prof_Roof roof;
+		printf("Measuring the roofline of the host\n");
+		if(preprocessing_prof_measureRoof(&roof) == PREPROCESSING_SUCCESSFUL){
+			FILE *fp = fopen("im/Roofline.json", "w");
+			preprocessing_prof_dumpRoofline(fp, &roof);
+			if(fp != NULL) fclose(fp);
+		}
+	}
+
 	printf("Done!\n");
 	return 1;
 
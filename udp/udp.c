@@ -6,86 +6,67 @@
  */
 
 #include "udp.h"
+#include "../libpreprocessing/preprocessing/kernel.h"
+#include "../libpreprocessing/preprocessing/prof.h"
 
 
 
 /* PUBLIC IMPLEMENTATION *****************************************************/
 
-void udp_createNANDFLASH(int32_t *NANDFLASH, int32_t **entriesOfNAND,
+int udp_createNANDFLASH(int32_t *NANDFLASH, int32_t **entriesOfNAND,
 		int stdimagesize, int numberOfImages){
 
+	PREPROCESSING_PROF_KERNEL(0,
+			(uint64_t)(numberOfImages + 1) * stdimagesize * sizeof(int32_t),
+			(uint64_t)(numberOfImages + 1) * stdimagesize, 0);
+
 	int nkeys;
 	char **header;
 	int *inputimg = (int*) malloc((uint32_t)stdimagesize*sizeof(int));			//Only one image
 
+	//	1.) Map NAND Flash entries: frames, mask, maskTmp, const, gain, pixCount, disp,
+	//	logGain, pair shifts and pair contributions
+	for(int i = 0; i < NAND_ENTRIES(numberOfImages); i++)
+		entriesOfNAND[i] = NANDFLASH + (size_t)i*(size_t)stdimagesize;
+
 	printf("Load images in NAND FLASH!\n");
-	char fileName[13] = "im/im00.fits";
-	for(unsigned int i = 0; i < numberOfImages; i++) {
-		fileName[6] = 48 + i;
+	char fileName[24];
+	for(int i = 0; i < numberOfImages; i++) {
+		snprintf(fileName, sizeof(fileName), "im/im%02d.fits", i);
 		printf("%s\n", fileName);
 		FITS_getImage(fileName, inputimg, stdimagesize, &nkeys, &header);
 		for (int j = 0; j < stdimagesize; j++)
-			NANDFLASH[i*stdimagesize + j]=(int32_t)eve_fp_int2s32(inputimg[j], FP32_FWL );
+			entriesOfNAND[i][j]=(int32_t)eve_fp_int2s32(inputimg[j], FP32_FWL );
 	}
 
 	char maskFileName[13] = "im/mask.fits";
 	printf("%s\n", maskFileName);
 	FITS_getImage(maskFileName, inputimg, stdimagesize, &nkeys, &header);
 	for (int j = 0; j < stdimagesize; j++)
-		NANDFLASH[MASK_INDEX*stdimagesize + j]=(int32_t)eve_fp_int2s32(inputimg[j], FP32_FWL );
-
-
-	//	1.) Load image data to NAND Flash:
-	uint32_t 	img1Nand = 0;
-	uint32_t 	img2Nand = img1Nand + stdimagesize;
-	uint32_t	img3Nand = img2Nand + stdimagesize;
-	uint32_t	img4Nand = img3Nand + stdimagesize;
-	uint32_t	img5Nand = img4Nand + stdimagesize;
-	uint32_t	img6Nand = img5Nand + stdimagesize;
-	uint32_t	img7Nand = img6Nand + stdimagesize;
-	uint32_t	img8Nand = img7Nand + stdimagesize;
-	uint32_t	img9Nand = img8Nand + stdimagesize;
-	uint32_t	maskNand = img9Nand + stdimagesize;
-	uint32_t	maskTmp	 = maskNand + stdimagesize;
-	uint32_t	cons	 = maskTmp  + stdimagesize;
-	uint32_t	gain	 = cons 	+ stdimagesize;
-	uint32_t	pixCount = gain 	+ stdimagesize;
-	uint32_t	dispNand = pixCount + stdimagesize;
-
-	entriesOfNAND[0]  = (NANDFLASH+img1Nand);
-	entriesOfNAND[1]  = (NANDFLASH+img2Nand);
-	entriesOfNAND[2]  = (NANDFLASH+img3Nand);
-	entriesOfNAND[3]  = (NANDFLASH+img4Nand);
-	entriesOfNAND[4]  = (NANDFLASH+img5Nand);
-	entriesOfNAND[5]  = (NANDFLASH+img6Nand);
-	entriesOfNAND[6]  = (NANDFLASH+img7Nand);
-	entriesOfNAND[7]  = (NANDFLASH+img8Nand);
-	entriesOfNAND[8]  = (NANDFLASH+img9Nand);
-	entriesOfNAND[9]  = (NANDFLASH+maskNand);
-	entriesOfNAND[10] = (NANDFLASH+maskTmp);
-	entriesOfNAND[11] = (NANDFLASH+cons);
-	entriesOfNAND[12] = (NANDFLASH+gain);
-	entriesOfNAND[13] = (NANDFLASH+pixCount);
-	entriesOfNAND[14] = (NANDFLASH+dispNand);
+		entriesOfNAND[NAND_MASK_INDEX(numberOfImages)][j]=(int32_t)eve_fp_int2s32(inputimg[j], FP32_FWL );
+
+	free(inputimg);
 
 	//READ DISP
 	int MAXCHAR = 1000;
 	FILE *fp2;
 	char str[MAXCHAR];
 	char* filename = "im/disp.txt";
+	int32_t *disp = entriesOfNAND[NAND_DISP_INDEX(numberOfImages)];
 
+	//Without a disp table the offsets have to be estimated from the frames
 	fp2 = fopen(filename, "r");
 	if (fp2 == NULL){
-		printf("Could not open file %s",filename);
-		return;
+		printf("Could not open file %s\n",filename);
+		return PREPROCESSING_INVALID_ADDRESS;
 	}
 
 	int index=0;
 	while (fgets(str, MAXCHAR, fp2) != NULL){
 		char *ch;
 		ch = strtok(str, " ");
-		while (ch != NULL) {
-			NANDFLASH[DISP_INDEX*stdimagesize + index]=(int32_t)eve_fp_int2s32(atoi(ch), FP32_FWL );
+		while (ch != NULL && index < numberOfImages*DISP_COLS) {
+			disp[index]=(int32_t)eve_fp_int2s32(atoi(ch), FP32_FWL );
 			index++;
 			ch = strtok(NULL, " ,");
 		}
@@ -93,6 +74,8 @@ void udp_createNANDFLASH(int32_t *NANDFLASH, int32_t **entriesOfNAND,
 	fclose(fp2);
 
 	printf("Images loaded successfully!\n");
+
+	return PREPROCESSING_SUCCESSFUL;
 }
 
 /*****************************************************************************/
@@ -100,6 +83,10 @@ void udp_createNANDFLASH(int32_t *NANDFLASH, int32_t **entriesOfNAND,
 int udp_loadImage(int32_t *nandSrc, uint16_t rows, uint16_t cols,
         uint32_t sdDst)
 {
+	PREPROCESSING_PROF_KERNEL(PREPROCESSING_PROF_FRAME(rows, cols),
+			PREPROCESSING_PROF_FRAME(rows, cols),
+			(uint64_t)(rows) * cols, 0);
+
 	int status = PREPROCESSING_SUCCESSFUL;
 	unsigned int size = (unsigned int)(rows) * cols;
 	unsigned int p = 0;
@@ -138,6 +125,10 @@ int udp_loadImage(int32_t *nandSrc, uint16_t rows, uint16_t cols,
 int udp_storeImage(uint32_t sdSrc, uint16_t rows, uint16_t cols,
         int32_t *nandDst)
 {
+	PREPROCESSING_PROF_KERNEL(PREPROCESSING_PROF_FRAME(rows, cols),
+			PREPROCESSING_PROF_FRAME(rows, cols),
+			(uint64_t)(rows) * cols, 0);
+
 	int status = PREPROCESSING_SUCCESSFUL;
 	unsigned int size = (unsigned int)(rows) * cols;
 	unsigned int p = 0;
@@ -176,9 +167,12 @@ int udp_storeImage(uint32_t sdSrc, uint16_t rows, uint16_t cols,
 
 int udp_getMask(uint32_t sdSrc, uint16_t rows, uint16_t cols, uint16_t index, uint32_t sdDst)
 {
+	PREPROCESSING_PROF_KERNEL(PREPROCESSING_PROF_FRAME(rows, cols),
+			PREPROCESSING_PROF_FRAME(rows, cols),
+			(uint64_t)(rows) * cols, 2);
+
     int status = PREPROCESSING_SUCCESSFUL;
     unsigned int size = (unsigned int)(rows) * (unsigned int)(cols);
-    unsigned int p = 0;
 
     const int32_t* src = preprocessing_vmem_getDataAddress(sdSrc);
     int32_t* dst = preprocessing_vmem_getDataAddress(sdDst);
@@ -190,24 +184,14 @@ int udp_getMask(uint32_t sdSrc, uint16_t rows, uint16_t cols, uint16_t index, ui
         return PREPROCESSING_INVALID_SIZE;
     }
 
+    // Check for valid pointer position.
+    PREPROCESSING_DEF_CHECK_POINTER(src, 0, size)
+    PREPROCESSING_DEF_CHECK_POINTER(dst, 0, size)
+
     // Process.
-    for (unsigned int r = 0; r < (unsigned int)rows; r++)
+    if (preprocessing_kernel_backend()->mask(src, index, dst, size))
     {
-        for (unsigned int c = 0; c < (unsigned int)cols; c++)
-        {
-            p = r * (unsigned int)(cols) + c;
-
-            // Check for valid pointer position.
-            PREPROCESSING_DEF_CHECK_POINTER(src, p, size);
-            PREPROCESSING_DEF_CHECK_POINTER(dst, p, size);
-
-			dst[p] = (src[p] & (FP32_BINARY_TRUE << index)) >> index;
-
-            if (dst[p] == EVE_FP32_NAN)
-            {
-                status = PREPROCESSING_INVALID_NUMBER;
-            }
-        }
+        status = PREPROCESSING_INVALID_NUMBER;
     }
 
     return status;
@@ -215,6 +199,10 @@ int udp_getMask(uint32_t sdSrc, uint16_t rows, uint16_t cols, uint16_t index, ui
 
 int udp_maskImagesLog10(uint32_t sdSrc,
             uint16_t rows, uint16_t cols, uint16_t index, uint32_t iMin, uint32_t iMax, uint32_t sdDst){
+	PREPROCESSING_PROF_KERNEL(2 * PREPROCESSING_PROF_FRAME(rows, cols),
+			2 * PREPROCESSING_PROF_FRAME(rows, cols),
+			(uint64_t)(rows) * cols, 4);
+
     int status = PREPROCESSING_SUCCESSFUL;
     unsigned int size = (unsigned int)(rows) * (unsigned int)(cols);
     unsigned int p = 0;
@@ -270,19 +258,77 @@ int udp_maskImagesLog10(uint32_t sdSrc,
     return status;
 }
 
-int udp_createROI(uint32_t sdSrc, uint16_t rows, uint16_t cols,
+int udp_getOverlap(uint16_t rows, uint16_t cols, int16_t dx, int16_t dy,
+		struct udp_Overlap *overlap){
+
+	// A shift of a full frame or more leaves no overlap.
+	if ((abs(dx) >= (int)cols) || (abs(dy) >= (int)rows)){
+		printf("Shift %d, %d leaves no overlap in %u x %u frame.\n",
+				(int)dx, (int)dy, (unsigned int)rows, (unsigned int)cols);
+		return PREPROCESSING_INVALID_SIZE;
+	}
+
+	//Calculate window edges
+	overlap->jyl = (unsigned int)udp_max16(0, -dy);				//Row
+	overlap->jyh = (unsigned int)(udp_min16(0, -dy) + rows); 	//Row
+	overlap->jxl = (unsigned int)udp_max16(0, -dx); 			//Column
+	overlap->jxh = (unsigned int)(udp_min16(0, -dx) + cols); 	//Column
+	overlap->rows = overlap->jyh - overlap->jyl;
+	overlap->cols = overlap->jxh - overlap->jxl;
+
+	return PREPROCESSING_SUCCESSFUL;
+}
+
+int udp_loadROI(const int32_t *nandSrc, uint16_t rows, uint16_t cols,
 		   int16_t dx, int16_t dy, uint32_t sdDst){
 
+	PREPROCESSING_PROF_KERNEL(PREPROCESSING_PROF_FRAME(rows, cols),
+			PREPROCESSING_PROF_FRAME(rows, cols),
+			(uint64_t)(rows) * cols, 0);
+
 	int status = PREPROCESSING_SUCCESSFUL;
-	unsigned int size = (unsigned int)(rows) * (unsigned int)(cols);
-	unsigned int p = 0;
-	unsigned int roiPoint = 0;
+	struct udp_Overlap w;
 
-	//Calculate window edges
-	unsigned int jyl = (unsigned int)udp_max16(0, -dy);				//Row
-	unsigned int jyh = (unsigned int)(udp_min16(0, -dy) + rows); 	//Row
-	unsigned int jxl = (unsigned int)udp_max16(0, -dx); 			//Column
-	unsigned int jxh = (unsigned int)(udp_min16(0, -dx) + cols); 	//Column
+	int32_t* dst = preprocessing_vmem_getDataAddress(sdDst);
+
+	// Check whether given rows and columns are in a valid range.
+	if (!preprocessing_vmem_isProcessingSizeValid(sdDst, rows, cols)){
+		return PREPROCESSING_INVALID_SIZE;
+	}
+
+	if ((nandSrc == 0) || (dst == 0)){
+		return PREPROCESSING_INVALID_ADDRESS;
+	}
+
+	CHECK_STATUS(udp_getOverlap(rows, cols, dx, dy, &w))
+
+	//Copy ROI row by row
+	for(unsigned int y = 0; y < w.rows; y++){
+		const int32_t* s = nandSrc + (y + w.jyl) * (unsigned int)cols + w.jxl;
+		int32_t* d = dst + y * (unsigned int)cols;
+
+		for(unsigned int x = 0; x < w.cols; x++){
+			d[x] = s[x];
+
+			if (d[x] == EVE_FP32_NAN)
+			{
+				status = PREPROCESSING_INVALID_NUMBER;
+			}
+		}
+	}
+
+	return status;
+}
+
+int udp_createROI(uint32_t sdSrc, uint16_t rows, uint16_t cols,
+		   int16_t dx, int16_t dy, uint32_t sdDst){
+
+	PREPROCESSING_PROF_KERNEL(PREPROCESSING_PROF_FRAME(rows, cols),
+			PREPROCESSING_PROF_FRAME(rows, cols),
+			(uint64_t)(rows) * cols, 0);
+
+	int status = PREPROCESSING_SUCCESSFUL;
+	struct udp_Overlap w;
 
 	const int32_t* src = preprocessing_vmem_getDataAddress(sdSrc);
 	int32_t* dst = preprocessing_vmem_getDataAddress(sdDst);
@@ -294,20 +340,18 @@ int udp_createROI(uint32_t sdSrc, uint16_t rows, uint16_t cols,
 		return PREPROCESSING_INVALID_SIZE;
 	}
 
-	//Calculate ROI
-	for(unsigned int y=jyl; y < jyh; y++){
-		for(unsigned int x=jxl; x < jxh; x++){
+	CHECK_STATUS(udp_getOverlap(rows, cols, dx, dy, &w))
 
-			p = y * (unsigned int)cols + x;
-			roiPoint = (y-jyl) * (unsigned int)cols + (x-jxl);
+	//Calculate ROI row by row. The ROI moves towards the origin, so it can be
+	//created in place.
+	for(unsigned int y = 0; y < w.rows; y++){
+		const int32_t* s = src + (y + w.jyl) * (unsigned int)cols + w.jxl;
+		int32_t* d = dst + y * (unsigned int)cols;
 
-			// Check for valid pointer position.
-			PREPROCESSING_DEF_CHECK_POINTER(src, p, size);
-			PREPROCESSING_DEF_CHECK_POINTER(dst, roiPoint, size);
+		for(unsigned int x = 0; x < w.cols; x++){
+			d[x] = s[x];
 
-			dst[roiPoint] = src[p];
-
-			if (dst[roiPoint] == EVE_FP32_NAN)
+			if (d[x] == EVE_FP32_NAN)
 			{
 				status = PREPROCESSING_INVALID_NUMBER;
 			}
@@ -320,14 +364,12 @@ int udp_createROI(uint32_t sdSrc, uint16_t rows, uint16_t cols,
 int udp_addROI(uint32_t sdSrc1, uint32_t sdSrc2, uint16_t rows, uint16_t cols,
 		   int16_t dx, int16_t dy, uint32_t sdDst){
 
-	int status = PREPROCESSING_SUCCESSFUL;
-	unsigned int size = (unsigned int)(rows) * (unsigned int)(cols);
-	unsigned int p = 0;
-	unsigned int roiPoint = 0;
+	PREPROCESSING_PROF_KERNEL(2 * PREPROCESSING_PROF_FRAME(rows, cols),
+			PREPROCESSING_PROF_FRAME(rows, cols),
+			(uint64_t)(rows) * cols, 1);
 
-	// Calculate window edges
-	unsigned int jyl = (unsigned int)udp_max16(0, -dy), jyh = (unsigned int)(udp_min16(0, -dy) + rows); 	// ROWS
-	unsigned int jxl = (unsigned int)udp_max16(0, -dx), jxh = (unsigned int)(udp_min16(0, -dx) + cols); 	// COLUMNS
+	int status = PREPROCESSING_SUCCESSFUL;
+	struct udp_Overlap w;
 
 	const int32_t* src1 = preprocessing_vmem_getDataAddress(sdSrc1);
 	const int32_t* src2 = preprocessing_vmem_getDataAddress(sdSrc2);
@@ -341,41 +383,71 @@ int udp_addROI(uint32_t sdSrc1, uint32_t sdSrc2, uint16_t rows, uint16_t cols,
 		return PREPROCESSING_INVALID_SIZE;
 	}
 
+	CHECK_STATUS(udp_getOverlap(rows, cols, dx, dy, &w))
+
 	//Calculate sum
-	for(int y=jyl; y < jyh; y++){
-		for(int x=jxl; x < jxh; x++){
+	for(unsigned int y = 0; y < w.rows; y++){
+		unsigned int p = (y + w.jyl) * (unsigned int)cols + w.jxl;
+		const int32_t* s1 = src1 + p;
+		const int32_t* s2 = src2 + y * (unsigned int)cols;
+		int32_t* d = dst + p;
+
+		if (preprocessing_kernel_backend()->add(s1, s2, d, w.cols)){
+			status = PREPROCESSING_INVALID_NUMBER;
+		}
+	}
+
+	return status;
+}
 
-			p = y * (unsigned int)(cols) + x;
-			roiPoint = (y-jyl)*(unsigned int)(cols) + (x-jxl);
+int udp_substractROI(uint32_t sdSrc1, uint32_t sdSrc2, uint16_t rows, uint16_t cols,
+		   int16_t dx, int16_t dy, uint32_t sdDst){
 
-			// Check for valid pointer position.
-			PREPROCESSING_DEF_CHECK_POINTER(src1, p, size);
-			PREPROCESSING_DEF_CHECK_POINTER(src2, roiPoint, size);
-			PREPROCESSING_DEF_CHECK_POINTER(dst, p, size);
+	PREPROCESSING_PROF_KERNEL(2 * PREPROCESSING_PROF_FRAME(rows, cols),
+			PREPROCESSING_PROF_FRAME(rows, cols),
+			(uint64_t)(rows) * cols, 1);
 
-			dst[p] = eve_fp_add32(src1[p], src2[roiPoint]);
+	int status = PREPROCESSING_SUCCESSFUL;
+	struct udp_Overlap w;
 
-			if (dst[p] == EVE_FP32_NAN)
-			{
-				status = PREPROCESSING_INVALID_NUMBER;
-			}
+	const int32_t* src1 = preprocessing_vmem_getDataAddress(sdSrc1);
+	const int32_t* src2 = preprocessing_vmem_getDataAddress(sdSrc2);
+	int32_t* dst = preprocessing_vmem_getDataAddress(sdDst);
+
+	// Check whether given rows and columns are in a valid range.
+	if ((!preprocessing_vmem_isProcessingSizeValid(sdSrc1, rows, cols))
+			|| (!preprocessing_vmem_isProcessingSizeValid(sdSrc2, rows, cols))
+			|| (!preprocessing_vmem_isProcessingSizeValid(sdDst, rows, cols)))
+	{
+		return PREPROCESSING_INVALID_SIZE;
+	}
+
+	CHECK_STATUS(udp_getOverlap(rows, cols, dx, dy, &w))
+
+	//Calculate difference
+	for(unsigned int y = 0; y < w.rows; y++){
+		unsigned int p = (y + w.jyl) * (unsigned int)cols + w.jxl;
+		const int32_t* s1 = src1 + p;
+		const int32_t* s2 = src2 + y * (unsigned int)cols;
+		int32_t* d = dst + p;
+
+		if (preprocessing_kernel_backend()->subtract(s1, s2, d, w.cols)){
+			status = PREPROCESSING_INVALID_NUMBER;
 		}
 	}
 
 	return status;
 }
 
-int udp_substractROI(uint32_t sdSrc1, uint32_t sdSrc2, uint16_t rows, uint16_t cols,
+int udp_multiplyOverlap(uint32_t sdSrc1, uint32_t sdSrc2, uint16_t rows, uint16_t cols,
 		   int16_t dx, int16_t dy, uint32_t sdDst){
 
-	int status = PREPROCESSING_SUCCESSFUL;
-	unsigned int size = (unsigned int)(rows) * (unsigned int)(cols);
-	unsigned int p = 0;
-	unsigned int roiPoint = 0;
+	PREPROCESSING_PROF_KERNEL(2 * PREPROCESSING_PROF_FRAME(rows, cols),
+			PREPROCESSING_PROF_FRAME(rows, cols),
+			(uint64_t)(rows) * cols, 1);
 
-	// Calculate window edges
-	unsigned int jyl = (unsigned int)udp_max16(0, -dy), jyh = (unsigned int)(udp_min16(0, -dy) + rows); 	// ROWS
-	unsigned int jxl = (unsigned int)udp_max16(0, -dx), jxh = (unsigned int)(udp_min16(0, -dx) + cols); 	// COLUMNS
+	int status = PREPROCESSING_SUCCESSFUL;
+	struct udp_Overlap w;
 
 	const int32_t* src1 = preprocessing_vmem_getDataAddress(sdSrc1);
 	const int32_t* src2 = preprocessing_vmem_getDataAddress(sdSrc2);
@@ -389,24 +461,50 @@ int udp_substractROI(uint32_t sdSrc1, uint32_t sdSrc2, uint16_t rows, uint16_t c
 		return PREPROCESSING_INVALID_SIZE;
 	}
 
-	//Calculate sum
-	for(int y=jyl; y < jyh; y++){
-		for(int x=jxl; x < jxh; x++){
+	CHECK_STATUS(udp_getOverlap(rows, cols, dx, dy, &w))
 
-			p = y * (unsigned int)cols + x;
-			roiPoint = (y-jyl) * (unsigned int)cols + (x-jxl);
+	//Calculate product of the ROIs
+	for(unsigned int y = 0; y < w.rows; y++){
+		unsigned int p = y * (unsigned int)cols;
 
-			// Check for valid pointer position.
-			PREPROCESSING_DEF_CHECK_POINTER(src1, p, size);
-			PREPROCESSING_DEF_CHECK_POINTER(src2, roiPoint, size);
-			PREPROCESSING_DEF_CHECK_POINTER(dst, p, size);
+		if (preprocessing_kernel_backend()->multiply(src1 + p, src2 + p, dst + p, w.cols)){
+			status = PREPROCESSING_INVALID_NUMBER;
+		}
+	}
 
-			dst[p] = eve_fp_subtract32(src1[p], src2[roiPoint]);
+	return status;
+}
 
-			if (dst[p] == EVE_FP32_NAN)
-			{
-				status = PREPROCESSING_INVALID_NUMBER;
-			}
+int udp_subtractOverlap(uint32_t sdSrc1, uint32_t sdSrc2, uint16_t rows, uint16_t cols,
+		   int16_t dx, int16_t dy, uint32_t sdDst){
+
+	PREPROCESSING_PROF_KERNEL(2 * PREPROCESSING_PROF_FRAME(rows, cols),
+			PREPROCESSING_PROF_FRAME(rows, cols),
+			(uint64_t)(rows) * cols, 1);
+
+	int status = PREPROCESSING_SUCCESSFUL;
+	struct udp_Overlap w;
+
+	const int32_t* src1 = preprocessing_vmem_getDataAddress(sdSrc1);
+	const int32_t* src2 = preprocessing_vmem_getDataAddress(sdSrc2);
+	int32_t* dst = preprocessing_vmem_getDataAddress(sdDst);
+
+	// Check whether given rows and columns are in a valid range.
+	if ((!preprocessing_vmem_isProcessingSizeValid(sdSrc1, rows, cols))
+			|| (!preprocessing_vmem_isProcessingSizeValid(sdSrc2, rows, cols))
+			|| (!preprocessing_vmem_isProcessingSizeValid(sdDst, rows, cols)))
+	{
+		return PREPROCESSING_INVALID_SIZE;
+	}
+
+	CHECK_STATUS(udp_getOverlap(rows, cols, dx, dy, &w))
+
+	//Calculate difference of the ROIs
+	for(unsigned int y = 0; y < w.rows; y++){
+		unsigned int p = y * (unsigned int)cols;
+
+		if (preprocessing_kernel_backend()->subtract(src1 + p, src2 + p, dst + p, w.cols)){
+			status = PREPROCESSING_INVALID_NUMBER;
 		}
 	}
 
@@ -415,11 +513,12 @@ int udp_substractROI(uint32_t sdSrc1, uint32_t sdSrc2, uint16_t rows, uint16_t c
 
 int udp_normalize(uint32_t sdSrc1, uint32_t sdSrc2, uint16_t rows, uint16_t cols, uint32_t sdDst){
 
+	PREPROCESSING_PROF_KERNEL(2 * PREPROCESSING_PROF_FRAME(rows, cols),
+			PREPROCESSING_PROF_FRAME(rows, cols),
+			(uint64_t)(rows) * cols, 2);
+
 	int status = PREPROCESSING_SUCCESSFUL;
 	unsigned int size = (unsigned int)(rows) * (unsigned int)(cols);
-	unsigned int p = 0;
-
-	uint32_t one = FP32_BINARY_TRUE;
 
 	const int32_t* src1 = preprocessing_vmem_getDataAddress(sdSrc1);
 	const int32_t* src2 = preprocessing_vmem_getDataAddress(sdSrc2);
@@ -433,25 +532,15 @@ int udp_normalize(uint32_t sdSrc1, uint32_t sdSrc2, uint16_t rows, uint16_t cols
 		return PREPROCESSING_INVALID_SIZE;
 	}
 
+	// Check for valid pointer position.
+	PREPROCESSING_DEF_CHECK_POINTER(src1, 0, size)
+	PREPROCESSING_DEF_CHECK_POINTER(src2, 0, size)
+	PREPROCESSING_DEF_CHECK_POINTER(dst, 0, size)
+
 	// Process.
-	for (unsigned int r = 0; r < (unsigned int)rows; r++)
+	if (preprocessing_kernel_backend()->normalize(src1, src2, dst, size))
 	{
-		for (unsigned int c = 0; c < (unsigned int)cols; c++)
-		{
-			p = r * (unsigned int)(cols) + c;
-
-			// Check for valid pointer position.
-			PREPROCESSING_DEF_CHECK_POINTER(src1, p, size);
-			PREPROCESSING_DEF_CHECK_POINTER(dst, p, size);
-
-			if(eve_fp_compare32(src2 + p, &one) == 1){
-				dst[p] = eve_fp_divide32(src1[p], src2[p], FP32_FWL);
-			}
-
-			if (dst[p] == EVE_FP32_NAN){
-				status = PREPROCESSING_INVALID_NUMBER;
-			}
-		}
+		status = PREPROCESSING_INVALID_NUMBER;
 	}
 
 	return status;
@@ -459,6 +548,10 @@ int udp_normalize(uint32_t sdSrc1, uint32_t sdSrc2, uint16_t rows, uint16_t cols
 
 int udp_mean(uint32_t sdSrc1, uint32_t sdSrc2, uint16_t rows, uint16_t cols, uint32_t sdDst){
 
+	PREPROCESSING_PROF_KERNEL(2 * PREPROCESSING_PROF_FRAME(rows, cols),
+			4 * sizeof(int32_t),
+			(uint64_t)(rows) * cols, 4);
+
 	int status = PREPROCESSING_SUCCESSFUL;
 	unsigned int size = (unsigned int)(rows) * (unsigned int)(cols);
 	unsigned int p = 0;
@@ -529,6 +622,10 @@ int udp_mean(uint32_t sdSrc1, uint32_t sdSrc2, uint16_t rows, uint16_t cols, uin
 
 int udp_fivesigma(uint32_t sdSrc, uint16_t rows, uint16_t cols, uint32_t mean, uint32_t fiveSigma, uint32_t sdDst){
 
+	PREPROCESSING_PROF_KERNEL(PREPROCESSING_PROF_FRAME(rows, cols),
+			2 * sizeof(int32_t),
+			(uint64_t)(rows) * cols, 4);
+
 	int status = PREPROCESSING_SUCCESSFUL;
 	unsigned int size = (unsigned int)(rows) * (unsigned int)(cols);
 	unsigned int p = 0;
@@ -587,11 +684,12 @@ int udp_fivesigma(uint32_t sdSrc, uint16_t rows, uint16_t cols, uint32_t mean, u
 
 int udp_flatfield(uint32_t sdSrc1, uint32_t sdSrc2, uint16_t rows, uint16_t cols, uint32_t sdDst){
 
+	PREPROCESSING_PROF_KERNEL(2 * PREPROCESSING_PROF_FRAME(rows, cols),
+			PREPROCESSING_PROF_FRAME(rows, cols),
+			(uint64_t)(rows) * cols, 2);
+
 	int status = PREPROCESSING_SUCCESSFUL;
 	unsigned int size = (unsigned int)(rows) * (unsigned int)(cols);
-	unsigned int p = 0;
-
-	uint32_t zero = 0;
 
 	const int32_t* src1 = preprocessing_vmem_getDataAddress(sdSrc1);		//GainTmp
 	const int32_t* src2 = preprocessing_vmem_getDataAddress(sdSrc2);		//Mask of all images
@@ -605,27 +703,15 @@ int udp_flatfield(uint32_t sdSrc1, uint32_t sdSrc2, uint16_t rows, uint16_t cols
 		return PREPROCESSING_INVALID_SIZE;
 	}
 
+	// Check for valid pointer position.
+	PREPROCESSING_DEF_CHECK_POINTER(src1, 0, size)
+	PREPROCESSING_DEF_CHECK_POINTER(src2, 0, size)
+	PREPROCESSING_DEF_CHECK_POINTER(dst, 0, size)
+
 	// Process.
-	for (unsigned int r = 0; r < (unsigned int)rows; r++)
+	if (preprocessing_kernel_backend()->pow10(src1, src2, dst, size))
 	{
-		for (unsigned int c = 0; c < (unsigned int)cols; c++)
-		{
-			p = r * (unsigned int)(cols) + c;
-
-			// Check for valid pointer position.
-			PREPROCESSING_DEF_CHECK_POINTER(src1, p, size);
-			PREPROCESSING_DEF_CHECK_POINTER(src2, p, size);
-			PREPROCESSING_DEF_CHECK_POINTER(dst, p, size);
-
-			if (eve_fp_compare32(src2 + p, &zero) != 0){
-				double n = pow(10.0, eve_fp_signed32ToDouble( src1[p] , FP32_FWL));
-				dst[p] = udp_double2s32rounded( n, FP32_FWL);
-			}
-
-			if (dst[p] == EVE_FP32_NAN){
-				status = PREPROCESSING_INVALID_NUMBER;
-			}
-		}
+		status = PREPROCESSING_INVALID_NUMBER;
 	}
 
 	return status;
@@ -36,7 +36,7 @@
  * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
  * @{
  */
-void udp_createNANDFLASH(int32_t *NANDFLASH, int32_t **entriesOfNAND,
+int udp_createNANDFLASH(int32_t *NANDFLASH, int32_t **entriesOfNAND,
         int stdimagesize,  int numberOfImages);
 int udp_loadImage(int32_t *nandSrc, uint16_t rows, uint16_t cols,
             uint32_t sdDst);
@@ -75,6 +75,51 @@ int udp_getMask(uint32_t sdSrc, uint16_t rows, uint16_t cols, uint16_t index, ui
 int udp_maskImagesLog10(uint32_t sdSrc,
             uint16_t rows, uint16_t cols, uint16_t index, uint32_t iMin, uint32_t iMax, uint32_t sdDst);
 
+/**
+ * This structure describes the overlap window of a frame and its copy shifted
+ * by dx, dy. A ROI holds the window at the frame origin, using the row stride
+ * of the frame.
+ */
+struct udp_Overlap
+{
+	unsigned int jyl;	// first row of the window in the frame
+	unsigned int jyh;	// last row + 1
+	unsigned int jxl;	// first column of the window in the frame
+	unsigned int jxh;	// last column + 1
+	unsigned int rows;	// number of window rows
+	unsigned int cols;	// number of window columns
+};
+
+/**
+    * Calculate the overlap window of a shift
+    *
+    * @param rows   	the number of image rows.
+    * @param cols   	the number of image columns.
+    * @param dx			the X position of beginning
+    * @param dy     	the Y position of beginning
+    * @param overlap  	the result window.
+    *
+    * @return PREPROCESSING_SUCCESSFUL on success, PREPROCESSING_INVALID_SIZE
+    * if the shift leaves no overlap.
+    */
+int udp_getOverlap(uint16_t rows, uint16_t cols, int16_t dx, int16_t dy,
+		struct udp_Overlap *overlap);
+
+/**
+    * Generate a ROI from an image in NAND
+    *
+    * @param nandSrc 	the NAND address of image.
+    * @param rows   	the number of image rows.
+    * @param cols   	the number of image columns.
+    * @param dx			the X position of beginning
+    * @param dy     	the Y position of beginning
+    * @param sdDst  	the VMEM (SDRAM) address of result ROI.
+    *
+    * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+    */
+int udp_loadROI(const int32_t *nandSrc, uint16_t rows, uint16_t cols,
+		   int16_t dx, int16_t dy, uint32_t sdDst);
+
 /**
     * Generate a ROI from an image
     *
@@ -122,6 +167,40 @@ int udp_addROI(uint32_t sdSrc1, uint32_t sdSrc2, uint16_t rows, uint16_t cols,
 int udp_substractROI(uint32_t sdSrc1, uint32_t sdSrc2, uint16_t rows, uint16_t cols,
 		   int16_t dx, int16_t dy, uint32_t sdDst);
 
+/**
+    * Multiply two ROIs of the overlap window of a shift. Pixels outside the
+    * window are not touched.
+    *
+    * @param sdSrc1 	the VMEM (SDRAM) address of ROI 1.
+    * @param sdSrc2		the VMEM (SDRAM) address of ROI 2.
+    * @param rows   	the number of image rows.
+    * @param cols   	the number of image columns.
+    * @param dx			the X position of beginning
+    * @param dy     	the Y position of beginning
+    * @param sdDst  	the VMEM (SDRAM) address of result ROI.
+    *
+    * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+    */
+int udp_multiplyOverlap(uint32_t sdSrc1, uint32_t sdSrc2, uint16_t rows, uint16_t cols,
+		   int16_t dx, int16_t dy, uint32_t sdDst);
+
+/**
+    * Subtract two ROIs of the overlap window of a shift. Pixels outside the
+    * window are not touched.
+    *
+    * @param sdSrc1 	the VMEM (SDRAM) address of ROI 1.
+    * @param sdSrc2		the VMEM (SDRAM) address of ROI 2.
+    * @param rows   	the number of image rows.
+    * @param cols   	the number of image columns.
+    * @param dx			the X position of beginning
+    * @param dy     	the Y position of beginning
+    * @param sdDst  	the VMEM (SDRAM) address of result ROI.
+    *
+    * @return PREPROCESSING_SUCCESSFUL on success, failure code otherwise.
+    */
+int udp_subtractOverlap(uint32_t sdSrc1, uint32_t sdSrc2, uint16_t rows, uint16_t cols,
+		   int16_t dx, int16_t dy, uint32_t sdDst);
+
 /**
     * Normalize an image using PixCnt
     *